@@ -0,0 +1,37 @@
+#include "AllocCounter.hpp"
+#include <cstdlib>
+#include <new>
+
+#ifdef DONUTEX_ALLOC_COUNTER
+
+// Per thread, so background indexing and loading don't show up in a
+// measurement taken on the UI thread
+static thread_local uint64_t allocations = 0;
+
+// new[] and the nothrow forms call this one
+void *operator new(std::size_t size) {
+  allocations++;
+  if (size == 0)
+    size = 1;
+  while (true) {
+    if (void *p = std::malloc(size))
+      return p;
+    std::new_handler handler = std::get_new_handler();
+    if (!handler)
+      throw std::bad_alloc();
+    handler();
+  }
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+
+bool AllocCounter::available() { return true; }
+uint64_t AllocCounter::count() { return allocations; }
+
+#else
+
+bool AllocCounter::available() { return false; }
+uint64_t AllocCounter::count() { return 0; }
+
+#endif
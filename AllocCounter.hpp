@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstdint>
+
+// Heap allocations made by the calling thread, counted by replacing the
+// global operator new. Compiled in only when DONUTEX_ALLOC_COUNTER is
+// defined (the CMake option of that name); otherwise available() is false
+// and count() stays 0. The "allocs" command uses it to show what typing
+// allocates.
+class AllocCounter {
+public:
+  static bool available();
+  static uint64_t count();
+};
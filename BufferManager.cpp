@@ -0,0 +1,284 @@
+#include "BufferManager.hpp"
+#include "FileOperations.hpp"
+#include "LargeFileView.hpp"
+#include <algorithm>
+#include <utility>
+
+BufferManager::BufferManager(TextEditor *editor) : editor_(editor) {
+  // The buffer already in the editor; its state stays there while active
+  Buffer first;
+  first.id = nextId_++;
+  first.lastUsed = ++clock_;
+  buffers_.push_back(std::move(first));
+}
+
+BufferManager::~BufferManager() {
+  // The active buffer's LargeFileView belongs to the editor
+  for (auto &buffer : buffers_)
+    delete buffer.largeView;
+}
+
+Buffer BufferManager::makeBlank() {
+  Buffer buffer;
+  buffer.id = nextId_++;
+  buffer.lineCache.push_back(CachedLine{"", 0.0f});
+  buffer.largeView = new LargeFileView(editor_);
+  return buffer;
+}
+
+int BufferManager::indexOf(unsigned id) const {
+  for (size_t i = 0; i < buffers_.size(); ++i)
+    if (buffers_[i].id == id)
+      return (int)i;
+  return -1;
+}
+
+std::string BufferManager::title(size_t index) const {
+  const std::string &path = index == active_ ? editor_->filename
+                                             : buffers_[index].filename;
+  if (path.empty())
+    return "untitled";
+  return std::filesystem::path(path).filename().string();
+}
+
+bool BufferManager::isModified(size_t index) const {
+  return index == active_ ? editor_->modified : buffers_[index].modified;
+}
+
+int BufferManager::find(const std::string &path) const {
+  for (size_t i = 0; i < buffers_.size(); ++i) {
+    const std::string &open =
+        i == active_ ? editor_->filename : buffers_[i].filename;
+    if (open.empty())
+      continue;
+    std::error_code ec;
+    if (open == path || std::filesystem::equivalent(open, path, ec))
+      return (int)i;
+  }
+  return -1;
+}
+
+void BufferManager::exchange(Buffer &buffer) {
+  TextEditor &ed = *editor_;
+  ed.refreshLineCache(); // a pending refresh belongs to the outgoing text
+  std::swap(ed.filename, buffer.filename);
+  std::swap(ed.content, buffer.content);
+  std::swap(ed.modified, buffer.modified);
+  std::swap(ed.lineCache, buffer.lineCache);
+  std::swap(ed.wordIndex, buffer.wordIndex);
+  std::swap(ed.undo_, buffer.undo);
+  std::swap(ed.cursorIndex, buffer.cursorIndex);
+  std::swap(ed.selectionStart, buffer.selectionStart);
+  std::swap(ed.selectionEnd, buffer.selectionEnd);
+  std::swap(ed.scrollX, buffer.scrollX);
+  std::swap(ed.scrollY, buffer.scrollY);
+  std::swap(ed.largeView_, buffer.largeView);
+  ed.fileOps_->exchangeDiskState(buffer.diskSize, buffer.diskTime,
+                                 buffer.follow);
+}
+
+void BufferManager::activate(size_t index) {
+  if (index >= buffers_.size())
+    return;
+  Buffer &target = buffers_[index];
+  if (index != active_ && (target.cachesDropped || target.contentDropped)) {
+    // The tab bar stays on the current buffer until the restore is in
+    if (editor_->fileOps_->restoringBuffer() != target.id)
+      startRestore(target);
+    selectRequest_ = buffers_[active_].id;
+    return;
+  }
+  editor_->fileOps_->cancelRestore(); // the latest switch wins
+  selectRequest_ = target.id;
+  if (index == active_) {
+    closeAfterSwitch_ = 0;
+    return;
+  }
+
+  exchange(buffers_[active_]);
+  buffers_[active_].lastUsed = ++clock_;
+  buffers_[active_].footprint = footprint(buffers_[active_]);
+  active_ = index;
+  exchange(buffers_[active_]);
+
+  editor_->contentVersion++;
+  editor_->regexMatches.clear();
+  editor_->isDragging = false;
+  editor_->hDragging = false;
+  editor_->vDragging = false;
+  editor_->caretFollow = false;
+  editor_->focusEditor = true;
+  editor_->indexToLineCol(editor_->cursorIndex, editor_->cursorLine,
+                          editor_->cursorColumn);
+  editor_->fileOps_->watchActive();
+  enforceBudget();
+
+  int closing = closeAfterSwitch_ ? indexOf(closeAfterSwitch_) : -1;
+  if (closing >= 0)
+    erase((size_t)closing);
+}
+
+void BufferManager::startRestore(const Buffer &slot) {
+  std::shared_ptr<const MappedFile> mapping;
+  if (slot.contentDropped) {
+    // A file changed since it was mapped is read again instead
+    std::error_code ec;
+    uintmax_t size = std::filesystem::file_size(slot.filename, ec);
+    auto time = std::filesystem::last_write_time(slot.filename, ec);
+    if (!ec && size == slot.mapping->size() && time == slot.mappedTime)
+      mapping = slot.mapping;
+  }
+  editor_->fileOps_->restoreBuffer(slot.id, slot.filename, slot.contentDropped,
+                                   std::move(mapping), slot.content);
+}
+
+void BufferManager::finishRestore(FileLoader::Result &result) {
+  int found = indexOf(result.buffer);
+  if (found < 0 || (size_t)found == active_)
+    return; // closed meanwhile
+  size_t index = (size_t)found;
+  if (!result.error.empty()) {
+    editor_->addOutput(editor_->icons["error"],
+                       "Could not reopen file: " + result.path + " (" +
+                           result.error + ")");
+    closeAfterSwitch_ = 0;
+    return;
+  }
+
+  Buffer &slot = buffers_[index];
+  bool textRestored = slot.contentDropped;
+  if (textRestored) {
+    slot.content = std::move(result.content);
+    slot.mapping.reset();
+    slot.contentDropped = false;
+  }
+  slot.lineCache = std::move(result.lines);
+  slot.wordIndex = std::move(result.words);
+  slot.cachesDropped = false;
+  activate(index);
+
+  if (textRestored)
+    editor_->clearUndoRedo(); // the old root checkpoint is gone with the text
+  if (result.reread) {
+    editor_->fileOps_->watchOpenFile(editor_->content.size());
+    int end = (int)editor_->content.size();
+    editor_->cursorIndex = std::min(editor_->cursorIndex, end);
+    editor_->selectionStart = editor_->selectionEnd = -1;
+    editor_->indexToLineCol(editor_->cursorIndex, editor_->cursorLine,
+                            editor_->cursorColumn);
+  }
+}
+
+void BufferManager::prepare(const std::string &path) {
+  bool blank = editor_->filename.empty() && !editor_->modified &&
+               editor_->content.size() == 0 && !editor_->largeView_->active();
+  bool same = !path.empty() && find(path) == (int)active_;
+  if (blank || same)
+    return;
+  buffers_.push_back(makeBlank());
+  activate(buffers_.size() - 1);
+}
+
+bool BufferManager::close(size_t index) {
+  if (index >= buffers_.size())
+    return false;
+  unsigned id = buffers_[index].id;
+  if (isModified(index) && confirmClose_ != id) {
+    confirmClose_ = id;
+    editor_->log(LogSeverity::Warning,
+                 "Unsaved changes in " + title(index) +
+                     " (close it again to discard them)");
+    return false;
+  }
+  confirmClose_ = 0;
+
+  if (index == active_) {
+    if (buffers_.size() == 1)
+      buffers_.push_back(makeBlank()); // always keep one buffer open
+    activate(index + 1 < buffers_.size() ? index + 1 : index - 1);
+    if (index == active_) {
+      closeAfterSwitch_ = id; // the neighbour is still being restored
+      return true;
+    }
+  }
+  erase(index);
+  return true;
+}
+
+void BufferManager::erase(size_t index) {
+  unsigned id = buffers_[index].id;
+  if (editor_->fileOps_->restoringBuffer() == id)
+    editor_->fileOps_->cancelRestore();
+  if (id == closeAfterSwitch_)
+    closeAfterSwitch_ = 0;
+  delete buffers_[index].largeView;
+  buffers_.erase(buffers_.begin() + index);
+  if (active_ > index)
+    active_--;
+  selectRequest_ = buffers_[active_].id;
+}
+
+size_t BufferManager::footprint(const Buffer &buffer) const {
+  if (buffer.largeView && buffer.largeView->active())
+    return buffer.largeView->residentBytes();
+  size_t bytes = buffer.content.memoryUsage() + buffer.wordIndex.memoryUsage();
+  for (const auto &line : buffer.lineCache)
+    bytes += sizeof(CachedLine) + line.text.capacity();
+  return bytes + TextEditor::undoHistoryBytes(buffer.undo);
+}
+
+size_t BufferManager::residentBytes() const {
+  size_t bytes = editor_->fileOps_->residentBytes();
+  for (size_t i = 0; i < buffers_.size(); ++i)
+    if (i != active_)
+      bytes += buffers_[i].footprint;
+  return bytes;
+}
+
+void BufferManager::enforceBudget() {
+  size_t total = residentBytes();
+  if (total <= editor_->bufferMemoryBudget)
+    return;
+
+  std::vector<size_t> cold;
+  for (size_t i = 0; i < buffers_.size(); ++i)
+    if (i != active_)
+      cold.push_back(i);
+  std::sort(cold.begin(), cold.end(), [this](size_t a, size_t b) {
+    return buffers_[a].lastUsed < buffers_[b].lastUsed;
+  });
+
+  for (size_t i : cold) {
+    if (total <= editor_->bufferMemoryBudget)
+      break;
+    Buffer &buffer = buffers_[i];
+    if (buffer.largeView->active())
+      continue; // already paged; its window is its own budget
+    size_t before = buffer.footprint;
+    if (!buffer.cachesDropped) {
+      std::vector<CachedLine>().swap(buffer.lineCache);
+      buffer.wordIndex = WordIndex();
+      buffer.cachesDropped = true;
+    }
+    // Undo steps refer into the piece table's buffers, so a buffer with
+    // history keeps its text
+    if (!buffer.contentDropped && !buffer.modified &&
+        !buffer.filename.empty() && buffer.undo.nodes.size() == 1) {
+      // Only text identical to the file can be dropped for a mapping
+      std::error_code ec;
+      uintmax_t size = std::filesystem::file_size(buffer.filename, ec);
+      auto time = std::filesystem::last_write_time(buffer.filename, ec);
+      auto mapping = std::make_shared<MappedFile>();
+      if (!ec && size == buffer.content.size() && time == buffer.diskTime &&
+          mapping->open(buffer.filename) &&
+          mapping->size() == buffer.content.size()) {
+        buffer.content = PieceTable();
+        buffer.mapping = std::move(mapping);
+        buffer.mappedTime = time;
+        buffer.contentDropped = true;
+      }
+    }
+    buffer.footprint = footprint(buffer);
+    total -= before - std::min(before, buffer.footprint);
+  }
+}
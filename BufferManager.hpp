@@ -0,0 +1,99 @@
+#pragma once
+
+#include "FileLoader.hpp"
+#include "MappedFile.hpp"
+#include "TextEditor.hpp"
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Saved state of a buffer that is not on screen. The active buffer lives
+// in TextEditor's own members; switching swaps the two, so nothing is
+// copied or rescanned.
+struct Buffer {
+  unsigned id = 0;
+  std::string filename;
+  PieceTable content;
+  bool modified = false;
+  std::vector<CachedLine> lineCache;
+  WordIndex wordIndex;
+  TextEditor::UndoHistory undo;
+  int cursorIndex = 0;
+  int selectionStart = -1;
+  int selectionEnd = -1;
+  float scrollX = 0.0f;
+  float scrollY = 0.0f;
+  LargeFileView *largeView = nullptr;
+
+  // FileOperations' view of the file on disk
+  uint64_t diskSize = 0;
+  std::filesystem::file_time_type diskTime{};
+  bool follow = false;
+
+  // Eviction: a cold buffer first loses lineCache and wordIndex, then,
+  // if it matches the file on disk, its text, which is kept as a mapping.
+  // Both are rebuilt on the loader worker before the tab is shown again.
+  uint64_t lastUsed = 0;
+  size_t footprint = 0;
+  bool cachesDropped = false;
+  bool contentDropped = false;
+  std::shared_ptr<const MappedFile> mapping;
+  std::filesystem::file_time_type mappedTime{};
+};
+
+// Open buffers shown as tabs above the editor. Inactive buffers are
+// evicted least recently used first while everything held exceeds
+// TextEditor::bufferMemoryBudget.
+class BufferManager {
+public:
+  BufferManager(TextEditor *editor);
+  ~BufferManager();
+
+  size_t count() const { return buffers_.size(); }
+  size_t active() const { return active_; }
+  unsigned id(size_t index) const { return buffers_[index].id; }
+  std::string title(size_t index) const;
+  bool isModified(size_t index) const;
+  // Index of the buffer showing path, or -1
+  int find(const std::string &path) const;
+
+  // Switches at once unless the buffer was evicted; then the switch waits
+  // for FileOperations to restore it in the background
+  void activate(size_t index);
+  // Takes in a restore started by activate() and completes the switch
+  void finishRestore(FileLoader::Result &result);
+  // Makes room for a file about to be opened: the active buffer is reused
+  // if it is an untouched blank one or already shows path, otherwise a new
+  // buffer is added and activated.
+  void prepare(const std::string &path);
+  // Unsaved buffers only close on the second request. Returns false if
+  // the buffer stayed open.
+  bool close(size_t index);
+  void enforceBudget();
+  // Memory held by all buffers, active one included
+  size_t residentBytes() const;
+
+  // Tab the renderer should select on its next frame (0 for none)
+  unsigned selectRequest() const { return selectRequest_; }
+  void clearSelectRequest() { selectRequest_ = 0; }
+
+private:
+  Buffer makeBlank();
+  void exchange(Buffer &buffer);
+  void startRestore(const Buffer &slot);
+  // Removes a buffer that is not the active one
+  void erase(size_t index);
+  int indexOf(unsigned id) const;
+  size_t footprint(const Buffer &buffer) const;
+
+  TextEditor *editor_;
+  std::vector<Buffer> buffers_;
+  size_t active_ = 0;
+  unsigned nextId_ = 1;
+  uint64_t clock_ = 0;
+  unsigned selectRequest_ = 0;
+  unsigned confirmClose_ = 0; // id of an unsaved buffer asked to close once
+  unsigned closeAfterSwitch_ = 0; // id of a closed tab still on screen
+};
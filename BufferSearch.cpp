@@ -0,0 +1,145 @@
+#include "BufferSearch.hpp"
+#include "PieceTable.hpp"
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define DONUTEX_SEARCH_SSE2 1
+#endif
+
+size_t BufferSearch::findInSpan(const char *hay, size_t n,
+                                std::string_view needle, size_t from) {
+  size_t m = needle.size();
+  if (m == 0 || n < m || from > n - m)
+    return npos;
+  if (m == 1) {
+    const void *p = std::memchr(hay + from, needle[0], n - from);
+    return p ? (size_t)((const char *)p - hay) : npos;
+  }
+
+  size_t i = from;
+#ifdef DONUTEX_SEARCH_SSE2
+  const __m128i first = _mm_set1_epi8(needle[0]);
+  const __m128i last = _mm_set1_epi8(needle[m - 1]);
+  for (; i + m - 1 + 16 <= n; i += 16) {
+    __m128i a = _mm_loadu_si128((const __m128i *)(hay + i));
+    __m128i b = _mm_loadu_si128((const __m128i *)(hay + i + m - 1));
+    unsigned mask = (unsigned)_mm_movemask_epi8(
+        _mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+    while (mask) {
+      unsigned bit = (unsigned)__builtin_ctz(mask);
+      if (std::memcmp(hay + i + bit + 1, needle.data() + 1, m - 2) == 0)
+        return i + bit;
+      mask &= mask - 1;
+    }
+  }
+#endif
+
+  while (i + m <= n) {
+    const void *p = std::memchr(hay + i, needle[0], n - m + 1 - i);
+    if (!p)
+      return npos;
+    i = (size_t)((const char *)p - hay);
+    if (hay[i + m - 1] == needle[m - 1] &&
+        std::memcmp(hay + i, needle.data(), m) == 0)
+      return i;
+    ++i;
+  }
+  return npos;
+}
+
+void BufferSearch::findAll(const PieceTable &text, std::string_view needle,
+                           size_t start, size_t end,
+                           const std::function<bool(size_t)> &onMatch) {
+  size_t m = needle.size();
+  end = std::min(end, text.size());
+  if (m == 0 || start >= end || end - start < m)
+    return;
+
+  // carry: the last m-1 bytes seen, so a match can start in earlier chunks.
+  // resume: matches don't overlap, so nothing is reported before this.
+  std::string carry;
+  std::string junction;
+  size_t chunkPos = start;
+  size_t resume = start;
+  bool stop = false;
+
+  text.forEachChunk(start, end - start, [&](const char *data, size_t n) {
+    if (!carry.empty()) {
+      junction.assign(carry);
+      junction.append(data, std::min(n, m - 1));
+      size_t junctionPos = chunkPos - carry.size();
+      size_t from = resume > junctionPos ? resume - junctionPos : 0;
+      size_t hit;
+      while ((hit = findInSpan(junction.data(), junction.size(), needle,
+                               from)) != npos &&
+             hit < carry.size()) {
+        resume = junctionPos + hit + m;
+        if (!onMatch(junctionPos + hit)) {
+          stop = true;
+          return false;
+        }
+        from = hit + m;
+      }
+    }
+
+    size_t from = resume > chunkPos ? resume - chunkPos : 0;
+    size_t hit;
+    while ((hit = findInSpan(data, n, needle, from)) != npos) {
+      resume = chunkPos + hit + m;
+      if (!onMatch(chunkPos + hit)) {
+        stop = true;
+        return false;
+      }
+      from = hit + m;
+    }
+
+    if (n >= m - 1) {
+      carry.assign(data + n - (m - 1), m - 1);
+    } else {
+      carry.append(data, n);
+      if (carry.size() > m - 1)
+        carry.erase(0, carry.size() - (m - 1));
+    }
+    chunkPos += n;
+    return !stop;
+  });
+}
+
+size_t BufferSearch::findNext(const PieceTable &text, std::string_view needle,
+                              size_t from) {
+  size_t found = npos;
+  auto first = [&](size_t pos) {
+    found = pos;
+    return false;
+  };
+  findAll(text, needle, from, text.size(), first);
+  if (found == npos && from > 0)
+    findAll(text, needle, 0, std::min(text.size(), from + needle.size() - 1),
+            first);
+  return found;
+}
+
+size_t BufferSearch::findPrev(const PieceTable &text, std::string_view needle,
+                              size_t before) {
+  size_t found = npos;
+  auto latest = [&](size_t pos) {
+    found = pos;
+    return true;
+  };
+  findAll(text, needle, 0, before, latest);
+  if (found == npos)
+    findAll(text, needle, 0, text.size(), latest);
+  return found;
+}
+
+size_t BufferSearch::count(const PieceTable &text, std::string_view needle) {
+  size_t total = 0;
+  findAll(text, needle, 0, text.size(), [&](size_t) {
+    total++;
+    return true;
+  });
+  return total;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <string_view>
+
+class PieceTable;
+
+struct SearchMatch {
+  size_t pos;
+  size_t len;
+};
+
+// std::regex (libstdc++) matches by recursion: a few hundred bytes of stack
+// per character for ".*", several times that with alternations. Regex
+// searches therefore run on a StackThread with kRegexStackSize of stack,
+// and skip lines longer than kMaxRegexLine rather than overflow it.
+constexpr size_t kMaxRegexLine = 1 << 20;
+constexpr size_t kRegexStackSize = (size_t)1 << 30;
+
+// Literal substring search over a PieceTable. Chunks are scanned in place
+// (no getText() copy); matches that straddle a piece boundary are caught by
+// searching a small junction buffer made of the previous chunk's tail and
+// the next chunk's head.
+class BufferSearch {
+public:
+  static constexpr size_t npos = (size_t)-1;
+
+  // First occurrence of needle in hay[from, n), or npos. Candidate positions
+  // are filtered 16 at a time on the needle's first and last byte (SSE2)
+  // before a memcmp confirms them.
+  static size_t findInSpan(const char *hay, size_t n, std::string_view needle,
+                           size_t from = 0);
+
+  // Calls onMatch(offset) for each match lying entirely in [start, end), in
+  // order, until it returns false.
+  static void findAll(const PieceTable &text, std::string_view needle,
+                      size_t start, size_t end,
+                      const std::function<bool(size_t)> &onMatch);
+
+  // Next match at or after `from`, wrapping to the top; npos if none.
+  static size_t findNext(const PieceTable &text, std::string_view needle,
+                         size_t from);
+  // Last match ending at or before `before`, wrapping to the bottom.
+  static size_t findPrev(const PieceTable &text, std::string_view needle,
+                         size_t before);
+  static size_t count(const PieceTable &text, std::string_view needle);
+};
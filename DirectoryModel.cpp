@@ -0,0 +1,233 @@
+#include "DirectoryModel.hpp"
+#include "FileWatcher.hpp"
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <set>
+
+DirectoryModel::DirectoryModel() {
+  worker_ = std::thread(&DirectoryModel::workerMain, this);
+}
+
+DirectoryModel::~DirectoryModel() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  if (worker_.joinable())
+    worker_.join();
+}
+
+void DirectoryModel::setRoot(const std::string &root) {
+  nodes_.clear();
+  dirs_.clear();
+  free_.clear();
+  Node node;
+  node.name = root;
+  node.path = root;
+  node.isDirectory = true;
+  node.expanded = true;
+  nodes_.push_back(node);
+  dirs_[root] = 0;
+  request(0);
+  version_++;
+}
+
+void DirectoryModel::request(int index) {
+  nodes_[index].loading = true;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    requests_.push_back(nodes_[index].path);
+  }
+  cv_.notify_one();
+}
+
+void DirectoryModel::toggle(int index) {
+  Node &n = nodes_[index];
+  if (!n.isDirectory)
+    return;
+  n.expanded = !n.expanded;
+  if (n.expanded && !n.loaded && !n.loading)
+    request(index);
+  version_++;
+}
+
+void DirectoryModel::reloadAll() {
+  for (const auto &dir : dirs_) {
+    if (nodes_[dir.second].loaded && !nodes_[dir.second].loading)
+      request(dir.second);
+  }
+}
+
+void DirectoryModel::update() {
+  std::vector<Listing> done;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (finished_.empty())
+      return;
+    done.swap(finished_);
+  }
+  // A file written in a watched directory gets it listed again; only a
+  // listing that adds, removes or first loads entries changes the tree
+  bool changed = false;
+  for (auto &listing : done)
+    changed |= apply(listing);
+  if (changed)
+    version_++;
+}
+
+int DirectoryModel::addNode(Node node) {
+  if (free_.empty()) {
+    nodes_.push_back(std::move(node));
+    return (int)nodes_.size() - 1;
+  }
+  int index = free_.back();
+  free_.pop_back();
+  nodes_[index] = std::move(node);
+  return index;
+}
+
+// Frees index and everything below it. Their directories are unregistered
+// so late listings for them are dropped.
+void DirectoryModel::removeNode(int index) {
+  std::vector<int> gone{index};
+  while (!gone.empty()) {
+    int g = gone.back();
+    gone.pop_back();
+    Node &n = nodes_[g];
+    if (n.isDirectory) {
+      auto it = dirs_.find(n.path);
+      if (it != dirs_.end() && it->second == g)
+        dirs_.erase(it);
+      gone.insert(gone.end(), n.children.begin(), n.children.end());
+    }
+    n = Node();
+    n.removed = true;
+    free_.push_back(g);
+  }
+}
+
+bool DirectoryModel::apply(Listing &listing) {
+  auto it = dirs_.find(listing.dir);
+  if (it == dirs_.end())
+    return false; // removed, or from before setRoot()
+  int index = it->second;
+  // A first listing, or one replacing the "Loading..." row
+  bool changed = !nodes_[index].loaded ||
+                 (nodes_[index].loading && nodes_[index].children.empty());
+
+  // Keep nodes for entries that survived so their expansion state and
+  // loaded children carry over
+  std::unordered_map<std::string, int> previous;
+  for (int child : nodes_[index].children)
+    previous[nodes_[child].name] = child;
+
+  std::vector<int> children;
+  children.reserve(listing.entries.size());
+  for (auto &entry : listing.entries) {
+    auto prev = previous.find(entry.name);
+    if (prev != previous.end() &&
+        nodes_[prev->second].isDirectory == entry.isDirectory) {
+      nodes_[prev->second].size = entry.size;
+      children.push_back(prev->second);
+      previous.erase(prev);
+      continue;
+    }
+    Node node;
+    node.name = std::move(entry.name);
+    node.path = nodes_[index].path + "/" + node.name;
+    node.isDirectory = entry.isDirectory;
+    node.size = entry.size;
+    node.parent = index;
+    bool isDirectory = node.isDirectory;
+    std::string path = isDirectory ? node.path : std::string();
+    int child = addNode(std::move(node));
+    if (isDirectory)
+      dirs_[path] = child;
+    children.push_back(child);
+    changed = true;
+  }
+
+  // Whatever is left was deleted
+  for (const auto &p : previous) {
+    removeNode(p.second);
+    changed = true;
+  }
+
+  Node &n = nodes_[index];
+  n.children = std::move(children);
+  n.loaded = true;
+  n.loading = false;
+  return changed;
+}
+
+DirectoryModel::Listing DirectoryModel::list(const std::string &dir) {
+  namespace fs = std::filesystem;
+  Listing listing;
+  listing.dir = dir;
+  std::error_code ec;
+  fs::directory_iterator it(dir, fs::directory_options::skip_permission_denied,
+                            ec);
+  listing.ok = !ec;
+  for (fs::directory_iterator end; !ec && it != end; it.increment(ec)) {
+    std::error_code typeEc;
+    Entry entry;
+    entry.name = it->path().filename().string();
+    entry.isDirectory = it->is_directory(typeEc);
+    entry.size = 0;
+    if (!entry.isDirectory) {
+      uintmax_t size = it->file_size(typeEc);
+      if (!typeEc)
+        entry.size = size;
+    }
+    listing.entries.push_back(std::move(entry));
+  }
+  std::sort(listing.entries.begin(), listing.entries.end(),
+            [](const Entry &a, const Entry &b) {
+              if (a.isDirectory != b.isDirectory)
+                return a.isDirectory;
+              return a.name < b.name;
+            });
+  return listing;
+}
+
+void DirectoryModel::workerMain() {
+  FileWatcher watcher;
+  std::set<std::string> listed;
+  std::vector<FileWatcher::Event> events;
+
+  for (;;) {
+    std::deque<std::string> batch;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait_for(lock, std::chrono::milliseconds(100),
+                   [this] { return stop_ || !requests_.empty(); });
+      if (stop_)
+        return;
+      batch.swap(requests_);
+    }
+
+    // A change to an entry means its directory needs listing again
+    events.clear();
+    watcher.poll(events);
+    for (const auto &ev : events) {
+      if (ev.kind == FileWatcher::Event::Kind::Overflow)
+        batch.insert(batch.end(), listed.begin(), listed.end());
+      else
+        batch.push_back(
+            std::filesystem::path(ev.path).parent_path().string());
+    }
+
+    std::set<std::string> seen;
+    for (const auto &dir : batch) {
+      if (!seen.insert(dir).second)
+        continue;
+      Listing listing = list(dir);
+      if (listing.ok && listed.insert(dir).second)
+        watcher.watchDirectory(dir);
+      std::lock_guard<std::mutex> lock(mutex_);
+      finished_.push_back(std::move(listing));
+    }
+  }
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Cached directory tree behind the file explorer. Listings are produced on a
+// worker thread, which also owns a FileWatcher on every listed directory and
+// re-lists a directory when its entries change. The UI thread only calls
+// update() once per frame to fold finished listings in, so rendering never
+// touches the file system. Subdirectories are listed the first time they
+// are expanded.
+class DirectoryModel {
+public:
+  struct Node {
+    std::string name;
+    std::string path;
+    bool isDirectory = false;
+    uintmax_t size = 0;
+    int parent = -1;
+    std::vector<int> children; // directories first, then by name
+    bool loaded = false;
+    bool loading = false;
+    bool expanded = false;
+    bool removed = false; // deleted on disk; the slot is reused
+  };
+
+  DirectoryModel();
+  ~DirectoryModel();
+  DirectoryModel(const DirectoryModel &) = delete;
+  DirectoryModel &operator=(const DirectoryModel &) = delete;
+
+  // Resets the tree to root (node 0, expanded) and lists it.
+  void setRoot(const std::string &root);
+  // Applies listings finished since the last call. UI thread only.
+  void update();
+
+  void toggle(int index);
+  // Re-lists every directory that has been listed before.
+  void reloadAll();
+
+  const Node &node(int index) const { return nodes_[index]; }
+  size_t nodeCount() const { return nodes_.size(); }
+  // Bumped whenever the tree changes shape, so views can rebuild caches.
+  // Slots of removed nodes (Node::removed) are reused after a bump.
+  unsigned version() const { return version_; }
+
+private:
+  struct Entry {
+    std::string name;
+    bool isDirectory;
+    uintmax_t size;
+  };
+  struct Listing {
+    std::string dir;
+    bool ok;
+    std::vector<Entry> entries;
+  };
+
+  void request(int index);
+  // False if the directory's children are what they were
+  bool apply(Listing &listing);
+  int addNode(Node node);
+  void removeNode(int index);
+  void workerMain();
+  static Listing list(const std::string &dir);
+
+  // UI thread state
+  std::vector<Node> nodes_;
+  std::unordered_map<std::string, int> dirs_; // path -> node
+  std::vector<int> free_;                     // removed nodes' slots
+  unsigned version_ = 0;
+
+  // Shared with the worker
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<std::string> requests_;
+  std::vector<Listing> finished_;
+  bool stop_ = false;
+  std::thread worker_;
+};
@@ -1,45 +1,233 @@
 #include "EditorCommands.hpp"
+#include "AllocCounter.hpp"
+#include "BufferManager.hpp"
+#include "EditorRenderer.hpp"
+#include "FileOperations.hpp"
 #include "LuaBindings.hpp"
+#include "Macros.hpp"
 #include "TextEditor.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
 
-EditorCommands::EditorCommands(TextEditor *editor) : editor_(editor) {}
+EditorCommands::EditorCommands(TextEditor *editor) : editor_(editor) {
+  directory_.setRoot(".");
+}
 
 void EditorCommands::registerCommands() {
-  commands_["save"] = [this]() {
-    editor_->addOutput("Executing save command...");
-  };
+  commands_["save"] = [this]() { editor_->fileOps_->saveFile(); };
 
-  commands_["new"] = [this]() {
-    editor_->addOutput("Executing new command...");
-  };
+  commands_["new"] = [this]() { editor_->fileOps_->newFile(); };
 
   commands_["clear"] = [this]() { editor_->outputLines.clear(); };
 
   commands_["refresh"] = [this]() { refreshFileList(); };
 
   commands_["focus"] = [this]() { editor_->focusEditor = true; };
+
+#ifdef DONUTEX_DEV_COMMANDS
+  commands_["bench_fuzzy"] = [this]() { benchmarkFuzzy(); };
+#endif
+
+  commands_["follow"] = [this]() {
+    editor_->fileOps_->setFollow(!editor_->fileOps_->following());
+  };
+
+  commands_["reload"] = [this]() { editor_->fileOps_->reloadFromDisk(true); };
+
+  commands_["stop"] = [this]() {
+    if (!tasks_.running())
+      editor_->addOutput("No task is running");
+    else if (!tasks_.stop())
+      editor_->log(LogSeverity::Warning, "This task can't be stopped here");
+  };
+
+  commands_["history"] = [this]() {
+    char line[128];
+    snprintf(line, sizeof(line),
+             "Undo history: %zu steps, %.1f KB (refers to %.1f KB of text, "
+             "limit %zu MB)",
+             editor_->undoSteps(), editor_->undoHistoryBytes() / 1024.0,
+             editor_->undoHistoryTextBytes() / 1024.0,
+             editor_->undoHistoryLimit >> 20);
+    editor_->addOutput(line);
+  };
+
+  commands_["allocs"] = [this]() {
+    if (!AllocCounter::available()) {
+      editor_->addOutput("Allocation counting needs a build with DONUTEX_ALLOC_COUNTER");
+      return;
+    }
+    const auto &stats = editor_->renderer_->typingStats();
+    char line[160];
+    snprintf(line, sizeof(line),
+             "Typing: %llu characters in %llu inserts made %llu heap "
+             "allocations (%llu in the last insert)",
+             (unsigned long long)stats.characters,
+             (unsigned long long)stats.inserts,
+             (unsigned long long)stats.allocations,
+             (unsigned long long)stats.lastAllocations);
+    editor_->addOutput(line);
+  };
+
+  commands_["record"] = [this]() {
+    Macros &macros = *editor_->macros_;
+    if (!macros.recording()) {
+      macros.startRecording();
+      editor_->addOutput("Recording a macro (run \"record\" again to stop)");
+      return;
+    }
+    macros.stopRecording();
+    char line[96];
+    snprintf(line, sizeof(line), "Macro recorded: %zu bytes",
+             macros.bytecode().size());
+    editor_->addOutput(line);
+  };
+
+  commands_["play"] = [this]() { playMacro(1); };
+
+  commands_["close"] = [this]() {
+    editor_->buffers_->close(editor_->buffers_->active());
+  };
 }
 
 void EditorCommands::executeCommand(const std::string &cmd) {
   editor_->addOutput("> " + cmd);
 
-  if (commands_.find(cmd) != commands_.end()) {
+  if (cmd.size() > 1 && cmd[0] == '!') {
+    runTask(cmd.substr(1));
+  } else if (cmd.compare(0, 4, "run ") == 0) {
+    runTask(cmd.substr(4));
+  } else if (cmd.compare(0, 5, "play ") == 0) {
+    playMacro(std::strtoll(cmd.c_str() + 5, nullptr, 10));
+  } else if (commands_.find(cmd) != commands_.end()) {
+    editor_->macros_->recordCommand(cmd);
     commands_[cmd]();
   } else {
     std::string luaCmd = "if type(command_" + cmd +
                          ")=='function' then command_" + cmd + "() end";
     // Lua evaluation would happen through LuaBindings
     editor_->addOutput(editor_->icons["error"], "Unknown command: " + cmd);
+
+    auto suggestions = suggestCommands(cmd, 3);
+    if (!suggestions.empty()) {
+      std::string hint = "Did you mean:";
+      for (const auto &s : suggestions)
+        hint += " " + s;
+      editor_->addOutput(hint);
+    }
+  }
+}
+
+// "play N" in the command box runs the last macro N times
+void EditorCommands::playMacro(long long times) {
+  if (times < 1) {
+    editor_->addOutput(editor_->icons["error"], "Usage: play [count]");
+    return;
+  }
+  Macros &macros = *editor_->macros_;
+  macros.stopRecording();
+  auto start = std::chrono::steady_clock::now();
+  long long runs = macros.play(times);
+  if (runs < 0) {
+    editor_->addOutput("No macro recorded yet (use \"record\")");
+    return;
+  }
+  double ms = std::chrono::duration<double, std::milli>(
+                  std::chrono::steady_clock::now() - start)
+                  .count();
+  char line[128];
+  snprintf(line, sizeof(line), "Macro ran %lld of %lld times in %.1f ms",
+           runs, times, ms);
+  editor_->addOutput(line);
+}
+
+void EditorCommands::runTask(const std::string &command) {
+  std::string error;
+  if (!tasks_.start(command, error))
+    editor_->addOutput(editor_->icons["error"],
+                       "Could not run task: " + error);
+}
+
+// At most this many task lines reach the panel per frame; a build printing
+// faster than that is caught up over the following frames
+static const size_t kTaskLinesPerFrame = 2000;
+
+void EditorCommands::pollTasks() {
+  tasks_.setMaxQueued(editor_->outputLines.capacity());
+  tasks_.take(editor_->outputLines, kTaskLinesPerFrame);
+}
+
+std::vector<std::string>
+EditorCommands::suggestCommands(const std::string &pattern,
+                                size_t limit) const {
+  std::vector<std::pair<int, std::string>> scored;
+  for (const auto &entry : commands_) {
+    int score = FuzzyMatcher::score(pattern, entry.first);
+    if (score != FuzzyMatcher::kNoMatch)
+      scored.push_back({score, entry.first});
   }
+  std::stable_sort(scored.begin(), scored.end(),
+                   [](const auto &a, const auto &b) { return a.first > b.first; });
+
+  std::vector<std::string> names;
+  for (size_t i = 0; i < scored.size() && i < limit; ++i)
+    names.push_back(scored[i].second);
+  return names;
 }
 
-void EditorCommands::refreshFileList() {
-  fileList_.clear();
-  try {
-    for (const auto &entry : std::filesystem::directory_iterator(".")) {
-      fileList_.push_back(entry.path().filename().string());
+// The tree follows file-system events by itself; this forces a re-list
+// (e.g. where no watcher is available).
+void EditorCommands::refreshFileList() { directory_.reloadAll(); }
+
+#ifdef DONUTEX_DEV_COMMANDS
+// Ranks a synthetic 100k path list the way the explorer filter would while
+// a query is typed one character at a time.
+void EditorCommands::benchmarkFuzzy() {
+  const char *parts[] = {"src",  "editor", "render", "piece", "table",
+                         "file", "ops",    "lua",    "bind",  "output",
+                         "panel", "core",  "util",   "test"};
+  const size_t partCount = sizeof(parts) / sizeof(parts[0]);
+
+  std::vector<std::string> paths;
+  paths.reserve(100000);
+  unsigned seed = 12345;
+  for (size_t i = 0; i < 100000; ++i) {
+    std::string path;
+    size_t depth = 2 + i % 4;
+    for (size_t d = 0; d < depth; ++d) {
+      seed = seed * 1103515245u + 12345u;
+      path += parts[(seed >> 16) % partCount];
+      path += d + 1 < depth ? "/" : "";
     }
-  } catch (...) {
-    editor_->addOutput(editor_->icons["error"], "Error reading directory");
+    path += std::to_string(i) + ".cpp";
+    paths.push_back(std::move(path));
+  }
+
+  using Clock = std::chrono::steady_clock;
+  FuzzyMatcher matcher;
+  auto t0 = Clock::now();
+  matcher.setCandidates(std::move(paths));
+  double setupMs =
+      std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+  editor_->addOutput("bench_fuzzy: indexed 100000 paths in " +
+                     std::to_string(setupMs) + " ms");
+
+  const std::string query = "edrndtbl";
+  for (size_t len = 1; len <= query.size(); ++len) {
+    std::string prefix = query.substr(0, len);
+    auto start = Clock::now();
+    auto results = matcher.rank(prefix, 50);
+    double ms =
+        std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    char line[160];
+    snprintf(line, sizeof(line), "  %-10s %7.2f ms  %zu shown  best: %s",
+             prefix.c_str(), ms, results.size(),
+             results.empty()
+                 ? "-"
+                 : matcher.candidates()[results[0].index].c_str());
+    editor_->addOutput(line);
   }
 }
+#endif
@@ -1,8 +1,12 @@
 #pragma once
 
+#include "DirectoryModel.hpp"
+#include "FuzzyMatcher.hpp"
+#include "TaskRunner.hpp"
 #include <functional>
 #include <map>
 #include <string>
+#include <vector>
 
 class TextEditor;
 
@@ -15,13 +19,32 @@ public:
   void executeCommand(const std::string &cmd);
   void refreshFileList();
 
+  // Command names ranked by fuzzy match against pattern
+  std::vector<std::string> suggestCommands(const std::string &pattern,
+                                           size_t limit) const;
+
   const std::map<std::string, std::function<void()>> &getCommands() const {
     return commands_;
   }
-  const std::vector<std::string> &getFileList() const { return fileList_; }
+  DirectoryModel &getDirectoryModel() { return directory_; }
+
+  // "!cmd" or "run cmd" in the command box starts a background task;
+  // "stop" ends it. Its output reaches the panel through pollTasks(),
+  // called once per frame.
+  void runTask(const std::string &command);
+  void pollTasks();
+  TaskRunner &getTasks() { return tasks_; }
+
+  // Runs the last recorded macro; "record" starts and stops recording
+  void playMacro(long long times);
 
 private:
+#ifdef DONUTEX_DEV_COMMANDS
+  void benchmarkFuzzy();
+#endif
+
   TextEditor *editor_;
   std::map<std::string, std::function<void()>> commands_;
-  std::vector<std::string> fileList_;
+  DirectoryModel directory_;
+  TaskRunner tasks_;
 };
@@ -1,7 +1,16 @@
 #include "EditorRenderer.hpp"
+#include "AllocCounter.hpp"
+#include "BufferManager.hpp"
+#include "BufferSearch.hpp"
+#include "FileOperations.hpp"
+#include "LargeFileView.hpp"
 #include "LuaBindings.hpp"
+#include "Macros.hpp"
+#include "MultiCursor.hpp"
 #include "TextEditor.hpp"
 #include "imgui_internal.h"
+#include <misc/cpp/imgui_stdlib.h>
+#include <regex>
 #include <algorithm>
 #include <cmath>
 #include <cstring>
@@ -53,6 +62,19 @@ void EditorRenderer::renderMenuBar() {
         editor_->showGrid = !editor_->showGrid;
       // toggle line numbers
       ImGui::MenuItem("Show Line Numbers", nullptr, &editor_->showLineNumbers);
+      ImGui::Separator();
+      ImGui::MenuItem("Find in Files", "Ctrl+Shift+F",
+                      &editor_->showFindInFiles);
+      if (ImGui::MenuItem("Go to Definition", "F12"))
+        editor_->gotoDefinition();
+      if (ImGui::MenuItem("Go to File", "Ctrl+P")) {
+        editor_->showQuickOpen = true;
+        editor_->focusQuickOpen = true;
+      }
+      ImGui::Separator();
+      if (ImGui::MenuItem("Follow File (tail -f)", nullptr,
+                          editor_->fileOps_->following()))
+        editor_->fileOps_->setFollow(!editor_->fileOps_->following());
       ImGui::EndMenu();
     }
 
@@ -78,6 +100,30 @@ void EditorRenderer::renderSettings() {
   ImGui::Begin("Settings", &editor_->showSettings,
                ImGuiWindowFlags_NoCollapse | ImGuiWindowFlags_NoDocking);
   ImGui::Text("Editor Settings");
+  int thresholdMb = (int)(editor_->largeFileThreshold >> 20);
+  if (ImGui::InputInt("Large file mode above (MB)", &thresholdMb))
+    editor_->largeFileThreshold = (size_t)std::max(1, thresholdMb) << 20;
+  ImGui::TextDisabled("Open buffer: %.1f MB resident",
+                      editor_->fileOps_->residentBytes() / 1048576.0);
+  int budgetMb = (int)(editor_->bufferMemoryBudget >> 20);
+  if (ImGui::InputInt("Buffer memory budget (MB)", &budgetMb)) {
+    editor_->bufferMemoryBudget = (size_t)std::max(1, budgetMb) << 20;
+    editor_->buffers_->enforceBudget();
+  }
+  int undoMb = (int)(editor_->undoHistoryLimit >> 20);
+  if (ImGui::InputInt("Undo history limit (MB)", &undoMb))
+    editor_->undoHistoryLimit = (size_t)std::max(1, undoMb) << 20;
+  ImGui::TextDisabled("Undo history: %zu steps, %.1f KB (refers to %.1f KB "
+                      "of text)",
+                      editor_->undoSteps(),
+                      editor_->undoHistoryBytes() / 1024.0,
+                      editor_->undoHistoryTextBytes() / 1024.0);
+  int outputLines = (int)editor_->outputLines.capacity();
+  if (ImGui::InputInt("Output panel lines", &outputLines, 1000, 100000))
+    editor_->outputLines.setCapacity((size_t)std::max(1, outputLines));
+  ImGui::TextDisabled("All buffers: %.1f MB resident in %zu tabs",
+                      editor_->buffers_->residentBytes() / 1048576.0,
+                      editor_->buffers_->count());
   lua_->eval("if show_font_menu then show_font_menu() end");
   ImGui::End();
 }
@@ -108,6 +154,219 @@ void EditorRenderer::renderGrid(ImDrawList *drawList, ImVec2 pos, float viewW,
   }
 }
 
+// Buffers above this size get their find count from a background worker
+static const size_t kSyncFindCountLimit = 1 << 20;
+
+void EditorRenderer::updateFindCount() {
+  if (editor_->findRegex) {
+    // stream in whatever the regex worker found since last frame
+    findCounter_.takeMatches(editor_->regexMatches);
+    if (findCountAsync_) {
+      char status[256];
+      snprintf(status, sizeof(status), "Regex /%s/: %zu matches%s",
+               countedQuery_.c_str(), findCounter_.matchCount(),
+               findCounter_.busy() ? " (searching...)" : "");
+      editor_->searchStatus = status;
+      if (size_t skipped = findCounter_.skippedLines())
+        editor_->searchStatus += ", " + std::to_string(skipped) +
+                                 " lines over " +
+                                 std::to_string(kMaxRegexLine >> 20) +
+                                 " MB skipped";
+    }
+  }
+
+  if (editor_->findQuery == countedQuery_ &&
+      editor_->contentVersion == countedVersion_ &&
+      editor_->findRegex == countedRegex_)
+    return;
+  countedQuery_ = editor_->findQuery;
+  countedVersion_ = editor_->contentVersion;
+  countedRegex_ = editor_->findRegex;
+  editor_->regexMatches.clear();
+  editor_->searchStatus.clear();
+
+  if (countedRegex_ && !countedQuery_.empty()) {
+    // Regex search always runs on the worker; restarting cancels the
+    // previous query and any search over a now stale buffer.
+    try {
+      std::regex re(countedQuery_, std::regex::ECMAScript);
+      findCounter_.searchRegex(editor_->content, std::move(re));
+      findCountAsync_ = true;
+    } catch (const std::regex_error &e) {
+      findCounter_.cancel();
+      findCount_ = 0;
+      findCountAsync_ = false;
+      editor_->searchStatus = std::string("Regex error: ") + e.what();
+    }
+  } else if (countedQuery_.empty() ||
+             editor_->content.size() < kSyncFindCountLimit) {
+    findCounter_.cancel();
+    findCount_ = countedQuery_.empty()
+                     ? 0
+                     : BufferSearch::count(editor_->content, countedQuery_);
+    findCountAsync_ = false;
+  } else {
+    findCounter_.countLiteral(editor_->content, countedQuery_);
+    findCountAsync_ = true;
+  }
+}
+
+void EditorRenderer::renderFindBar(ImVec2 editorPos, ImVec2 editorSize) {
+  updateFindCount();
+
+  ImGui::SetNextWindowPos(
+      ImVec2(editorPos.x + editorSize.x - 24.0f, editorPos.y + 8.0f),
+      ImGuiCond_Always, ImVec2(1.0f, 0.0f));
+  if (ImGui::Begin("##find_bar", nullptr,
+                   ImGuiWindowFlags_NoDecoration |
+                       ImGuiWindowFlags_AlwaysAutoResize |
+                       ImGuiWindowFlags_NoSavedSettings |
+                       ImGuiWindowFlags_NoDocking)) {
+    if (editor_->focusFind) {
+      ImGui::SetKeyboardFocusHere();
+      editor_->focusFind = false;
+    }
+    ImGui::SetNextItemWidth(240.0f);
+    bool enter = ImGui::InputTextWithHint(
+        "##find_query", "Find", &editor_->findQuery,
+        ImGuiInputTextFlags_EnterReturnsTrue |
+            ImGuiInputTextFlags_AutoSelectAll);
+    if (enter) {
+      if (ImGui::GetIO().KeyShift)
+        editor_->findPrev();
+      else
+        editor_->findNext();
+      ImGui::SetKeyboardFocusHere(-1); // keep typing in the find field
+    }
+    ImGui::SameLine();
+    ImGui::Checkbox(".*", &editor_->findRegex);
+
+    ImGui::SameLine();
+    size_t shown = findCountAsync_ ? findCounter_.matchCount() : findCount_;
+    if (findCountAsync_ && findCounter_.busy())
+      ImGui::TextDisabled("%zu+ matches", shown);
+    else
+      ImGui::TextDisabled("%zu matches", shown);
+
+    ImGui::SameLine();
+    if (ImGui::SmallButton("<"))
+      editor_->findPrev();
+    ImGui::SameLine();
+    if (ImGui::SmallButton(">"))
+      editor_->findNext();
+    ImGui::SameLine();
+    bool close = ImGui::SmallButton("x");
+
+    if (editor_->showReplace) {
+      ImGui::SetNextItemWidth(240.0f);
+      bool replace = ImGui::InputTextWithHint(
+          "##replace_text", editor_->findRegex ? "Replace ($1 for a group)"
+                                               : "Replace",
+          &editor_->replaceText, ImGuiInputTextFlags_EnterReturnsTrue);
+      ImGui::SameLine();
+      if (ImGui::SmallButton("Replace all") || replace)
+        editor_->replaceAll(editor_->findQuery, editor_->replaceText,
+                            editor_->findRegex);
+    }
+
+    if (close || (ImGui::IsWindowFocused() &&
+                  ImGui::IsKeyPressed(ImGuiKey_Escape))) {
+      editor_->showFind = false;
+      editor_->focusEditor = true;
+      findCounter_.cancel();
+      editor_->regexMatches.clear();
+      editor_->searchStatus.clear();
+      countedVersion_ = (size_t)-1; // recount when reopened
+    }
+  }
+  ImGui::End();
+}
+
+void EditorRenderer::renderLoadProgress(ImVec2 editorPos, ImVec2 editorSize) {
+  const FileLoader &loader = editor_->fileOps_->loader();
+  ImGui::SetNextWindowPos(ImVec2(editorPos.x + editorSize.x * 0.5f,
+                                 editorPos.y + editorSize.y * 0.5f),
+                          ImGuiCond_Always, ImVec2(0.5f, 0.5f));
+  ImGui::SetNextWindowSize(ImVec2(360.0f, 0.0f), ImGuiCond_Always);
+  if (ImGui::Begin("##load_progress", nullptr,
+                   ImGuiWindowFlags_NoDecoration |
+                       ImGuiWindowFlags_AlwaysAutoResize |
+                       ImGuiWindowFlags_NoSavedSettings |
+                       ImGuiWindowFlags_NoDocking)) {
+    ImGui::Text("Opening %s", loader.path().c_str());
+    uint64_t total = loader.totalBytes();
+    char overlay[64];
+    if (loader.phase() == FileLoader::Phase::Indexing || total == 0) {
+      // Line and word indexing report no progress; animate instead
+      ImGui::ProgressBar(-1.0f * (float)ImGui::GetTime(), ImVec2(-1.0f, 0.0f),
+                         "Indexing...");
+    } else {
+      double done = (double)loader.bytesRead();
+      snprintf(overlay, sizeof(overlay), "%.1f / %.1f MB", done / 1048576.0,
+               (double)total / 1048576.0);
+      ImGui::ProgressBar((float)(done / (double)total), ImVec2(-1.0f, 0.0f),
+                         overlay);
+    }
+    if (ImGui::Button("Cancel"))
+      editor_->fileOps_->cancelLoad();
+  }
+  ImGui::End();
+}
+
+void EditorRenderer::renderFindMatches(ImDrawList *drawList, ImVec2 pos,
+                                       float cellWidth, float lineHeight,
+                                       float padX, float padY,
+                                       int firstVisibleLine,
+                                       int lastVisibleLine) {
+  const std::string &query = editor_->findQuery;
+  if (!editor_->showFind || query.empty())
+    return;
+
+  ImU32 matchColor = IM_COL32(210, 160, 40, 90);
+
+  if (editor_->findRegex) {
+    // Regex results are sorted offsets; walk them alongside the lines
+    const auto &matches = editor_->regexMatches;
+    int lineStart = editor_->lineColToIndex(firstVisibleLine, 0);
+    auto it = std::lower_bound(
+        matches.begin(), matches.end(), (size_t)lineStart,
+        [](const SearchMatch &m, size_t p) { return m.pos < p; });
+    for (int line = firstVisibleLine;
+         line < lastVisibleLine && line < (int)editor_->lineCache.size();
+         line++) {
+      int lineLen = (int)editor_->lineCache[line].text.size();
+      float lineY = pos.y + padY - editor_->scrollY + line * lineHeight;
+      for (; it != matches.end() && it->pos <= (size_t)(lineStart + lineLen);
+           ++it) {
+        size_t col = it->pos - (size_t)lineStart;
+        float x1 = pos.x + padX - editor_->scrollX + col * cellWidth;
+        float x2 = x1 + std::max<size_t>(it->len, 1) * cellWidth;
+        drawList->AddRectFilled(ImVec2(x1, lineY),
+                                ImVec2(x2, lineY + lineHeight), matchColor);
+      }
+      lineStart += lineLen + 1;
+    }
+    return;
+  }
+
+  // Find queries are single-line, so each visible line is searched on its own
+  for (int line = firstVisibleLine;
+       line < lastVisibleLine && line < (int)editor_->lineCache.size();
+       line++) {
+    const std::string &text = editor_->lineCache[line].text;
+    float lineY = pos.y + padY - editor_->scrollY + line * lineHeight;
+    size_t hit = 0;
+    while ((hit = BufferSearch::findInSpan(text.data(), text.size(), query,
+                                           hit)) != BufferSearch::npos) {
+      float x1 = pos.x + padX - editor_->scrollX + hit * cellWidth;
+      float x2 = x1 + query.size() * cellWidth;
+      drawList->AddRectFilled(ImVec2(x1, lineY),
+                              ImVec2(x2, lineY + lineHeight), matchColor);
+      hit += query.size();
+    }
+  }
+}
+
 static float computeGutterWidth(int totalLines, float cellWidth) {
   int lines = std::max(1, totalLines);
   int digits = 1;
@@ -162,6 +421,76 @@ void EditorRenderer::renderSelection(ImDrawList *drawList, ImVec2 pos,
   }
 }
 
+// Selections and carets of MultiCursor. They are sorted, so the visible
+// ones are found by a binary search and placed in one walk down the
+// visible lines.
+void EditorRenderer::renderExtraCarets(ImDrawList *drawList, ImVec2 pos,
+                                       float cellWidth, float lineHeight,
+                                       float padX, float padY,
+                                       int firstVisibleLine,
+                                       int lastVisibleLine, bool isFocused) {
+  const MultiCursor &carets = *editor_->multiCursor_;
+  const auto &lines = editor_->lineCache;
+  if (!carets.active() || firstVisibleLine >= lastVisibleLine)
+    return;
+
+  int visibleStart = 0;
+  for (int i = 0; i < firstVisibleLine; ++i)
+    visibleStart += (int)lines[i].text.size() + 1;
+  const auto &extra = carets.extra();
+  auto it = std::lower_bound(
+      extra.begin(), extra.end(), visibleStart,
+      [](const MultiCursor::Caret &c, int value) { return c.hi() < value; });
+
+  ImU32 selectionColor = IM_COL32(60, 120, 200, 100);
+  bool blink = isFocused && (int)(ImGui::GetTime() * 2) % 2 == 0;
+  auto screenX = [&](int col) {
+    return pos.x + padX - editor_->scrollX + col * cellWidth;
+  };
+  auto screenY = [&](int line) {
+    return pos.y + padY - editor_->scrollY + line * lineHeight;
+  };
+  auto drawCaret = [&](int line, int col) {
+    float top = screenY(line) + lineHeight * 0.15f;
+    drawList->AddLine(ImVec2(screenX(col), top),
+                      ImVec2(screenX(col), top + lineHeight * 0.75f),
+                      ImGui::GetColorU32(ImGuiCol_Text), 2.0f);
+  };
+
+  int line = firstVisibleLine;
+  int start = visibleStart;
+  for (; it != extra.end(); ++it) {
+    int lo = std::max(it->lo(), visibleStart);
+    while (line < lastVisibleLine &&
+           lo > start + (int)lines[line].text.size()) {
+      start += (int)lines[line].text.size() + 1;
+      line++;
+    }
+    if (line >= lastVisibleLine)
+      break;
+    if (blink && it->index == it->lo() && it->lo() >= visibleStart)
+      drawCaret(line, it->index - start);
+
+    // The selection, a rectangle per line, down to the line holding hi
+    int l = line, s = start;
+    while (it->hi() > it->lo() && l < lastVisibleLine) {
+      int length = (int)lines[l].text.size();
+      int from = std::max(lo, s) - s;
+      int to = std::min(it->hi(), s + length) - s;
+      drawList->AddRectFilled(ImVec2(screenX(from), screenY(l)),
+                              ImVec2(screenX(to), screenY(l) + lineHeight),
+                              selectionColor);
+      if (it->hi() <= s + length) {
+        if (blink && it->index == it->hi())
+          drawCaret(l, to);
+        break;
+      }
+      s += length + 1;
+      l++;
+    }
+  }
+}
+
 void EditorRenderer::renderVisibleLines(ImDrawList *drawList, ImVec2 pos,
                                         float padX, float padY,
                                         int firstVisibleLine,
@@ -188,6 +517,8 @@ void EditorRenderer::handleMouseInput(ImVec2 pos, float padX, float padY,
 
   if (ImGui::IsItemClicked()) {
     ImGui::SetKeyboardFocusHere();
+    editor_->breakUndoCoalescing();
+    editor_->multiCursor_->clear();
 
     if (editor_->lineCache.empty()) {
       editor_->cursorIndex = 0;
@@ -248,46 +579,151 @@ void EditorRenderer::handleMouseInput(ImVec2 pos, float padX, float padY,
 
 void EditorRenderer::handleKeyboardInput() {
   ImGuiIO &io = ImGui::GetIO();
+  Macros &macros = *editor_->macros_; // records each step while recording
+
+  // Moving the caret starts a new undo step for whatever is typed next
+  for (ImGuiKey key : {ImGuiKey_LeftArrow, ImGuiKey_RightArrow, ImGuiKey_UpArrow,
+                       ImGuiKey_DownArrow, ImGuiKey_Home, ImGuiKey_End})
+    if (ImGui::IsKeyPressed(key))
+      editor_->breakUndoCoalescing();
+
+  // Ctrl+D: a caret on the next occurrence of the selection; Ctrl+Shift+L:
+  // one at the end of each selected line
+  MultiCursor &carets = *editor_->multiCursor_;
+  if (io.KeyCtrl && ImGui::IsKeyPressed(ImGuiKey_D))
+    carets.addNextOccurrence();
+  if (io.KeyCtrl && io.KeyShift && ImGui::IsKeyPressed(ImGuiKey_L))
+    carets.addOnSelectedLines();
+  // A macro replays through the one caret, so recording ends where extra
+  // carets begin instead of keeping a partial copy of their edits
+  if (carets.active() && macros.recording()) {
+    macros.stopRecording();
+    editor_->log(LogSeverity::Warning,
+                 "Macro recording stopped: edits with several carets can't "
+                 "be recorded (" +
+                     std::to_string(macros.bytecode().size()) +
+                     " bytes kept)");
+  }
+  if (carets.active())
+    handleMultiCursorKeys();
+  else
+    handleCaretKeys();
+
+  // With extra carets the clipboard holds each one's selection on a line
+  if (io.KeyCtrl && ImGui::IsKeyPressed(ImGuiKey_C)) {
+    if (carets.active())
+      ImGui::SetClipboardText(carets.selectedText().c_str());
+    else
+      editor_->copySelection();
+  }
+  if (io.KeyCtrl && ImGui::IsKeyPressed(ImGuiKey_V)) {
+    const char *clip = ImGui::GetClipboardText();
+    if (carets.active()) {
+      if (clip && clip[0])
+        carets.insert(clip);
+    } else {
+      if (clip)
+        macros.recordInsert(clip); // replayed as typing, not a paste
+      editor_->pasteFromClipboard();
+    }
+  }
+  if (io.KeyCtrl && ImGui::IsKeyPressed(ImGuiKey_X)) {
+    if (carets.active()) {
+      ImGui::SetClipboardText(carets.selectedText().c_str());
+      carets.eraseSelections();
+    } else {
+      if (editor_->hasSelection())
+        macros.recordStep(Macros::Op::Backspace);
+      editor_->cutSelection();
+    }
+  }
+  if (io.KeyCtrl && ImGui::IsKeyPressed(ImGuiKey_A)) {
+    carets.clear();
+    editor_->selectAll();
+    macros.recordStep(Macros::Op::SelectAll);
+  }
+
+  if (io.KeyCtrl && ImGui::IsKeyPressed(ImGuiKey_Z)) {
+    editor_->undo();
+  }
+  if (io.KeyCtrl && ImGui::IsKeyPressed(ImGuiKey_Y)) {
+    editor_->redo();
+  }
+
+  if (!io.KeyShift && io.MouseWheel != 0.0f) {
+    editor_->scrollY -= io.MouseWheel * editor_->lineHeight * 3.0f;
+  }
+
+  if (io.KeyShift && io.MouseWheel != 0.0f) {
+    editor_->scrollX -= io.MouseWheel * 40.0f;
+  }
+}
+
+// The editor's own caret: each key as one edit or motion
+void EditorRenderer::handleCaretKeys() {
+  ImGuiIO &io = ImGui::GetIO();
+  Macros &macros = *editor_->macros_;
 
   // Enter key
   if (ImGui::IsKeyPressed(ImGuiKey_Enter) ||
       ImGui::IsKeyPressed(ImGuiKey_KeypadEnter)) {
     editor_->deleteSelection();
-    editor_->applyInsert(editor_->cursorIndex, "\n");
+    editor_->applyInsert(editor_->cursorIndex, "\n", true);
     editor_->caretFollow = true;
+    macros.recordInsert("\n");
   }
 
-  // Text input
+  // Text input: a burst from key repeat or an IME is one insert, so one
+  // undo record and one line refresh rather than one per character
+  typed_.clear();
   for (unsigned int c : io.InputQueueCharacters) {
-    if (c == '\n' || c == '\r')
-      continue;
-    if (c >= 32) {
-      editor_->deleteSelection();
-      char ch = (char)c;
-      editor_->applyInsert(editor_->cursorIndex, std::string(1, ch));
-      editor_->caretFollow = true;
+    if (c >= 32)
+      typed_.push_back((char)c);
+  }
+  if (!typed_.empty()) {
+    uint64_t before = AllocCounter::count();
+    unsigned step = editor_->undoState();
+    editor_->deleteSelection();
+    editor_->applyInsert(editor_->cursorIndex, typed_, true);
+    editor_->caretFollow = true;
+    typingStats_.inserts++;
+    typingStats_.characters += typed_.size();
+    typingStats_.lastAllocations = AllocCounter::count() - before;
+    typingStats_.allocations += typingStats_.lastAllocations;
+    // Continuing an undo step should not allocate, apart from the odd
+    // amortized buffer growth; anything more is a regression worth seeing
+    if (typingStats_.lastAllocations != 0 && editor_->undoState() == step) {
+      editor_->log(LogSeverity::Warning,
+                   "Typing made " +
+                       std::to_string(typingStats_.lastAllocations) +
+                       " heap allocations in an insert that continued an "
+                       "undo step");
     }
+    macros.recordInsert(typed_);
   }
 
   if (ImGui::IsKeyPressed(ImGuiKey_Backspace)) {
     if (editor_->hasSelection()) {
       editor_->deleteSelection();
     } else if (editor_->cursorIndex > 0) {
-      editor_->applyErase(editor_->cursorIndex - 1, 1);
+      editor_->applyErase(editor_->cursorIndex - 1, 1, true);
     }
     editor_->caretFollow = true;
+    macros.recordStep(Macros::Op::Backspace);
   }
 
   if (ImGui::IsKeyPressed(ImGuiKey_Delete)) {
     if (editor_->hasSelection()) {
       editor_->deleteSelection();
     } else if (editor_->cursorIndex < (int)editor_->content.size()) {
-      editor_->applyErase(editor_->cursorIndex, 1);
+      editor_->applyErase(editor_->cursorIndex, 1, true);
     }
     editor_->caretFollow = true;
+    macros.recordStep(Macros::Op::Delete);
   }
 
   if (ImGui::IsKeyPressed(ImGuiKey_LeftArrow)) {
+    macros.recordStep(Macros::Op::Left, io.KeyShift);
     if (io.KeyShift) {
       if (editor_->selectionStart == -1)
         editor_->selectionStart = editor_->cursorIndex;
@@ -307,6 +743,7 @@ void EditorRenderer::handleKeyboardInput() {
   }
 
   if (ImGui::IsKeyPressed(ImGuiKey_RightArrow)) {
+    macros.recordStep(Macros::Op::Right, io.KeyShift);
     if (io.KeyShift) {
       if (editor_->selectionStart == -1)
         editor_->selectionStart = editor_->cursorIndex;
@@ -326,6 +763,7 @@ void EditorRenderer::handleKeyboardInput() {
   }
 
   if (ImGui::IsKeyPressed(ImGuiKey_UpArrow)) {
+    macros.recordStep(Macros::Op::Up, io.KeyShift);
     int line, col;
     editor_->indexToLineCol(editor_->cursorIndex, line, col);
     if (line > 0) {
@@ -341,6 +779,7 @@ void EditorRenderer::handleKeyboardInput() {
   }
 
   if (ImGui::IsKeyPressed(ImGuiKey_DownArrow)) {
+    macros.recordStep(Macros::Op::Down, io.KeyShift);
     int line, col;
     editor_->indexToLineCol(editor_->cursorIndex, line, col);
     if (line < (int)editor_->lineCache.size() - 1) {
@@ -356,6 +795,7 @@ void EditorRenderer::handleKeyboardInput() {
   }
 
   if (ImGui::IsKeyPressed(ImGuiKey_Home)) {
+    macros.recordStep(Macros::Op::Home, io.KeyShift);
     int line, col;
     editor_->indexToLineCol(editor_->cursorIndex, line, col);
     if (io.KeyShift && editor_->selectionStart == -1)
@@ -369,6 +809,7 @@ void EditorRenderer::handleKeyboardInput() {
   }
 
   if (ImGui::IsKeyPressed(ImGuiKey_End)) {
+    macros.recordStep(Macros::Op::End, io.KeyShift);
     int line, col;
     editor_->indexToLineCol(editor_->cursorIndex, line, col);
     if (line < (int)editor_->lineCache.size()) {
@@ -384,32 +825,48 @@ void EditorRenderer::handleKeyboardInput() {
     editor_->caretFollow = true;
   }
 
-  if (io.KeyCtrl && ImGui::IsKeyPressed(ImGuiKey_C)) {
-    editor_->copySelection();
-  }
-  if (io.KeyCtrl && ImGui::IsKeyPressed(ImGuiKey_V)) {
-    editor_->pasteFromClipboard();
-  }
-  if (io.KeyCtrl && ImGui::IsKeyPressed(ImGuiKey_X)) {
-    editor_->cutSelection();
-  }
-  if (io.KeyCtrl && ImGui::IsKeyPressed(ImGuiKey_A)) {
-    editor_->selectAll();
-  }
+}
 
-  if (io.KeyCtrl && ImGui::IsKeyPressed(ImGuiKey_Z)) {
-    editor_->undo();
-  }
-  if (io.KeyCtrl && ImGui::IsKeyPressed(ImGuiKey_Y)) {
-    editor_->redo();
+// Extra carets: each key is one batch of edits or motions over all of them
+void EditorRenderer::handleMultiCursorKeys() {
+  ImGuiIO &io = ImGui::GetIO();
+  MultiCursor &carets = *editor_->multiCursor_;
+  if (ImGui::IsKeyPressed(ImGuiKey_Escape)) {
+    carets.clear();
+    return;
   }
 
-  if (!io.KeyShift && io.MouseWheel != 0.0f) {
-    editor_->scrollY -= io.MouseWheel * editor_->lineHeight * 3.0f;
-  }
+  if (ImGui::IsKeyPressed(ImGuiKey_Enter) ||
+      ImGui::IsKeyPressed(ImGuiKey_KeypadEnter))
+    carets.insert("\n");
 
-  if (io.KeyShift && io.MouseWheel != 0.0f) {
-    editor_->scrollX -= io.MouseWheel * 40.0f;
+  typed_.clear();
+  for (unsigned int c : io.InputQueueCharacters) {
+    if (c >= 32)
+      typed_.push_back((char)c);
+  }
+  if (!typed_.empty())
+    carets.insert(typed_);
+
+  if (ImGui::IsKeyPressed(ImGuiKey_Backspace))
+    carets.backspace();
+  if (ImGui::IsKeyPressed(ImGuiKey_Delete))
+    carets.deleteForward();
+
+  static const struct {
+    ImGuiKey key;
+    MultiCursor::Motion motion;
+  } motions[] = {
+      {ImGuiKey_LeftArrow, MultiCursor::Motion::Left},
+      {ImGuiKey_RightArrow, MultiCursor::Motion::Right},
+      {ImGuiKey_UpArrow, MultiCursor::Motion::Up},
+      {ImGuiKey_DownArrow, MultiCursor::Motion::Down},
+      {ImGuiKey_Home, MultiCursor::Motion::Home},
+      {ImGuiKey_End, MultiCursor::Motion::End},
+  };
+  for (const auto &m : motions) {
+    if (ImGui::IsKeyPressed(m.key))
+      carets.move(m.motion, io.KeyShift);
   }
 }
 
@@ -634,12 +1091,59 @@ void EditorRenderer::renderScrollbars(ImVec2 pos, float viewW, float viewH,
   editor_->scrollY = std::clamp(editor_->scrollY, 0.0f, maxScrollY);
 }
 
+void EditorRenderer::renderTabs() {
+  BufferManager &buffers = *editor_->buffers_;
+  if (!ImGui::BeginTabBar("##buffers", ImGuiTabBarFlags_FittingPolicyScroll))
+    return;
+
+  // A programmatic switch keeps asking for its tab until the bar shows it;
+  // otherwise a change of selected tab is a click
+  unsigned wanted = buffers.selectRequest();
+  unsigned shown = 0;
+  int closing = -1;
+  for (size_t i = 0; i < buffers.count(); ++i) {
+    unsigned id = buffers.id(i);
+    std::string label = buffers.title(i) + "###buf" + std::to_string(id);
+    ImGuiTabItemFlags flags = 0;
+    if (buffers.isModified(i))
+      flags |= ImGuiTabItemFlags_UnsavedDocument;
+    if (id == wanted)
+      flags |= ImGuiTabItemFlags_SetSelected;
+    bool open = true;
+    if (ImGui::BeginTabItem(label.c_str(), &open, flags)) {
+      shown = id;
+      ImGui::EndTabItem();
+    }
+    if (!open)
+      closing = (int)i;
+  }
+  ImGui::EndTabBar();
+
+  if (closing >= 0) {
+    buffers.close((size_t)closing);
+  } else if (wanted != 0) {
+    if (shown == wanted)
+      buffers.clearSelectRequest();
+  } else if (shown != 0 && shown != buffers.id(buffers.active())) {
+    for (size_t i = 0; i < buffers.count(); ++i)
+      if (buffers.id(i) == shown)
+        buffers.activate(i);
+  }
+}
+
 void EditorRenderer::renderEditor() {
   if (ImGui::Begin("Editor", nullptr,
                    ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoResize |
                        ImGuiWindowFlags_NoCollapse |
                        ImGuiWindowFlags_NoTitleBar |
                        ImGuiWindowFlags_NoBringToFrontOnFocus)) {
+    renderTabs();
+    if (editor_->largeView_->active()) {
+      editor_->largeView_->render();
+      ImGui::End();
+      return;
+    }
+
     ImDrawList *drawList = ImGui::GetWindowDrawList();
     ImVec2 pos = ImGui::GetCursorScreenPos();
 
@@ -737,14 +1241,22 @@ void EditorRenderer::renderEditor() {
                textPadX, padY);
 
     // Editor interactive area
+    if (editor_->focusEditor) {
+      ImGui::SetKeyboardFocusHere();
+      editor_->focusEditor = false;
+    }
     ImGui::InvisibleButton("editor_area", ImVec2(viewW, viewH),
                            ImGuiButtonFlags_MouseButtonLeft);
     bool isFocused = ImGui::IsItemFocused();
 
-    // render selection, lines, caret, and handle input — pass textPadX so
-    // rendering is shifted
+    // render find matches, selection, lines, caret, and handle input — pass
+    // textPadX so rendering is shifted
+    renderFindMatches(drawList, pos, cellWidth, editor_->lineHeight, textPadX,
+                      padY, firstVisibleLine, lastVisibleLine);
     renderSelection(drawList, pos, cellWidth, editor_->lineHeight, textPadX,
                     padY, firstVisibleLine, lastVisibleLine);
+    renderExtraCarets(drawList, pos, cellWidth, editor_->lineHeight, textPadX,
+                      padY, firstVisibleLine, lastVisibleLine, isFocused);
     renderVisibleLines(drawList, pos, textPadX, padY, firstVisibleLine,
                        lastVisibleLine);
     renderCaret(drawList, pos, textPadX, padY, cellWidth, editor_->lineHeight,
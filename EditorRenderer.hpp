@@ -1,6 +1,9 @@
 #pragma once
 
+#include "SearchWorker.hpp"
 #include "imgui.h"
+#include <cstdint>
+#include <string>
 
 class TextEditor;
 class LuaBindings;
@@ -12,17 +15,53 @@ public:
 
   void renderMenuBar();
   void renderEditor();
+  // One tab per open buffer, above the text
+  void renderTabs();
   void renderSettings();
+  void renderFindBar(ImVec2 editorPos, ImVec2 editorSize);
+  void renderLoadProgress(ImVec2 editorPos, ImVec2 editorSize);
+
+  // Typed text: each frame's queued characters go in as one insert. The
+  // allocation figures are heap allocations made by those inserts (only
+  // with DONUTEX_ALLOC_COUNTER, see AllocCounter).
+  struct TypingStats {
+    uint64_t inserts = 0;
+    uint64_t characters = 0;
+    uint64_t allocations = 0;
+    uint64_t lastAllocations = 0;
+  };
+  const TypingStats &typingStats() const { return typingStats_; }
 
 private:
   TextEditor *editor_;
   LuaBindings *lua_;
 
+  // Find bar match count: counted inline for small buffers, on a worker
+  // for large ones and for regex queries. Restarted whenever the query,
+  // the mode or the buffer changes.
+  SearchWorker findCounter_;
+  std::string countedQuery_;
+  size_t countedVersion_ = (size_t)-1;
+  bool countedRegex_ = false;
+  size_t findCount_ = 0;
+  bool findCountAsync_ = false;
+
+  std::string typed_; // this frame's characters; keeps its capacity
+  TypingStats typingStats_;
+
   void renderGrid(ImDrawList *drawList, ImVec2 pos, float viewW, float viewH,
                   float cellWidth, float lineHeight, float padX, float padY);
+  void renderFindMatches(ImDrawList *drawList, ImVec2 pos, float cellWidth,
+                         float lineHeight, float padX, float padY,
+                         int firstVisibleLine, int lastVisibleLine);
+  void updateFindCount();
   void renderSelection(ImDrawList *drawList, ImVec2 pos, float cellWidth,
                        float lineHeight, float padX, float padY,
                        int firstVisibleLine, int lastVisibleLine);
+  void renderExtraCarets(ImDrawList *drawList, ImVec2 pos, float cellWidth,
+                         float lineHeight, float padX, float padY,
+                         int firstVisibleLine, int lastVisibleLine,
+                         bool isFocused);
   void renderVisibleLines(ImDrawList *drawList, ImVec2 pos, float padX,
                           float padY, int firstVisibleLine,
                           int lastVisibleLine);
@@ -32,6 +71,8 @@ private:
   void handleMouseInput(ImVec2 pos, float padX, float padY, float cellWidth,
                         float lineHeight);
   void handleKeyboardInput();
+  void handleCaretKeys();
+  void handleMultiCursorKeys();
   void renderCaret(ImDrawList *drawList, ImVec2 pos, float padX, float padY,
                    float cellWidth, float lineHeight, bool isFocused);
   void renderScrollbars(ImVec2 pos, float viewW, float viewH, float scrollbarW,
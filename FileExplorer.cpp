@@ -2,14 +2,117 @@
 #include "EditorCommands.hpp"
 #include "IconManager.hpp"
 #include "TextEditor.hpp"
-#include <filesystem>
+#include <algorithm>
+#include <misc/cpp/imgui_stdlib.h>
 
 FileExplorer::FileExplorer(TextEditor *editor, IconManager *iconMgr,
                            EditorCommands *commands)
     : editor_(editor), iconMgr_(iconMgr), commands_(commands) {}
 
+void FileExplorer::flattenTree() {
+  DirectoryModel &model = commands_->getDirectoryModel();
+  // Iterative pre-order walk over expanded directories
+  std::vector<std::pair<int, int>> stack; // node, depth
+  const auto &root = model.node(0);
+  if (root.loading && root.children.empty())
+    rows_.push_back({0, 0, RowKind::Loading, "Loading..."});
+  for (auto it = root.children.rbegin(); it != root.children.rend(); ++it)
+    stack.push_back({*it, 0});
+
+  while (!stack.empty()) {
+    auto [index, depth] = stack.back();
+    stack.pop_back();
+    const auto &node = model.node(index);
+    rows_.push_back({index, depth,
+                     node.isDirectory ? RowKind::Folder : RowKind::Document,
+                     node.name});
+    if (!node.isDirectory || !node.expanded)
+      continue;
+    if (node.loading && node.children.empty())
+      rows_.push_back({index, depth + 1, RowKind::Loading, "Loading..."});
+    for (auto it = node.children.rbegin(); it != node.children.rend(); ++it)
+      stack.push_back({*it, depth + 1});
+  }
+}
+
+void FileExplorer::updateRows() {
+  DirectoryModel &model = commands_->getDirectoryModel();
+  if (filter_ == appliedFilter_ && appliedVersion_ == model.version())
+    return;
+  appliedFilter_ = filter_;
+  appliedVersion_ = model.version();
+
+  rows_.clear();
+  if (filter_.empty()) {
+    flattenTree();
+    return;
+  }
+  if (matcherVersion_ != model.version()) {
+    matcherVersion_ = model.version();
+    // Candidates are the listed files, by path relative to the root
+    std::vector<std::string> paths;
+    matcherNodes_.clear();
+    const std::string &root = model.node(0).path;
+    for (size_t i = 1; i < model.nodeCount(); ++i) {
+      const auto &n = model.node((int)i);
+      if (n.removed || n.parent < 0 || n.isDirectory)
+        continue;
+      paths.push_back(n.path.substr(std::min(root.size() + 1, n.path.size())));
+      matcherNodes_.push_back((int)i);
+    }
+    matcher_.setCandidates(std::move(paths));
+  }
+  for (const auto &r : matcher_.rank(filter_, 1000))
+    rows_.push_back({matcherNodes_[r.index], 0, RowKind::Document,
+                     matcher_.candidates()[r.index]});
+}
+
+void FileExplorer::renderRow(const Row &row, ImTextureID folderTex,
+                             ImTextureID docTex) {
+  float indent = row.depth * 14.0f;
+  if (row.kind == RowKind::Loading) {
+    ImGui::SetCursorPosX(ImGui::GetCursorPosX() + indent + 4);
+    ImGui::TextDisabled("%s", row.label.c_str());
+    return;
+  }
+
+  ImGui::PushID(row.node);
+  ImGui::Selectable("##fileitem", false);
+
+  ImVec2 pos = ImGui::GetItemRectMin();
+  ImVec2 size = ImGui::GetItemRectSize();
+  float iconSize = 18.0f;
+  ImVec2 iconPos(pos.x + 4 + indent, pos.y + (size.y - iconSize) * 0.5f);
+  ImDrawList *drawList = ImGui::GetWindowDrawList();
+  ImU32 textColor = ImGui::GetColorU32(ImGuiCol_Text);
+
+  drawList->AddImage(row.kind == RowKind::Folder ? folderTex : docTex,
+                     iconPos,
+                     ImVec2(iconPos.x + iconSize, iconPos.y + iconSize),
+                     ImVec2(0, 0), ImVec2(1, 1), textColor);
+  ImVec2 textPos(iconPos.x + iconSize + 6,
+                 pos.y + (size.y - ImGui::GetTextLineHeight()) * 0.5f);
+  drawList->AddText(textPos, textColor, row.label.c_str());
+
+  if (ImGui::IsItemClicked()) {
+    const auto &node = commands_->getDirectoryModel().node(row.node);
+    if (row.kind == RowKind::Folder)
+      pendingToggle_ = row.node; // applied after the loop; rows_ is live
+    else
+      editor_->openFile(node.path);
+  }
+  if (row.kind == RowKind::Document && ImGui::IsItemHovered()) {
+    const auto &node = commands_->getDirectoryModel().node(row.node);
+    ImGui::SetTooltip("%s (%.1f KB)", node.path.c_str(), node.size / 1024.0);
+  }
+  ImGui::PopID();
+}
+
 void FileExplorer::render(ImVec2 workPos, ImVec2 workSize,
                           float explorerWidth) {
+  DirectoryModel &model = commands_->getDirectoryModel();
+  model.update();
+
   if (ImGui::Begin("File Explorer", nullptr,
                    ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoResize |
                        ImGuiWindowFlags_NoCollapse |
@@ -19,36 +122,26 @@ void FileExplorer::render(ImVec2 workPos, ImVec2 workSize,
       commands_->refreshFileList();
     }
 
+    ImGui::SetNextItemWidth(-1);
+    ImGui::InputTextWithHint("##file_filter", "Filter...", &filter_);
+    updateRows();
+
     ImGui::Separator();
     ImGui::BeginChild("FileList", ImVec2(0, -40), true);
 
-    for (size_t i = 0; i < commands_->getFileList().size(); ++i) {
-      const auto &file = commands_->getFileList()[i];
-      bool isDirectory = std::filesystem::is_directory(file);
-      ImGui::PushID((int)i);
-      ImGui::Selectable("##fileitem", false);
-
-      ImVec2 pos = ImGui::GetItemRectMin();
-      ImVec2 size = ImGui::GetItemRectSize();
-      ImTextureID iconTex =
-          isDirectory ? editor_->icons["folder"] : editor_->icons["document"];
-      float iconSize = 18.0f;
-      ImVec2 iconPos(pos.x + 4, pos.y + (size.y - iconSize) * 0.5f);
-
-      ImGui::GetWindowDrawList()->AddImage(
-          iconTex, iconPos, ImVec2(iconPos.x + iconSize, iconPos.y + iconSize),
-          ImVec2(0, 0), ImVec2(1, 1), ImGui::GetColorU32(ImGuiCol_Text));
-
-      ImVec2 textPos(iconPos.x + iconSize + 6,
-                     pos.y + (size.y - ImGui::GetTextLineHeight()) * 0.5f);
-      ImGui::GetWindowDrawList()->AddText(
-          textPos, ImGui::GetColorU32(ImGuiCol_Text), file.c_str());
-
-      if (ImGui::IsItemClicked() && !isDirectory) {
-        editor_->openFile(file);
-      }
-
-      ImGui::PopID();
+    // Only the rows in view are submitted, however large the tree is
+    ImTextureID folderTex = editor_->icons["folder"];
+    ImTextureID docTex = editor_->icons["document"];
+    ImGuiListClipper clipper;
+    clipper.Begin((int)rows_.size());
+    while (clipper.Step()) {
+      for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; ++i)
+        renderRow(rows_[i], folderTex, docTex);
+    }
+    clipper.End();
+    if (pendingToggle_ >= 0) {
+      model.toggle(pendingToggle_);
+      pendingToggle_ = -1;
     }
     ImGui::EndChild();
 
@@ -1,6 +1,9 @@
 #pragma once
 
+#include "FuzzyMatcher.hpp"
 #include "imgui.h"
+#include <string>
+#include <vector>
 
 class TextEditor;
 class IconManager;
@@ -15,7 +18,34 @@ public:
   void render(ImVec2 workPos, ImVec2 workSize, float explorerWidth);
 
 private:
+  enum class RowKind { Folder, Document, Loading };
+
+  // One visible line of the explorer, computed when the tree or the filter
+  // changes so a frame only touches the rows the clipper shows
+  struct Row {
+    int node;
+    int depth;
+    RowKind kind;
+    std::string label;
+  };
+
+  void updateRows();
+  void flattenTree();
+  void renderRow(const Row &row, ImTextureID folderTex, ImTextureID docTex);
+
   TextEditor *editor_;
   IconManager *iconMgr_;
   EditorCommands *commands_;
+
+  std::string filter_;
+  std::string appliedFilter_;
+  unsigned appliedVersion_ = ~0u;
+  std::vector<Row> rows_;
+  int pendingToggle_ = -1;
+
+  // Fuzzy filter over every listed file; matcherNodes maps candidates back
+  // to DirectoryModel nodes
+  FuzzyMatcher matcher_;
+  unsigned matcherVersion_ = ~0u;
+  std::vector<int> matcherNodes_;
 };
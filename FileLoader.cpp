@@ -0,0 +1,149 @@
+#include "FileLoader.hpp"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+const size_t kChunkSize = 4 << 20;
+} // namespace
+
+FileLoader::~FileLoader() { cancel(); }
+
+void FileLoader::join() {
+  if (thread_.joinable())
+    thread_.join();
+}
+
+void FileLoader::begin(const std::string &path, Job job) {
+  cancel();
+  path_ = path;
+  job_ = job;
+  cancel_ = false;
+  done_ = false;
+  phase_ = Phase::Reading;
+  bytesRead_ = 0;
+  totalBytes_ = 0;
+  busy_ = true;
+}
+
+void FileLoader::start(const std::string &path, float cellWidth) {
+  begin(path, Job::Open);
+  thread_ = std::thread([this, path, cellWidth]() {
+    Result result;
+    result.path = path;
+    std::string data;
+    if (read(path, data, result) && !cancel_) {
+      result.content = PieceTable(std::move(data));
+      phase_ = Phase::Indexing;
+      if (TextEditor::buildLineCache(result.content, cellWidth, result.lines,
+                                     &cancel_))
+        result.words.build(result.content, &cancel_);
+    }
+    finish(std::move(result));
+  });
+}
+
+void FileLoader::startReload(const std::string &path, PieceTable current,
+                             size_t version) {
+  begin(path, Job::Reload);
+  thread_ = std::thread([this, path, current = std::move(current), version]() {
+    Result result;
+    result.job = Job::Reload;
+    result.path = path;
+    result.version = version;
+    if (read(path, result.text, result) && !cancel_) {
+      phase_ = Phase::Diffing;
+      result.hunks = LineDiff::compute(current.getText(), result.text);
+    }
+    finish(std::move(result));
+  });
+}
+
+void FileLoader::cancel() {
+  cancel_ = true;
+  join();
+  busy_ = false;
+}
+
+bool FileLoader::take(Result &out) {
+  if (!busy_ || !done_)
+    return false;
+  join();
+  std::lock_guard<std::mutex> lock(mutex_);
+  out = std::move(result_);
+  result_ = Result{};
+  busy_ = false;
+  return true;
+}
+
+void FileLoader::startRestore(unsigned buffer, const std::string &path,
+                              bool textDropped,
+                              std::shared_ptr<const MappedFile> mapping,
+                              PieceTable content, float cellWidth) {
+  begin(path, Job::Restore);
+  thread_ = std::thread([this, buffer, path, textDropped,
+                         mapping = std::move(mapping),
+                         content = std::move(content), cellWidth]() mutable {
+    Result result;
+    result.job = Job::Restore;
+    result.buffer = buffer;
+    result.path = path;
+    if (!textDropped) {
+      result.content = std::move(content);
+    } else if (mapping) {
+      totalBytes_ = mapping->size();
+      result.content =
+          PieceTable(std::string(mapping->data(), mapping->size()));
+      bytesRead_ = mapping->size();
+    } else {
+      std::string data;
+      result.reread = true;
+      if (read(path, data, result))
+        result.content = PieceTable(std::move(data));
+    }
+    if (result.error.empty() && !cancel_) {
+      phase_ = Phase::Indexing;
+      if (TextEditor::buildLineCache(result.content, cellWidth, result.lines,
+                                     &cancel_))
+        result.words.build(result.content, &cancel_);
+    }
+    finish(std::move(result));
+  });
+}
+
+bool FileLoader::read(const std::string &path, std::string &data,
+                      Result &result) {
+  FILE *file = std::fopen(path.c_str(), "rb");
+  if (!file) {
+    result.error = std::strerror(errno);
+    return false;
+  }
+  if (std::fseek(file, 0, SEEK_END) == 0) {
+    long size = std::ftell(file);
+    if (size > 0) {
+      totalBytes_ = (uint64_t)size;
+      data.reserve((size_t)size);
+    }
+    std::fseek(file, 0, SEEK_SET);
+  }
+  std::vector<char> chunk(kChunkSize);
+  while (!cancel_) {
+    size_t n = std::fread(chunk.data(), 1, chunk.size(), file);
+    data.append(chunk.data(), n);
+    bytesRead_ = data.size();
+    if (n < chunk.size())
+      break;
+  }
+  if (std::ferror(file))
+    result.error = std::strerror(errno);
+  std::fclose(file);
+  return result.error.empty();
+}
+
+void FileLoader::finish(Result result) {
+  if (cancel_)
+    return;
+  std::lock_guard<std::mutex> lock(mutex_);
+  result_ = std::move(result);
+  done_ = true;
+}
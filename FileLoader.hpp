@@ -0,0 +1,92 @@
+#pragma once
+
+#include "LineDiff.hpp"
+#include "MappedFile.hpp"
+#include "TextEditor.hpp"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Reads a file and builds its line cache and word index on a worker thread,
+// so opening a large file never stalls the UI. The result is handed back
+// whole through take() and swapped into the editor in one step; until then
+// the current buffer stays editable. Cancelling is checked between read
+// chunks and while splitting lines. The same worker also re-reads a file
+// that changed on disk and diffs it against the buffer (startReload), and
+// brings back a tab that BufferManager evicted (startRestore), so the UI
+// thread only swaps results in.
+class FileLoader {
+public:
+  enum class Phase { Reading, Indexing, Diffing };
+  enum class Job { Open, Reload, Restore };
+
+  struct Result {
+    Job job = Job::Open;
+    unsigned buffer = 0; // Restore: the BufferManager id
+    bool reread = false; // Restore: the text was read from the file again
+    std::string path;
+    PieceTable content;
+    std::vector<CachedLine> lines;
+    WordIndex words;
+    std::string error; // non-empty if the file could not be read
+    // Reload: the file as read, and the hunks that turn the buffer
+    // snapshot (taken at contentVersion `version`) into it
+    std::string text;
+    std::vector<LineDiff::Hunk> hunks;
+    size_t version = 0;
+  };
+
+  FileLoader() = default;
+  ~FileLoader();
+  FileLoader(const FileLoader &) = delete;
+  FileLoader &operator=(const FileLoader &) = delete;
+
+  // Cancels any load in flight and starts reading `path`.
+  void start(const std::string &path, float cellWidth);
+  // Cancels any load in flight, then reads `path` and diffs it against
+  // `current`, a snapshot of the buffer at contentVersion `version`.
+  void startReload(const std::string &path, PieceTable current,
+                   size_t version);
+  // Cancels any load in flight, then rebuilds the line cache and word
+  // index of buffer `buffer`. Its text is `content` if it was kept, else a
+  // copy of `mapping`, else (no mapping: the file changed) read from path.
+  void startRestore(unsigned buffer, const std::string &path, bool textDropped,
+                    std::shared_ptr<const MappedFile> mapping,
+                    PieceTable content, float cellWidth);
+  void cancel();
+
+  // True from start() until the result is taken or the load is cancelled.
+  bool busy() const { return busy_; }
+  // Moves the finished result into `out`; false while still loading.
+  bool take(Result &out);
+
+  const std::string &path() const { return path_; }
+  Job job() const { return job_; }
+  Phase phase() const { return phase_.load(); }
+  uint64_t bytesRead() const { return bytesRead_.load(); }
+  uint64_t totalBytes() const { return totalBytes_.load(); }
+
+private:
+  void begin(const std::string &path, Job job);
+  // The file's bytes; false with result.error set if it can't be read
+  bool read(const std::string &path, std::string &data, Result &result);
+  void finish(Result result);
+  void join();
+
+  std::thread thread_;
+  std::string path_;
+  Job job_ = Job::Open;
+  bool busy_ = false;
+  std::atomic<bool> cancel_{false};
+  std::atomic<bool> done_{false};
+  std::atomic<Phase> phase_{Phase::Reading};
+  std::atomic<uint64_t> bytesRead_{0};
+  std::atomic<uint64_t> totalBytes_{0};
+
+  std::mutex mutex_;
+  Result result_;
+};
@@ -1,44 +1,389 @@
 #include "FileOperations.hpp"
+#include "BufferManager.hpp"
+#include "LargeFileView.hpp"
 #include "TextEditor.hpp"
+#include <cstdio>
 #include <cstring>
+#include <filesystem>
 #include <fstream>
 #include <nfd.h>
-#include <sstream>
+
+// Pages of a large file kept in memory at once
+static const size_t kLargeFileWindow = (size_t)64 << 20;
+// Changes on disk are merged once the file has been quiet this long, so a
+// formatter or checkout isn't caught half-written
+static const double kReloadSettleSeconds = 0.2;
+
+static std::string megabytes(size_t bytes) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%.1f MB", (double)bytes / (1 << 20));
+  return buf;
+}
 
 FileOperations::FileOperations(TextEditor *editor) : editor_(editor) {}
 
 void FileOperations::openFile(const std::string &fname) {
-  std::ifstream file(fname, std::ios::binary);
-  if (!file.is_open()) {
+  pendingLine_ = -1;
+  int open = editor_->buffers_->find(fname);
+  if (open >= 0) {
+    // Already in a tab: switch to it instead of reading it again
+    loader_.cancel();
+    editor_->buffers_->activate((size_t)open);
+    return;
+  }
+  startLoad(fname);
+}
+
+void FileOperations::startLoad(const std::string &fname) {
+  std::error_code ec;
+  uintmax_t size = std::filesystem::file_size(fname, ec);
+  if (!ec && size >= editor_->largeFileThreshold) {
+    openLarge(fname);
+    return;
+  }
+  loader_.start(fname, TextEditor::cellWidth());
+}
+
+void FileOperations::openLarge(const std::string &fname) {
+  loader_.cancel();
+  if (!std::ifstream(fname, std::ios::binary).is_open()) {
+    editor_->addOutput(editor_->icons["error"],
+                       "Could not open file: " + fname + " (" +
+                           std::strerror(errno) + ")");
+    return;
+  }
+  editor_->buffers_->prepare(fname);
+  if (!editor_->largeView_->open(fname, kLargeFileWindow)) {
     editor_->addOutput(editor_->icons["error"],
                        "Could not open file: " + fname + " (" +
                            std::strerror(errno) + ")");
     return;
   }
+  resetBuffer();
+  editor_->filename = fname;
+  watchOpenFile(editor_->largeView_->buffer().originalSize());
+  editor_->addOutput(editor_->icons["folder"],
+                     "Opened in large file mode: " + fname + " (" +
+                         std::to_string(editor_->largeView_->buffer().size()) +
+                         " bytes, " + megabytes(kLargeFileWindow) +
+                         " page window)");
+  editor_->buffers_->enforceBudget();
+}
 
-  std::ostringstream buffer;
-  buffer << file.rdbuf();
-  editor_->content = PieceTable(buffer.str());
+// Drops the in-memory buffer, e.g. when a large file takes over the view
+void FileOperations::resetBuffer() {
+  editor_->content = PieceTable();
   editor_->rebuildCache();
-  editor_->filename = fname;
+  editor_->wordIndex.clear();
+  editor_->contentVersion++;
+  editor_->clearUndoRedo();
   editor_->modified = false;
   editor_->focusEditor = true;
+  editor_->cursorIndex = 0;
+  editor_->selectionStart = editor_->selectionEnd = -1;
+  editor_->scrollX = 0.0f;
+  editor_->scrollY = 0.0f;
+}
+
+size_t FileOperations::residentBytes() const {
+  if (editor_->largeView_->active())
+    return editor_->largeView_->residentBytes();
+  size_t bytes = editor_->content.memoryUsage();
+  for (const auto &line : editor_->lineCache)
+    bytes += sizeof(CachedLine) + line.text.capacity();
+  return bytes;
+}
+
+void FileOperations::cancelLoad() {
+  if (!loader_.busy()) {
+    if (restoringBuffer()) {
+      cancelRestore();
+      editor_->addOutput(editor_->icons["error"],
+                         "Cancelled opening: " + background_.path());
+    }
+    return;
+  }
+  loader_.cancel();
+  pendingLine_ = -1;
+  editor_->addOutput(editor_->icons["error"],
+                     "Cancelled opening: " + loader_.path());
+}
+
+void FileOperations::restoreBuffer(unsigned id, const std::string &path,
+                                   bool textDropped,
+                                   std::shared_ptr<const MappedFile> mapping,
+                                   PieceTable content) {
+  if (background_.busy() && background_.job() == FileLoader::Job::Reload)
+    reloadAt_ = ImGui::GetTime(); // cancelled below; run it again after
+  restoring_ = id;
+  background_.startRestore(id, path, textDropped, std::move(mapping),
+                           std::move(content), TextEditor::cellWidth());
+}
+
+unsigned FileOperations::restoringBuffer() const {
+  return background_.busy() && background_.job() == FileLoader::Job::Restore
+             ? restoring_
+             : 0;
+}
+
+void FileOperations::cancelRestore() {
+  if (restoringBuffer())
+    background_.cancel();
+}
+
+void FileOperations::gotoAfterLoad(int line, int col) {
+  pendingLine_ = line;
+  pendingColumn_ = col;
+}
+
+void FileOperations::pollLoad() {
+  FileLoader::Result result;
+  if (background_.take(result)) {
+    if (result.job == FileLoader::Job::Restore)
+      editor_->buffers_->finishRestore(result);
+    else
+      applyReload(result);
+  }
+
+  if (!loader_.take(result))
+    return;
+  if (!result.error.empty()) {
+    pendingLine_ = -1;
+    editor_->addOutput(editor_->icons["error"],
+                       "Could not open file: " + result.path + " (" +
+                           result.error + ")");
+    return;
+  }
+
+  // Swap the finished buffer in as a whole; nothing below rescans it
+  editor_->buffers_->prepare(result.path);
+  editor_->largeView_->close();
+  editor_->content = std::move(result.content);
+  editor_->lineCache = std::move(result.lines);
+  editor_->wordIndex = std::move(result.words);
+  editor_->contentVersion++;
+  editor_->clearUndoRedo();
+  editor_->filename = result.path;
+  watchOpenFile(editor_->content.size());
+  editor_->modified = false;
+  editor_->focusEditor = true;
+  editor_->cursorIndex = 0;
   editor_->cursorLine = 0;
   editor_->cursorColumn = 0;
+  editor_->selectionStart = editor_->selectionEnd = -1;
+  editor_->scrollX = 0.0f;
+  editor_->scrollY = 0.0f;
+  editor_->caretFollow = true;
 
+  const std::string &fname = editor_->filename;
   if (editor_->content.size() == 0)
     editor_->addOutput(editor_->icons["folder"], "Opened empty file: " + fname);
   else
     editor_->addOutput(editor_->icons["folder"],
                        "Opened: " + fname + " (" +
-                           std::to_string(editor_->content.size()) + " bytes)");
+                           std::to_string(editor_->content.size()) +
+                           " bytes, " + megabytes(residentBytes()) +
+                           " resident)");
+  editor_->buffers_->enforceBudget();
+
+  if (pendingLine_ >= 0) {
+    int line = pendingLine_;
+    pendingLine_ = -1;
+    editor_->gotoLine(line, pendingColumn_);
+  }
+}
+
+void FileOperations::watchOpenFile(uint64_t diskSize) {
+  const std::string &path = editor_->filename;
+  watchPath(path);
+  diskSize_ = diskSize;
+  std::error_code ec;
+  diskTime_ = path.empty() ? std::filesystem::file_time_type{}
+                           : std::filesystem::last_write_time(path, ec);
+}
+
+void FileOperations::exchangeDiskState(uint64_t &size,
+                                       std::filesystem::file_time_type &time,
+                                       bool &follow) {
+  std::swap(diskSize_, size);
+  std::swap(diskTime_, time);
+  std::swap(follow_, follow);
+}
+
+void FileOperations::watchPath(const std::string &path) {
+  if (path == watchedPath_)
+    return;
+  if (!watchedPath_.empty())
+    watcher_.unwatchFile(watchedPath_);
+  if (!path.empty())
+    watcher_.watchFile(path);
+  watchedPath_ = path;
+}
+
+void FileOperations::watchActive() {
+  const std::string &path = editor_->filename;
+  watchPath(path);
+  events_.clear();
+  watcher_.poll(events_); // drop events for the previous file
+  if (path.empty())
+    return;
+  if (follow_)
+    checkDiskSize();
+  else
+    reloadAt_ = ImGui::GetTime(); // merges anything changed in the background
+}
+
+void FileOperations::setFollow(bool follow) {
+  follow_ = follow;
+  editor_->addOutput(follow ? "Follow mode on" : "Follow mode off");
+  if (follow_)
+    checkDiskSize(); // catch up on anything written meanwhile
+}
+
+void FileOperations::pollWatch() {
+  // Changes during a reload wait for it to finish, then start another
+  if (watchedPath_.empty() || loader_.busy() || background_.busy())
+    return;
+  bool changed = false;
+  if (watcher_.available()) {
+    events_.clear();
+    watcher_.poll(events_);
+    changed = !events_.empty();
+  } else if (ImGui::GetTime() >= nextStat_) {
+    nextStat_ = ImGui::GetTime() + (follow_ ? 0.25 : 1.0);
+    changed = true;
+  }
+  if (changed) {
+    if (follow_)
+      checkDiskSize();
+    else
+      reloadAt_ = ImGui::GetTime() + kReloadSettleSeconds;
+  }
+  if (reloadAt_ > 0.0 && ImGui::GetTime() >= reloadAt_) {
+    reloadAt_ = 0.0;
+    reloadFromDisk(false);
+  }
+}
+
+void FileOperations::reloadFromDisk(bool force) {
+  // A tab restore in flight switches buffers; its activation checks again
+  if (watchedPath_.empty() || loader_.busy() || restoringBuffer())
+    return;
+  std::error_code ec;
+  uintmax_t size = std::filesystem::file_size(watchedPath_, ec);
+  if (ec)
+    return; // deleted or mid-replace; a later event will catch the new file
+  auto time = std::filesystem::last_write_time(watchedPath_, ec);
+  if (ec || (!force && size == diskSize_ && time == diskTime_))
+    return; // e.g. our own save
+
+  if (editor_->largeView_->active()) {
+    diskSize_ = size;
+    diskTime_ = time;
+    editor_->addOutput("File changed on disk: " + watchedPath_ +
+                       " (reopen it to see the changes)");
+    return;
+  }
+  if (editor_->modified && !force) {
+    diskSize_ = size;
+    diskTime_ = time;
+    editor_->log(LogSeverity::Warning,
+                 "File changed on disk but has unsaved edits: " +
+                     watchedPath_ +
+                     " (run 'reload' to replace the buffer with the disk "
+                     "version; undo brings your edits back)");
+    return;
+  }
+
+  // The disk state is only taken on once the hunks are in
+  reloadForce_ = force;
+  reloadSize_ = size;
+  reloadTime_ = time;
+  background_.startReload(watchedPath_, editor_->content,
+                          editor_->contentVersion);
+}
+
+void FileOperations::applyReload(FileLoader::Result &result) {
+  if (!result.error.empty()) {
+    editor_->log(LogSeverity::Warning, "Could not reload " + result.path +
+                                           " (" + result.error + ")");
+    return;
+  }
+  if (result.path != watchedPath_ ||
+      result.version != editor_->contentVersion) {
+    // Edited or switched away from while the file was read; diff again
+    // against what the buffer holds now
+    reloadFromDisk(reloadForce_);
+    return;
+  }
+  diskSize_ = reloadSize_;
+  diskTime_ = reloadTime_;
+  size_t hunks = editor_->applyHunks(result.text, result.hunks);
+  editor_->modified = false;
+  if (hunks > 0)
+    editor_->addOutput(editor_->icons["document"],
+                       "Reloaded from disk: " + watchedPath_ + " (" +
+                           std::to_string(hunks) + " changed regions)");
+}
+
+void FileOperations::checkDiskSize() {
+  std::error_code ec;
+  uintmax_t size = std::filesystem::file_size(watchedPath_, ec);
+  if (ec || size == diskSize_)
+    return;
+  if (size < diskSize_) {
+    // Truncated or rotated: appending no longer makes sense
+    editor_->addOutput("File shrank on disk, reloading: " + watchedPath_);
+    startLoad(watchedPath_);
+    return;
+  }
+  appendFromDisk(size);
+}
+
+void FileOperations::appendFromDisk(uint64_t size) {
+  if (editor_->largeView_->active()) {
+    editor_->largeView_->grow();
+    diskSize_ = editor_->largeView_->buffer().originalSize();
+    return;
+  }
+
+  std::ifstream file(watchedPath_, std::ios::binary);
+  if (!file.is_open())
+    return;
+  file.seekg((std::streamoff)diskSize_);
+  std::string text(size - diskSize_, '\0');
+  file.read(&text[0], (std::streamsize)text.size());
+  text.resize((size_t)file.gcount());
+  if (text.empty())
+    return;
+
+  // New bytes go on the end without touching undo history or the
+  // modified flag; the caret rides along if it was at the end
+  bool atEnd = editor_->cursorIndex == (int)editor_->content.size() &&
+               !editor_->hasSelection();
+  editor_->appendUnrecorded(text);
+  editor_->refreshLineCache();
+  diskSize_ += text.size();
+  std::error_code ec;
+  diskTime_ = std::filesystem::last_write_time(watchedPath_, ec);
+  if (atEnd) {
+    editor_->cursorIndex = (int)editor_->content.size();
+    editor_->caretFollow = true;
+  }
 }
 
 void FileOperations::newFile() {
+  loader_.cancel();
+  editor_->buffers_->prepare("");
+  editor_->largeView_->close();
   editor_->content.clear();
   editor_->content.insert(0, "");
   editor_->rebuildCache();
+  editor_->wordIndex.clear();
+  editor_->contentVersion++;
+  editor_->clearUndoRedo();
   editor_->filename.clear();
+  watchOpenFile(0);
   editor_->modified = false;
   editor_->focusEditor = true;
   editor_->cursorIndex = 0;
@@ -53,13 +398,29 @@ void FileOperations::saveFile() {
     showSaveDialog("untitled.txt");
     return;
   }
+  // A reload in flight read the file this save replaces
+  if (background_.job() == FileLoader::Job::Reload)
+    background_.cancel();
+
+  if (editor_->largeView_->active()) {
+    if (editor_->largeView_->save(editor_->filename)) {
+      std::error_code ec;
+      watchOpenFile(std::filesystem::file_size(editor_->filename, ec));
+      editor_->modified = false;
+      editor_->addOutput(editor_->icons["save"], "Saved: " + editor_->filename);
+    }
+    return;
+  }
 
   std::ofstream file(editor_->filename);
   if (file.is_open()) {
     file << editor_->content.getText();
+    file.close();
+    std::error_code ec;
+    watchOpenFile(std::filesystem::file_size(editor_->filename, ec));
     editor_->modified = false;
     editor_->addOutput(editor_->icons["save"], "Saved: " + editor_->filename);
-    file.close();
+    editor_->symbolIndex.updateFile(editor_->filename);
   } else {
     editor_->addOutput(editor_->icons["error"],
                        "Could not save file: " + editor_->filename);
@@ -1,6 +1,11 @@
 #pragma once
 
+#include "FileLoader.hpp"
+#include "FileWatcher.hpp"
+#include <cstdint>
+#include <filesystem>
 #include <string>
+#include <vector>
 
 class TextEditor;
 
@@ -9,12 +14,83 @@ public:
   FileOperations(TextEditor *editor);
   ~FileOperations() = default;
 
+  // Starts loading fname in the background; the buffer is replaced once
+  // pollLoad() sees the load finish.
   void openFile(const std::string &fname);
+  void pollLoad();
+  void cancelLoad();
+  bool isLoading() const { return loader_.busy(); }
+  // The load whose progress is on screen: an open, else a tab restore
+  const FileLoader &loader() const {
+    return loader_.busy() ? loader_ : background_;
+  }
+  // Rebuilds what BufferManager evicted from buffer `id` on the worker;
+  // pollLoad() hands the result to BufferManager::finishRestore()
+  void restoreBuffer(unsigned id, const std::string &path, bool textDropped,
+                     std::shared_ptr<const MappedFile> mapping,
+                     PieceTable content);
+  // Id of the buffer being restored, or 0
+  unsigned restoringBuffer() const;
+  void cancelRestore();
+  // Defers a gotoLine() until the file being loaded is swapped in.
+  void gotoAfterLoad(int line, int col);
+  // Memory held by the open buffer, in either mode.
+  size_t residentBytes() const;
+
+  // Follow mode (tail -f): bytes appended to the open file on disk are
+  // appended to the buffer as they arrive, without reloading it.
+  void setFollow(bool follow);
+  bool following() const { return follow_; }
+  // Checks the open file for changes; called once per frame. Outside
+  // follow mode a change made by another program is merged into the
+  // buffer with reloadFromDisk().
+  void pollWatch();
+  // Brings the buffer in line with the file on disk by editing only the
+  // lines that differ, as one undo step. Without `force` nothing happens
+  // if the file looks unchanged or the buffer has unsaved edits. The file
+  // is read and diffed on a worker; pollLoad() applies the hunks.
+  void reloadFromDisk(bool force);
+  // Per-buffer disk bookkeeping, swapped in and out by BufferManager
+  void exchangeDiskState(uint64_t &size, std::filesystem::file_time_type &time,
+                         bool &follow);
+  // Watches the active buffer's file and checks it for changes made while
+  // it was in the background
+  void watchActive();
+  // Records the file as it is on disk now, e.g. after loading or saving it
+  void watchOpenFile(uint64_t diskSize);
   void newFile();
   void saveFile();
   void showOpenDialog();
   void showSaveDialog(const std::string &defaultFileName);
 
 private:
+  void startLoad(const std::string &fname);
+  void openLarge(const std::string &fname);
+  void resetBuffer();
+  void watchPath(const std::string &path);
+  void checkDiskSize();
+  void appendFromDisk(uint64_t size);
+  void applyReload(FileLoader::Result &result);
+
   TextEditor *editor_;
+  FileLoader loader_;
+  // Work on buffers already open (reloads, tab restores), so it never
+  // cancels an open
+  FileLoader background_;
+  unsigned restoring_ = 0;
+  int pendingLine_ = -1;
+  int pendingColumn_ = 0;
+
+  FileWatcher watcher_;
+  std::vector<FileWatcher::Event> events_;
+  std::string watchedPath_;
+  uint64_t diskSize_ = 0; // bytes of the file already in the buffer
+  std::filesystem::file_time_type diskTime_{};
+  double reloadAt_ = 0.0; // pending reload once writes settle
+  // The reload in flight: whether it was forced, and the file it read
+  bool reloadForce_ = false;
+  uint64_t reloadSize_ = 0;
+  std::filesystem::file_time_type reloadTime_{};
+  bool follow_ = false;
+  double nextStat_ = 0.0; // polling fallback without inotify
 };
@@ -0,0 +1,170 @@
+#include "FileWatcher.hpp"
+#include "WorkspaceWalker.hpp"
+#include <filesystem>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+static const uint32_t kDirMask = IN_CREATE | IN_DELETE | IN_MODIFY |
+                                 IN_CLOSE_WRITE | IN_MOVED_FROM | IN_MOVED_TO |
+                                 IN_ATTRIB | IN_DELETE_SELF;
+#endif
+
+FileWatcher::FileWatcher() {
+#ifdef __linux__
+  fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+}
+
+FileWatcher::~FileWatcher() {
+#ifdef __linux__
+  if (fd_ >= 0)
+    close(fd_);
+#endif
+}
+
+int FileWatcher::addWatch(const std::string &dir) {
+#ifdef __linux__
+  if (fd_ < 0)
+    return -1;
+  auto it = dirs_.find(dir);
+  if (it != dirs_.end())
+    return it->second;
+  int wd = inotify_add_watch(fd_, dir.c_str(), kDirMask);
+  if (wd < 0)
+    return -1;
+  watches_[wd].dir = dir;
+  dirs_[dir] = wd;
+  return wd;
+#else
+  (void)dir;
+  return -1;
+#endif
+}
+
+void FileWatcher::addTree(const std::string &dir) {
+  int wd = addWatch(dir);
+  if (wd < 0)
+    return;
+  watches_[wd].allEntries = true;
+  watches_[wd].recursive = true;
+
+  std::error_code ec;
+  for (const auto &entry : std::filesystem::directory_iterator(dir, ec)) {
+    std::error_code typeEc;
+    if (entry.is_directory(typeEc) && !entry.is_symlink(typeEc) &&
+        !WorkspaceWalker::isIgnoredDirectory(
+            entry.path().filename().string()))
+      addTree(entry.path().string());
+  }
+}
+
+bool FileWatcher::watchTree(const std::string &root) {
+  if (fd_ < 0)
+    return false;
+  addTree(root);
+  return dirs_.count(root) > 0;
+}
+
+bool FileWatcher::watchDirectory(const std::string &dir) {
+  int wd = addWatch(dir);
+  if (wd < 0)
+    return false;
+  watches_[wd].allEntries = true;
+  return true;
+}
+
+bool FileWatcher::watchFile(const std::string &path) {
+  std::filesystem::path p(path);
+  std::string dir = p.has_parent_path() ? p.parent_path().string() : ".";
+  int wd = addWatch(dir);
+  if (wd < 0)
+    return false;
+  watches_[wd].files.insert(p.filename().string());
+  return true;
+}
+
+void FileWatcher::unwatchFile(const std::string &path) {
+  std::filesystem::path p(path);
+  std::string dir = p.has_parent_path() ? p.parent_path().string() : ".";
+  auto it = dirs_.find(dir);
+  if (it == dirs_.end())
+    return;
+  Watch &w = watches_[it->second];
+  w.files.erase(p.filename().string());
+#ifdef __linux__
+  if (w.files.empty() && !w.allEntries) {
+    inotify_rm_watch(fd_, it->second);
+    watches_.erase(it->second);
+    dirs_.erase(it);
+  }
+#endif
+}
+
+bool FileWatcher::wait(int timeoutMs) {
+#ifdef __linux__
+  if (fd_ < 0)
+    return false;
+  struct pollfd pfd = {fd_, POLLIN, 0};
+  return ::poll(&pfd, 1, timeoutMs) > 0;
+#else
+  (void)timeoutMs;
+  return false;
+#endif
+}
+
+void FileWatcher::poll(std::vector<Event> &out) {
+#ifdef __linux__
+  if (fd_ < 0)
+    return;
+  alignas(struct inotify_event) char buf[16384];
+  for (;;) {
+    ssize_t len = read(fd_, buf, sizeof(buf));
+    if (len <= 0)
+      return;
+    for (char *p = buf; p < buf + len;) {
+      auto *ev = (struct inotify_event *)p;
+      p += sizeof(struct inotify_event) + ev->len;
+
+      if (ev->mask & IN_Q_OVERFLOW) {
+        out.push_back({Event::Kind::Overflow, "", false});
+        continue;
+      }
+      auto wit = watches_.find(ev->wd);
+      if (wit == watches_.end())
+        continue;
+      if (ev->mask & IN_IGNORED) {
+        dirs_.erase(wit->second.dir);
+        watches_.erase(wit);
+        continue;
+      }
+      const Watch &w = wit->second;
+      if (ev->len == 0)
+        continue; // event on the directory itself
+      std::string name = ev->name;
+      if (!w.allEntries && !w.files.count(name))
+        continue;
+
+      bool isDir = (ev->mask & IN_ISDIR) != 0;
+      // Same shape as the paths WorkspaceWalker yields for the same root
+      std::string path = w.dir + "/" + name;
+      Event::Kind kind = Event::Kind::Modified;
+      if (ev->mask & (IN_CREATE | IN_MOVED_TO))
+        kind = Event::Kind::Created;
+      else if (ev->mask & (IN_DELETE | IN_MOVED_FROM))
+        kind = Event::Kind::Removed;
+
+      if (isDir && kind == Event::Kind::Created && w.recursive &&
+          !WorkspaceWalker::isIgnoredDirectory(name))
+        addTree(path);
+      out.push_back({kind, path, isDir});
+    }
+  }
+#else
+  (void)out;
+#endif
+}
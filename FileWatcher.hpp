@@ -0,0 +1,56 @@
+#pragma once
+
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Thin wrapper over inotify. Each consumer owns its own watcher and either
+// polls it once per frame or blocks in wait() on a worker thread. On
+// platforms without inotify available() is false and nothing is reported.
+class FileWatcher {
+public:
+  struct Event {
+    enum class Kind { Created, Modified, Removed, Overflow };
+    Kind kind;
+    std::string path;
+    bool isDirectory;
+  };
+
+  FileWatcher();
+  ~FileWatcher();
+  FileWatcher(const FileWatcher &) = delete;
+  FileWatcher &operator=(const FileWatcher &) = delete;
+
+  bool available() const { return fd_ >= 0; }
+
+  // Watches root and every non-ignored directory below it; directories
+  // created later are picked up automatically.
+  bool watchTree(const std::string &root);
+  // Watches the entries of a single directory.
+  bool watchDirectory(const std::string &dir);
+  // Watches one file. The parent directory is watched so saves that
+  // replace the file (write + rename) are still seen.
+  bool watchFile(const std::string &path);
+  void unwatchFile(const std::string &path);
+
+  // Blocks until events are pending or timeoutMs elapses.
+  bool wait(int timeoutMs);
+  // Appends all pending events to out without blocking.
+  void poll(std::vector<Event> &out);
+
+private:
+  struct Watch {
+    std::string dir;
+    bool allEntries = false;     // report every entry, not just `files`
+    bool recursive = false;      // auto-watch new subdirectories
+    std::set<std::string> files; // entry names watched via watchFile()
+  };
+
+  int addWatch(const std::string &dir);
+  void addTree(const std::string &dir);
+
+  int fd_ = -1;
+  std::unordered_map<int, Watch> watches_;
+  std::unordered_map<std::string, int> dirs_;
+};
@@ -0,0 +1,103 @@
+#include "FindInFilesPanel.hpp"
+#include "BufferSearch.hpp"
+#include "TextEditor.hpp"
+#include <misc/cpp/imgui_stdlib.h>
+#include <regex>
+
+FindInFilesPanel::FindInFilesPanel(TextEditor *editor) : editor_(editor) {
+  index_.start(".", ".donutex/trigrams.idx");
+}
+
+void FindInFilesPanel::render() {
+  search_.takeResults(results_);
+
+  ImGui::SetNextWindowSize(ImVec2(700, 450), ImGuiCond_FirstUseEver);
+  if (!ImGui::Begin("Find in Files", &editor_->showFindInFiles,
+                    ImGuiWindowFlags_NoCollapse | ImGuiWindowFlags_NoDocking)) {
+    ImGui::End();
+    return;
+  }
+
+  if (ImGui::IsWindowAppearing())
+    focusQuery_ = true;
+  if (focusQuery_) {
+    ImGui::SetKeyboardFocusHere();
+    focusQuery_ = false;
+  }
+  ImGui::SetNextItemWidth(-150);
+  bool enter = ImGui::InputTextWithHint("##fif_query", "Search workspace",
+                                        &query_,
+                                        ImGuiInputTextFlags_EnterReturnsTrue);
+  ImGui::SameLine();
+  ImGui::Checkbox(".*##fif_regex", &regex_);
+  ImGui::SameLine();
+  if (ImGui::Button("Search") || enter) {
+    results_.clear();
+    error_.clear();
+    // The index narrows the search to files holding every trigram of the
+    // query; without it (still loading, or a query too short to help) the
+    // whole tree is scanned.
+    std::vector<std::string> files;
+    usedIndex_ = index_.candidates(query_, regex_, files);
+    candidateCount_ = files.size();
+    try {
+      if (usedIndex_)
+        search_.startOnFiles(std::move(files), query_, regex_);
+      else
+        search_.start(".", query_, regex_);
+    } catch (const std::regex_error &e) {
+      error_ = std::string("Invalid regex: ") + e.what();
+    }
+  }
+
+  if (!error_.empty()) {
+    ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "%s", error_.c_str());
+  } else {
+    ImGui::TextDisabled("%zu matches in %zu files (%.1f MB)%s",
+                        search_.matchCount(), search_.filesScanned(),
+                        search_.bytesScanned() / (1024.0 * 1024.0),
+                        search_.busy() ? " - searching..." : "");
+    if (size_t skipped = search_.skippedLines()) {
+      ImGui::SameLine();
+      ImGui::TextDisabled("| %zu lines over %zu MB skipped", skipped,
+                          kMaxRegexLine >> 20);
+    }
+  }
+  ImGui::SameLine();
+  if (usedIndex_)
+    ImGui::TextDisabled("| %zu candidates of %zu indexed files",
+                        candidateCount_, index_.fileCount());
+  else if (index_.building() || !index_.ready())
+    ImGui::TextDisabled("| indexing workspace...");
+  ImGui::Separator();
+
+  // Only the rows in view are submitted, however many results there are
+  ImGui::BeginChild("##fif_results");
+  ImGuiListClipper clipper;
+  clipper.Begin((int)results_.size());
+  while (clipper.Step()) {
+    for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; ++i) {
+      const auto &r = results_[i];
+      size_t indent = r.preview.find_first_not_of(" \t");
+      const char *preview =
+          r.preview.c_str() + (indent == std::string::npos ? 0 : indent);
+
+      char label[64];
+      snprintf(label, sizeof(label), "##fif_row%d", i);
+      ImGui::PushID(i);
+      if (ImGui::Selectable(label, false)) {
+        editor_->openFile(r.path);
+        editor_->gotoLine(r.line, r.column);
+      }
+      ImGui::SameLine();
+      ImGui::Text("%s:%d:%d", r.path.c_str(), r.line + 1, r.column + 1);
+      ImGui::SameLine();
+      ImGui::TextDisabled("%s", preview);
+      ImGui::PopID();
+    }
+  }
+  clipper.End();
+  ImGui::EndChild();
+
+  ImGui::End();
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "TrigramIndex.hpp"
+#include "WorkspaceSearch.hpp"
+#include "imgui.h"
+#include <string>
+#include <vector>
+
+class TextEditor;
+
+class FindInFilesPanel {
+public:
+  FindInFilesPanel(TextEditor *editor);
+  ~FindInFilesPanel() = default;
+
+  void render();
+
+private:
+  TextEditor *editor_;
+  WorkspaceSearch search_;
+  TrigramIndex index_;
+  std::string query_;
+  bool regex_ = false;
+  std::string error_;
+  size_t candidateCount_ = 0;
+  bool usedIndex_ = false;
+  std::vector<WorkspaceSearch::Result> results_;
+  bool focusQuery_ = true;
+};
@@ -0,0 +1,296 @@
+#include "FuzzyMatcher.hpp"
+#include <algorithm>
+#include <cctype>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define DONUTEX_FUZZY_SSE2 1
+#endif
+
+namespace {
+const int kMatch = 16;
+const int kBoundaryBonus = 30;
+const int kCamelBonus = 25;
+const int kConsecutiveBonus = 15;
+const int kExactCaseBonus = 1;
+const int kGapPenalty = 1;
+const size_t kMaxScored = 512; // longer candidates are scored on a prefix
+
+int charClass(unsigned char c) {
+  if (c >= 'a' && c <= 'z')
+    return c - 'a';
+  if (c >= 'A' && c <= 'Z')
+    return c - 'A';
+  if (c >= '0' && c <= '9')
+    return 26 + (c - '0');
+  switch (c) {
+  case '_':
+    return 36;
+  case '.':
+    return 37;
+  case '/':
+  case '\\':
+    return 38;
+  case '-':
+    return 39;
+  case ' ':
+    return 40;
+  default:
+    return 41 + c % 23;
+  }
+}
+
+inline unsigned char fold(unsigned char c) {
+  return (c >= 'A' && c <= 'Z') ? (unsigned char)(c + 32) : c;
+}
+
+inline bool isSeparator(unsigned char c) {
+  return c == '/' || c == '\\' || c == '_' || c == '-' || c == '.' ||
+         c == ' ' || c == ':';
+}
+
+bool isSubsequence(std::string_view pattern, std::string_view candidate) {
+  size_t j = 0;
+  for (char p : pattern) {
+    unsigned char pc = fold((unsigned char)p);
+    while (j < candidate.size() && fold((unsigned char)candidate[j]) != pc)
+      ++j;
+    if (j == candidate.size())
+      return false;
+    ++j;
+  }
+  return true;
+}
+
+inline int positionBonus(const unsigned char *s, size_t j) {
+  if (j == 0)
+    return kBoundaryBonus;
+  unsigned char prev = s[j - 1];
+  unsigned char cur = s[j];
+  if (isSeparator(prev))
+    return kBoundaryBonus;
+  if (prev >= 'a' && prev <= 'z' && cur >= 'A' && cur <= 'Z')
+    return kCamelBonus;
+  if ((prev < '0' || prev > '9') && cur >= '0' && cur <= '9')
+    return kCamelBonus / 2;
+  return 0;
+}
+} // namespace
+
+uint64_t FuzzyMatcher::charMask(std::string_view text) {
+  uint64_t mask = 0;
+  for (char c : text)
+    mask |= 1ull << charClass((unsigned char)c);
+  return mask;
+}
+
+void FuzzyMatcher::setCandidates(std::vector<std::string> candidates) {
+  candidates_ = std::move(candidates);
+  masks_.resize(candidates_.size());
+  for (size_t i = 0; i < candidates_.size(); ++i)
+    masks_[i] = charMask(candidates_[i]);
+}
+
+int FuzzyMatcher::score(std::string_view pattern, std::string_view candidate) {
+  if (pattern.empty())
+    return 0;
+  size_t n = std::min(candidate.size(), kMaxScored);
+  size_t m = pattern.size();
+  if (m > n)
+    return kNoMatch;
+  const unsigned char *cand = (const unsigned char *)candidate.data();
+  const unsigned char *pat = (const unsigned char *)pattern.data();
+
+  // Cheap greedy pass: bail out early and find where each row can start
+  size_t first = 0;
+  for (size_t i = 0, j = 0; i < m; ++i, ++j) {
+    unsigned char pc = fold(pat[i]);
+    while (j < n && fold(cand[j]) != pc)
+      ++j;
+    if (j == n)
+      return kNoMatch;
+    if (i == 0)
+      first = j;
+  }
+
+  // Two DP rows: prev[j] is the best score with pattern[i-1] at candidate[j].
+  // Each row only spans [lo, to): nothing before the previous row's first
+  // hit can continue a match, nothing after `to` leaves room for the rest.
+  int rows[2][kMaxScored];
+  int *prevRow = rows[0];
+  int *curRow = rows[1];
+  size_t lo = first;
+  size_t prevLo = 0;
+
+  for (size_t i = 0; i < m; ++i) {
+    unsigned char pc = pat[i];
+    unsigned char folded = fold(pc);
+    size_t to = n - (m - 1 - i);
+    // best prev[k] - gap * (j - 1 - k) over k <= j - 2
+    int gapBest = kNoMatch;
+    size_t firstHit = n;
+    for (size_t j = lo; j < to; ++j) {
+      if (i > 0 && j >= prevLo + 2 && prevRow[j - 2] != kNoMatch)
+        gapBest = std::max(gapBest, prevRow[j - 2] - kGapPenalty);
+      int fromGap = gapBest;
+      if (gapBest != kNoMatch)
+        gapBest -= kGapPenalty;
+
+      unsigned char cc = cand[j];
+      if (fold(cc) != folded) {
+        curRow[j] = kNoMatch;
+        continue;
+      }
+      int base = kMatch + positionBonus(cand, j) +
+                 (cc == pc ? kExactCaseBonus : 0);
+      int best;
+      if (i == 0) {
+        // leading characters cost a little so earlier hits win ties
+        best = base - (int)std::min<size_t>(j, 16);
+      } else {
+        int viaRun = (j >= prevLo + 1 && prevRow[j - 1] != kNoMatch)
+                         ? prevRow[j - 1] + kConsecutiveBonus
+                         : kNoMatch;
+        int via = std::max(viaRun, fromGap);
+        best = via == kNoMatch ? kNoMatch : via + base;
+      }
+      curRow[j] = best;
+      if (best != kNoMatch && firstHit == n)
+        firstHit = j;
+    }
+    if (firstHit == n)
+      return kNoMatch;
+    if (i + 1 == m) {
+      int result = kNoMatch;
+      for (size_t j = firstHit; j < to; ++j)
+        result = std::max(result, curRow[j]);
+      return result;
+    }
+    std::swap(prevRow, curRow);
+    prevLo = lo;
+    lo = firstHit + 1;
+  }
+  return kNoMatch;
+}
+
+void FuzzyMatcher::prefilter(uint64_t need,
+                             std::vector<uint32_t> &out) const {
+  size_t count = masks_.size();
+  size_t i = 0;
+#ifdef DONUTEX_FUZZY_SSE2
+  const __m128i needV = _mm_set1_epi64x((long long)need);
+  for (; i + 2 <= count; i += 2) {
+    __m128i m = _mm_loadu_si128((const __m128i *)(masks_.data() + i));
+    __m128i eq = _mm_cmpeq_epi32(_mm_and_si128(m, needV), needV);
+    int bits = _mm_movemask_epi8(eq);
+    if (bits == 0)
+      continue;
+    if ((bits & 0x00FF) == 0x00FF)
+      out.push_back((uint32_t)i);
+    if ((bits & 0xFF00) == 0xFF00)
+      out.push_back((uint32_t)i + 1);
+  }
+#endif
+  for (; i < count; ++i) {
+    if ((masks_[i] & need) == need)
+      out.push_back((uint32_t)i);
+  }
+}
+
+std::vector<FuzzyMatcher::Result>
+FuzzyMatcher::rank(std::string_view pattern, size_t limit) const {
+  if (pattern.empty()) {
+    std::vector<Result> results(std::min(limit, candidates_.size()));
+    for (size_t i = 0; i < results.size(); ++i)
+      results[i] = {(uint32_t)i, 0};
+    return results;
+  }
+  std::vector<uint32_t> survivors;
+  survivors.reserve(candidates_.size() / 4);
+  prefilter(charMask(pattern), survivors);
+  return finish(pattern, limit, survivors);
+}
+
+std::vector<FuzzyMatcher::Result>
+FuzzyMatcher::rank(std::string_view pattern, size_t limit,
+                   const std::vector<uint32_t> &subset) const {
+  uint64_t need = charMask(pattern);
+  std::vector<uint32_t> survivors;
+  survivors.reserve(subset.size());
+  for (uint32_t idx : subset) {
+    if (idx < masks_.size() && (masks_[idx] & need) == need)
+      survivors.push_back(idx);
+  }
+  return finish(pattern, limit, survivors);
+}
+
+std::vector<uint32_t>
+FuzzyMatcher::matches(std::string_view pattern,
+                      const std::vector<uint32_t> *subset) const {
+  std::vector<uint32_t> out;
+  uint64_t need = charMask(pattern);
+  if (subset) {
+    out.reserve(subset->size());
+    for (uint32_t idx : *subset) {
+      if (idx < masks_.size() && (masks_[idx] & need) == need &&
+          isSubsequence(pattern, candidates_[idx]))
+        out.push_back(idx);
+    }
+    return out;
+  }
+  prefilter(need, out);
+  out.erase(std::remove_if(out.begin(), out.end(),
+                           [&](uint32_t idx) {
+                             return !isSubsequence(pattern, candidates_[idx]);
+                           }),
+            out.end());
+  return out;
+}
+
+bool FuzzyMatcher::better(const Result &a, const Result &b) const {
+  if (a.score != b.score)
+    return a.score > b.score;
+  size_t la = candidates_[a.index].size(), lb = candidates_[b.index].size();
+  if (la != lb)
+    return la < lb;
+  return a.index < b.index;
+}
+
+std::vector<FuzzyMatcher::Result>
+FuzzyMatcher::merge(const std::vector<Result> &a, const std::vector<Result> &b,
+                    size_t limit) const {
+  std::vector<Result> merged;
+  merged.reserve(std::min(limit, a.size() + b.size()));
+  size_t i = 0, j = 0;
+  while (merged.size() < limit && (i < a.size() || j < b.size())) {
+    if (j == b.size() || (i < a.size() && !better(b[j], a[i])))
+      merged.push_back(a[i++]);
+    else
+      merged.push_back(b[j++]);
+  }
+  return merged;
+}
+
+std::vector<FuzzyMatcher::Result>
+FuzzyMatcher::finish(std::string_view pattern, size_t limit,
+                     const std::vector<uint32_t> &survivors) const {
+  std::vector<Result> results;
+  results.reserve(survivors.size());
+  for (uint32_t idx : survivors) {
+    int s = score(pattern, candidates_[idx]);
+    if (s != kNoMatch)
+      results.push_back({idx, s});
+  }
+
+  auto better = [this](const Result &a, const Result &b) {
+    return this->better(a, b);
+  };
+  if (results.size() > limit) {
+    std::partial_sort(results.begin(), results.begin() + limit, results.end(),
+                      better);
+    results.resize(limit);
+  } else {
+    std::sort(results.begin(), results.end(), better);
+  }
+  return results;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Fuzzy subsequence matcher shared by the command box, file lists and
+// completion. Candidates are reduced to a 64-bit character-class mask once;
+// a query first rejects every candidate missing one of its classes (SSE2,
+// two masks per compare) and only scores the survivors.
+class FuzzyMatcher {
+public:
+  struct Result {
+    uint32_t index; // position in candidates()
+    int score;
+  };
+
+  static constexpr int kNoMatch = -1000000;
+
+  void setCandidates(std::vector<std::string> candidates);
+  const std::vector<std::string> &candidates() const { return candidates_; }
+
+  // Best `limit` candidates for pattern, highest score first. An empty
+  // pattern returns the first `limit` candidates in their original order.
+  std::vector<Result> rank(std::string_view pattern, size_t limit) const;
+  // Same, but only considers the given candidate indices.
+  std::vector<Result> rank(std::string_view pattern, size_t limit,
+                           const std::vector<uint32_t> &subset) const;
+
+  // Best `limit` of two rankings of the same pattern, e.g. when a large
+  // subset is ranked a slice at a time.
+  std::vector<Result> merge(const std::vector<Result> &a,
+                            const std::vector<Result> &b, size_t limit) const;
+
+  // Every candidate pattern is a subsequence of, in index order, without
+  // scoring. Passing the previous result as subset narrows it when the
+  // pattern has only grown, since anything matching "abc" matches "ab".
+  std::vector<uint32_t>
+  matches(std::string_view pattern,
+          const std::vector<uint32_t> *subset = nullptr) const;
+
+  // Subsequence score of pattern in candidate (case-insensitive), kNoMatch
+  // if pattern is not a subsequence. Word starts and camelCase humps earn a
+  // bonus, consecutive runs are rewarded and gaps cost a little.
+  static int score(std::string_view pattern, std::string_view candidate);
+  static uint64_t charMask(std::string_view text);
+
+private:
+  bool better(const Result &a, const Result &b) const;
+  void prefilter(uint64_t need, std::vector<uint32_t> &out) const;
+  std::vector<Result> finish(std::string_view pattern, size_t limit,
+                             const std::vector<uint32_t> &survivors) const;
+
+  std::vector<std::string> candidates_;
+  std::vector<uint64_t> masks_;
+};
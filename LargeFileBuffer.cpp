@@ -0,0 +1,636 @@
+#include "LargeFileBuffer.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+const size_t kIndexBlock = 4 << 20;
+// readLine() gives up looking for the end of a line after this many bytes
+const uint64_t kMaxLineScan = 4 << 20;
+} // namespace
+
+bool LargeFileBuffer::open(const std::string &path, size_t windowPages) {
+  close();
+  if (!file_.open(path))
+    return false;
+  file_.setMaxPages(windowPages);
+  path_ = path;
+  size_ = file_.size();
+  if (size_ > 0)
+    pieces_.push_back({false, 0, size_, 0});
+  checkpoints_.assign(1, 0);
+  fileSize_ = size_;
+  version_++;
+  startIndexer();
+  return true;
+}
+
+void LargeFileBuffer::close() {
+  stopIndexer();
+  file_.close();
+  path_.clear();
+  std::string().swap(add_);
+  std::vector<Piece>().swap(pieces_);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<uint64_t>().swap(checkpoints_);
+  }
+  size_ = 0;
+  newlines_ = 0;
+  modified_ = false;
+  indexed_ = false;
+  indexError_.clear();
+  version_++;
+}
+
+void LargeFileBuffer::startIndexer() {
+  stop_ = false;
+  indexDone_ = false;
+  indexFailed_ = false;
+  failure_.clear();
+  scanned_ = 0;
+  scannedNewlines_ = 0;
+  indexer_ = std::thread(&LargeFileBuffer::indexMain, this, path_);
+}
+
+void LargeFileBuffer::stopIndexer() {
+  stop_ = true;
+  if (indexer_.joinable())
+    indexer_.join();
+}
+
+void LargeFileBuffer::indexMain(std::string path) {
+  // A separate handle, so the scan neither contends with nor evicts the
+  // pages the UI is showing
+  FILE *file = std::fopen(path.c_str(), "rb");
+  if (!file) {
+    failure_ = std::strerror(errno);
+    indexFailed_ = true;
+    return;
+  }
+  std::vector<char> buf(kIndexBlock);
+  std::vector<uint64_t> batch;
+  uint64_t pos = 0, count = 0;
+  while (!stop_ && pos < fileSize_) {
+    size_t want = (size_t)std::min<uint64_t>(buf.size(), fileSize_ - pos);
+    size_t n = std::fread(buf.data(), 1, want, file);
+    if (n == 0) {
+      failure_ = std::ferror(file) ? std::strerror(errno)
+                                   : "the file got shorter while indexing";
+      indexFailed_ = true;
+      break;
+    }
+    const char *p = buf.data();
+    const char *end = p + n;
+    while ((p = (const char *)std::memchr(p, '\n', (size_t)(end - p)))) {
+      ++p;
+      if (++count % kLineStride == 0)
+        batch.push_back(pos + (uint64_t)(p - buf.data()));
+    }
+    pos += n;
+    // Checkpoints must be visible before the newline count that covers them
+    if (!batch.empty()) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      checkpoints_.insert(checkpoints_.end(), batch.begin(), batch.end());
+      batch.clear();
+    }
+    scannedNewlines_ = count;
+    scanned_ = pos;
+  }
+  std::fclose(file);
+  if (!stop_ && !indexFailed_)
+    indexDone_ = true;
+}
+
+void LargeFileBuffer::update() {
+  if (indexFailed_ && indexError_.empty()) {
+    stopIndexer();
+    indexError_ = failure_.empty() ? "read error" : failure_;
+    version_++;
+    return;
+  }
+  if (indexed_ || !indexDone_)
+    return;
+  stopIndexer();
+  indexTail(); // anything appended after the indexer's last read
+  newlines_ = scannedNewlines_;
+  if (!pieces_.empty())
+    pieces_[0].newlines = newlines_;
+  indexed_ = true;
+  version_++;
+}
+
+void LargeFileBuffer::indexTail() {
+  uint64_t pos = scanned_;
+  uint64_t count = scannedNewlines_;
+  std::vector<uint64_t> batch;
+  file_.forEachChunk(pos, file_.size() - pos, [&](const char *data, size_t n) {
+    const char *p = data;
+    const char *end = data + n;
+    while ((p = (const char *)std::memchr(p, '\n', (size_t)(end - p)))) {
+      ++p;
+      if (++count % kLineStride == 0)
+        batch.push_back(pos + (uint64_t)(p - data));
+    }
+    pos += n;
+    return true;
+  });
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    checkpoints_.insert(checkpoints_.end(), batch.begin(), batch.end());
+  }
+  scannedNewlines_ = count;
+  scanned_ = pos;
+}
+
+bool LargeFileBuffer::grow() {
+  uint64_t oldSize = file_.size();
+  if (!file_.refresh() || file_.size() <= oldSize)
+    return false;
+  uint64_t added = file_.size() - oldSize;
+  if (!pieces_.empty() && !pieces_.back().added &&
+      pieces_.back().start + pieces_.back().length == oldSize)
+    pieces_.back().length += added;
+  else
+    pieces_.push_back({false, oldSize, added, 0});
+  size_ += added;
+  fileSize_ = file_.size();
+
+  // While the background pass runs it simply reads further
+  if (indexed_) {
+    uint64_t before = scannedNewlines_;
+    indexTail();
+    uint64_t newlines = scannedNewlines_ - before;
+    pieces_.back().newlines += newlines;
+    newlines_ += newlines;
+  }
+  version_++;
+  return true;
+}
+
+double LargeFileBuffer::indexProgress() const {
+  if (indexed_ || size_ == 0)
+    return 1.0;
+  return (double)scanned_ / (double)size_;
+}
+
+uint64_t LargeFileBuffer::lineCount() const {
+  if (indexed_)
+    return newlines_ + 1;
+  uint64_t scanned = scanned_;
+  uint64_t lines = scannedNewlines_;
+  if (scanned == 0)
+    return 1;
+  uint64_t estimate = (uint64_t)((double)lines * (double)size_ / (double)scanned);
+  return std::max(lines, estimate) + 1;
+}
+
+template <typename Fn>
+bool LargeFileBuffer::forEachChunk(uint64_t pos, uint64_t len, Fn &&fn) {
+  uint64_t cur = 0;
+  bool more = true;
+  for (const auto &p : pieces_) {
+    if (len == 0 || !more)
+      break;
+    if (pos >= cur + p.length) {
+      cur += p.length;
+      continue;
+    }
+    uint64_t offset = pos - cur;
+    uint64_t n = std::min(len, p.length - offset);
+    if (p.added) {
+      more = fn(add_.data() + p.start + offset, (size_t)n);
+    } else if (!file_.forEachChunk(p.start + offset, n,
+                                   [&](const char *data, size_t k) {
+                                     more = fn(data, k);
+                                     return more;
+                                   })) {
+      return false;
+    }
+    pos += n;
+    len -= n;
+    cur += p.length;
+  }
+  return true;
+}
+
+uint64_t LargeFileBuffer::originalLineOf(uint64_t offset) {
+  uint64_t k, base;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    k = (uint64_t)(std::upper_bound(checkpoints_.begin(), checkpoints_.end(),
+                                    offset) -
+                   checkpoints_.begin()) -
+        1;
+    base = checkpoints_[k];
+  }
+  uint64_t count = 0;
+  file_.forEachChunk(base, offset - base, [&](const char *data, size_t n) {
+    count += (uint64_t)std::count(data, data + n, '\n');
+    return true;
+  });
+  return k * kLineStride + count;
+}
+
+uint64_t LargeFileBuffer::originalLineStart(uint64_t line) {
+  uint64_t base;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    base = checkpoints_[line / kLineStride];
+  }
+  uint64_t remaining = line % kLineStride;
+  uint64_t result = base;
+  uint64_t pos = base;
+  if (remaining == 0)
+    return base;
+  file_.forEachChunk(base, file_.size() - base,
+                     [&](const char *data, size_t n) {
+                       const char *p = data;
+                       const char *end = data + n;
+                       while ((p = (const char *)std::memchr(
+                                   p, '\n', (size_t)(end - p)))) {
+                         ++p;
+                         if (--remaining == 0) {
+                           result = pos + (uint64_t)(p - data);
+                           return false;
+                         }
+                       }
+                       pos += n;
+                       return true;
+                     });
+  return result;
+}
+
+uint64_t LargeFileBuffer::pieceNewlines(const Piece &p, uint64_t from,
+                                        uint64_t to) {
+  if (from == 0 && to == p.length)
+    return p.newlines;
+  if (p.added)
+    return (uint64_t)std::count(add_.begin() + (ptrdiff_t)(p.start + from),
+                                add_.begin() + (ptrdiff_t)(p.start + to), '\n');
+  return originalLineOf(p.start + to) - originalLineOf(p.start + from);
+}
+
+bool LargeFileBuffer::lineStart(uint64_t line, uint64_t &offset) {
+  if (line == 0) {
+    offset = 0;
+    return true;
+  }
+  if (!indexed_) {
+    if (line > scannedNewlines_)
+      return false;
+    offset = originalLineStart(line);
+    return true;
+  }
+  if (line > newlines_)
+    return false;
+
+  uint64_t before = 0, docPos = 0;
+  for (const auto &p : pieces_) {
+    if (before + p.newlines < line) {
+      before += p.newlines;
+      docPos += p.length;
+      continue;
+    }
+    uint64_t nth = line - before; // line starts after the nth '\n' here
+    if (p.added) {
+      const char *data = add_.data() + p.start;
+      const char *q = data;
+      while (nth > 0) {
+        q = (const char *)std::memchr(q, '\n', p.length - (size_t)(q - data));
+        ++q;
+        --nth;
+      }
+      offset = docPos + (uint64_t)(q - data);
+    } else {
+      uint64_t first = originalLineOf(p.start);
+      offset = docPos + (originalLineStart(first + nth) - p.start);
+    }
+    return true;
+  }
+  return false;
+}
+
+uint64_t LargeFileBuffer::approximateLineStart(uint64_t line) {
+  uint64_t offset;
+  if (lineStart(line, offset))
+    return offset;
+  uint64_t byte =
+      (uint64_t)((double)line / (double)lineCount() * (double)size_);
+  byte = std::min(byte, size_);
+  uint64_t next;
+  readLine(byte, 0, &next);
+  return next == npos || next > size_ ? byte : next;
+}
+
+std::string LargeFileBuffer::readLine(uint64_t offset, size_t maxBytes,
+                                      uint64_t *next) {
+  std::string text;
+  *next = npos;
+  if (offset >= size_) {
+    *next = size_ + 1;
+    return text;
+  }
+  uint64_t scanned = 0;
+  bool found = false;
+  forEachChunk(offset, size_ - offset, [&](const char *data, size_t n) {
+    const char *nl = (const char *)std::memchr(data, '\n', n);
+    size_t take = nl ? (size_t)(nl - data) : n;
+    if (text.size() < maxBytes)
+      text.append(data, std::min(take, maxBytes - text.size()));
+    if (nl) {
+      *next = offset + scanned + take + 1;
+      found = true;
+      return false;
+    }
+    scanned += n;
+    return scanned < kMaxLineScan;
+  });
+  if (!found && offset + scanned >= size_)
+    *next = size_ + 1;
+  return text;
+}
+
+bool LargeFileBuffer::forEachLine(
+    size_t maxLength, uint64_t &skipped,
+    const std::function<void(const char *, const char *, uint64_t, uint64_t)>
+        &fn) {
+  // Lines inside a chunk are passed from the page itself; only one that
+  // crosses a chunk boundary is copied
+  std::string carry;
+  uint64_t carryStart = 0;
+  bool carryLong = false;
+  uint64_t line = 0;
+  uint64_t chunkPos = 0;
+  skipped = 0;
+  bool ok = forEachChunk(0, size_, [&](const char *data, size_t n) {
+    const char *end = data + n;
+    const char *begin = data;
+    while (begin < end) {
+      const char *nl =
+          (const char *)std::memchr(begin, '\n', (size_t)(end - begin));
+      if (!carryLong) {
+        if (carry.empty() && nl) {
+          if ((size_t)(nl - begin) > maxLength)
+            skipped++;
+          else
+            fn(begin, nl, chunkPos + (uint64_t)(begin - data), line);
+          line++;
+          begin = nl + 1;
+          continue;
+        }
+        if (carry.empty())
+          carryStart = chunkPos + (uint64_t)(begin - data);
+        carry.append(begin, nl ? nl : end);
+        if (carry.size() > maxLength) {
+          carryLong = true;
+          carry.clear();
+        }
+      }
+      if (!nl)
+        break;
+      if (carryLong)
+        skipped++;
+      else
+        fn(carry.data(), carry.data() + carry.size(), carryStart, line);
+      line++;
+      carry.clear();
+      carryLong = false;
+      begin = nl + 1;
+    }
+    chunkPos += n;
+    return true;
+  });
+  if (!ok)
+    return false;
+  // The last line, which is empty after a final '\n'
+  if (carryLong)
+    skipped++;
+  else
+    fn(carry.data(), carry.data() + carry.size(),
+       carry.empty() ? size_ : carryStart, line);
+  return true;
+}
+
+size_t LargeFileBuffer::splitAt(uint64_t pos) {
+  uint64_t cur = 0;
+  for (size_t i = 0; i < pieces_.size(); ++i) {
+    if (pos == cur)
+      return i;
+    const Piece p = pieces_[i];
+    if (pos < cur + p.length) {
+      uint64_t k = pos - cur;
+      uint64_t leftNewlines = pieceNewlines(p, 0, k);
+      pieces_[i].length = k;
+      pieces_[i].newlines = leftNewlines;
+      pieces_.insert(pieces_.begin() + (ptrdiff_t)i + 1,
+                     Piece{p.added, p.start + k, p.length - k,
+                           p.newlines - leftNewlines});
+      return i + 1;
+    }
+    cur += p.length;
+  }
+  return pieces_.size();
+}
+
+bool LargeFileBuffer::insert(uint64_t pos, const std::string &text) {
+  if (!indexed_ || pos > size_)
+    return false;
+  if (text.empty())
+    return true;
+  uint64_t newlines = (uint64_t)std::count(text.begin(), text.end(), '\n');
+  size_t i = splitAt(pos);
+  // Typing extends the previous insertion instead of adding a piece
+  if (i > 0 && pieces_[i - 1].added &&
+      pieces_[i - 1].start + pieces_[i - 1].length == add_.size()) {
+    pieces_[i - 1].length += text.size();
+    pieces_[i - 1].newlines += newlines;
+  } else {
+    pieces_.insert(pieces_.begin() + (ptrdiff_t)i,
+                   Piece{true, add_.size(), text.size(), newlines});
+  }
+  add_ += text;
+  size_ += text.size();
+  newlines_ += newlines;
+  modified_ = true;
+  version_++;
+  return true;
+}
+
+bool LargeFileBuffer::erase(uint64_t pos, uint64_t len) {
+  if (!indexed_ || pos >= size_)
+    return false;
+  len = std::min(len, size_ - pos);
+  if (len == 0)
+    return true;
+  size_t first = splitAt(pos);
+  size_t last = splitAt(pos + len);
+  for (size_t i = first; i < last; ++i)
+    newlines_ -= pieces_[i].newlines;
+  pieces_.erase(pieces_.begin() + (ptrdiff_t)first,
+                pieces_.begin() + (ptrdiff_t)last);
+  size_ -= len;
+  modified_ = true;
+  version_++;
+  return true;
+}
+
+bool LargeFileBuffer::replace(const std::vector<Splice> &splices,
+                              const std::string &text) {
+  if (!indexed_)
+    return false;
+  if (splices.empty())
+    return true;
+  uint64_t base = add_.size();
+  add_ += text;
+
+  // The old pieces are copied between splices. A copy's newline count is
+  // the difference of the line numbers at its ends: known at piece ends,
+  // and given by the splice at a match.
+  std::vector<Piece> out;
+  out.reserve(pieces_.size() + splices.size() * 2);
+  size_t i = 0;
+  uint64_t pieceStart = 0, pieceLine = 0; // where pieces_[i] begins
+  uint64_t pos = 0, line = 0;             // old text copied up to here
+  auto copyTo = [&](uint64_t to, uint64_t toLine) {
+    while (pos < to) {
+      const Piece &p = pieces_[i];
+      uint64_t pieceEnd = pieceStart + p.length;
+      uint64_t end = std::min(to, pieceEnd);
+      uint64_t endLine = end == pieceEnd ? pieceLine + p.newlines : toLine;
+      out.push_back(
+          Piece{p.added, p.start + (pos - pieceStart), end - pos, endLine - line});
+      pos = end;
+      line = endLine;
+      if (pos == pieceEnd) {
+        pieceStart = pieceEnd;
+        pieceLine += p.newlines;
+        i++;
+      }
+    }
+  };
+
+  uint64_t removed = 0, inserted = 0, newlines = 0;
+  for (const Splice &s : splices) {
+    copyTo(s.pos, s.line);
+    if (s.textLength > 0) {
+      auto from = add_.begin() + (ptrdiff_t)(base + s.textStart);
+      uint64_t n = (uint64_t)std::count(from, from + (ptrdiff_t)s.textLength,
+                                        '\n');
+      out.push_back(Piece{true, base + s.textStart, s.textLength, n});
+      inserted += s.textLength;
+      newlines += n;
+    }
+    // The match holds no line break, so only the position moves on
+    pos = s.pos + s.len;
+    while (i < pieces_.size() && pieceStart + pieces_[i].length <= pos) {
+      pieceStart += pieces_[i].length;
+      pieceLine += pieces_[i].newlines;
+      i++;
+    }
+    removed += s.len;
+  }
+  copyTo(size_, newlines_);
+
+  pieces_.swap(out);
+  size_ = size_ - removed + inserted;
+  newlines_ += newlines;
+  modified_ = true;
+  version_++;
+  return true;
+}
+
+bool LargeFileBuffer::save(const std::string &path, std::string &error) {
+  // Replace the file a symlink points to, not the link, and give the new
+  // copy the old one's mode and owner before it takes its place
+  namespace fs = std::filesystem;
+  std::error_code ec;
+  std::string target = path;
+  if (fs::is_symlink(path, ec)) {
+    fs::path resolved = fs::canonical(path, ec);
+    if (ec) {
+      error = ec.message();
+      return false;
+    }
+    target = resolved.string();
+  }
+  fs::file_status old = fs::status(target, ec);
+  bool existed = !ec && fs::exists(old);
+
+  std::string tmp = target + ".donutex-save";
+  FILE *out = std::fopen(tmp.c_str(), "wb");
+  if (!out) {
+    error = std::strerror(errno);
+    return false;
+  }
+  bool written = true;
+  bool read = forEachChunk(0, size_, [&](const char *data, size_t n) {
+    written = std::fwrite(data, 1, n, out) == n;
+    return written;
+  });
+  written = std::fflush(out) == 0 && written;
+  std::fclose(out);
+  if (!read || !written) {
+    error = read ? std::strerror(errno) : "could not read " + path_;
+    std::remove(tmp.c_str());
+    return false;
+  }
+  if (existed) {
+#ifndef _WIN32
+    // Giving a file away needs privileges; its group often doesn't. The
+    // mode goes last, since chown can clear the set-id bits.
+    struct stat st;
+    if (::stat(target.c_str(), &st) == 0 &&
+        ::chown(tmp.c_str(), st.st_uid, st.st_gid) != 0) {
+      int ignored = ::chown(tmp.c_str(), (uid_t)-1, st.st_gid);
+      (void)ignored;
+    }
+#endif
+    fs::permissions(tmp, old.permissions(), ec);
+  }
+
+  // Start over on the saved copy (read-only until it is re-indexed), so
+  // reads and follow mode (grow()) see the new file rather than the old
+  // inode
+  size_t window = file_.maxPages();
+#ifdef _WIN32
+  // An open file can't be replaced here, so let go of the original first
+  std::string original = path_;
+  file_.close();
+  fs::rename(tmp, target, ec);
+  if (ec) {
+    error = ec.message();
+    std::remove(tmp.c_str());
+    open(original, window);
+    return false;
+  }
+#else
+  if (std::rename(tmp.c_str(), target.c_str()) != 0) {
+    error = std::strerror(errno);
+    std::remove(tmp.c_str());
+    return false;
+  }
+#endif
+  if (!open(path, window)) {
+    error = "could not reopen " + path;
+    return false;
+  }
+  modified_ = false;
+  return true;
+}
+
+size_t LargeFileBuffer::residentBytes() const {
+  size_t checkpoints;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    checkpoints = checkpoints_.capacity() * sizeof(uint64_t);
+  }
+  return file_.residentBytes() + add_.capacity() +
+         pieces_.capacity() * sizeof(Piece) + checkpoints;
+}
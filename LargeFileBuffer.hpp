@@ -0,0 +1,137 @@
+#pragma once
+
+#include "PagedFile.hpp"
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Text buffer for files too large to load: the original stays on disk
+// behind a PagedFile and edits are pieces over it plus an in-memory add
+// buffer. A background pass records the start of every kLineStride-th line
+// so any line can be found by seeking to the nearest checkpoint and
+// scanning forward; until it finishes, lineCount() is an estimate from the
+// bytes scanned so far and the buffer is read-only.
+class LargeFileBuffer {
+public:
+  static constexpr uint64_t kLineStride = 1024;
+  static constexpr uint64_t npos = ~0ull;
+
+  LargeFileBuffer() = default;
+  ~LargeFileBuffer() { close(); }
+  LargeFileBuffer(const LargeFileBuffer &) = delete;
+  LargeFileBuffer &operator=(const LargeFileBuffer &) = delete;
+
+  bool open(const std::string &path, size_t windowPages);
+  void close();
+  bool isOpen() const { return file_.isOpen(); }
+  const std::string &path() const { return path_; }
+
+  // Picks up a finished (or failed) line index; call once per frame from
+  // the UI thread.
+  void update();
+  bool indexed() const { return indexed_; }
+  // Set by update() when the background pass could not read the file; the
+  // buffer then stays read-only until it is reopened.
+  const std::string &indexError() const { return indexError_; }
+  double indexProgress() const;
+
+  uint64_t size() const { return size_; }
+  // Bytes of the file on disk that the buffer covers.
+  uint64_t originalSize() const { return file_.size(); }
+  // Takes in bytes appended to the file since open() or the last grow(),
+  // extending the original piece and the line index. False if the file
+  // did not grow.
+  bool grow();
+  size_t version() const { return version_; }
+  bool modified() const { return modified_; }
+  // Exact once indexed(), an estimate before that.
+  uint64_t lineCount() const;
+  // Start offset of `line`; false if the index has not reached it yet.
+  bool lineStart(uint64_t line, uint64_t &offset);
+  // Offset of a line start near `line`, estimated from the bytes indexed so
+  // far. Used to show not-yet-indexed parts of the file.
+  uint64_t approximateLineStart(uint64_t line);
+  // Up to maxBytes of the line starting at offset. *next is the offset of
+  // the following line, size() + 1 after the last line, or npos if no line
+  // break was found within the scan limit.
+  std::string readLine(uint64_t offset, size_t maxBytes, uint64_t *next);
+
+  // Calls fn(begin, end, offset, line) for each line without its '\n',
+  // skipping lines over maxLength bytes, which are counted in skipped.
+  // False if the file could not be read.
+  bool forEachLine(
+      size_t maxLength, uint64_t &skipped,
+      const std::function<void(const char *, const char *, uint64_t, uint64_t)>
+          &fn);
+
+  // One change for replace(): len bytes at pos, on line `line` and holding
+  // no line break, become textLength bytes of its text from textStart.
+  struct Splice {
+    uint64_t pos;
+    uint64_t len;
+    uint64_t line;
+    size_t textStart;
+    size_t textLength;
+  };
+
+  // Edits are refused until the line index is complete.
+  bool insert(uint64_t pos, const std::string &text);
+  bool erase(uint64_t pos, uint64_t len);
+  // Applies splices, in ascending order and not overlapping, as one edit:
+  // text goes into the add buffer once and the piece list is rebuilt in a
+  // single walk, without reading the file.
+  bool replace(const std::vector<Splice> &splices, const std::string &text);
+  // Writes a copy, renames it over path and reopens the buffer on it; the
+  // line index is rebuilt in the background. A symlinked path is saved
+  // through to its target, and the copy gets the original's permissions
+  // (and owner, where allowed).
+  bool save(const std::string &path, std::string &error);
+
+  // Pages in the window plus the add buffer, line index and piece list.
+  size_t residentBytes() const;
+
+private:
+  struct Piece {
+    bool added;
+    uint64_t start;
+    uint64_t length;
+    uint64_t newlines;
+  };
+
+  void startIndexer();
+  void stopIndexer();
+  void indexMain(std::string path);
+  void indexTail();
+
+  template <typename Fn> bool forEachChunk(uint64_t pos, uint64_t len, Fn &&fn);
+  uint64_t originalLineOf(uint64_t offset);
+  uint64_t originalLineStart(uint64_t line);
+  uint64_t pieceNewlines(const Piece &p, uint64_t from, uint64_t to);
+  size_t splitAt(uint64_t pos);
+
+  std::string path_;
+  PagedFile file_;
+  std::string add_;
+  std::vector<Piece> pieces_;
+  uint64_t size_ = 0;
+  uint64_t newlines_ = 0; // in the whole document, once indexed
+  size_t version_ = 0;
+  bool modified_ = false;
+  bool indexed_ = false;
+
+  std::thread indexer_;
+  std::atomic<bool> stop_{false};
+  std::atomic<bool> indexDone_{false};
+  std::atomic<bool> indexFailed_{false}; // the indexer's error is in failure_
+  std::string failure_;
+  std::string indexError_;
+  std::atomic<uint64_t> fileSize_{0}; // how far the indexer should read
+  std::atomic<uint64_t> scanned_{0};
+  std::atomic<uint64_t> scannedNewlines_{0};
+  mutable std::mutex mutex_;
+  std::vector<uint64_t> checkpoints_; // start of line k * kLineStride
+};
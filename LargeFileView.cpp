@@ -0,0 +1,460 @@
+#include "LargeFileView.hpp"
+#include "TextEditor.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+namespace {
+// Longer lines are shown and edited only up to this many bytes
+const size_t kMaxLineBytes = 64 << 10;
+
+void formatBytes(char *buf, size_t size, uint64_t bytes) {
+  if (bytes >= (1ull << 30))
+    snprintf(buf, size, "%.1f GB", (double)bytes / (double)(1ull << 30));
+  else
+    snprintf(buf, size, "%.1f MB", (double)bytes / (double)(1ull << 20));
+}
+} // namespace
+
+LargeFileView::LargeFileView(TextEditor *editor) : editor_(editor) {}
+
+bool LargeFileView::open(const std::string &path, size_t windowBytes) {
+  if (!buffer_.open(path, windowBytes / PagedFile::kPageSize))
+    return false;
+  topLine_ = 0;
+  scrollX_ = 0.0f;
+  caretLine_ = caretColumn_ = 0;
+  dragging_ = false;
+  rows_.clear();
+  rowsTop_ = ~0ull;
+  return true;
+}
+
+void LargeFileView::close() {
+  buffer_.close();
+  rows_.clear();
+  rowsTop_ = ~0ull;
+}
+
+bool LargeFileView::save(const std::string &path) {
+  std::string error;
+  if (buffer_.save(path, error))
+    return true;
+  editor_->addOutput(editor_->icons["error"],
+                     "Could not save file: " + path + " (" + error + ")");
+  return false;
+}
+
+void LargeFileView::gotoLine(uint64_t line, uint64_t col) {
+  caretLine_ = std::min(line, buffer_.lineCount() - 1);
+  caretColumn_ = col;
+  topLine_ = caretLine_ > 5 ? caretLine_ - 5 : 0;
+  editor_->focusEditor = true;
+}
+
+bool LargeFileView::replace(const std::vector<LargeFileBuffer::Splice> &splices,
+                            const std::string &text) {
+  if (!buffer_.replace(splices, text))
+    return false;
+  caretLine_ = std::min(caretLine_, buffer_.lineCount() - 1);
+  topLine_ = std::min(topLine_, caretLine_);
+  editor_->modified = true;
+  return true;
+}
+
+bool LargeFileView::grow() {
+  uint64_t lines = buffer_.lineCount();
+  bool atEnd = buffer_.indexed() ? caretLine_ + 1 >= lines
+                                 : topLine_ + rowsCount_ >= lines;
+  if (!buffer_.grow())
+    return false;
+  if (atEnd) {
+    if (buffer_.indexed()) {
+      caretLine_ = buffer_.lineCount() - 1;
+      caretColumn_ = lineLength(caretLine_);
+      followCaret(std::max<size_t>(rowsCount_, 1));
+    } else {
+      scrollBy((int64_t)buffer_.lineCount(), rowsCount_);
+    }
+  }
+  return true;
+}
+
+void LargeFileView::updateRows(size_t count) {
+  if (rowsExact_ && rowsTop_ == topLine_ && rowsCount_ == count &&
+      rowsVersion_ == buffer_.version())
+    return;
+  rowsTop_ = topLine_;
+  rowsCount_ = count;
+  rowsVersion_ = buffer_.version();
+  rows_.clear();
+
+  uint64_t start;
+  rowsExact_ = buffer_.lineStart(topLine_, start);
+  if (!rowsExact_)
+    start = buffer_.approximateLineStart(topLine_);
+  for (size_t i = 0; i < count; ++i) {
+    uint64_t next;
+    std::string text = buffer_.readLine(start, kMaxLineBytes, &next);
+    rows_.push_back(Row{start, std::move(text)});
+    // A line too long to scan for its end is skipped via the index
+    if (next == LargeFileBuffer::npos &&
+        !(rowsExact_ && buffer_.lineStart(topLine_ + i + 1, next)))
+      break;
+    if (next > buffer_.size())
+      break;
+    start = next;
+  }
+}
+
+uint64_t LargeFileView::lineLength(uint64_t line) {
+  if (rowsExact_ && rowsVersion_ == buffer_.version() && line >= rowsTop_ &&
+      line - rowsTop_ < rows_.size())
+    return rows_[(size_t)(line - rowsTop_)].text.size();
+  uint64_t start, next;
+  if (!buffer_.lineStart(line, start))
+    return 0;
+  return buffer_.readLine(start, kMaxLineBytes, &next).size();
+}
+
+uint64_t LargeFileView::caretOffset() {
+  uint64_t start = 0;
+  buffer_.lineStart(caretLine_, start);
+  return start + std::min(caretColumn_, lineLength(caretLine_));
+}
+
+void LargeFileView::insertText(const std::string &text) {
+  if (!buffer_.insert(caretOffset(), text))
+    return;
+  caretColumn_ = std::min(caretColumn_, lineLength(caretLine_));
+  for (char c : text) {
+    if (c == '\n') {
+      caretLine_++;
+      caretColumn_ = 0;
+    } else {
+      caretColumn_++;
+    }
+  }
+  editor_->modified = true;
+}
+
+void LargeFileView::scrollBy(int64_t lines, size_t visibleRows) {
+  uint64_t total = buffer_.lineCount();
+  uint64_t maxTop = total > visibleRows ? total - visibleRows : 0;
+  if (lines < 0)
+    topLine_ = topLine_ > (uint64_t)-lines ? topLine_ - (uint64_t)-lines : 0;
+  else
+    topLine_ = std::min(maxTop, topLine_ + (uint64_t)lines);
+}
+
+void LargeFileView::followCaret(size_t visibleRows) {
+  if (caretLine_ < topLine_)
+    topLine_ = caretLine_;
+  else if (caretLine_ >= topLine_ + visibleRows)
+    topLine_ = caretLine_ - visibleRows + 1;
+
+  float caretX = std::min(caretColumn_, lineLength(caretLine_)) * cellWidth_;
+  if (caretX < scrollX_)
+    scrollX_ = caretX;
+  else if (caretX > scrollX_ + textWidth_ - 2.0f * cellWidth_)
+    scrollX_ = caretX - textWidth_ + 2.0f * cellWidth_;
+}
+
+void LargeFileView::handleKeyboard(size_t visibleRows) {
+  ImGuiIO &io = ImGui::GetIO();
+  int64_t page = (int64_t)visibleRows;
+
+  // Until every line is numbered there is no caret, only scrolling
+  if (!buffer_.indexed()) {
+    if (ImGui::IsKeyPressed(ImGuiKey_UpArrow))
+      scrollBy(-1, visibleRows);
+    if (ImGui::IsKeyPressed(ImGuiKey_DownArrow))
+      scrollBy(1, visibleRows);
+    if (ImGui::IsKeyPressed(ImGuiKey_PageUp))
+      scrollBy(-page, visibleRows);
+    if (ImGui::IsKeyPressed(ImGuiKey_PageDown))
+      scrollBy(page, visibleRows);
+    if (io.KeyCtrl && ImGui::IsKeyPressed(ImGuiKey_Home))
+      topLine_ = 0;
+    if (io.KeyCtrl && ImGui::IsKeyPressed(ImGuiKey_End))
+      scrollBy((int64_t)buffer_.lineCount(), visibleRows);
+    return;
+  }
+
+  uint64_t lines = buffer_.lineCount();
+  bool moved = false;
+  if (ImGui::IsKeyPressed(ImGuiKey_UpArrow) && caretLine_ > 0) {
+    caretLine_--;
+    moved = true;
+  }
+  if (ImGui::IsKeyPressed(ImGuiKey_DownArrow) && caretLine_ + 1 < lines) {
+    caretLine_++;
+    moved = true;
+  }
+  if (ImGui::IsKeyPressed(ImGuiKey_PageUp)) {
+    caretLine_ -= std::min<uint64_t>(caretLine_, visibleRows);
+    moved = true;
+  }
+  if (ImGui::IsKeyPressed(ImGuiKey_PageDown)) {
+    caretLine_ = std::min<uint64_t>(lines - 1, caretLine_ + visibleRows);
+    moved = true;
+  }
+  if (ImGui::IsKeyPressed(ImGuiKey_Home)) {
+    if (io.KeyCtrl)
+      caretLine_ = 0;
+    caretColumn_ = 0;
+    moved = true;
+  }
+  if (ImGui::IsKeyPressed(ImGuiKey_End)) {
+    if (io.KeyCtrl)
+      caretLine_ = lines - 1;
+    caretColumn_ = lineLength(caretLine_);
+    moved = true;
+  }
+  if (ImGui::IsKeyPressed(ImGuiKey_LeftArrow)) {
+    caretColumn_ = std::min(caretColumn_, lineLength(caretLine_));
+    if (caretColumn_ > 0) {
+      caretColumn_--;
+    } else if (caretLine_ > 0) {
+      caretLine_--;
+      caretColumn_ = lineLength(caretLine_);
+    }
+    moved = true;
+  }
+  if (ImGui::IsKeyPressed(ImGuiKey_RightArrow)) {
+    if (caretColumn_ < lineLength(caretLine_)) {
+      caretColumn_++;
+    } else if (caretLine_ + 1 < lines) {
+      caretLine_++;
+      caretColumn_ = 0;
+    }
+    moved = true;
+  }
+
+  if (ImGui::IsKeyPressed(ImGuiKey_Enter) ||
+      ImGui::IsKeyPressed(ImGuiKey_KeypadEnter)) {
+    insertText("\n");
+    moved = true;
+  }
+  for (unsigned int c : io.InputQueueCharacters) {
+    if (c >= 32 && c != 127) {
+      insertText(std::string(1, (char)c));
+      moved = true;
+    }
+  }
+  if (ImGui::IsKeyPressed(ImGuiKey_Backspace)) {
+    uint64_t offset = caretOffset();
+    if (offset > 0) {
+      caretColumn_ = std::min(caretColumn_, lineLength(caretLine_));
+      uint64_t previous = 0;
+      if (caretColumn_ == 0)
+        previous = lineLength(caretLine_ - 1);
+      buffer_.erase(offset - 1, 1);
+      if (caretColumn_ > 0) {
+        caretColumn_--;
+      } else {
+        caretLine_--;
+        caretColumn_ = previous;
+      }
+      editor_->modified = true;
+    }
+    moved = true;
+  }
+  if (ImGui::IsKeyPressed(ImGuiKey_Delete)) {
+    uint64_t offset = caretOffset();
+    if (offset < buffer_.size() && buffer_.erase(offset, 1))
+      editor_->modified = true;
+    moved = true;
+  }
+
+  if (moved)
+    followCaret(visibleRows);
+}
+
+void LargeFileView::renderScrollbar(ImVec2 barPos, float trackH, float barW,
+                                    size_t visibleRows) {
+  uint64_t lines = buffer_.lineCount();
+  uint64_t maxTop = lines > visibleRows ? lines - visibleRows : 0;
+
+  ImDrawList *dl = ImGui::GetWindowDrawList();
+  dl->AddRectFilled(barPos, ImVec2(barPos.x + barW, barPos.y + trackH),
+                    ImGui::GetColorU32(ImGuiCol_FrameBgHovered));
+
+  float thumbH = std::clamp(
+      (float)((double)visibleRows / (double)lines) * trackH, 24.0f, trackH);
+  float range = trackH - thumbH;
+  float thumbY =
+      maxTop > 0 ? (float)((double)topLine_ / (double)maxTop) * range : 0.0f;
+
+  // Clicking the track jumps there; dragging moves by fraction of the file
+  ImGuiIO &io = ImGui::GetIO();
+  ImGui::SetCursorScreenPos(barPos);
+  ImGui::InvisibleButton("large_vtrack", ImVec2(barW, trackH));
+  bool hovered = ImGui::IsItemHovered();
+  if (ImGui::IsItemActivated()) {
+    float mouseY = io.MousePos.y - barPos.y;
+    bool onThumb = mouseY >= thumbY && mouseY <= thumbY + thumbH;
+    dragGrab_ = onThumb ? mouseY - thumbY : thumbH * 0.5f;
+    dragging_ = true;
+  }
+  if (dragging_) {
+    if (ImGui::IsMouseDown(ImGuiMouseButton_Left)) {
+      float y = std::clamp(io.MousePos.y - barPos.y - dragGrab_, 0.0f, range);
+      thumbY = y;
+      topLine_ = range > 0.0f
+                     ? (uint64_t)((double)y / (double)range * (double)maxTop)
+                     : 0;
+    } else {
+      dragging_ = false;
+    }
+  }
+
+  ImU32 thumbCol = ImGui::GetColorU32(
+      dragging_ ? ImGuiCol_ScrollbarGrabActive
+                : (hovered ? ImGuiCol_ScrollbarGrabHovered
+                           : ImGuiCol_ScrollbarGrab));
+  dl->AddRectFilled(ImVec2(barPos.x, barPos.y + thumbY),
+                    ImVec2(barPos.x + barW, barPos.y + thumbY + thumbH),
+                    thumbCol, 3.0f);
+}
+
+void LargeFileView::render() {
+  buffer_.update();
+  if (buffer_.indexError().empty()) {
+    indexErrorShown_ = false;
+  } else if (!indexErrorShown_) {
+    editor_->addOutput(editor_->icons["error"],
+                       "Could not index " + buffer_.path() + " (" +
+                           buffer_.indexError() +
+                           "); it stays read-only until reopened");
+    indexErrorShown_ = true;
+  }
+
+  ImDrawList *drawList = ImGui::GetWindowDrawList();
+  ImVec2 pos = ImGui::GetCursorScreenPos();
+  ImVec2 winSize = ImGui::GetContentRegionAvail();
+  editor_->lineHeight = ImGui::GetTextLineHeightWithSpacing();
+  const float lineHeight = editor_->lineHeight;
+  cellWidth_ = TextEditor::cellWidth();
+
+  const float padX = 4.0f;
+  const float padY = 4.0f;
+  const float scrollbarW = 12.0f;
+  const float viewW = winSize.x - scrollbarW;
+  const float viewH = winSize.y - lineHeight; // last row is the status line
+  size_t visibleRows =
+      (size_t)std::max(1.0f, std::floor((viewH - padY) / lineHeight));
+
+  // Gutter sized for the (possibly estimated) line count plus a "~"
+  uint64_t lines = buffer_.lineCount();
+  int digits = 1;
+  for (uint64_t n = lines; n >= 10; n /= 10)
+    digits++;
+  digits = std::max(digits, 6);
+  float gutterW = editor_->showLineNumbers ? (digits + 3) * cellWidth_ : 0.0f;
+  float textX = pos.x + gutterW + padX;
+  textWidth_ = viewW - gutterW - padX;
+
+  drawList->AddRectFilled(pos, ImVec2(pos.x + winSize.x, pos.y + winSize.y),
+                          ImGui::GetColorU32(ImGuiCol_FrameBg));
+
+  if (editor_->focusEditor) {
+    ImGui::SetKeyboardFocusHere();
+    editor_->focusEditor = false;
+  }
+  ImGui::InvisibleButton("large_file_area", ImVec2(viewW, viewH));
+  bool focused = ImGui::IsItemFocused();
+  ImGuiIO &io = ImGui::GetIO();
+  if (ImGui::IsItemHovered() && io.MouseWheel != 0.0f) {
+    if (io.KeyShift)
+      scrollX_ = std::max(0.0f, scrollX_ - io.MouseWheel * 40.0f);
+    else
+      scrollBy((int64_t)(-io.MouseWheel * 3.0f), visibleRows);
+  }
+  if (ImGui::IsItemClicked() && buffer_.indexed()) {
+    uint64_t row = (uint64_t)std::max(
+        0.0f, std::floor((io.MousePos.y - pos.y - padY) / lineHeight));
+    caretLine_ = std::min(topLine_ + row, lines - 1);
+    caretColumn_ = (uint64_t)std::max(
+        0.0f, std::round((io.MousePos.x - textX + scrollX_) / cellWidth_));
+    caretColumn_ = std::min(caretColumn_, lineLength(caretLine_));
+  }
+  if (focused)
+    handleKeyboard(visibleRows);
+
+  scrollBy(0, visibleRows); // clamp after edits and index progress
+  updateRows(visibleRows);
+
+  // Line numbers
+  if (editor_->showLineNumbers) {
+    drawList->AddRectFilled(pos, ImVec2(pos.x + gutterW, pos.y + viewH),
+                            ImGui::GetColorU32(ImGuiCol_ScrollbarBg));
+    for (size_t i = 0; i < rows_.size(); ++i) {
+      char buf[32];
+      snprintf(buf, sizeof(buf), rowsExact_ ? "%llu" : "~%llu",
+               (unsigned long long)(topLine_ + i + 1));
+      float numW = ImGui::CalcTextSize(buf).x;
+      drawList->AddText(
+          ImVec2(roundf(pos.x + gutterW - cellWidth_ - numW),
+                 roundf(pos.y + padY + i * lineHeight)),
+          ImGui::GetColorU32(ImGuiCol_TextDisabled), buf);
+    }
+  }
+
+  // Text, clipped to the columns on screen
+  drawList->PushClipRect(ImVec2(textX, pos.y), ImVec2(pos.x + viewW, pos.y + viewH),
+                         true);
+  size_t firstCol = (size_t)(scrollX_ / cellWidth_);
+  size_t cols = (size_t)(textWidth_ / cellWidth_) + 2;
+  for (size_t i = 0; i < rows_.size(); ++i) {
+    const std::string &text = rows_[i].text;
+    if (firstCol >= text.size())
+      continue;
+    size_t n = std::min(cols, text.size() - firstCol);
+    drawList->AddText(ImVec2(roundf(textX + firstCol * cellWidth_ - scrollX_),
+                             roundf(pos.y + padY + i * lineHeight)),
+                      ImGui::GetColorU32(ImGuiCol_Text),
+                      text.data() + firstCol, text.data() + firstCol + n);
+  }
+
+  // Caret
+  if (focused && buffer_.indexed() && caretLine_ >= topLine_ &&
+      caretLine_ < topLine_ + rows_.size() &&
+      (int)(ImGui::GetTime() * 2) % 2 == 0) {
+    uint64_t col = std::min(caretColumn_, lineLength(caretLine_));
+    float x = textX + col * cellWidth_ - scrollX_;
+    float top = pos.y + padY + (caretLine_ - topLine_) * lineHeight +
+                lineHeight * 0.15f;
+    drawList->AddLine(ImVec2(x, top), ImVec2(x, top + lineHeight * 0.75f),
+                      ImGui::GetColorU32(ImGuiCol_Text), 2.0f);
+  }
+  drawList->PopClipRect();
+
+  renderScrollbar(ImVec2(pos.x + viewW, pos.y), viewH, scrollbarW,
+                  visibleRows);
+
+  // Status line: size, index progress, line count and resident memory
+  char size[32], resident[32], status[256];
+  formatBytes(size, sizeof(size), buffer_.size());
+  formatBytes(resident, sizeof(resident), buffer_.residentBytes());
+  if (buffer_.indexed())
+    snprintf(status, sizeof(status),
+             "Large file mode | %s | %llu lines | Ln %llu, Col %llu | "
+             "%s resident",
+             size, (unsigned long long)lines,
+             (unsigned long long)(caretLine_ + 1),
+             (unsigned long long)(caretColumn_ + 1), resident);
+  else if (!buffer_.indexError().empty())
+    snprintf(status, sizeof(status),
+             "Large file mode | %s | indexing failed (%s), read-only | "
+             "%s resident",
+             size, buffer_.indexError().c_str(), resident);
+  else
+    snprintf(status, sizeof(status),
+             "Large file mode | %s | indexing %d%%, read-only | ~%llu lines | "
+             "%s resident",
+             size, (int)(buffer_.indexProgress() * 100.0),
+             (unsigned long long)lines, resident);
+  drawList->AddText(ImVec2(pos.x + padX, pos.y + viewH),
+                    ImGui::GetColorU32(ImGuiCol_TextDisabled), status);
+}
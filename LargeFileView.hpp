@@ -0,0 +1,76 @@
+#pragma once
+
+#include "LargeFileBuffer.hpp"
+#include "imgui.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class TextEditor;
+
+// Editor view for a LargeFileBuffer. Only the visible lines are ever read,
+// and scrolling is by line number, so nothing grows with the file. Until
+// the line index is complete the scrollbar uses the estimated line count,
+// unindexed lines are placed by byte offset and numbered with a "~", and
+// the view is read-only. Editing is plain typing and deletion at a single
+// caret, plus replace all; undo, selection and find are not available in
+// this mode.
+class LargeFileView {
+public:
+  LargeFileView(TextEditor *editor);
+  ~LargeFileView() = default;
+
+  bool open(const std::string &path, size_t windowBytes);
+  void close();
+  bool active() const { return buffer_.isOpen(); }
+  bool save(const std::string &path);
+  void gotoLine(uint64_t line, uint64_t col);
+  // Replace all: applies the splices as one edit and keeps the caret on a
+  // line that still exists
+  bool replace(const std::vector<LargeFileBuffer::Splice> &splices,
+               const std::string &text);
+  // Follow mode: takes in appended bytes, keeping the caret (or, while
+  // indexing, the view) pinned to the end if it was there.
+  bool grow();
+  size_t residentBytes() const { return buffer_.residentBytes(); }
+  LargeFileBuffer &buffer() { return buffer_; }
+
+  // Draws into the current window (the editor window).
+  void render();
+
+private:
+  struct Row {
+    uint64_t start;
+    std::string text;
+  };
+
+  void updateRows(size_t count);
+  uint64_t caretOffset();
+  uint64_t lineLength(uint64_t line);
+  void handleKeyboard(size_t visibleRows);
+  void insertText(const std::string &text);
+  void followCaret(size_t visibleRows);
+  void scrollBy(int64_t lines, size_t visibleRows);
+  void renderScrollbar(ImVec2 pos, float height, float width,
+                       size_t visibleRows);
+
+  TextEditor *editor_;
+  LargeFileBuffer buffer_;
+
+  uint64_t topLine_ = 0;
+  float scrollX_ = 0.0f;
+  uint64_t caretLine_ = 0;
+  uint64_t caretColumn_ = 0;
+  bool dragging_ = false;
+  float dragGrab_ = 0.0f;
+
+  // Visible lines, re-read when the buffer or the first line changes
+  std::vector<Row> rows_;
+  uint64_t rowsTop_ = ~0ull;
+  size_t rowsVersion_ = 0;
+  size_t rowsCount_ = 0;
+  bool rowsExact_ = false;
+  float cellWidth_ = 1.0f;
+  float textWidth_ = 0.0f;
+  bool indexErrorShown_ = false;
+};
@@ -0,0 +1,132 @@
+#include "LineDiff.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <functional>
+
+namespace {
+struct Lines {
+  std::vector<std::string_view> text; // each with its '\n'
+  std::vector<size_t> hash;
+  std::vector<size_t> offset; // start of each line, plus the end
+};
+
+Lines split(std::string_view s) {
+  Lines lines;
+  std::hash<std::string_view> hasher;
+  size_t start = 0;
+  while (start < s.size()) {
+    size_t nl = s.find('\n', start);
+    size_t end = nl == std::string_view::npos ? s.size() : nl + 1;
+    lines.text.push_back(s.substr(start, end - start));
+    lines.hash.push_back(hasher(lines.text.back()));
+    lines.offset.push_back(start);
+    start = end;
+  }
+  lines.offset.push_back(s.size());
+  return lines;
+}
+} // namespace
+
+std::vector<LineDiff::Hunk> LineDiff::compute(std::string_view oldText,
+                                              std::string_view newText,
+                                              size_t maxEdits) {
+  Lines a = split(oldText);
+  Lines b = split(newText);
+  auto same = [&](size_t x, size_t y) {
+    return a.hash[x] == b.hash[y] && a.text[x] == b.text[y];
+  };
+
+  // Common head and tail
+  size_t head = 0;
+  size_t n = a.text.size(), m = b.text.size();
+  while (head < n && head < m && same(head, head))
+    ++head;
+  while (n > head && m > head && same(n - 1, m - 1)) {
+    --n;
+    --m;
+  }
+
+  // Edit script over a[head, n) and b[head, m) as (x, y, isInsert) steps
+  struct Step {
+    size_t x, y;
+    bool insert;
+  };
+  std::vector<Step> steps;
+  long N = (long)(n - head), M = (long)(m - head);
+  long max = N + M;
+  // At least |N - M| lines differ, so that many more than maxEdits means
+  // the search can only give up; and it never looks at a diagonal beyond
+  // maxEdits, so v only needs that many
+  bool fallback = (size_t)std::labs(N - M) > maxEdits;
+  long limit = std::min(max, (long)maxEdits);
+  if (max > 0 && !fallback) {
+    std::vector<long> v((size_t)(2 * limit + 2), 0);
+    std::vector<std::vector<long>> trace; // v[-d..d] after each round d
+    long end = -1;
+    for (long d = 0; d <= max && end < 0; ++d) {
+      if ((size_t)d > maxEdits) {
+        fallback = true;
+        break;
+      }
+      for (long k = -d; k <= d; k += 2) {
+        long x = (k == -d || (k != d && v[(size_t)(k - 1 + limit)] <
+                                            v[(size_t)(k + 1 + limit)]))
+                     ? v[(size_t)(k + 1 + limit)]
+                     : v[(size_t)(k - 1 + limit)] + 1;
+        long y = x - k;
+        while (x < N && y < M && same(head + (size_t)x, head + (size_t)y)) {
+          ++x;
+          ++y;
+        }
+        v[(size_t)(k + limit)] = x;
+        if (x >= N && y >= M)
+          end = d;
+      }
+      trace.emplace_back(v.begin() + (limit - d), v.begin() + (limit + d + 1));
+    }
+
+    if (!fallback) {
+      long x = N, y = M;
+      for (long d = end; d > 0; --d) {
+        const std::vector<long> &prev = trace[(size_t)(d - 1)];
+        auto at = [&](long k) { return prev[(size_t)(k + d - 1)]; };
+        long k = x - y;
+        bool down = k == -d || (k != d && at(k - 1) < at(k + 1));
+        long prevK = down ? k + 1 : k - 1;
+        long prevX = at(prevK);
+        long prevY = prevX - prevK;
+        steps.push_back(Step{(size_t)prevX, (size_t)prevY, down});
+        x = prevX;
+        y = prevY;
+      }
+    }
+  }
+
+  std::vector<Hunk> hunks;
+  auto emit = [&](size_t x0, size_t x1, size_t y0, size_t y1) {
+    hunks.push_back(Hunk{x0, x1 - x0, y0, y1 - y0, a.offset[x0],
+                         a.offset[x1] - a.offset[x0], b.offset[y0],
+                         b.offset[y1] - b.offset[y0]});
+  };
+  if (fallback) {
+    emit(head, n, head, m);
+    return hunks;
+  }
+
+  // Steps were collected back to front; runs of adjacent ones make a hunk
+  std::reverse(steps.begin(), steps.end());
+  for (size_t i = 0; i < steps.size();) {
+    size_t x0 = head + steps[i].x, y0 = head + steps[i].y;
+    size_t x1 = x0, y1 = y0;
+    for (; i < steps.size() && head + steps[i].x == x1 &&
+           head + steps[i].y == y1;
+         ++i) {
+      if (steps[i].insert)
+        ++y1;
+      else
+        ++x1;
+    }
+    emit(x0, x1, y0, y1);
+  }
+  return hunks;
+}
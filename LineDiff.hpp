@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+#include <vector>
+
+// Line diff between two texts. Lines are compared by hash first (and by
+// content only when the hashes agree), the common head and tail are
+// trimmed, and Myers' O(ND) algorithm runs on what is left. If more than
+// maxEdits lines differ the middle is reported as one replaced block
+// rather than spending quadratic time on it.
+class LineDiff {
+public:
+  // Lines [oldLine, oldLine + oldCount) of the old text become lines
+  // [newLine, newLine + newCount) of the new one. The pos/len fields give
+  // the same ranges in bytes, trailing newlines included.
+  struct Hunk {
+    size_t oldLine, oldCount;
+    size_t newLine, newCount;
+    size_t oldPos, oldLen;
+    size_t newPos, newLen;
+  };
+
+  static std::vector<Hunk> compute(std::string_view oldText,
+                                   std::string_view newText,
+                                   size_t maxEdits = 2000);
+};
@@ -0,0 +1,31 @@
+#include "LogQueue.hpp"
+
+LogQueue::LogQueue() : head_(new Node), tail_(head_.load()) {}
+
+LogQueue::~LogQueue() {
+  while (tail_) {
+    Node *next = tail_->next.load(std::memory_order_acquire);
+    delete tail_;
+    tail_ = next;
+  }
+}
+
+void LogQueue::push(OutputLine line) {
+  Node *node = new Node;
+  node->line = std::move(line);
+  // Claim the end of the list, then link the previous end to it. Between
+  // the two the list is briefly cut; drain() stops there and resumes later.
+  Node *prev = head_.exchange(node, std::memory_order_acq_rel);
+  prev->next.store(node, std::memory_order_release);
+}
+
+size_t LogQueue::drain(OutputLog &log) {
+  size_t count = 0;
+  while (Node *next = tail_->next.load(std::memory_order_acquire)) {
+    log.push(std::move(next->line));
+    delete tail_;
+    tail_ = next; // stays allocated as the new sentinel
+    count++;
+  }
+  return count;
+}
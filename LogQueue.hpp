@@ -0,0 +1,31 @@
+#pragma once
+
+#include "OutputLog.hpp"
+#include <atomic>
+
+// Output lines from any thread on their way to the UI thread's OutputLog.
+// Producers never block or take a lock: a push is one allocation and one
+// atomic exchange (an intrusive multi-producer single-consumer list). The
+// UI thread moves everything queued so far into the log once per frame.
+class LogQueue {
+public:
+  LogQueue();
+  ~LogQueue();
+  LogQueue(const LogQueue &) = delete;
+  LogQueue &operator=(const LogQueue &) = delete;
+
+  // Safe from any thread
+  void push(OutputLine line);
+  // UI thread only. Returns the number of lines moved into log; a line
+  // whose push is still in flight is picked up by the next call.
+  size_t drain(OutputLog &log);
+
+private:
+  struct Node {
+    std::atomic<Node *> next{nullptr};
+    OutputLine line;
+  };
+
+  std::atomic<Node *> head_; // last pushed node, shared by producers
+  Node *tail_;               // consumed node whose successor is next out
+};
@@ -1,4 +1,7 @@
 #include "LuaBindings.hpp"
+#include "FuzzyMatcher.hpp"
+#include "Macros.hpp"
+#include "MultiCursor.hpp"
 #include "TextEditor.hpp"
 #include <filesystem>
 #include <string>
@@ -33,7 +36,7 @@ void LuaBindings::initLua()
     luaL_openlibs(L_);
     luaL_dostring(L_, "package.path = 'plugins/?.lua;' .. package.path");
     luaL_dostring(L_, R"(
-        hooks = { on_text_input = {}, on_render = {} }
+        hooks = { on_text_input = {}, on_render = {}, on_text_changed = {} }
         function register_hook(event, fn)
             if hooks[event] then table.insert(hooks[event], fn) end
         end
@@ -99,6 +102,25 @@ bool LuaBindings::runHook(const char *hookName)
     return eval(code);
 }
 
+void LuaBindings::runChangeHook(size_t start, size_t end)
+{
+    lua_getglobal(L_, "hooks");
+    lua_getfield(L_, -1, "on_text_changed");
+    size_t count = lua_type(L_, -1) == LUA_TTABLE ? lua_rawlen(L_, -1) : 0;
+    for (size_t i = 1; i <= count; ++i)
+    {
+        lua_rawgeti(L_, -1, (lua_Integer)i);
+        lua_pushinteger(L_, (lua_Integer)start);
+        lua_pushinteger(L_, (lua_Integer)end);
+        if (lua_pcall(L_, 2, 0, 0))
+        {
+            editor_->addOutput(editor_->icons["error"], std::string("Lua: ") + lua_tostring(L_, -1));
+            lua_pop(L_, 1);
+        }
+    }
+    lua_pop(L_, 2);
+}
+
 // register the c++ <-> lua interactions
 void LuaBindings::registerBridges()
 {
@@ -188,6 +210,21 @@ void LuaBindings::registerBridges()
     return 0; }, 1);
     lua_setglobal(L_, "print_with_icon");
 
+    // editor_log(severity, msg): severity is "info", "warning" or "error".
+    // Goes through the editor's log queue, so it is safe from any thread.
+    push_editor();
+    lua_pushcclosure(L_, [](lua_State *L) -> int
+                     {
+                         auto *ed = static_cast<TextEditor *>(lua_touserdata(L, lua_upvalueindex(1)));
+                         static const char *const kSeverities[] = {"info", "warning", "error", nullptr};
+                         int severity = luaL_checkoption(L, 1, "info", kSeverities);
+                         const char *msg = luaL_checkstring(L, 2);
+                         ed->log((LogSeverity)severity, msg);
+                         return 0;
+                     },
+                     1);
+    lua_setglobal(L_, "editor_log");
+
     // editor_replace_current_word(full_text)
     push_editor();
     lua_pushcclosure(L_, [](lua_State *L) -> int
@@ -218,6 +255,56 @@ void LuaBindings::registerBridges()
         return 1; }, 1);
     lua_setglobal(L_, "detect_language");
 
+    // complete(prefix, limit?) -> { word, ... } ranked by occurrences in buffer
+    push_editor();
+    lua_pushcclosure(L_, [](lua_State *L) -> int
+                     {
+        auto* ed = static_cast<TextEditor*>(lua_touserdata(L, lua_upvalueindex(1)));
+        size_t len;
+        const char* prefix = luaL_checklstring(L, 1, &len);
+        lua_Integer limit = luaL_optinteger(L, 2, 10);
+        auto results = ed->wordIndex.complete(std::string_view(prefix, len),
+                                              limit > 0 ? (size_t)limit : 0);
+        lua_createtable(L, (int)results.size(), 0);
+        for (size_t i = 0; i < results.size(); ++i) {
+            lua_pushlstring(L, results[i].word.data(), results[i].word.size());
+            lua_rawseti(L, -2, (lua_Integer)i + 1);
+        }
+        return 1; }, 1);
+    lua_setglobal(L_, "complete");
+
+    // fuzzy_match(pattern, { candidates }, limit?) -> { candidate, ... } best first
+    lua_pushcfunction(L_, [](lua_State *L) -> int
+                      {
+        size_t len;
+        const char* pattern = luaL_checklstring(L, 1, &len);
+        luaL_checktype(L, 2, LUA_TTABLE);
+        lua_Integer limit = luaL_optinteger(L, 3, 20);
+
+        std::vector<std::string> candidates;
+        size_t n = lua_rawlen(L, 2);
+        candidates.reserve(n);
+        for (size_t i = 1; i <= n; ++i) {
+            lua_rawgeti(L, 2, (lua_Integer)i);
+            size_t slen;
+            const char* s = lua_tolstring(L, -1, &slen);
+            candidates.emplace_back(s ? s : "", s ? slen : 0);
+            lua_pop(L, 1);
+        }
+
+        FuzzyMatcher matcher;
+        matcher.setCandidates(std::move(candidates));
+        auto results = matcher.rank(std::string_view(pattern, len),
+                                    limit > 0 ? (size_t)limit : 0);
+        lua_createtable(L, (int)results.size(), 0);
+        for (size_t i = 0; i < results.size(); ++i) {
+            const std::string& c = matcher.candidates()[results[i].index];
+            lua_pushlstring(L, c.data(), c.size());
+            lua_rawseti(L, -2, (lua_Integer)i + 1);
+        }
+        return 1; });
+    lua_setglobal(L_, "fuzzy_match");
+
     // Fonts stuff
 
     // editor_load_font(path, size) -> bool
@@ -323,6 +410,268 @@ void LuaBindings::registerBridges()
                      1);
     lua_setglobal(L_, "editor_get_line_height");
 
+    // editor_set_large_file_threshold(mb): files this big or larger open in
+    // large-file mode
+    push_editor();
+    lua_pushcclosure(L_, [](lua_State *L) -> int
+                     {
+                         auto *ed = static_cast<TextEditor *>(lua_touserdata(L, lua_upvalueindex(1)));
+                         lua_Integer mb = luaL_checkinteger(L, 1);
+                         ed->largeFileThreshold = (size_t)std::max<lua_Integer>(1, mb) << 20;
+                         return 0;
+                     },
+                     1);
+    lua_setglobal(L_, "editor_set_large_file_threshold");
+
+    // editor_set_buffer_budget(mb): memory all open buffers may hold before
+    // background tabs are evicted (applied on the next switch or open)
+    push_editor();
+    lua_pushcclosure(L_, [](lua_State *L) -> int
+                     {
+                         auto *ed = static_cast<TextEditor *>(lua_touserdata(L, lua_upvalueindex(1)));
+                         lua_Integer mb = luaL_checkinteger(L, 1);
+                         ed->bufferMemoryBudget = (size_t)std::max<lua_Integer>(1, mb) << 20;
+                         return 0;
+                     },
+                     1);
+    lua_setglobal(L_, "editor_set_buffer_budget");
+
+    // editor_set_output_lines(n): lines the output panel keeps (up to 1M)
+    push_editor();
+    lua_pushcclosure(L_, [](lua_State *L) -> int
+                     {
+                         auto *ed = static_cast<TextEditor *>(lua_touserdata(L, lua_upvalueindex(1)));
+                         lua_Integer lines = luaL_checkinteger(L, 1);
+                         ed->outputLines.setCapacity((size_t)std::max<lua_Integer>(1, lines));
+                         return 0;
+                     },
+                     1);
+    lua_setglobal(L_, "editor_set_output_lines");
+
+    // editor_undo() / editor_redo()
+    push_editor();
+    lua_pushcclosure(L_, [](lua_State *L) -> int
+                     {
+                         static_cast<TextEditor *>(lua_touserdata(L, lua_upvalueindex(1)))->undo();
+                         return 0;
+                     },
+                     1);
+    lua_setglobal(L_, "editor_undo");
+
+    push_editor();
+    lua_pushcclosure(L_, [](lua_State *L) -> int
+                     {
+                         static_cast<TextEditor *>(lua_touserdata(L, lua_upvalueindex(1)))->redo();
+                         return 0;
+                     },
+                     1);
+    lua_setglobal(L_, "editor_redo");
+
+    // editor_undo_state(): id of the undo state the buffer is in
+    push_editor();
+    lua_pushcclosure(L_, [](lua_State *L) -> int
+                     {
+                         auto *ed = static_cast<TextEditor *>(lua_touserdata(L, lua_upvalueindex(1)));
+                         lua_pushinteger(L, (lua_Integer)ed->undoState());
+                         return 1;
+                     },
+                     1);
+    lua_setglobal(L_, "editor_undo_state");
+
+    // editor_undo_goto(id): jumps to any state in the undo tree, on any
+    // branch. Returns false if the state was trimmed or never existed.
+    push_editor();
+    lua_pushcclosure(L_, [](lua_State *L) -> int
+                     {
+                         auto *ed = static_cast<TextEditor *>(lua_touserdata(L, lua_upvalueindex(1)));
+                         lua_Integer id = luaL_checkinteger(L, 1);
+                         lua_pushboolean(L, id >= 0 && ed->gotoUndoState((unsigned)id));
+                         return 1;
+                     },
+                     1);
+    lua_setglobal(L_, "editor_undo_goto");
+
+    // editor_undo_tree(): array of { id, parent, children = {ids}, time },
+    // parents before children; the root's parent is nil
+    push_editor();
+    lua_pushcclosure(L_, [](lua_State *L) -> int
+                     {
+                         auto *ed = static_cast<TextEditor *>(lua_touserdata(L, lua_upvalueindex(1)));
+                         const auto &nodes = ed->undoHistory().nodes;
+                         lua_createtable(L, (int)nodes.size(), 0);
+                         for (size_t i = 0; i < nodes.size(); ++i)
+                         {
+                             const auto &node = nodes[i];
+                             lua_createtable(L, 0, 4);
+                             lua_pushinteger(L, (lua_Integer)node.seq);
+                             lua_setfield(L, -2, "id");
+                             if (node.parent >= 0)
+                             {
+                                 lua_pushinteger(L, (lua_Integer)nodes[node.parent].seq);
+                                 lua_setfield(L, -2, "parent");
+                             }
+                             lua_createtable(L, (int)node.children.size(), 0);
+                             for (size_t c = 0; c < node.children.size(); ++c)
+                             {
+                                 lua_pushinteger(L, (lua_Integer)nodes[node.children[c]].seq);
+                                 lua_rawseti(L, -2, (lua_Integer)c + 1);
+                             }
+                             lua_setfield(L, -2, "children");
+                             lua_pushnumber(L, node.time);
+                             lua_setfield(L, -2, "time");
+                             lua_rawseti(L, -2, (lua_Integer)i + 1);
+                         }
+                         return 1;
+                     },
+                     1);
+    lua_setglobal(L_, "editor_undo_tree");
+
+    // editor_begin_transaction() / editor_commit_transaction(): the edits
+    // in between are one undo step, and the line cache and on_text_changed
+    // hooks are updated once, at the commit
+    push_editor();
+    lua_pushcclosure(L_, [](lua_State *L) -> int
+                     {
+                         static_cast<TextEditor *>(lua_touserdata(L, lua_upvalueindex(1)))->beginTransaction();
+                         return 0;
+                     },
+                     1);
+    lua_setglobal(L_, "editor_begin_transaction");
+
+    push_editor();
+    lua_pushcclosure(L_, [](lua_State *L) -> int
+                     {
+                         static_cast<TextEditor *>(lua_touserdata(L, lua_upvalueindex(1)))->commitTransaction();
+                         return 0;
+                     },
+                     1);
+    lua_setglobal(L_, "editor_commit_transaction");
+
+    // editor_get_text(pos?, len?): buffer text; offsets are 0-based bytes
+    push_editor();
+    lua_pushcclosure(L_, [](lua_State *L) -> int
+                     {
+                         auto *ed = static_cast<TextEditor *>(lua_touserdata(L, lua_upvalueindex(1)));
+                         lua_Integer size = (lua_Integer)ed->content.size();
+                         lua_Integer pos = std::min(std::max<lua_Integer>(0, luaL_optinteger(L, 1, 0)), size);
+                         lua_Integer len = std::min(std::max<lua_Integer>(0, luaL_optinteger(L, 2, size)), size - pos);
+                         std::string text = ed->content.substr((size_t)pos, (size_t)len);
+                         lua_pushlstring(L, text.data(), text.size());
+                         return 1;
+                     },
+                     1);
+    lua_setglobal(L_, "editor_get_text");
+
+    // editor_insert(pos, text) / editor_erase(pos, len): undoable edits
+    push_editor();
+    lua_pushcclosure(L_, [](lua_State *L) -> int
+                     {
+                         auto *ed = static_cast<TextEditor *>(lua_touserdata(L, lua_upvalueindex(1)));
+                         lua_Integer pos = luaL_checkinteger(L, 1);
+                         size_t len;
+                         const char *text = luaL_checklstring(L, 2, &len);
+                         ed->applyInsert((int)pos, std::string(text, len));
+                         return 0;
+                     },
+                     1);
+    lua_setglobal(L_, "editor_insert");
+
+    push_editor();
+    lua_pushcclosure(L_, [](lua_State *L) -> int
+                     {
+                         auto *ed = static_cast<TextEditor *>(lua_touserdata(L, lua_upvalueindex(1)));
+                         lua_Integer pos = luaL_checkinteger(L, 1);
+                         lua_Integer len = luaL_checkinteger(L, 2);
+                         ed->applyErase((int)pos, (int)len);
+                         return 0;
+                     },
+                     1);
+    lua_setglobal(L_, "editor_erase");
+
+    // editor_macro_record() starts recording keyboard steps and commands;
+    // editor_macro_stop() ends it and returns the macro's size in bytes
+    push_editor();
+    lua_pushcclosure(L_, [](lua_State *L) -> int
+                     {
+                         static_cast<TextEditor *>(lua_touserdata(L, lua_upvalueindex(1)))->macros().startRecording();
+                         return 0;
+                     },
+                     1);
+    lua_setglobal(L_, "editor_macro_record");
+
+    push_editor();
+    lua_pushcclosure(L_, [](lua_State *L) -> int
+                     {
+                         Macros &macros = static_cast<TextEditor *>(lua_touserdata(L, lua_upvalueindex(1)))->macros();
+                         macros.stopRecording();
+                         lua_pushinteger(L, (lua_Integer)macros.bytecode().size());
+                         return 1;
+                     },
+                     1);
+    lua_setglobal(L_, "editor_macro_stop");
+
+    // editor_macro_play(times?): runs the last macro as one undo step and
+    // returns how many runs completed (nil if nothing was recorded)
+    push_editor();
+    lua_pushcclosure(L_, [](lua_State *L) -> int
+                     {
+                         Macros &macros = static_cast<TextEditor *>(lua_touserdata(L, lua_upvalueindex(1)))->macros();
+                         lua_Integer times = luaL_optinteger(L, 1, 1);
+                         macros.stopRecording();
+                         long long runs = macros.play(std::max<lua_Integer>(1, times));
+                         if (runs < 0)
+                             lua_pushnil(L);
+                         else
+                             lua_pushinteger(L, (lua_Integer)runs);
+                         return 1;
+                     },
+                     1);
+    lua_setglobal(L_, "editor_macro_play");
+
+    // editor_add_cursor_next(): Ctrl+D, a caret on the next occurrence of
+    // the selection (or selects the word under the caret); returns whether
+    // anything was added
+    push_editor();
+    lua_pushcclosure(L_, [](lua_State *L) -> int
+                     {
+                         TextEditor *ed = static_cast<TextEditor *>(lua_touserdata(L, lua_upvalueindex(1)));
+                         lua_pushboolean(L, ed->multiCursor().addNextOccurrence());
+                         return 1;
+                     },
+                     1);
+    lua_setglobal(L_, "editor_add_cursor_next");
+
+    // editor_cursors_on_lines(): Ctrl+Shift+L, a caret at the end of each
+    // selected line; returns the number of carets
+    push_editor();
+    lua_pushcclosure(L_, [](lua_State *L) -> int
+                     {
+                         TextEditor *ed = static_cast<TextEditor *>(lua_touserdata(L, lua_upvalueindex(1)));
+                         lua_pushinteger(L, (lua_Integer)ed->multiCursor().addOnSelectedLines());
+                         return 1;
+                     },
+                     1);
+    lua_setglobal(L_, "editor_cursors_on_lines");
+
+    // editor_replace_all(query, replacement, regex?): replaces every match
+    // as one undo step; with regex, replacement may use $1..$9 and $&.
+    // Returns the number of replacements.
+    push_editor();
+    lua_pushcclosure(L_, [](lua_State *L) -> int
+                     {
+                         TextEditor *ed = static_cast<TextEditor *>(lua_touserdata(L, lua_upvalueindex(1)));
+                         size_t queryLen = 0, replacementLen = 0;
+                         const char *query = luaL_checklstring(L, 1, &queryLen);
+                         const char *replacement = luaL_checklstring(L, 2, &replacementLen);
+                         bool regex = lua_toboolean(L, 3) != 0;
+                         size_t replaced = ed->replaceAll(std::string(query, queryLen),
+                                                          std::string(replacement, replacementLen), regex);
+                         lua_pushinteger(L, (lua_Integer)replaced);
+                         return 1;
+                     },
+                     1);
+    lua_setglobal(L_, "editor_replace_all");
+
     // ImGui hooks
     lua_newtable(L_);
 
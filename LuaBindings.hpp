@@ -13,6 +13,8 @@ public:
     bool eval(const std::string &code);
     void loadPluginFile(const std::string &path);
     bool runHook(const char *hookName);
+    // Calls each on_text_changed hook with the changed byte span [start, end)
+    void runChangeHook(size_t start, size_t end);
     void loadPlugins();
 private:
     void initLua();
@@ -0,0 +1,300 @@
+#include "Macros.hpp"
+#include "EditorCommands.hpp"
+#include "LargeFileView.hpp"
+#include "TextEditor.hpp"
+#include <algorithm>
+
+Macros::Macros(TextEditor *editor) : editor_(editor) {}
+
+void Macros::startRecording() {
+  recording_ = true;
+  building_.clear();
+  lastOp_ = (size_t)-1;
+}
+
+void Macros::stopRecording() {
+  if (!recording_)
+    return;
+  recording_ = false;
+  code_.swap(building_);
+  building_.clear();
+}
+
+static void putVarint(std::vector<uint8_t> &out, uint64_t value) {
+  while (value >= 0x80) {
+    out.push_back((uint8_t)(value | 0x80));
+    value >>= 7;
+  }
+  out.push_back((uint8_t)value);
+}
+
+static uint64_t getVarint(const std::vector<uint8_t> &in, size_t &pos) {
+  uint64_t value = 0;
+  for (int shift = 0; pos < in.size() && shift < 64; shift += 7) {
+    uint8_t byte = in[pos++];
+    value |= (uint64_t)(byte & 0x7f) << shift;
+    if (!(byte & 0x80))
+      break;
+  }
+  return value;
+}
+
+// Appends an instruction, or folds it into the previous one when both are
+// the same step: counts add up, inserted text is concatenated
+void Macros::emit(Op op, uint8_t flags, uint64_t count, const char *data,
+                  size_t length) {
+  uint8_t code = (uint8_t)op | flags;
+  if (op != Op::Command && op != Op::SelectAll && lastOp_ < building_.size() &&
+      building_[lastOp_] == code) {
+    size_t pos = lastOp_ + 1;
+    uint64_t previous = getVarint(building_, pos);
+    std::string text(building_.begin() + pos, building_.end());
+    building_.resize(lastOp_ + 1);
+    putVarint(building_, previous + count);
+    building_.insert(building_.end(), text.begin(), text.end());
+  } else {
+    lastOp_ = building_.size();
+    building_.push_back(code);
+    putVarint(building_, count);
+  }
+  building_.insert(building_.end(), data, data + length);
+}
+
+void Macros::recordInsert(const std::string &text) {
+  if (recording_ && !text.empty())
+    emit(Op::Insert, 0, text.size(), text.data(), text.size());
+}
+
+void Macros::recordStep(Op op, bool select) {
+  if (recording_)
+    emit(op, select ? kSelect : 0, 1);
+}
+
+void Macros::recordCommand(const std::string &name) {
+  if (!recording_ || name == "record" || name == "play")
+    return;
+  emit(Op::Command, 0, name.size(), name.data(), name.size());
+}
+
+namespace {
+
+// The buffer split at the caret: moving the caret or editing next to it
+// only touches the ends of the two strings
+struct SplitText {
+  std::string before; // text before the caret
+  std::string after;  // text after the caret, reversed
+  long long anchor = -1; // other end of the selection, or -1
+
+  size_t pos() const { return before.size(); }
+  size_t size() const { return before.size() + after.size(); }
+
+  void load(TextEditor &ed) {
+    std::string text = ed.content.getText();
+    size_t caret = std::min((size_t)std::max(ed.cursorIndex, 0), text.size());
+    before.assign(text, 0, caret);
+    after.assign(text.rbegin(), text.rend() - caret);
+    anchor = -1;
+    if (ed.hasSelection()) {
+      anchor = ed.selectionStart == (int)caret ? ed.selectionEnd
+                                               : ed.selectionStart;
+      anchor = std::min(anchor, (long long)text.size());
+    }
+  }
+
+  std::string text() const {
+    std::string text = before;
+    text.append(after.rbegin(), after.rend());
+    return text;
+  }
+
+  void moveTo(size_t target) {
+    size_t caret = pos();
+    if (target < caret) {
+      after.append(before.rbegin(), before.rbegin() + (caret - target));
+      before.resize(target);
+    } else if (target > caret) {
+      size_t n = std::min(target - caret, after.size());
+      before.append(after.rbegin(), after.rbegin() + n);
+      after.resize(after.size() - n);
+    }
+  }
+
+  // First '\n' at or after from (from >= pos()), or size()
+  size_t newlineFrom(size_t from) const {
+    if (from >= size())
+      return size();
+    size_t i = after.rfind('\n', after.size() - 1 - (from - pos()));
+    return i == std::string::npos ? size() : pos() + (after.size() - 1 - i);
+  }
+
+  // Start of the line holding offset at (at <= pos())
+  size_t lineStart(size_t at) const {
+    if (at == 0)
+      return 0;
+    size_t i = before.rfind('\n', at - 1);
+    return i == std::string::npos ? 0 : i + 1;
+  }
+
+  bool eraseSelection() {
+    if (anchor < 0 || (size_t)anchor == pos()) {
+      anchor = -1;
+      return false;
+    }
+    if ((size_t)anchor < pos())
+      before.resize((size_t)anchor);
+    else
+      after.resize(after.size() - ((size_t)anchor - pos()));
+    anchor = -1;
+    return true;
+  }
+
+  // Shift extends the selection; otherwise it is dropped
+  void select(bool extend) {
+    if (!extend)
+      anchor = -1;
+    else if (anchor < 0)
+      anchor = (long long)pos();
+  }
+
+  // One motion, as the editor's keyboard handler does it. False if the
+  // caret could not move at all.
+  bool move(Macros::Op op, bool extend) {
+    size_t caret = pos();
+    size_t start = lineStart(caret);
+    size_t col = caret - start;
+    switch (op) {
+    case Macros::Op::Left:
+    case Macros::Op::Right: {
+      bool left = op == Macros::Op::Left;
+      if (!extend && anchor >= 0 && (size_t)anchor != caret) {
+        moveTo(left ? std::min((size_t)anchor, caret)
+                    : std::max((size_t)anchor, caret));
+        anchor = -1;
+        return true;
+      }
+      if (left ? caret == 0 : caret == size())
+        return false;
+      select(extend);
+      moveTo(left ? caret - 1 : caret + 1);
+      return true;
+    }
+    case Macros::Op::Up: {
+      if (start == 0)
+        return false;
+      size_t prev = lineStart(start - 1);
+      select(extend);
+      moveTo(prev + std::min(col, start - 1 - prev));
+      return true;
+    }
+    case Macros::Op::Down: {
+      size_t end = newlineFrom(caret);
+      if (end == size())
+        return false;
+      size_t next = newlineFrom(end + 1);
+      select(extend);
+      moveTo(end + 1 + std::min(col, next - (end + 1)));
+      return true;
+    }
+    case Macros::Op::Home:
+      select(extend);
+      moveTo(start);
+      return true;
+    case Macros::Op::End:
+      select(extend);
+      moveTo(newlineFrom(caret));
+      return true;
+    default:
+      return true;
+    }
+  }
+};
+
+} // namespace
+
+// Puts the replayed text back as one edit: only the lines that differ are
+// replaced, and the caret and selection follow
+static void store(TextEditor &ed, const SplitText &split) {
+  ed.applyExternalText(split.text());
+  ed.cursorIndex = (int)split.pos();
+  if (split.anchor >= 0 && (size_t)split.anchor != split.pos()) {
+    ed.selectionStart = (int)split.anchor;
+    ed.selectionEnd = (int)split.pos();
+  } else {
+    ed.selectionStart = ed.selectionEnd = -1;
+  }
+  ed.caretFollow = true;
+}
+
+long long Macros::play(long long times) {
+  if (code_.empty())
+    return -1;
+  if (editor_->largeView_->active()) {
+    editor_->log(LogSeverity::Warning,
+                 "Macros can't run on a file opened in large file mode");
+    return 0;
+  }
+
+  editor_->beginTransaction();
+  SplitText split;
+  split.load(*editor_);
+  long long runs = 0;
+  bool stopped = false;
+  while (runs < times && !stopped) {
+    size_t ip = 0;
+    while (ip < code_.size() && !stopped) {
+      uint8_t code = code_[ip++];
+      Op op = (Op)(code & ~kSelect);
+      bool extend = (code & kSelect) != 0;
+      uint64_t count = getVarint(code_, ip);
+
+      switch (op) {
+      case Op::Insert:
+        split.eraseSelection();
+        split.before.append((const char *)&code_[ip], (size_t)count);
+        ip += (size_t)count;
+        break;
+      case Op::Backspace:
+        if (split.eraseSelection())
+          count--;
+        count = std::min<uint64_t>(count, split.before.size());
+        split.before.resize(split.before.size() - (size_t)count);
+        break;
+      case Op::Delete:
+        if (split.eraseSelection())
+          count--;
+        count = std::min<uint64_t>(count, split.after.size());
+        split.after.resize(split.after.size() - (size_t)count);
+        break;
+      case Op::SelectAll:
+        split.moveTo(split.size());
+        split.anchor = 0;
+        break;
+      case Op::Command: {
+        // Commands see the real buffer, so the text is put back first;
+        // the transaction is closed around them since some (new, close,
+        // reload) replace the buffer
+        std::string name((const char *)&code_[ip], (size_t)count);
+        ip += (size_t)count;
+        store(*editor_, split);
+        editor_->commitTransaction();
+        auto &commands = editor_->commands_->getCommands();
+        auto it = commands.find(name);
+        if (it != commands.end())
+          it->second();
+        editor_->beginTransaction();
+        split.load(*editor_);
+        break;
+      }
+      default:
+        for (uint64_t i = 0; i < count && !stopped; ++i)
+          stopped = !split.move(op, extend);
+        break;
+      }
+    }
+    if (!stopped)
+      runs++;
+  }
+  store(*editor_, split);
+  editor_->commitTransaction();
+  return runs;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class TextEditor;
+
+// Keyboard macros. While recording, the keyboard handler and the command
+// box report each editing step, stored as bytecode: one opcode byte (bit 7
+// set when Shift extends the selection) and a varint operand, a repeat
+// count for motions and erases or a byte length before inserted text and
+// command names. Runs of the same step merge into one instruction. Steps
+// taken with extra carets can't be expressed; the keyboard handler ends a
+// recording as soon as MultiCursor becomes active.
+//
+// play() does not go through the editor per step. It splits the text at
+// the caret into two strings, the text before it and the text after it
+// reversed, so every step only touches the bytes next to the caret. The
+// result goes back into the buffer as one edit transaction (one undo step,
+// one line cache refresh). A motion that can't move, such as Down on the
+// last line, ends the replay, so "play 100000" stops at the end of the
+// buffer.
+class Macros {
+public:
+  enum class Op : uint8_t {
+    Insert,
+    Backspace, // erases the selection, or the count bytes before the caret
+    Delete,    // erases the selection, or the count bytes after it
+    Left,
+    Right,
+    Up,
+    Down,
+    Home,
+    End,
+    SelectAll,
+    Command, // an EditorCommands command, by name
+  };
+  static constexpr uint8_t kSelect = 0x80;
+
+  Macros(TextEditor *editor);
+
+  bool recording() const { return recording_; }
+  void startRecording();
+  void stopRecording();
+  const std::vector<uint8_t> &bytecode() const { return code_; }
+
+  // Called for each step taken while recording; ignored otherwise
+  void recordInsert(const std::string &text);
+  void recordStep(Op op, bool select = false);
+  void recordCommand(const std::string &name);
+
+  // Replays the last macro up to `times` times as one undo step. Returns
+  // the number of complete runs, or -1 if there is nothing to play.
+  long long play(long long times);
+
+private:
+  void emit(Op op, uint8_t flags, uint64_t count, const char *data = nullptr,
+            size_t length = 0);
+
+  TextEditor *editor_;
+  bool recording_ = false;
+  std::vector<uint8_t> code_;      // last finished macro
+  std::vector<uint8_t> building_;  // the one being recorded
+  size_t lastOp_ = (size_t)-1;     // offset of building_'s last instruction
+};
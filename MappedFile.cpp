@@ -0,0 +1,62 @@
+#include "MappedFile.hpp"
+#include <fstream>
+#include <sstream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+bool MappedFile::open(const std::string &path) {
+  close();
+#ifndef _WIN32
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return false;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    ::close(fd);
+    return false;
+  }
+  size_ = (size_t)st.st_size;
+  if (size_ > 0) {
+    void *p = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p == MAP_FAILED) {
+      ::close(fd);
+      size_ = 0;
+      return false;
+    }
+    madvise(p, size_, MADV_SEQUENTIAL);
+    data_ = (const char *)p;
+    mapped_ = true;
+  }
+  ::close(fd); // the mapping stays valid
+  open_ = true;
+  return true;
+#else
+  std::ifstream file(path, std::ios::binary);
+  if (!file.is_open())
+    return false;
+  std::ostringstream buffer;
+  buffer << file.rdbuf();
+  fallback_ = buffer.str();
+  data_ = fallback_.data();
+  size_ = fallback_.size();
+  open_ = true;
+  return true;
+#endif
+}
+
+void MappedFile::close() {
+#ifndef _WIN32
+  if (mapped_)
+    munmap((void *)data_, size_);
+#endif
+  fallback_.clear();
+  data_ = nullptr;
+  size_ = 0;
+  open_ = false;
+  mapped_ = false;
+}
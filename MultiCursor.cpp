@@ -0,0 +1,349 @@
+#include "MultiCursor.hpp"
+#include "BufferSearch.hpp"
+#include "TextEditor.hpp"
+
+MultiCursor::MultiCursor(TextEditor *editor) : editor_(editor) {}
+
+bool MultiCursor::active() const {
+  return !extra_.empty() && version_ == editor_->contentVersion;
+}
+
+bool MultiCursor::addNextOccurrence() {
+  TextEditor &ed = *editor_;
+  if (!active()) {
+    extra_.clear();
+    lastAdded_ = -1;
+  }
+
+  if (!ed.hasSelection()) {
+    if (!extra_.empty())
+      return false;
+    // The word under the caret, as wordAtCursor() finds it
+    const int window = 128;
+    int size = (int)ed.content.size();
+    int pos = std::clamp(ed.cursorIndex, 0, size);
+    int from = std::max(pos - window, 0);
+    std::string text =
+        ed.content.substr((size_t)from, (size_t)(std::min(size, pos + window) - from));
+    int start = pos - from, end = start;
+    while (start > 0 && WordIndex::isWordChar((unsigned char)text[start - 1]))
+      --start;
+    while (end < (int)text.size() &&
+           WordIndex::isWordChar((unsigned char)text[end]))
+      ++end;
+    if (start == end)
+      return false;
+    ed.selectionStart = from + start;
+    ed.selectionEnd = ed.cursorIndex = from + end;
+    lastAdded_ = ed.cursorIndex;
+    return true;
+  }
+
+  int lo = std::min(ed.selectionStart, ed.selectionEnd);
+  int hi = std::max(ed.selectionStart, ed.selectionEnd);
+  std::string needle = ed.content.substr((size_t)lo, (size_t)(hi - lo));
+  if (lastAdded_ < 0)
+    lastAdded_ = hi;
+
+  // Occurrences already selected are passed over, at most once each
+  size_t from = (size_t)lastAdded_;
+  for (size_t tries = 0; tries <= extra_.size() + 1; ++tries) {
+    size_t hit = BufferSearch::findNext(ed.content, needle, from);
+    if (hit == BufferSearch::npos)
+      return false;
+    int start = (int)hit, end = start + (int)needle.size();
+    auto it = std::lower_bound(
+        extra_.begin(), extra_.end(), start,
+        [](const Caret &c, int value) { return c.lo() < value; });
+    bool taken = (start < hi && end > lo) ||
+                 (it != extra_.end() && it->lo() < end) ||
+                 (it != extra_.begin() && std::prev(it)->hi() > start);
+    if (!taken) {
+      extra_.insert(it, Caret{end, start});
+      lastAdded_ = end;
+      version_ = ed.contentVersion;
+      return true;
+    }
+    from = (size_t)end;
+  }
+  return false;
+}
+
+size_t MultiCursor::addOnSelectedLines() {
+  TextEditor &ed = *editor_;
+  if (!ed.hasSelection())
+    return count();
+  ed.refreshLineCache();
+  const auto &lines = ed.lineCache;
+  if (lines.empty())
+    return count();
+  int lo = std::min(ed.selectionStart, ed.selectionEnd);
+  int hi = std::max(ed.selectionStart, ed.selectionEnd);
+
+  size_t line = 0;
+  int start = 0;
+  while (line + 1 < lines.size() &&
+         lo > start + (int)lines[line].text.size()) {
+    start += (int)lines[line].text.size() + 1;
+    line++;
+  }
+  // Down to the line holding the selection's end, unless it ends at the
+  // very start of that line
+  extra_.clear();
+  while (true) {
+    int end = start + (int)lines[line].text.size();
+    extra_.push_back(Caret{end, -1});
+    if (hi <= end || line + 1 >= lines.size() || end + 1 == hi)
+      break;
+    start = end + 1;
+    line++;
+  }
+
+  ed.cursorIndex = extra_.back().index;
+  ed.selectionStart = ed.selectionEnd = -1;
+  ed.caretFollow = true;
+  extra_.pop_back();
+  version_ = ed.contentVersion;
+  lastAdded_ = -1;
+  return count();
+}
+
+void MultiCursor::gather() {
+  TextEditor &ed = *editor_;
+  int size = (int)ed.content.size();
+  work_.clear();
+  if (active()) {
+    for (const Caret &c : extra_)
+      work_.push_back({c, false});
+  }
+  Caret primary{ed.cursorIndex, -1};
+  if (ed.hasSelection())
+    primary.anchor = ed.selectionStart == ed.cursorIndex ? ed.selectionEnd
+                                                         : ed.selectionStart;
+  work_.push_back({primary, true});
+  for (Work &w : work_) {
+    w.caret.index = std::clamp(w.caret.index, 0, size);
+    if (w.caret.anchor >= 0)
+      w.caret.anchor = std::clamp(w.caret.anchor, 0, size);
+  }
+  sortAndMerge();
+}
+
+void MultiCursor::sortAndMerge() {
+  std::sort(work_.begin(), work_.end(), [](const Work &a, const Work &b) {
+    return a.caret.lo() != b.caret.lo() ? a.caret.lo() < b.caret.lo()
+                                        : a.caret.hi() < b.caret.hi();
+  });
+  // Overlapping carets become one; so do a caret and a selection it
+  // touches, while two selections may share an end
+  size_t out = 0;
+  for (size_t i = 0; i < work_.size(); ++i) {
+    const Work &w = work_[i];
+    if (out > 0) {
+      Work &back = work_[out - 1];
+      int lo = w.caret.lo(), hi = w.caret.hi();
+      bool empty = lo == hi || back.caret.lo() == back.caret.hi();
+      if (lo < back.caret.hi() || (lo == back.caret.hi() && empty)) {
+        int mergedLo = back.caret.lo();
+        int mergedHi = std::max(back.caret.hi(), hi);
+        back.caret = Caret{mergedHi, mergedHi > mergedLo ? mergedLo : -1};
+        back.primary = back.primary || w.primary;
+        continue;
+      }
+    }
+    work_[out++] = w;
+  }
+  work_.resize(out);
+}
+
+void MultiCursor::scatter() {
+  TextEditor &ed = *editor_;
+  sortAndMerge();
+  extra_.clear();
+  for (const Work &w : work_) {
+    if (!w.primary) {
+      extra_.push_back(w.caret);
+      continue;
+    }
+    ed.cursorIndex = w.caret.index;
+    if (w.caret.anchor >= 0 && w.caret.anchor != w.caret.index) {
+      ed.selectionStart = w.caret.anchor;
+      ed.selectionEnd = w.caret.index;
+    } else {
+      ed.selectionStart = ed.selectionEnd = -1;
+    }
+  }
+  version_ = ed.contentVersion;
+  ed.caretFollow = true;
+}
+
+void MultiCursor::replace(const std::string &text) {
+  TextEditor &ed = *editor_;
+  std::vector<PieceTable::Splice> edits;
+  std::vector<Piece> inserts;
+  // Every caret gets the same text, so it goes into the add buffer once
+  if (!text.empty())
+    inserts.push_back(ed.content.append(text.data(), text.size()));
+  int length = (int)text.size();
+
+  int shift = 0;
+  int prevEnd = 0;
+  for (size_t k = 0; k < work_.size(); ++k) {
+    Caret &c = work_[k].caret;
+    int lo = ranges_[k].first, hi = ranges_[k].second;
+    if (lo < 0 || (lo == hi && length == 0)) {
+      c.index += shift;
+      if (c.anchor >= 0)
+        c.anchor += shift;
+      continue;
+    }
+    lo = std::max(lo, prevEnd);
+    hi = std::max(hi, lo);
+    edits.push_back({(size_t)lo, (size_t)(hi - lo), 0, inserts.size()});
+    c = Caret{lo + shift + length, -1};
+    shift += length - (hi - lo);
+    prevEnd = hi;
+  }
+  ed.applySplices(std::move(edits), std::move(inserts));
+}
+
+void MultiCursor::insert(const std::string &text) {
+  gather();
+  ranges_.clear();
+  for (const Work &w : work_)
+    ranges_.push_back({w.caret.lo(), w.caret.hi()});
+  replace(text);
+  scatter();
+}
+
+void MultiCursor::backspace() {
+  gather();
+  ranges_.clear();
+  for (const Work &w : work_) {
+    const Caret &c = w.caret;
+    if (c.lo() != c.hi())
+      ranges_.push_back({c.lo(), c.hi()});
+    else if (c.index > 0)
+      ranges_.push_back({c.index - 1, c.index});
+    else
+      ranges_.push_back({-1, -1});
+  }
+  replace("");
+  scatter();
+}
+
+void MultiCursor::deleteForward() {
+  gather();
+  int size = (int)editor_->content.size();
+  ranges_.clear();
+  for (const Work &w : work_) {
+    const Caret &c = w.caret;
+    if (c.lo() != c.hi())
+      ranges_.push_back({c.lo(), c.hi()});
+    else if (c.index < size)
+      ranges_.push_back({c.index, c.index + 1});
+    else
+      ranges_.push_back({-1, -1});
+  }
+  replace("");
+  scatter();
+}
+
+void MultiCursor::eraseSelections() {
+  gather();
+  ranges_.clear();
+  for (const Work &w : work_) {
+    const Caret &c = w.caret;
+    if (c.lo() != c.hi())
+      ranges_.push_back({c.lo(), c.hi()});
+    else
+      ranges_.push_back({-1, -1});
+  }
+  replace("");
+  scatter();
+}
+
+void MultiCursor::move(Motion motion, bool select) {
+  TextEditor &ed = *editor_;
+  gather();
+  ed.refreshLineCache();
+  const auto &lines = ed.lineCache;
+  int size = (int)ed.content.size();
+
+  // Carets are in order, so their lines are found in one sweep
+  size_t line = 0;
+  int start = 0;
+  for (Work &w : work_) {
+    Caret &c = w.caret;
+    while (line + 1 < lines.size() &&
+           c.index > start + (int)lines[line].text.size()) {
+      start += (int)lines[line].text.size() + 1;
+      line++;
+    }
+    int length = lines.empty() ? size : (int)lines[line].text.size();
+    int col = c.index - start;
+
+    // As the keyboard handler moves the editor's own caret
+    int target = c.index;
+    switch (motion) {
+    case Motion::Left:
+    case Motion::Right:
+      if (!select && c.lo() != c.hi()) {
+        c = Caret{motion == Motion::Left ? c.lo() : c.hi(), -1};
+        continue;
+      }
+      target = motion == Motion::Left ? std::max(c.index - 1, 0)
+                                      : std::min(c.index + 1, size);
+      break;
+    case Motion::Up: {
+      if (line == 0)
+        continue;
+      int above = (int)lines[line - 1].text.size();
+      target = start - above - 1 + std::min(col, above);
+      break;
+    }
+    case Motion::Down: {
+      if (line + 1 >= lines.size())
+        continue;
+      int below = (int)lines[line + 1].text.size();
+      target = start + length + 1 + std::min(col, below);
+      break;
+    }
+    case Motion::Home:
+      target = start;
+      break;
+    case Motion::End:
+      target = start + length;
+      break;
+    }
+    if (!select)
+      c.anchor = -1;
+    else if (c.anchor < 0)
+      c.anchor = c.index;
+    c.index = target;
+  }
+  scatter();
+}
+
+std::string MultiCursor::selectedText() const {
+  TextEditor &ed = *editor_;
+  std::vector<Caret> carets;
+  if (active())
+    carets = extra_;
+  if (ed.hasSelection())
+    carets.push_back(Caret{ed.selectionEnd, ed.selectionStart});
+  std::sort(carets.begin(), carets.end(), [](const Caret &a, const Caret &b) {
+    return a.lo() < b.lo();
+  });
+
+  std::string text = ed.content.getText();
+  std::string out;
+  for (const Caret &c : carets) {
+    if (c.lo() == c.hi() || c.hi() > (int)text.size())
+      continue;
+    if (!out.empty())
+      out += '\n';
+    out.append(text, (size_t)c.lo(), (size_t)(c.hi() - c.lo()));
+  }
+  return out;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+class TextEditor;
+
+// Carets beside the editor's own one (cursorIndex and its selection),
+// added on the next occurrence of the selection or at the end of every
+// line it covers. While there are any, typing, erasing and the motion keys
+// act on all of them: the edits are gathered sorted by offset and made in
+// one pass over the piece table (TextEditor::applySplices), as one undo
+// step, and motions find every caret's line in one sweep over the line
+// cache. Any edit made some other way (undo, a plugin, a buffer switch)
+// drops the extra carets.
+class MultiCursor {
+public:
+  struct Caret {
+    int index;
+    int anchor; // other end of its selection, or -1
+    int lo() const { return anchor < 0 ? index : std::min(index, anchor); }
+    int hi() const { return anchor < 0 ? index : std::max(index, anchor); }
+  };
+  enum class Motion { Left, Right, Up, Down, Home, End };
+
+  MultiCursor(TextEditor *editor);
+
+  bool active() const;
+  // Carets, the editor's own included
+  size_t count() const { return active() ? extra_.size() + 1 : 1; }
+  // The extra ones, sorted and not overlapping
+  const std::vector<Caret> &extra() const { return extra_; }
+  void clear() { extra_.clear(); }
+
+  // Without a selection, selects the word under the caret. Otherwise adds
+  // a caret selecting the next occurrence of the selected text after the
+  // one added last, wrapping around. False if there is nothing to add.
+  bool addNextOccurrence();
+  // A caret at the end of each line the selection touches; the editor's
+  // own goes to the last one. Returns the number of carets.
+  size_t addOnSelectedLines();
+
+  void insert(const std::string &text);
+  void backspace();
+  void deleteForward();
+  // Erases every caret's selection
+  void eraseSelections();
+  void move(Motion motion, bool select);
+  // Each caret's selected text, one per line, for the clipboard
+  std::string selectedText() const;
+
+private:
+  struct Work {
+    Caret caret;
+    bool primary;
+  };
+  // All carets, the editor's included, into work_: clamped to the text,
+  // sorted, and merged where they overlap
+  void gather();
+  // work_ back into extra_ and the editor's caret, merging again
+  void scatter();
+  void sortAndMerge();
+  // Replaces ranges_[k] by text for each caret work_[k] that has one
+  // (first >= 0), in one pass and one undo step; the carets end up after
+  // the text, or move along with it
+  void replace(const std::string &text);
+
+  TextEditor *editor_;
+  std::vector<Caret> extra_;
+  size_t version_ = 0;    // editor contentVersion extra_ is valid for
+  int lastAdded_ = -1;    // end of the occurrence added last
+  std::vector<Work> work_;
+  std::vector<std::pair<int, int>> ranges_; // per caret in work_
+};
@@ -0,0 +1,34 @@
+#include "OutputLog.hpp"
+#include <algorithm>
+
+OutputLog::OutputLog(size_t capacity)
+    : capacity_(std::clamp<size_t>(capacity, 1, kMaxCapacity)) {}
+
+void OutputLog::push(OutputLine line) {
+  pushed_++;
+  if (lines_.size() < capacity_) {
+    lines_.push_back(std::move(line));
+    return;
+  }
+  lines_[head_] = std::move(line);
+  head_ = (head_ + 1) % lines_.size();
+}
+
+void OutputLog::clear() {
+  lines_.clear();
+  head_ = 0;
+}
+
+void OutputLog::setCapacity(size_t capacity) {
+  capacity = std::clamp<size_t>(capacity, 1, kMaxCapacity);
+  if (capacity == capacity_)
+    return;
+  size_t keep = std::min(lines_.size(), capacity);
+  std::vector<OutputLine> lines;
+  lines.reserve(keep);
+  for (size_t i = lines_.size() - keep; i < lines_.size(); ++i)
+    lines.push_back(std::move(lines_[(head_ + i) % lines_.size()]));
+  lines_ = std::move(lines);
+  head_ = 0;
+  capacity_ = capacity;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "imgui.h"
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum class LogSeverity : uint8_t { Info, Warning, Error };
+
+struct OutputLine {
+  ImTextureID icon;
+  std::string text;
+  LogSeverity severity = LogSeverity::Info;
+  std::chrono::system_clock::time_point time{};
+};
+
+// Output panel history: a ring holding the newest capacity() lines. Adding
+// a line to a full log overwrites the oldest one in place. Storage grows
+// with use, so a large capacity costs nothing until it fills.
+class OutputLog {
+public:
+  static constexpr size_t kMaxCapacity = 1000000;
+
+  explicit OutputLog(size_t capacity = 10000);
+
+  void push(OutputLine line);
+  void clear();
+  // Keeps the newest lines that still fit
+  void setCapacity(size_t capacity);
+  size_t capacity() const { return capacity_; }
+  size_t size() const { return lines_.size(); }
+  bool empty() const { return lines_.empty(); }
+  // Line i counting from the oldest retained one
+  const OutputLine &operator[](size_t i) const {
+    return lines_[(head_ + i) % lines_.size()];
+  }
+  // Lines ever pushed; line i is number pushed() - size() + i
+  uint64_t pushed() const { return pushed_; }
+
+private:
+  std::vector<OutputLine> lines_;
+  size_t head_ = 0; // oldest line once full
+  size_t capacity_;
+  uint64_t pushed_ = 0;
+};
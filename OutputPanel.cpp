@@ -1,8 +1,15 @@
 #include "OutputPanel.hpp"
 #include "EditorCommands.hpp"
 #include "TextEditor.hpp"
+#include <algorithm>
+#include <cctype>
+#include <ctime>
+#include <filesystem>
 #include <misc/cpp/imgui_stdlib.h>
 
+static const float kIconSize = 18.0f;
+static const float kIconGap = 6.0f;
+
 OutputPanel::OutputPanel(TextEditor *editor, EditorCommands *commands)
     : editor_(editor), commands_(commands) {}
 
@@ -31,22 +38,46 @@ void OutputPanel::render(ImVec2 workPos, ImVec2 workSize, float outputHeight,
       }
     }
 
+    static const char *kFilters[] = {"All", "Warnings", "Errors"};
+    ImGui::SetNextItemWidth(110);
+    ImGui::Combo("##severity", &minSeverity_, kFilters, 3);
+    TaskRunner &tasks = commands_->getTasks();
+    if (tasks.running()) {
+      ImGui::SameLine();
+      if (ImGui::SmallButton("Stop"))
+        tasks.stop();
+      ImGui::SameLine();
+      ImGui::TextDisabled("Running: %s", tasks.command().c_str());
+    }
+    if (!editor_->searchStatus.empty()) {
+      ImGui::SameLine();
+      ImGui::TextDisabled("%s", editor_->searchStatus.c_str());
+    }
+
     ImGui::Separator();
     ImGui::BeginChild("OutputText");
 
-    for (const auto &line : editor_->outputLines) {
-      ImVec2 pos = ImGui::GetCursorScreenPos();
-      float iconSize = 18.0f;
-
-      if (line.icon != (ImTextureID)0) {
-        ImGui::GetWindowDrawList()->AddImage(
-            line.icon, pos, ImVec2(pos.x + iconSize, pos.y + iconSize),
-            ImVec2(0, 0), ImVec2(1, 1), IM_COL32_WHITE);
-        ImGui::SetCursorScreenPos(ImVec2(pos.x + iconSize + 6, pos.y));
-      }
-
-      ImGui::TextWrapped("%s", line.text.c_str());
+    // Only the lines in view are submitted; the rest is one dummy item
+    // sized from the cached heights
+    const OutputLog &log = editor_->outputLines;
+    syncHeights(ImGui::GetContentRegionAvail().x);
+    double base = heightTop_.front();
+    double scroll = ImGui::GetScrollY();
+    double bottom = scroll + ImGui::GetWindowHeight();
+    size_t first = 0;
+    if (!log.empty()) {
+      auto it = std::upper_bound(heightTop_.begin(), heightTop_.end() - 1,
+                                 base + scroll);
+      first = (size_t)std::max<ptrdiff_t>(0, it - heightTop_.begin() - 1);
     }
+    float startY = ImGui::GetCursorPosY();
+    ImGui::SetCursorPosY(startY + (float)(heightTop_[first] - base));
+    for (size_t i = first; i < log.size() && heightTop_[i] - base < bottom;
+         ++i)
+      if (shown(log[i]))
+        renderLine(log[i]);
+    ImGui::SetCursorPosY(startY + (float)(heightTop_.back() - base));
+    ImGui::Dummy(ImVec2(0.0f, 0.0f));
 
     // Auto-scroll to bottom
     if (ImGui::GetScrollY() >= ImGui::GetScrollMaxY()) {
@@ -57,3 +88,137 @@ void OutputPanel::render(ImVec2 workPos, ImVec2 workSize, float outputHeight,
   }
   ImGui::End();
 }
+
+bool OutputPanel::shown(const OutputLine &line) const {
+  return (int)line.severity >= minSeverity_;
+}
+
+// Errors logged from other threads carry no icon; they get the error icon
+ImTextureID OutputPanel::iconFor(const OutputLine &line) const {
+  if (line.icon != (ImTextureID)0 || line.severity != LogSeverity::Error)
+    return line.icon;
+  auto error = editor_->icons.find("error");
+  return error != editor_->icons.end() ? error->second : (ImTextureID)0;
+}
+
+void OutputPanel::renderLine(const OutputLine &line) {
+  ImVec2 pos = ImGui::GetCursorScreenPos();
+  ImTextureID icon = iconFor(line);
+  if (icon != (ImTextureID)0) {
+    ImGui::GetWindowDrawList()->AddImage(
+        icon, pos, ImVec2(pos.x + kIconSize, pos.y + kIconSize),
+        ImVec2(0, 0), ImVec2(1, 1), IM_COL32_WHITE);
+    ImGui::SetCursorScreenPos(ImVec2(pos.x + kIconSize + kIconGap, pos.y));
+  }
+  bool warning = line.severity == LogSeverity::Warning;
+  if (warning)
+    ImGui::PushStyleColor(ImGuiCol_Text, ImVec4(1.0f, 0.8f, 0.3f, 1.0f));
+  ImGui::TextWrapped("%s", line.text.c_str());
+  if (warning)
+    ImGui::PopStyleColor();
+  if (!ImGui::IsItemHovered())
+    return;
+
+  // Only the hovered line is parsed, so locations cost nothing otherwise
+  std::string path;
+  int lineNo = 0, col = 0;
+  bool location = parseLocation(line.text, path, lineNo, col);
+  if (location)
+    ImGui::SetMouseCursor(ImGuiMouseCursor_Hand);
+  if (location && ImGui::IsItemClicked()) {
+    std::error_code ec;
+    if (std::filesystem::is_regular_file(path, ec)) {
+      editor_->openFile(path);
+      editor_->gotoLine(lineNo - 1, std::max(col - 1, 0));
+    } else {
+      editor_->addOutput(editor_->icons["error"], "No such file: " + path);
+    }
+  }
+  if (line.time != std::chrono::system_clock::time_point{}) {
+    std::time_t time = std::chrono::system_clock::to_time_t(line.time);
+    char stamp[16];
+    std::strftime(stamp, sizeof(stamp), "%H:%M:%S", std::localtime(&time));
+    if (location)
+      ImGui::SetTooltip("%s  (click to open %s:%d)", stamp, path.c_str(),
+                        lineNo);
+    else
+      ImGui::SetTooltip("%s", stamp);
+  }
+}
+
+static int readNumber(const std::string &text, size_t &pos) {
+  int value = 0;
+  while (pos < text.size() && std::isdigit((unsigned char)text[pos]))
+    value = value * 10 + (text[pos++] - '0');
+  return value;
+}
+
+bool OutputPanel::parseLocation(const std::string &text, std::string &path,
+                                int &line, int &col) {
+  size_t tokenStart = 0;
+  for (size_t i = 0; i + 1 < text.size(); ++i) {
+    char c = text[i];
+    if (c == ' ' || c == '\t' || c == '\'' || c == '"') {
+      tokenStart = i + 1;
+      continue;
+    }
+    if ((c != ':' && c != '(') ||
+        !std::isdigit((unsigned char)text[i + 1]) || i == tokenStart)
+      continue;
+    // A path has a file extension or a directory; this skips "12:30:05"
+    std::string candidate = text.substr(tokenStart, i - tokenStart);
+    if (candidate.find_first_of("./\\") == std::string::npos ||
+        !std::isalpha((unsigned char)candidate.back()))
+      continue;
+    size_t pos = i + 1;
+    line = readNumber(text, pos);
+    col = 0;
+    char sep = c == '(' ? ',' : ':';
+    if (pos + 1 < text.size() && text[pos] == sep &&
+        std::isdigit((unsigned char)text[pos + 1])) {
+      pos++;
+      col = readNumber(text, pos);
+    }
+    if (line <= 0)
+      continue;
+    path = candidate;
+    return true;
+  }
+  return false;
+}
+
+// Height TextWrapped() will give the line, item spacing included
+float OutputPanel::lineHeight(const OutputLine &line, float width) const {
+  if (!shown(line))
+    return 0.0f;
+  if (iconFor(line) != (ImTextureID)0)
+    width -= kIconSize + kIconGap;
+  const char *text = line.text.c_str();
+  float height = ImGui::CalcTextSize(text, text + line.text.size(), false,
+                                     std::max(width, 1.0f))
+                     .y;
+  return height + ImGui::GetStyle().ItemSpacing.y;
+}
+
+void OutputPanel::syncHeights(float width) {
+  const OutputLog &log = editor_->outputLines;
+  uint64_t first = log.pushed() - log.size();
+  float font = ImGui::GetFontSize();
+  if (width != heightWidth_ || font != heightFont_ ||
+      minSeverity_ != heightSeverity_ || first < heightFirst_) {
+    heightTop_.assign(1, 0.0);
+    heightFirst_ = first;
+    heightWidth_ = width;
+    heightFont_ = font;
+    heightSeverity_ = minSeverity_;
+  }
+  // Lines that fell off the front of the ring
+  while (heightFirst_ < first && heightTop_.size() > 1) {
+    heightTop_.pop_front();
+    heightFirst_++;
+  }
+  if (heightTop_.size() == 1)
+    heightFirst_ = first;
+  for (size_t i = heightTop_.size() - 1; i < log.size(); ++i)
+    heightTop_.push_back(heightTop_.back() + lineHeight(log[i], width));
+}
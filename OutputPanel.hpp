@@ -1,10 +1,13 @@
 #pragma once
 
 #include "imgui.h"
+#include <cstdint>
+#include <deque>
 #include <string>
 
 class TextEditor;
 class EditorCommands;
+struct OutputLine;
 
 class OutputPanel {
 public:
@@ -14,8 +17,30 @@ public:
   void render(ImVec2 workPos, ImVec2 workSize, float outputHeight,
               float explorerWidth);
 
+  // Finds a compiler-style location ("src/a.cpp:12:5", "a.lua:3",
+  // "a.cpp(12,5)") in text. line and col are 1-based; col is 0 if absent.
+  static bool parseLocation(const std::string &text, std::string &path,
+                            int &line, int &col);
+
 private:
+  bool shown(const OutputLine &line) const;
+  ImTextureID iconFor(const OutputLine &line) const;
+  // Brings heightTop_ in line with the log; every line is measured again
+  // only when the wrap width, font size or filter changes
+  void syncHeights(float width);
+  float lineHeight(const OutputLine &line, float width) const;
+  void renderLine(const OutputLine &line);
+
   TextEditor *editor_;
   EditorCommands *commands_;
   std::string commandInput_;
+  int minSeverity_ = 0; // a LogSeverity; lines below it are hidden
+
+  // heightTop_[k] is the y of line heightFirst_ + k (numbered as in
+  // OutputLog::pushed()), plus one entry for the bottom of the last line
+  std::deque<double> heightTop_{0.0};
+  uint64_t heightFirst_ = 0;
+  float heightWidth_ = -1.0f;
+  float heightFont_ = 0.0f;
+  int heightSeverity_ = 0;
 };
@@ -0,0 +1,95 @@
+#include "PagedFile.hpp"
+#include <algorithm>
+
+#ifdef _WIN32
+#define donut_fseek _fseeki64
+#define donut_ftell _ftelli64
+#else
+#define donut_fseek fseeko
+#define donut_ftell ftello
+#endif
+
+bool PagedFile::open(const std::string &path) {
+  close();
+  file_ = std::fopen(path.c_str(), "rb");
+  if (!file_)
+    return false;
+  // Reads are page-sized and cached here, so stdio's buffer is redundant
+  std::setvbuf(file_, nullptr, _IONBF, 0);
+  if (donut_fseek(file_, 0, SEEK_END) != 0) {
+    close();
+    return false;
+  }
+  size_ = (uint64_t)donut_ftell(file_);
+  return true;
+}
+
+bool PagedFile::refresh() {
+  if (!file_ || donut_fseek(file_, 0, SEEK_END) != 0)
+    return false;
+  uint64_t size = (uint64_t)donut_ftell(file_);
+  if (size != size_) {
+    // A partially filled last page no longer matches the file
+    pages_.erase(std::remove_if(pages_.begin(), pages_.end(),
+                                [](const Page &p) {
+                                  return p.bytes < kPageSize;
+                                }),
+                 pages_.end());
+    size_ = size;
+  }
+  return true;
+}
+
+void PagedFile::close() {
+  if (file_)
+    std::fclose(file_);
+  file_ = nullptr;
+  size_ = 0;
+  pages_.clear();
+}
+
+void PagedFile::setMaxPages(size_t pages) {
+  maxPages_ = std::max<size_t>(pages, 2);
+  while (pages_.size() > maxPages_) {
+    auto oldest = std::min_element(
+        pages_.begin(), pages_.end(),
+        [](const Page &a, const Page &b) { return a.lastUse < b.lastUse; });
+    pages_.erase(oldest);
+  }
+}
+
+const PagedFile::Page *PagedFile::page(uint64_t index) {
+  ++clock_;
+  for (auto &p : pages_) {
+    if (p.index == index) {
+      p.lastUse = clock_;
+      return &p;
+    }
+  }
+  if (!file_)
+    return nullptr;
+
+  // Reuse the least recently used page once the window is full
+  Page *slot;
+  if (pages_.size() < maxPages_) {
+    pages_.push_back(Page{index, clock_, 0, std::unique_ptr<char[]>(
+                                                new char[kPageSize])});
+    slot = &pages_.back();
+  } else {
+    slot = &*std::min_element(
+        pages_.begin(), pages_.end(),
+        [](const Page &a, const Page &b) { return a.lastUse < b.lastUse; });
+    slot->index = index;
+    slot->lastUse = clock_;
+  }
+
+  size_t want = (size_t)std::min<uint64_t>(kPageSize, size_ - index * kPageSize);
+  slot->bytes = 0;
+  if (donut_fseek(file_, (int64_t)(index * kPageSize), SEEK_SET) == 0)
+    slot->bytes = std::fread(slot->data.get(), 1, want, file_);
+  if (slot->bytes == 0) {
+    slot->index = ~0ull; // don't cache the failure
+    return nullptr;
+  }
+  return slot;
+}
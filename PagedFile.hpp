@@ -0,0 +1,74 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Random access to a file that may be larger than memory. Reads go through
+// a small cache of fixed-size pages; once it holds maxPages() pages the
+// least recently used one is dropped, so only a sliding window around the
+// current reads is ever resident. Not thread-safe: one reader per instance.
+class PagedFile {
+public:
+  static constexpr size_t kPageSize = 1 << 20;
+
+  PagedFile() = default;
+  ~PagedFile() { close(); }
+  PagedFile(const PagedFile &) = delete;
+  PagedFile &operator=(const PagedFile &) = delete;
+
+  bool open(const std::string &path);
+  void close();
+  bool isOpen() const { return file_ != nullptr; }
+  uint64_t size() const { return size_; }
+  // Re-reads the size of a file that is being appended to.
+  bool refresh();
+
+  void setMaxPages(size_t pages);
+  size_t maxPages() const { return maxPages_; }
+  size_t residentBytes() const { return pages_.size() * kPageSize; }
+
+  // Calls fn(const char *data, size_t len) for each resident run covering
+  // [pos, pos + len). Pointers are only valid during the call. Stops early
+  // if fn returns false; returns false if a page could not be read.
+  template <typename Fn> bool forEachChunk(uint64_t pos, uint64_t len, Fn &&fn);
+
+private:
+  struct Page {
+    uint64_t index;
+    uint64_t lastUse;
+    size_t bytes;
+    std::unique_ptr<char[]> data;
+  };
+
+  const Page *page(uint64_t index);
+
+  FILE *file_ = nullptr;
+  uint64_t size_ = 0;
+  size_t maxPages_ = 64;
+  uint64_t clock_ = 0;
+  std::vector<Page> pages_;
+};
+
+template <typename Fn>
+bool PagedFile::forEachChunk(uint64_t pos, uint64_t len, Fn &&fn) {
+  if (pos >= size_)
+    return true;
+  len = std::min(len, size_ - pos);
+  while (len > 0) {
+    const Page *p = page(pos / kPageSize);
+    size_t offset = (size_t)(pos % kPageSize);
+    if (!p || offset >= p->bytes)
+      return false;
+    size_t n = (size_t)std::min<uint64_t>(len, p->bytes - offset);
+    if (!fn(p->data.get() + offset, n))
+      return true;
+    pos += n;
+    len -= n;
+  }
+  return true;
+}
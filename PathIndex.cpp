@@ -0,0 +1,148 @@
+#include "PathIndex.hpp"
+#include "FileWatcher.hpp"
+#include "WorkspaceWalker.hpp"
+#include <algorithm>
+#include <chrono>
+
+namespace {
+const int kQuietMs = 150;     // publish once events pause this long...
+const int kMaxDelayMs = 1000; // ...or at least this often during a storm
+} // namespace
+
+PathIndex::~PathIndex() { stop(); }
+
+void PathIndex::start(const std::string &root) {
+  stop();
+  root_ = root;
+  stop_ = false;
+  thread_ = std::thread(&PathIndex::run, this);
+}
+
+void PathIndex::stop() {
+  stop_ = true;
+  if (thread_.joinable())
+    thread_.join();
+}
+
+std::shared_ptr<const FuzzyMatcher> PathIndex::snapshot() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return snapshot_;
+}
+
+std::string PathIndex::relative(const std::string &path) const {
+  if (path.size() > root_.size() + 1 && path.compare(0, root_.size(), root_) == 0 &&
+      path[root_.size()] == '/')
+    return path.substr(root_.size() + 1);
+  return path;
+}
+
+void PathIndex::add(const std::string &path) {
+  std::string rel = relative(path);
+  if (slots_.count(rel))
+    return;
+  slots_[rel] = paths_.size();
+  paths_.push_back(std::move(rel));
+}
+
+void PathIndex::remove(const std::string &path) {
+  auto it = slots_.find(relative(path));
+  if (it == slots_.end())
+    return;
+  size_t slot = it->second;
+  slots_.erase(it);
+  if (slot + 1 != paths_.size()) {
+    paths_[slot] = std::move(paths_.back());
+    slots_[paths_[slot]] = slot;
+  }
+  paths_.pop_back();
+}
+
+void PathIndex::removeTree(const std::string &dir) {
+  std::string prefix = relative(dir) + "/";
+  std::vector<std::string> doomed;
+  for (const auto &p : paths_) {
+    if (p.compare(0, prefix.size(), prefix) == 0)
+      doomed.push_back(p);
+  }
+  for (const auto &p : doomed)
+    remove(root_ + "/" + p);
+}
+
+void PathIndex::scan(const std::string &dir) {
+  WorkspaceWalker::walk(dir, &stop_,
+                        [this](const std::filesystem::path &path, uintmax_t) {
+                          add(path.string());
+                        });
+}
+
+void PathIndex::publish() {
+  std::vector<std::string> sorted(paths_);
+  std::sort(sorted.begin(), sorted.end());
+  auto matcher = std::make_shared<FuzzyMatcher>();
+  matcher->setCandidates(std::move(sorted));
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    snapshot_ = std::move(matcher);
+  }
+  version_++;
+}
+
+void PathIndex::run() {
+  FileWatcher watcher;
+  watcher.watchTree(root_);
+
+  building_ = true;
+  scan(root_);
+  publish();
+  building_ = false;
+
+  using Clock = std::chrono::steady_clock;
+  std::vector<FileWatcher::Event> events;
+  bool dirty = false;
+  Clock::time_point firstChange, lastChange;
+  while (!stop_) {
+    if (watcher.wait(50)) {
+      events.clear();
+      watcher.poll(events);
+      for (const auto &ev : events) {
+        switch (ev.kind) {
+        case FileWatcher::Event::Kind::Created:
+          if (ev.isDirectory)
+            scan(ev.path); // e.g. a directory moved into the tree
+          else
+            add(ev.path);
+          break;
+        case FileWatcher::Event::Kind::Removed:
+          if (ev.isDirectory)
+            removeTree(ev.path);
+          else
+            remove(ev.path);
+          break;
+        case FileWatcher::Event::Kind::Overflow:
+          paths_.clear();
+          slots_.clear();
+          scan(root_);
+          break;
+        case FileWatcher::Event::Kind::Modified:
+          break;
+        }
+      }
+      auto now = Clock::now();
+      if (!dirty)
+        firstChange = now;
+      lastChange = now;
+      dirty = true;
+    }
+    if (!dirty)
+      continue;
+    auto since = [](Clock::time_point t) {
+      return std::chrono::duration_cast<std::chrono::milliseconds>(
+                 Clock::now() - t)
+          .count();
+    };
+    if (since(lastChange) >= kQuietMs || since(firstChange) >= kMaxDelayMs) {
+      publish();
+      dirty = false;
+    }
+  }
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "FuzzyMatcher.hpp"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Every file path under the workspace root, for quick-open. A worker walks
+// the tree once and then follows FileWatcher events, adding and removing
+// single paths. After each burst of changes it publishes a fresh immutable
+// FuzzyMatcher, so the UI ranks against a consistent snapshot without
+// holding a lock while it does.
+class PathIndex {
+public:
+  PathIndex() = default;
+  ~PathIndex();
+  PathIndex(const PathIndex &) = delete;
+  PathIndex &operator=(const PathIndex &) = delete;
+
+  void start(const std::string &root);
+  void stop();
+
+  // Candidates are paths relative to the root
+  std::shared_ptr<const FuzzyMatcher> snapshot() const;
+  unsigned version() const { return version_.load(); }
+  bool building() const { return building_.load(); }
+  const std::string &root() const { return root_; }
+
+private:
+  void run();
+  void scan(const std::string &dir);
+  void add(const std::string &path);
+  void remove(const std::string &path);
+  void removeTree(const std::string &dir);
+  void publish();
+  std::string relative(const std::string &path) const;
+
+  std::string root_;
+  std::thread thread_;
+  std::atomic<bool> stop_{false};
+  std::atomic<bool> building_{false};
+  std::atomic<unsigned> version_{0};
+
+  mutable std::mutex mutex_;
+  std::shared_ptr<const FuzzyMatcher> snapshot_;
+
+  // Worker-only: paths in no particular order, and where each one sits
+  std::vector<std::string> paths_;
+  std::unordered_map<std::string, size_t> slots_;
+};
@@ -1,14 +1,22 @@
 #include "PieceTable.hpp"
 #include <algorithm> // for std::min
 
-PieceTable::PieceTable() = default;
+PieceTable::PieceTable() : originalBuffer(std::make_shared<std::string>()) {}
 
-PieceTable::PieceTable(const std::string &original) : originalBuffer(original) {
+PieceTable::PieceTable(const std::string &original)
+    : originalBuffer(std::make_shared<std::string>(original)) {
   if (!original.empty()) {
     pieces.push_back({Piece::BufferKind::Original, 0, original.size()});
   }
 }
 
+PieceTable::PieceTable(std::string &&original)
+    : originalBuffer(std::make_shared<std::string>(std::move(original))) {
+  if (!originalBuffer->empty()) {
+    pieces.push_back({Piece::BufferKind::Original, 0, originalBuffer->size()});
+  }
+}
+
 void PieceTable::insert(size_t pos, const std::string &text) {
   if (text.empty())
     return;
@@ -19,20 +27,23 @@ void PieceTable::insert(size_t pos, const std::string &text) {
   for (size_t i = 0; i < pieces.size(); ++i) {
     auto &p = pieces[i];
     if (pos <= cur + p.length) {
+      if (pos == cur + p.length && p.buffer == Piece::BufferKind::Add &&
+          p.start + p.length == addStart) {
+        p.length += text.size(); // typing: grow the piece typed last
+        return;
+      }
       size_t offset = pos - cur;
-      Piece before = {p.buffer, p.start, offset};
       Piece inserted = {Piece::BufferKind::Add, addStart, text.size()};
-      Piece after = {p.buffer, p.start + offset, p.length - offset};
-
-      std::vector<Piece> newPieces;
-      if (before.length)
-        newPieces.push_back(before);
-      newPieces.push_back(inserted);
-      if (after.length)
-        newPieces.push_back(after);
-
-      pieces.erase(pieces.begin() + i);
-      pieces.insert(pieces.begin() + i, newPieces.begin(), newPieces.end());
+      // Split in place; only the list's own growth allocates
+      if (offset == 0) {
+        pieces.insert(pieces.begin() + i, inserted);
+      } else if (offset == p.length) {
+        pieces.insert(pieces.begin() + i + 1, inserted);
+      } else {
+        Piece after = {p.buffer, p.start + offset, p.length - offset};
+        p.length = offset;
+        pieces.insert(pieces.begin() + i + 1, {inserted, after});
+      }
       return;
     }
     cur += p.length;
@@ -41,7 +52,60 @@ void PieceTable::insert(size_t pos, const std::string &text) {
   pieces.push_back({Piece::BufferKind::Add, addStart, text.size()});
 }
 
+size_t PieceTable::splitAt(size_t pos) {
+  size_t cur = 0;
+  for (size_t i = 0; i < pieces.size(); ++i) {
+    Piece &p = pieces[i];
+    if (pos == cur)
+      return i;
+    if (pos < cur + p.length) {
+      size_t offset = pos - cur;
+      Piece after = {p.buffer, p.start + offset, p.length - offset};
+      p.length = offset;
+      pieces.insert(pieces.begin() + i + 1, after);
+      return i + 1;
+    }
+    cur += p.length;
+  }
+  return pieces.size();
+}
+
+void PieceTable::slice(size_t pos, size_t len, std::vector<Piece> &out) const {
+  size_t cur = 0;
+  for (const auto &p : pieces) {
+    if (len == 0)
+      return;
+    if (pos >= cur + p.length) {
+      cur += p.length;
+      continue;
+    }
+    size_t offset = pos - cur;
+    size_t n = std::min(len, p.length - offset);
+    Piece part = {p.buffer, p.start + offset, n};
+    if (!out.empty() && out.back().buffer == part.buffer &&
+        out.back().start + out.back().length == part.start)
+      out.back().length += n; // e.g. consecutive typed characters
+    else
+      out.push_back(part);
+    pos += n;
+    len -= n;
+    cur += p.length;
+  }
+}
+
+void PieceTable::insertPieces(size_t pos, const std::vector<Piece> &span) {
+  if (span.empty())
+    return;
+  size_t i = splitAt(pos);
+  pieces.insert(pieces.begin() + i, span.begin(), span.end());
+}
+
 void PieceTable::erase(size_t pos, size_t len) {
+  erasePieces(pieces, pos, len);
+}
+
+void PieceTable::erasePieces(std::vector<Piece> &pieces, size_t pos,
+                             size_t len) {
   if (len == 0)
     return;
 
@@ -81,17 +145,101 @@ void PieceTable::erase(size_t pos, size_t len) {
   }
 }
 
+Piece PieceTable::append(const char *data, size_t len) {
+  Piece piece = {Piece::BufferKind::Add, addBuffer.size(), len};
+  addBuffer.append(data, len);
+  return piece;
+}
+
+// Appends a piece to out, merging it into the last one from index `from`
+// on when the two are contiguous
+static void pushPiece(std::vector<Piece> &out, size_t from, const Piece &p) {
+  if (p.length == 0)
+    return;
+  if (out.size() > from && out.back().buffer == p.buffer &&
+      out.back().start + out.back().length == p.start)
+    out.back().length += p.length;
+  else
+    out.push_back(p);
+}
+
+void PieceTable::splice(const std::vector<Splice> &edits,
+                        const std::vector<Piece> &inserts,
+                        std::vector<Splice> *undo,
+                        std::vector<Piece> *undoPieces) {
+  if (undo)
+    undo->clear();
+  if (undoPieces)
+    undoPieces->clear();
+  if (edits.empty())
+    return;
+
+  std::vector<Piece> out;
+  out.reserve(pieces.size() + edits.size() * 2 + inserts.size());
+  size_t i = 0;      // next piece of the old list
+  size_t offset = 0; // bytes of pieces[i] already consumed
+  size_t cur = 0;    // text offset of that point
+  long long shift = 0;
+
+  // Moves len bytes of the old list to `to` (merging from index `from` on),
+  // or drops them when to is null
+  auto take = [&](size_t len, std::vector<Piece> *to, size_t from) {
+    while (len > 0 && i < pieces.size()) {
+      const Piece &p = pieces[i];
+      size_t n = std::min(len, p.length - offset);
+      if (to)
+        pushPiece(*to, from, {p.buffer, p.start + offset, n});
+      offset += n;
+      cur += n;
+      len -= n;
+      if (offset == p.length) {
+        ++i;
+        offset = 0;
+      }
+    }
+  };
+
+  for (const Splice &edit : edits) {
+    take(edit.pos - cur, &out, 0);
+    size_t erasedFirst = undoPieces ? undoPieces->size() : 0;
+    take(edit.erase, undoPieces, erasedFirst);
+    size_t inserted = 0;
+    for (size_t k = edit.first; k < edit.first + edit.count; ++k) {
+      pushPiece(out, 0, inserts[k]);
+      inserted += inserts[k].length;
+    }
+    if (undo) {
+      size_t erasedCount = undoPieces->size() - erasedFirst;
+      undo->push_back({(size_t)((long long)edit.pos + shift), inserted,
+                       erasedFirst, erasedCount});
+    }
+    shift += (long long)inserted - (long long)edit.erase;
+  }
+  take((size_t)-1, &out, 0);
+  pieces.swap(out);
+}
+
 std::string PieceTable::getText() const {
   std::string result;
   result.reserve(size());
   for (auto &p : pieces) {
     const std::string &buf =
-        (p.buffer == Piece::BufferKind::Original) ? originalBuffer : addBuffer;
+        (p.buffer == Piece::BufferKind::Original) ? *originalBuffer : addBuffer;
     result.append(buf, p.start, p.length);
   }
   return result;
 }
 
+std::string PieceTable::substr(size_t pos, size_t len) const {
+  std::string result;
+  result.reserve(len);
+  forEachChunk(pos, len, [&](const char *data, size_t n) {
+    result.append(data, n);
+    return true;
+  });
+  return result;
+}
+
 size_t PieceTable::size() const {
   size_t total = 0;
   for (auto &p : pieces)
@@ -100,7 +248,12 @@ size_t PieceTable::size() const {
 }
 
 void PieceTable::clear() {
-  originalBuffer.clear();
+  originalBuffer = std::make_shared<std::string>();
   addBuffer.clear();
   pieces.clear();
 }
+
+size_t PieceTable::memoryUsage() const {
+  return originalBuffer->capacity() + addBuffer.capacity() +
+         pieces.capacity() * sizeof(Piece);
+}
@@ -1,4 +1,6 @@
 #pragma once
+#include <algorithm>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -14,18 +16,89 @@ class PieceTable {
 public:
     PieceTable();
     PieceTable(const std::string& original);
+    PieceTable(std::string&& original);
 
     void insert(size_t pos, const std::string& text);
     void erase(size_t pos, size_t len);
 
+    // Appends the pieces covering [pos, pos + len) to out. Both buffers only
+    // ever grow, so the pieces keep describing that text until clear(); undo
+    // history stores edits this way instead of copying them.
+    void slice(size_t pos, size_t len, std::vector<Piece>& out) const;
+    // Inserts text captured by slice() without copying it.
+    void insertPieces(size_t pos, const std::vector<Piece>& span);
+
+    // The whole piece list, e.g. as an undo checkpoint; setPieceList()
+    // restores one taken from this table.
+    const std::vector<Piece>& pieceList() const { return pieces; }
+    void setPieceList(const std::vector<Piece>& list) { pieces = list; }
+    // erase() on a detached piece list
+    static void erasePieces(std::vector<Piece>& list, size_t pos, size_t len);
+
+    // One edit of a batch: `erase` bytes at pos, an offset in the text as
+    // it was before the batch, are replaced by pieces [first, first + count)
+    // of the batch's piece list.
+    struct Splice {
+        size_t pos;
+        size_t erase;
+        size_t first;
+        size_t count;
+    };
+    // Applies edits sorted by pos and not overlapping in one pass over the
+    // piece list, however many there are. With undo, also builds the batch
+    // that turns the result back into the current text.
+    void splice(const std::vector<Splice>& edits,
+                const std::vector<Piece>& inserts,
+                std::vector<Splice>* undo = nullptr,
+                std::vector<Piece>* undoPieces = nullptr);
+    // Adds text to the add buffer without placing it anywhere yet; the
+    // returned piece can go into any number of splices.
+    Piece append(const char* data, size_t len);
+
     std::string getText() const;
+    std::string substr(size_t pos, size_t len) const;
     size_t size() const;
     bool empty() const { return size() == 0; }
 
+    // Calls fn(const char *data, size_t len) for each contiguous run of text
+    // covering [pos, pos + len), without copying. Stops early if fn returns
+    // false.
+    template <typename Fn>
+    void forEachChunk(size_t pos, size_t len, Fn &&fn) const;
+
     void clear();
+    // Bytes held by the buffers and piece list.
+    size_t memoryUsage() const;
 
 private:
-    std::string originalBuffer;
+    // Index of the piece starting at pos, splitting one if pos falls inside.
+    size_t splitAt(size_t pos);
+
+    // Shared so copies of the table (snapshots handed to background
+    // searches) don't duplicate the file contents.
+    std::shared_ptr<const std::string> originalBuffer;
     std::string addBuffer;
     std::vector<Piece> pieces;
 };
+
+template <typename Fn>
+void PieceTable::forEachChunk(size_t pos, size_t len, Fn &&fn) const {
+    size_t cur = 0;
+    for (const auto &p : pieces) {
+        if (len == 0)
+            return;
+        if (pos >= cur + p.length) {
+            cur += p.length;
+            continue;
+        }
+        const std::string &buf =
+            (p.buffer == Piece::BufferKind::Original) ? *originalBuffer : addBuffer;
+        size_t offset = pos - cur;
+        size_t n = std::min(len, p.length - offset);
+        if (!fn(buf.data() + p.start + offset, n))
+            return;
+        pos += n;
+        len -= n;
+        cur += p.length;
+    }
+}
@@ -0,0 +1,122 @@
+#include "QuickOpenPanel.hpp"
+#include "TextEditor.hpp"
+#include <algorithm>
+#include <misc/cpp/imgui_stdlib.h>
+
+namespace {
+const size_t kMaxResults = 50;
+const size_t kScoreBudget = 20000; // candidates scored per frame
+} // namespace
+
+QuickOpenPanel::QuickOpenPanel(TextEditor *editor) : editor_(editor) {
+  index_.start(".");
+}
+
+void QuickOpenPanel::updateResults() {
+  if (index_.version() != matcherVersion_) {
+    matcherVersion_ = index_.version();
+    matcher_ = index_.snapshot();
+    applied_ = false; // indices refer to the old snapshot
+    narrowed_.clear();
+  } else if (applied_ && query_ == appliedQuery_) {
+    scoreSlice();
+    return;
+  }
+  if (!matcher_)
+    return;
+
+  if (query_.empty()) {
+    narrowed_.clear();
+    results_ = matcher_->rank("", kMaxResults);
+    selected_ = 0;
+  } else {
+    bool extends = applied_ && !appliedQuery_.empty() &&
+                   query_.compare(0, appliedQuery_.size(), appliedQuery_) == 0;
+    narrowed_ = matcher_->matches(query_, extends ? &narrowed_ : nullptr);
+    results_.clear();
+  }
+  scored_ = 0;
+  appliedQuery_ = query_;
+  applied_ = true;
+  scoreSlice();
+}
+
+void QuickOpenPanel::scoreSlice() {
+  if (query_.empty() || scored_ >= narrowed_.size())
+    return;
+  size_t end = std::min(narrowed_.size(), scored_ + kScoreBudget);
+  std::vector<uint32_t> slice(narrowed_.begin() + scored_,
+                              narrowed_.begin() + end);
+  results_ = matcher_->merge(results_,
+                             matcher_->rank(query_, kMaxResults, slice),
+                             kMaxResults);
+  scored_ = end;
+  selected_ = std::min(selected_, std::max(0, (int)results_.size() - 1));
+}
+
+void QuickOpenPanel::open(size_t row) {
+  const std::string &rel = matcher_->candidates()[results_[row].index];
+  std::string path =
+      index_.root() == "." ? rel : index_.root() + "/" + rel;
+  editor_->showQuickOpen = false;
+  editor_->openFile(path);
+  editor_->focusEditor = true;
+}
+
+void QuickOpenPanel::render() {
+  const ImGuiViewport *viewport = ImGui::GetMainViewport();
+  ImGui::SetNextWindowPos(ImVec2(viewport->WorkPos.x + viewport->WorkSize.x * 0.5f,
+                                 viewport->WorkPos.y + 40.0f),
+                          ImGuiCond_Always, ImVec2(0.5f, 0.0f));
+  ImGui::SetNextWindowSize(ImVec2(600, 0), ImGuiCond_Always);
+  if (!ImGui::Begin("##quick_open", nullptr,
+                    ImGuiWindowFlags_NoDecoration |
+                        ImGuiWindowFlags_AlwaysAutoResize |
+                        ImGuiWindowFlags_NoSavedSettings |
+                        ImGuiWindowFlags_NoDocking)) {
+    ImGui::End();
+    return;
+  }
+
+  if (editor_->focusQuickOpen) {
+    ImGui::SetKeyboardFocusHere();
+    editor_->focusQuickOpen = false;
+    query_.clear();
+    selected_ = 0;
+  }
+  ImGui::SetNextItemWidth(-1);
+  bool enter = ImGui::InputTextWithHint("##quick_open_query", "Go to file",
+                                        &query_,
+                                        ImGuiInputTextFlags_EnterReturnsTrue);
+  updateResults();
+
+  if (ImGui::IsKeyPressed(ImGuiKey_DownArrow))
+    selected_ = std::min(selected_ + 1, (int)results_.size() - 1);
+  if (ImGui::IsKeyPressed(ImGuiKey_UpArrow))
+    selected_ = std::max(selected_ - 1, 0);
+  if (ImGui::IsKeyPressed(ImGuiKey_Escape))
+    editor_->showQuickOpen = false;
+
+  if (!matcher_) {
+    ImGui::TextDisabled("Indexing workspace...");
+  } else {
+    for (size_t i = 0; i < results_.size(); ++i) {
+      const std::string &rel = matcher_->candidates()[results_[i].index];
+      ImGui::PushID((int)i);
+      if (ImGui::Selectable(rel.c_str(), (int)i == selected_)) {
+        selected_ = (int)i;
+        enter = true;
+      }
+      ImGui::PopID();
+    }
+    if (query_.empty())
+      ImGui::TextDisabled("%zu files", matcher_->candidates().size());
+    else
+      ImGui::TextDisabled("%zu of %zu files", narrowed_.size(),
+                          matcher_->candidates().size());
+  }
+
+  if (enter && selected_ >= 0 && (size_t)selected_ < results_.size())
+    open((size_t)selected_);
+  ImGui::End();
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "FuzzyMatcher.hpp"
+#include "PathIndex.hpp"
+#include "imgui.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+class TextEditor;
+
+// Ctrl+P "Go to File". Each keystroke that only extends the query filters
+// the previous match set instead of the whole index, so the work shrinks as
+// the query gets longer. Scoring is spread over frames in fixed-size slices
+// that are merged into a running top list, so a short query against a huge
+// tree shows results on the first frame and refines them over the next few.
+class QuickOpenPanel {
+public:
+  QuickOpenPanel(TextEditor *editor);
+  ~QuickOpenPanel() = default;
+
+  void render();
+
+private:
+  void updateResults();
+  void scoreSlice();
+  void open(size_t row);
+
+  TextEditor *editor_;
+  PathIndex index_;
+
+  std::shared_ptr<const FuzzyMatcher> matcher_;
+  unsigned matcherVersion_ = ~0u;
+  std::string query_;
+  std::string appliedQuery_;
+  bool applied_ = false;
+  std::vector<uint32_t> narrowed_; // every match for appliedQuery_
+  size_t scored_ = 0; // narrowed_ entries already folded into results_
+  std::vector<FuzzyMatcher::Result> results_;
+  int selected_ = 0;
+};
@@ -0,0 +1,157 @@
+#include "SearchWorker.hpp"
+#include "BufferSearch.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+// Work is split into blocks so cancellation is noticed promptly even when
+// there are no matches to report.
+const size_t kBlockSize = 4 << 20;
+// Matches are handed to the UI in groups of this size
+const size_t kBatchSize = 256;
+// Only this many matches are kept; counting continues past it
+const size_t kMaxStoredMatches = 1 << 20;
+} // namespace
+
+SearchWorker::~SearchWorker() { cancel(); }
+
+void SearchWorker::join() {
+  if (thread_.joinable())
+    thread_.join();
+}
+
+void SearchWorker::cancel() {
+  cancel_ = true;
+  join();
+  cancel_ = false;
+}
+
+void SearchWorker::takeMatches(std::vector<SearchMatch> &out) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  out.insert(out.end(), pending_.begin(), pending_.end());
+  pending_.clear();
+}
+
+void SearchWorker::publish(std::vector<SearchMatch> &batch) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  pending_.insert(pending_.end(), batch.begin(), batch.end());
+  batch.clear();
+}
+
+void SearchWorker::countLiteral(PieceTable snapshot, std::string needle) {
+  cancel();
+  count_ = 0;
+  done_ = false;
+  thread_ = StackThread(0, [this, text = std::move(snapshot),
+                            needle = std::move(needle)]() {
+    size_t total = text.size();
+    size_t m = needle.size();
+    size_t pos = 0;
+    while (pos < total && !cancel_) {
+      size_t blockEnd = std::min(total, pos + kBlockSize);
+      size_t next = blockEnd;
+      // Let the last match of a block run into the next one, but only
+      // count matches that start inside it.
+      BufferSearch::findAll(text, needle, pos, std::min(total, blockEnd + m - 1),
+                            [&](size_t hit) {
+                              if (hit >= blockEnd)
+                                return false;
+                              count_++;
+                              next = std::max(next, hit + m);
+                              return true;
+                            });
+      pos = next;
+    }
+    done_ = true;
+  });
+}
+
+void SearchWorker::searchRegex(PieceTable snapshot, std::regex pattern) {
+  cancel();
+  count_ = 0;
+  skipped_ = 0;
+  done_ = false;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending_.clear();
+  }
+  thread_ = StackThread(kRegexStackSize, [this, text = std::move(snapshot),
+                                          re = std::move(pattern)]() {
+    std::vector<SearchMatch> batch;
+    size_t stored = 0;
+
+    auto searchLine = [&](const char *begin, const char *end, size_t offset) {
+      std::cmatch m;
+      const char *from = begin;
+      auto flags = std::regex_constants::match_default;
+      while (from <= end && std::regex_search(from, end, m, re, flags)) {
+        size_t pos = offset + (size_t)(m[0].first - begin);
+        size_t len = (size_t)m.length(0);
+        count_++;
+        if (stored < kMaxStoredMatches) {
+          batch.push_back({pos, len});
+          stored++;
+          if (batch.size() >= kBatchSize)
+            publish(batch);
+        }
+        // step past empty matches so the search always advances
+        from = m[0].second + (len == 0 ? 1 : 0);
+        flags = std::regex_constants::match_prev_avail;
+      }
+    };
+
+    // Only the current, still incomplete line is carried between chunks;
+    // complete lines are searched straight out of the piece's memory.
+    // Lines over kMaxRegexLine are counted and skipped.
+    std::string carry;
+    size_t carryStart = 0;
+    bool carryLong = false;
+    size_t chunkPos = 0;
+    text.forEachChunk(0, text.size(), [&](const char *data, size_t n) {
+      const char *end = data + n;
+      const char *lineBegin = data;
+      while (lineBegin < end) {
+        if (cancel_)
+          return false;
+        const char *nl =
+            (const char *)std::memchr(lineBegin, '\n', (size_t)(end - lineBegin));
+        const char *lineEnd = nl ? nl : end;
+        if (!carryLong) {
+          if (carry.empty() && nl) {
+            if ((size_t)(nl - lineBegin) > kMaxRegexLine)
+              skipped_++;
+            else
+              searchLine(lineBegin, nl, chunkPos + (size_t)(lineBegin - data));
+            lineBegin = nl + 1;
+            continue;
+          }
+          if (carry.empty())
+            carryStart = chunkPos + (size_t)(lineBegin - data);
+          carry.append(lineBegin, lineEnd);
+          if (carry.size() > kMaxRegexLine) {
+            carryLong = true;
+            carry.clear();
+          }
+        }
+        if (!nl)
+          break;
+        if (carryLong)
+          skipped_++;
+        else
+          searchLine(carry.data(), carry.data() + carry.size(), carryStart);
+        carry.clear();
+        carryLong = false;
+        lineBegin = nl + 1;
+      }
+      chunkPos += n;
+      return true;
+    });
+    if (!cancel_ && carryLong)
+      skipped_++;
+    else if (!cancel_ && !carry.empty())
+      searchLine(carry.data(), carry.data() + carry.size(), carryStart);
+
+    publish(batch);
+    done_ = true;
+  });
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "BufferSearch.hpp"
+#include "PieceTable.hpp"
+#include "StackThread.hpp"
+#include <atomic>
+#include <mutex>
+#include <regex>
+#include <string>
+#include <vector>
+
+// Runs a search over a snapshot of the buffer on a background thread so the
+// UI never waits on a large file. Starting a new job cancels the old one.
+class SearchWorker {
+public:
+  SearchWorker() = default;
+  ~SearchWorker();
+  SearchWorker(const SearchWorker &) = delete;
+  SearchWorker &operator=(const SearchWorker &) = delete;
+
+  // Counts non-overlapping occurrences of needle in snapshot.
+  void countLiteral(PieceTable snapshot, std::string needle);
+  // Line-by-line regex search (matches don't span lines). Matches are
+  // published in batches; collect them with takeMatches(). Lines longer
+  // than kMaxRegexLine are skipped and counted in skippedLines().
+  void searchRegex(PieceTable snapshot, std::regex pattern);
+  void cancel();
+
+  bool busy() const { return !done_.load(); }
+  size_t matchCount() const { return count_.load(); }
+  size_t skippedLines() const { return skipped_.load(); }
+  // Moves matches found since the last call onto the end of out.
+  void takeMatches(std::vector<SearchMatch> &out);
+
+private:
+  void join();
+  void publish(std::vector<SearchMatch> &batch);
+
+  StackThread thread_;
+  std::atomic<bool> cancel_{false};
+  std::atomic<bool> done_{true};
+  std::atomic<size_t> count_{0};
+  std::atomic<size_t> skipped_{0};
+
+  std::mutex mutex_;
+  std::vector<SearchMatch> pending_;
+};
@@ -0,0 +1,74 @@
+#include "StackThread.hpp"
+#include <cerrno>
+#include <memory>
+#include <system_error>
+#include <utility>
+
+#ifdef _WIN32
+#include <process.h>
+#include <windows.h>
+#endif
+
+namespace {
+#ifdef _WIN32
+unsigned __stdcall threadMain(void *arg) {
+#else
+void *threadMain(void *arg) {
+#endif
+  std::unique_ptr<std::function<void()>> fn((std::function<void()> *)arg);
+  (*fn)();
+  return 0;
+}
+} // namespace
+
+StackThread::StackThread(size_t stackBytes, std::function<void()> fn) {
+  auto *arg = new std::function<void()>(std::move(fn));
+#ifdef _WIN32
+  // Without the flag the size would be committed up front, not reserved
+  handle_ = (void *)_beginthreadex(nullptr, (unsigned)stackBytes, threadMain,
+                                   arg, STACK_SIZE_PARAM_IS_A_RESERVATION,
+                                   nullptr);
+  int error = handle_ ? 0 : errno;
+#else
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  int error = stackBytes ? pthread_attr_setstacksize(&attr, stackBytes) : 0;
+  if (!error)
+    error = pthread_create(&thread_, &attr, threadMain, arg);
+  pthread_attr_destroy(&attr);
+#endif
+  if (error) {
+    delete arg;
+    throw std::system_error(error, std::generic_category(),
+                            "StackThread: can't create thread");
+  }
+  started_ = true;
+}
+
+StackThread::StackThread(StackThread &&other) noexcept { *this = std::move(other); }
+
+StackThread &StackThread::operator=(StackThread &&other) noexcept {
+  if (this != &other) {
+    join();
+#ifdef _WIN32
+    handle_ = std::exchange(other.handle_, nullptr);
+#else
+    thread_ = other.thread_;
+#endif
+    started_ = std::exchange(other.started_, false);
+  }
+  return *this;
+}
+
+void StackThread::join() {
+  if (!started_)
+    return;
+#ifdef _WIN32
+  WaitForSingleObject((HANDLE)handle_, INFINITE);
+  CloseHandle((HANDLE)handle_);
+  handle_ = nullptr;
+#else
+  pthread_join(thread_, nullptr);
+#endif
+  started_ = false;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+// A thread with a stack of a chosen size, which std::thread can't set. The
+// size is reserved address space; pages are only committed as they're
+// touched. Otherwise used like std::thread, except that destroying a
+// running one joins it. Throws std::system_error if the thread can't be
+// created.
+class StackThread {
+public:
+  StackThread() = default;
+  // stackBytes 0 keeps the platform default
+  StackThread(size_t stackBytes, std::function<void()> fn);
+  ~StackThread() { join(); }
+  StackThread(StackThread &&other) noexcept;
+  StackThread &operator=(StackThread &&other) noexcept;
+  StackThread(const StackThread &) = delete;
+  StackThread &operator=(const StackThread &) = delete;
+
+  bool joinable() const { return started_; }
+  void join();
+
+private:
+#ifdef _WIN32
+  void *handle_ = nullptr;
+#else
+  pthread_t thread_{};
+#endif
+  bool started_ = false;
+};
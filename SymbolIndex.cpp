@@ -0,0 +1,941 @@
+#include "SymbolIndex.hpp"
+#include "MappedFile.hpp"
+#include "WorkspaceWalker.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <unordered_map>
+
+namespace {
+const char kMagic[4] = {'D', 'X', 'S', 'Y'};
+const uint32_t kVersion = 1;
+const uint64_t kMaxIndexedSize = 8ull << 20;
+
+// On-disk layout, native endianness (the index is a local cache):
+//   Header | FileEntry[fileCount] | SymbolEntry[symbolCount] | strings
+// Symbols are sorted by name so lookups binary-search the mapped table.
+struct Header {
+  char magic[4];
+  uint32_t version;
+  uint32_t fileCount;
+  uint32_t symbolCount;
+  uint64_t filesOffset;
+  uint64_t symbolsOffset;
+  uint64_t stringsOffset;
+  uint64_t stringsSize;
+};
+
+struct FileEntry {
+  int64_t mtime;
+  uint64_t size;
+  uint32_t pathOffset;
+  uint32_t pathLen;
+};
+
+struct SymbolEntry {
+  uint32_t nameOffset;
+  uint32_t scopeOffset;
+  uint32_t file;
+  uint32_t line;
+  uint32_t column;
+  uint16_t nameLen;
+  uint16_t scopeLen;
+  uint8_t kind;
+  uint8_t reserved[3];
+};
+
+struct Pending {
+  SymbolIndex::Symbol symbol;
+  uint32_t file;
+};
+
+int64_t modificationTime(const std::filesystem::path &path) {
+  std::error_code ec;
+  auto t = std::filesystem::last_write_time(path, ec);
+  return ec ? 0 : (int64_t)t.time_since_epoch().count();
+}
+
+bool isLuaPath(const std::string &path) {
+  return path.size() > 4 && path.compare(path.size() - 4, 4, ".lua") == 0;
+}
+
+inline bool isIdentStart(unsigned char c) {
+  return std::isalpha(c) || c == '_' || c >= 0x80;
+}
+inline bool isIdentChar(unsigned char c) {
+  return std::isalnum(c) || c == '_' || c >= 0x80;
+}
+
+// Just enough of a C++ lexer to find definitions: comments, string and
+// character literals (raw strings included) and preprocessor lines are
+// skipped, "::" and "->" are single tokens, everything else is one char.
+struct Token {
+  enum Type { Ident, Punct, Literal } type;
+  std::string_view text;
+  int line;
+  int column;
+};
+
+class CppLexer {
+public:
+  CppLexer(const char *data, size_t size)
+      : p_(data), end_(data + size), lineStart_(data) {}
+
+  bool next(Token &t) {
+    for (;;) {
+      while (p_ < end_ && std::isspace((unsigned char)*p_)) {
+        if (*p_ == '\n')
+          newline(p_ + 1);
+        ++p_;
+      }
+      if (p_ >= end_)
+        return false;
+      if (*p_ == '#' && atLineStart_) {
+        skipLine(true);
+        continue;
+      }
+      atLineStart_ = false;
+      if (*p_ == '/' && p_ + 1 < end_ && p_[1] == '/') {
+        skipLine(false);
+        continue;
+      }
+      if (*p_ == '/' && p_ + 1 < end_ && p_[1] == '*') {
+        p_ += 2;
+        while (p_ + 1 < end_ && !(p_[0] == '*' && p_[1] == '/')) {
+          if (*p_ == '\n')
+            newline(p_ + 1);
+          ++p_;
+        }
+        p_ = std::min(end_, p_ + 2);
+        continue;
+      }
+      break;
+    }
+
+    const char *start = p_;
+    t.line = line_;
+    t.column = (int)(start - lineStart_);
+    unsigned char c = (unsigned char)*p_;
+    if (isIdentStart(c)) {
+      while (p_ < end_ && isIdentChar((unsigned char)*p_))
+        ++p_;
+      if (p_ < end_ && *p_ == '"' && p_[-1] == 'R') {
+        skipRawString();
+        t.type = Token::Literal;
+      } else {
+        t.type = Token::Ident;
+      }
+    } else if (std::isdigit(c)) {
+      while (p_ < end_ && (isIdentChar((unsigned char)*p_) || *p_ == '.' ||
+                           *p_ == '\'' ||
+                           ((*p_ == '+' || *p_ == '-') &&
+                            std::strchr("eEpP", p_[-1]))))
+        ++p_;
+      t.type = Token::Literal;
+    } else if (c == '"' || c == '\'') {
+      ++p_;
+      while (p_ < end_ && *p_ != (char)c && *p_ != '\n') {
+        if (*p_ == '\\' && p_ + 1 < end_)
+          ++p_;
+        ++p_;
+      }
+      if (p_ < end_ && *p_ == (char)c)
+        ++p_;
+      t.type = Token::Literal;
+    } else {
+      if (p_ + 1 < end_ && ((c == ':' && p_[1] == ':') ||
+                            (c == '-' && p_[1] == '>')))
+        p_ += 2;
+      else
+        ++p_;
+      t.type = Token::Punct;
+    }
+    t.text = std::string_view(start, (size_t)(p_ - start));
+    return true;
+  }
+
+private:
+  void newline(const char *next) {
+    line_++;
+    lineStart_ = next;
+    atLineStart_ = true;
+  }
+
+  void skipLine(bool continuations) {
+    while (p_ < end_ && *p_ != '\n') {
+      if (continuations && *p_ == '\\' && p_ + 1 < end_ && p_[1] == '\n') {
+        p_ += 2;
+        newline(p_);
+        continue;
+      }
+      ++p_;
+    }
+  }
+
+  // At the opening quote of R"delim( ... )delim"
+  void skipRawString() {
+    const char *open = ++p_;
+    while (p_ < end_ && *p_ != '(' && *p_ != '\n')
+      ++p_;
+    std::string close = ")" + std::string(open, (size_t)(p_ - open)) + "\"";
+    while (p_ < end_ && (size_t)(end_ - p_) >= close.size() &&
+           std::memcmp(p_, close.data(), close.size()) != 0) {
+      if (*p_ == '\n')
+        newline(p_ + 1);
+      ++p_;
+    }
+    p_ = std::min(end_, p_ + close.size());
+  }
+
+  const char *p_;
+  const char *end_;
+  const char *lineStart_;
+  int line_ = 0;
+  bool atLineStart_ = true;
+};
+
+bool is(const Token &t, const char *text) { return t.text == text; }
+
+bool isNonNameKeyword(std::string_view w) {
+  static const char *words[] = {
+      "if",       "for",      "while",     "switch",        "catch",
+      "return",   "sizeof",   "alignof",   "decltype",      "alignas",
+      "noexcept", "typeid",   "static_assert", "new",       "delete",
+      "throw",    "co_await", "co_return", "co_yield",      "requires",
+      "__attribute__", "__declspec"};
+  for (const char *k : words) {
+    if (w == k)
+      return true;
+  }
+  return false;
+}
+
+enum class Scope { Global, Namespace, Class, Function, Other };
+
+struct Frame {
+  Scope kind;
+  std::string name;
+};
+
+class CppParser {
+public:
+  CppParser(const char *data, size_t size, std::vector<SymbolIndex::Symbol> &out)
+      : lexer_(data, size), out_(out) {}
+
+  void run() {
+    Token t;
+    while (lexer_.next(t)) {
+      Scope top = stack_.back().kind;
+      bool declScope = top == Scope::Global || top == Scope::Namespace ||
+                       top == Scope::Class;
+      if (t.type == Token::Punct && is(t, "{")) {
+        if (declScope && isInitializerBrace()) {
+          skipBraces();
+          t.text = "}"; // stands in for the skipped "{...}"
+          stmt_.push_back(t);
+          continue;
+        }
+        stack_.push_back(declScope ? classify() : Frame{Scope::Other, ""});
+        stmt_.clear();
+      } else if (t.type == Token::Punct && is(t, "}")) {
+        if (stack_.size() > 1)
+          stack_.pop_back();
+        stmt_.clear();
+      } else if (!declScope) {
+        continue; // inside a body: only braces matter
+      } else if (t.type == Token::Punct && is(t, ";")) {
+        stmt_.clear();
+      } else if (t.type == Token::Ident && is(t, "template")) {
+        skipTemplateParameters();
+      } else if (t.type == Token::Punct && is(t, ":") && stmt_.size() == 1 &&
+                 (is(stmt_[0], "public") || is(stmt_[0], "private") ||
+                  is(stmt_[0], "protected"))) {
+        stmt_.clear();
+      } else {
+        if (stmt_.size() > 512)
+          stmt_.clear(); // runaway macro soup; start over
+        stmt_.push_back(t);
+      }
+    }
+  }
+
+private:
+  void skipTemplateParameters() {
+    Token t;
+    if (!lexer_.next(t))
+      return;
+    if (!is(t, "<")) {
+      stmt_.push_back(t);
+      return;
+    }
+    int depth = 1;
+    while (depth > 0 && lexer_.next(t)) {
+      if (is(t, "<"))
+        depth++;
+      else if (is(t, ">"))
+        depth--;
+      else if (is(t, "{") || is(t, ";"))
+        return; // not a template header after all
+    }
+  }
+
+  void skipBraces() {
+    int depth = 1;
+    Token t;
+    while (depth > 0 && lexer_.next(t)) {
+      if (is(t, "{"))
+        depth++;
+      else if (is(t, "}"))
+        depth--;
+    }
+  }
+
+  // Index of the ')' closing the '(' at open, or npos
+  size_t closeParen(size_t open) const {
+    int depth = 0;
+    for (size_t i = open; i < stmt_.size(); ++i) {
+      if (is(stmt_[i], "("))
+        depth++;
+      else if (is(stmt_[i], ")") && --depth == 0)
+        return i;
+    }
+    return std::string::npos;
+  }
+
+  // Position of the '(' opening a function's parameter list, or npos
+  size_t functionHead() const {
+    for (size_t i = 0; i < stmt_.size(); ++i) {
+      const Token &t = stmt_[i];
+      if (t.type == Token::Punct && (is(t, "=") || is(t, "{")))
+        return std::string::npos;
+      if (!is(t, "("))
+        continue;
+      if (i == 0 || stmt_[i - 1].type != Token::Ident ||
+          isNonNameKeyword(stmt_[i - 1].text))
+        return std::string::npos;
+      if (i >= 2 && (is(stmt_[i - 2], ".") || is(stmt_[i - 2], "->")))
+        return std::string::npos;
+      return i;
+    }
+    return std::string::npos;
+  }
+
+  // "{" in a constructor's member initializer list, e.g. `: x_{0} {`
+  bool isInitializerBrace() const {
+    if (stmt_.empty())
+      return false;
+    const Token &last = stmt_.back();
+    if (last.type != Token::Ident && !is(last, ">"))
+      return false;
+    static const char *qualifiers[] = {"const", "override", "final",
+                                       "noexcept", "volatile", "try"};
+    for (const char *q : qualifiers) {
+      if (is(last, q))
+        return false;
+    }
+    size_t open = functionHead();
+    if (open == std::string::npos)
+      return false;
+    size_t close = closeParen(open);
+    return close != std::string::npos && close + 1 < stmt_.size() &&
+           is(stmt_[close + 1], ":");
+  }
+
+  std::string enclosingClass() const {
+    for (size_t i = stack_.size(); i-- > 0;) {
+      if (stack_[i].kind == Scope::Class)
+        return stack_[i].name;
+    }
+    return "";
+  }
+
+  Frame classify() {
+    if (stmt_.empty())
+      return {Scope::Other, ""};
+    size_t first = 0;
+    while (first < stmt_.size() &&
+           (is(stmt_[first], "inline") || is(stmt_[first], "export")))
+      ++first;
+    if (first < stmt_.size() && is(stmt_[first], "namespace")) {
+      std::string name;
+      for (size_t i = first + 1; i < stmt_.size(); ++i)
+        name += stmt_[i].text;
+      return {Scope::Namespace, name};
+    }
+    if (is(stmt_[0], "extern"))
+      return {Scope::Namespace, ""}; // extern "C" { ... }
+
+    // class/struct/union head, unless a '(' comes first (a function
+    // returning `struct X` or taking one)
+    for (size_t i = 0; i < stmt_.size(); ++i) {
+      const Token &t = stmt_[i];
+      if (is(t, "(") || is(t, "="))
+        break;
+      if (is(t, "enum"))
+        return {Scope::Other, ""};
+      if (!is(t, "class") && !is(t, "struct") && !is(t, "union"))
+        continue;
+      // Name is the last identifier before the base clause
+      const Token *name = nullptr;
+      for (size_t k = i + 1; k < stmt_.size() && !is(stmt_[k], ":"); ++k) {
+        if (stmt_[k].type == Token::Ident && !is(stmt_[k], "final") &&
+            !is(stmt_[k], "alignas"))
+          name = &stmt_[k];
+      }
+      if (!name)
+        return {Scope::Class, ""};
+      SymbolIndex::Symbol sym;
+      sym.name = std::string(name->text);
+      sym.scope = enclosingClass();
+      sym.kind = is(t, "class") ? SymbolIndex::Kind::Class
+                                : SymbolIndex::Kind::Struct;
+      sym.line = name->line;
+      sym.column = name->column;
+      out_.push_back(sym);
+      return {Scope::Class, sym.name};
+    }
+
+    size_t open = functionHead();
+    if (open == std::string::npos || closeParen(open) == std::string::npos)
+      return {Scope::Other, ""};
+    size_t nameAt = open - 1;
+    SymbolIndex::Symbol sym;
+    sym.name = std::string(stmt_[nameAt].text);
+    if (nameAt >= 1 && is(stmt_[nameAt - 1], "~")) {
+      sym.name = "~" + sym.name;
+      nameAt--;
+    }
+    // Qualified definition: Outer::Class::method
+    std::string scope;
+    while (nameAt >= 2 && is(stmt_[nameAt - 1], "::") &&
+           stmt_[nameAt - 2].type == Token::Ident) {
+      scope = scope.empty() ? std::string(stmt_[nameAt - 2].text)
+                            : std::string(stmt_[nameAt - 2].text) + "::" + scope;
+      nameAt -= 2;
+    }
+    sym.scope = scope.empty() ? enclosingClass() : scope;
+    sym.kind = SymbolIndex::Kind::Function;
+    sym.line = stmt_[open - 1].line;
+    sym.column = stmt_[open - 1].column;
+    out_.push_back(sym);
+    return {Scope::Function, sym.name};
+  }
+
+  CppLexer lexer_;
+  std::vector<SymbolIndex::Symbol> &out_;
+  std::vector<Frame> stack_{{Scope::Global, ""}};
+  std::vector<Token> stmt_;
+};
+
+// Identifier at s[i]; returns its length (0 if none)
+size_t luaIdent(std::string_view s, size_t i) {
+  size_t j = i;
+  if (j < s.size() && isIdentStart((unsigned char)s[j])) {
+    while (j < s.size() && isIdentChar((unsigned char)s[j]))
+      ++j;
+  }
+  return j - i;
+}
+
+size_t skipSpaces(std::string_view s, size_t i) {
+  while (i < s.size() && (s[i] == ' ' || s[i] == '\t'))
+    ++i;
+  return i;
+}
+
+bool startsWithWord(std::string_view s, size_t i, std::string_view word) {
+  return s.compare(i, word.size(), word) == 0 &&
+         (i + word.size() == s.size() ||
+          !isIdentChar((unsigned char)s[i + word.size()]));
+}
+
+// Dotted name a.b:c starting at i: name gets the last part, scope the rest
+size_t luaDottedName(std::string_view s, size_t i, std::string &scope,
+                     std::string &name, size_t &nameAt) {
+  size_t len = luaIdent(s, i);
+  if (len == 0)
+    return 0;
+  size_t j = i + len;
+  nameAt = i;
+  while (j + 1 < s.size() && (s[j] == '.' || s[j] == ':')) {
+    size_t next = luaIdent(s, j + 1);
+    if (next == 0)
+      break;
+    nameAt = j + 1;
+    j += 1 + next;
+  }
+  scope.assign(nameAt > i ? s.substr(i, nameAt - 1 - i) : std::string_view());
+  name.assign(s.substr(nameAt, j - nameAt));
+  return j - i;
+}
+} // namespace
+
+void SymbolIndex::extractCpp(const char *data, size_t size,
+                             std::vector<Symbol> &out) {
+  CppParser(data, size, out).run();
+}
+
+void SymbolIndex::extractLua(const char *data, size_t size,
+                             std::vector<Symbol> &out) {
+  std::string_view text(data, size);
+  std::string longClose; // "]]" or "]==]" while inside a long comment/string
+  int line = 0;
+  for (size_t start = 0; start <= size; ++line) {
+    size_t nl = text.find('\n', start);
+    if (nl == std::string_view::npos)
+      nl = size;
+    std::string_view s = text.substr(start, nl - start);
+    start = nl + 1;
+
+    if (!longClose.empty()) {
+      size_t close = s.find(longClose);
+      if (close == std::string_view::npos)
+        continue;
+      longClose.clear();
+      continue; // code after a closing ]] on the same line is rare
+    }
+    size_t i = skipSpaces(s, 0);
+    if (s.compare(i, 2, "--") == 0) {
+      size_t b = i + 2;
+      if (b < s.size() && s[b] == '[') {
+        size_t eq = b + 1;
+        while (eq < s.size() && s[eq] == '=')
+          ++eq;
+        if (eq < s.size() && s[eq] == '[') {
+          std::string close = "]" + std::string(eq - b - 1, '=') + "]";
+          if (s.find(close, eq) == std::string_view::npos)
+            longClose = close;
+        }
+      }
+      continue;
+    }
+
+    Symbol sym;
+    sym.kind = Kind::LuaFunction;
+    sym.line = line;
+    size_t nameAt = 0;
+    bool isLocal = startsWithWord(s, i, "local");
+    size_t j = isLocal ? skipSpaces(s, i + 5) : i;
+    if (startsWithWord(s, j, "function")) {
+      j = skipSpaces(s, j + 8);
+      if (isLocal) {
+        size_t len = luaIdent(s, j);
+        if (len == 0)
+          continue;
+        sym.name.assign(s.substr(j, len));
+        nameAt = j;
+      } else if (luaDottedName(s, j, sym.scope, sym.name, nameAt) == 0) {
+        continue;
+      }
+    } else {
+      // name = function(...)  /  local name = function(...)
+      size_t len = isLocal ? luaIdent(s, j)
+                           : luaDottedName(s, j, sym.scope, sym.name, nameAt);
+      if (len == 0)
+        continue;
+      if (isLocal) {
+        sym.name.assign(s.substr(j, len));
+        nameAt = j;
+      }
+      size_t k = skipSpaces(s, j + len);
+      if (k >= s.size() || s[k] != '=' || (k + 1 < s.size() && s[k + 1] == '='))
+        continue;
+      k = skipSpaces(s, k + 1);
+      if (!startsWithWord(s, k, "function"))
+        continue;
+    }
+    sym.column = (int)nameAt;
+    out.push_back(std::move(sym));
+  }
+}
+
+struct SymbolIndex::Snapshot {
+  MappedFile file;
+  const Header *header = nullptr;
+  const FileEntry *files = nullptr;
+  const SymbolEntry *symbols = nullptr;
+  const char *strings = nullptr;
+
+  std::string_view str(uint32_t offset, uint32_t len) const {
+    return std::string_view(strings + offset, len);
+  }
+  std::string_view name(const SymbolEntry &e) const {
+    return str(e.nameOffset, e.nameLen);
+  }
+  std::string path(uint32_t id) const {
+    return std::string(str(files[id].pathOffset, files[id].pathLen));
+  }
+};
+
+SymbolIndex::~SymbolIndex() { stop(); }
+
+bool SymbolIndex::isIndexable(const std::string &path) {
+  static const char *exts[] = {".cpp", ".cc", ".cxx", ".c",   ".h",
+                               ".hpp", ".hh", ".hxx", ".inl", ".lua"};
+  std::string ext = std::filesystem::path(path).extension().string();
+  for (const char *e : exts) {
+    if (ext == e)
+      return true;
+  }
+  return false;
+}
+
+const char *SymbolIndex::kindName(Kind kind) {
+  switch (kind) {
+  case Kind::Function:
+    return "function";
+  case Kind::Class:
+    return "class";
+  case Kind::Struct:
+    return "struct";
+  case Kind::LuaFunction:
+    return "lua function";
+  }
+  return "";
+}
+
+void SymbolIndex::start(const std::string &root, const std::string &indexPath) {
+  stop();
+  root_ = root;
+  indexPath_ = indexPath;
+  stop_ = false;
+  thread_ = std::thread(&SymbolIndex::run, this);
+}
+
+void SymbolIndex::stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  if (thread_.joinable())
+    thread_.join();
+}
+
+void SymbolIndex::updateFile(const std::string &path) {
+  if (!isIndexable(path))
+    return;
+  // The index keys files by the walker's spelling (root_ + "/" + relative
+  // path); the editor may have the same file as "foo.cpp", "./foo.cpp" or
+  // an absolute path. Files the walker wouldn't visit are left out.
+  namespace fs = std::filesystem;
+  std::error_code ec;
+  fs::path relative = fs::relative(path, root_, ec).lexically_normal();
+  if (ec || relative.empty() || relative.is_absolute())
+    return;
+  for (const fs::path &part : relative.parent_path()) {
+    if (part == ".." || WorkspaceWalker::isIgnoredDirectory(part.string()))
+      return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    updates_.push_back((fs::path(root_) / relative).string());
+  }
+  cv_.notify_one();
+}
+
+bool SymbolIndex::ready() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return snapshot_ != nullptr;
+}
+
+size_t SymbolIndex::symbolCount() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return snapshot_ ? snapshot_->header->symbolCount : 0;
+}
+
+std::shared_ptr<const SymbolIndex::Snapshot>
+SymbolIndex::load(const std::string &path) {
+  auto snap = std::make_shared<Snapshot>();
+  if (!snap->file.open(path) || snap->file.size() < sizeof(Header))
+    return nullptr;
+  const char *base = snap->file.data();
+  uint64_t size = snap->file.size();
+  const Header *h = (const Header *)base;
+  if (std::memcmp(h->magic, kMagic, 4) != 0 || h->version != kVersion)
+    return nullptr;
+  auto fits = [size](uint64_t off, uint64_t len) {
+    return off <= size && len <= size - off;
+  };
+  if (!fits(h->filesOffset, (uint64_t)h->fileCount * sizeof(FileEntry)) ||
+      !fits(h->symbolsOffset, (uint64_t)h->symbolCount * sizeof(SymbolEntry)) ||
+      !fits(h->stringsOffset, h->stringsSize))
+    return nullptr;
+
+  snap->header = h;
+  snap->files = (const FileEntry *)(base + h->filesOffset);
+  snap->symbols = (const SymbolEntry *)(base + h->symbolsOffset);
+  snap->strings = base + h->stringsOffset;
+  for (uint32_t i = 0; i < h->fileCount; ++i) {
+    const FileEntry &f = snap->files[i];
+    if ((uint64_t)f.pathOffset + f.pathLen > h->stringsSize)
+      return nullptr;
+  }
+  for (uint32_t i = 0; i < h->symbolCount; ++i) {
+    const SymbolEntry &e = snap->symbols[i];
+    if ((uint64_t)e.nameOffset + e.nameLen > h->stringsSize ||
+        (uint64_t)e.scopeOffset + e.scopeLen > h->stringsSize ||
+        e.file >= h->fileCount)
+      return nullptr;
+  }
+  return snap;
+}
+
+bool SymbolIndex::rebuild(std::vector<FileInfo> files,
+                          const std::unordered_set<std::string> &force) {
+  std::shared_ptr<const Snapshot> old;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    old = snapshot_;
+  }
+  std::sort(files.begin(), files.end(),
+            [](const FileInfo &a, const FileInfo &b) { return a.path < b.path; });
+
+  // Unchanged files keep the symbols the old index has for them
+  std::vector<Pending> symbols;
+  std::vector<uint32_t> changed;
+  std::vector<int64_t> oldToNew;
+  if (old) {
+    oldToNew.assign(old->header->fileCount, -1);
+    std::unordered_map<std::string, uint32_t> oldIds;
+    for (uint32_t i = 0; i < old->header->fileCount; ++i)
+      oldIds.emplace(old->path(i), i);
+    for (size_t i = 0; i < files.size(); ++i) {
+      auto it = oldIds.find(files[i].path);
+      if (it != oldIds.end() && !force.count(files[i].path)) {
+        const FileEntry &e = old->files[it->second];
+        if (e.mtime == files[i].mtime && e.size == files[i].size) {
+          oldToNew[it->second] = (int64_t)i;
+          continue;
+        }
+      }
+      changed.push_back((uint32_t)i);
+    }
+    if (changed.empty() &&
+        files.size() == old->header->fileCount)
+      return true;
+    for (uint32_t i = 0; i < old->header->symbolCount; ++i) {
+      const SymbolEntry &e = old->symbols[i];
+      if (oldToNew[e.file] < 0)
+        continue;
+      Pending p;
+      p.symbol.name = std::string(old->name(e));
+      p.symbol.scope = std::string(old->str(e.scopeOffset, e.scopeLen));
+      p.symbol.kind = (Kind)e.kind;
+      p.symbol.line = (int)e.line;
+      p.symbol.column = (int)e.column;
+      p.file = (uint32_t)oldToNew[e.file];
+      symbols.push_back(std::move(p));
+    }
+  } else {
+    for (size_t i = 0; i < files.size(); ++i)
+      changed.push_back((uint32_t)i);
+  }
+
+  // Extract the rest on a small pool
+  std::mutex symbolsMutex;
+  std::atomic<size_t> next{0};
+  auto worker = [&]() {
+    std::vector<Symbol> found;
+    while (!stop_) {
+      size_t k = next++;
+      if (k >= changed.size())
+        break;
+      const FileInfo &info = files[changed[k]];
+      if (info.size > kMaxIndexedSize)
+        continue;
+      MappedFile file(info.path);
+      if (!file.isOpen() || WorkspaceWalker::looksBinary(file.data(), file.size()))
+        continue;
+      found.clear();
+      if (isLuaPath(info.path))
+        extractLua(file.data(), file.size(), found);
+      else
+        extractCpp(file.data(), file.size(), found);
+      std::lock_guard<std::mutex> lock(symbolsMutex);
+      for (auto &sym : found)
+        symbols.push_back({std::move(sym), changed[k]});
+    }
+  };
+  unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+  std::vector<std::thread> pool;
+  for (unsigned i = 1; i < threads && i < changed.size(); ++i)
+    pool.emplace_back(worker);
+  worker();
+  for (auto &t : pool)
+    t.join();
+  if (stop_)
+    return false;
+
+  std::sort(symbols.begin(), symbols.end(),
+            [](const Pending &a, const Pending &b) {
+              if (a.symbol.name != b.symbol.name)
+                return a.symbol.name < b.symbol.name;
+              if (a.file != b.file)
+                return a.file < b.file;
+              return a.symbol.line < b.symbol.line;
+            });
+
+  // Serialize; names repeat a lot, so identical strings share storage
+  std::string strings;
+  std::unordered_map<std::string, uint32_t> interned;
+  auto intern = [&](const std::string &s) {
+    auto it = interned.find(s);
+    if (it != interned.end())
+      return it->second;
+    uint32_t offset = (uint32_t)strings.size();
+    strings += s;
+    interned.emplace(s, offset);
+    return offset;
+  };
+  std::vector<FileEntry> fileTable(files.size());
+  for (size_t i = 0; i < files.size(); ++i)
+    fileTable[i] = {files[i].mtime, files[i].size, intern(files[i].path),
+                    (uint32_t)files[i].path.size()};
+  std::vector<SymbolEntry> symbolTable(symbols.size());
+  for (size_t i = 0; i < symbols.size(); ++i) {
+    const Symbol &sym = symbols[i].symbol;
+    SymbolEntry &e = symbolTable[i];
+    e.nameOffset = intern(sym.name);
+    e.nameLen = (uint16_t)std::min<size_t>(sym.name.size(), 0xffff);
+    e.scopeOffset = intern(sym.scope);
+    e.scopeLen = (uint16_t)std::min<size_t>(sym.scope.size(), 0xffff);
+    e.file = symbols[i].file;
+    e.line = (uint32_t)sym.line;
+    e.column = (uint32_t)sym.column;
+    e.kind = (uint8_t)sym.kind;
+    std::memset(e.reserved, 0, sizeof(e.reserved));
+  }
+
+  Header h;
+  std::memcpy(h.magic, kMagic, 4);
+  h.version = kVersion;
+  h.fileCount = (uint32_t)fileTable.size();
+  h.symbolCount = (uint32_t)symbolTable.size();
+  h.filesOffset = sizeof(Header);
+  h.symbolsOffset = h.filesOffset + fileTable.size() * sizeof(FileEntry);
+  h.stringsOffset = h.symbolsOffset + symbolTable.size() * sizeof(SymbolEntry);
+  h.stringsSize = strings.size();
+
+  std::error_code ec;
+  std::filesystem::path target(indexPath_);
+  if (target.has_parent_path())
+    std::filesystem::create_directories(target.parent_path(), ec);
+  std::string tmp = indexPath_ + ".tmp";
+  {
+    std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+    if (!out)
+      return false;
+    out.write((const char *)&h, sizeof(h));
+    out.write((const char *)fileTable.data(),
+              (std::streamsize)(fileTable.size() * sizeof(FileEntry)));
+    out.write((const char *)symbolTable.data(),
+              (std::streamsize)(symbolTable.size() * sizeof(SymbolEntry)));
+    out.write(strings.data(), (std::streamsize)strings.size());
+    if (!out)
+      return false;
+  }
+  std::filesystem::rename(tmp, indexPath_, ec);
+  if (ec)
+    return false;
+
+  auto snap = load(indexPath_);
+  if (!snap)
+    return false;
+  std::lock_guard<std::mutex> lock(mutex_);
+  snapshot_ = snap;
+  return true;
+}
+
+void SymbolIndex::run() {
+  if (auto snap = load(indexPath_)) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    snapshot_ = snap;
+  }
+
+  building_ = true;
+  std::vector<FileInfo> files;
+  WorkspaceWalker::walk(root_, &stop_,
+                        [&](const std::filesystem::path &path, uintmax_t size) {
+                          std::string p = path.string();
+                          if (isIndexable(p))
+                            files.push_back({p, modificationTime(path), size});
+                        });
+  if (!stop_)
+    rebuild(std::move(files), {});
+  building_ = false;
+
+  for (;;) {
+    // Every save queued so far goes into one rebuild, so a burst of saves
+    // rewrites the index once rather than once per file
+    std::unordered_set<std::string> paths;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait(lock, [this] { return stop_ || !updates_.empty(); });
+      if (stop_)
+        return;
+      for (std::string &path : updates_)
+        paths.insert(std::move(path));
+      updates_.clear();
+    }
+
+    // Same file list as the current index, with these files refreshed
+    std::shared_ptr<const Snapshot> snap;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      snap = snapshot_;
+    }
+    std::vector<FileInfo> current;
+    bool changed = false;
+    if (snap) {
+      for (uint32_t i = 0; i < snap->header->fileCount; ++i) {
+        const FileEntry &f = snap->files[i];
+        std::string p = snap->path(i);
+        if (paths.count(p)) {
+          changed = true; // refreshed below, or gone
+          continue;
+        }
+        current.push_back({std::move(p), f.mtime, f.size});
+      }
+    }
+    for (const std::string &path : paths) {
+      std::error_code ec;
+      uintmax_t size = std::filesystem::file_size(path, ec);
+      if (ec)
+        continue;
+      current.push_back({path, modificationTime(path), size});
+      changed = true;
+    }
+    if (!changed)
+      continue;
+    building_ = true;
+    rebuild(std::move(current), paths);
+    building_ = false;
+  }
+}
+
+std::vector<SymbolIndex::Location>
+SymbolIndex::lookup(std::string_view name) const {
+  std::shared_ptr<const Snapshot> snap;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    snap = snapshot_;
+  }
+  std::vector<Location> locations;
+  if (!snap)
+    return locations;
+  const SymbolEntry *begin = snap->symbols;
+  const SymbolEntry *end = begin + snap->header->symbolCount;
+  const SymbolEntry *it = std::lower_bound(
+      begin, end, name, [&](const SymbolEntry &e, std::string_view n) {
+        return snap->name(e) < n;
+      });
+  for (; it != end && snap->name(*it) == name; ++it) {
+    locations.push_back({snap->path(it->file),
+                         std::string(snap->str(it->scopeOffset, it->scopeLen)),
+                         (Kind)it->kind, (int)it->line, (int)it->column});
+  }
+  return locations;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+// ctags-style definitions for the C++ and Lua files in the workspace:
+// functions and methods with a body, classes and structs with a body, Lua
+// `function a.b:c()` / `local function f()` and locals or fields assigned a
+// function. A background pass extracts symbols on a thread pool, re-reading
+// only files whose mtime or size changed, and writes them sorted by name to
+// one file (e.g. .donutex/symbols.idx) that is mapped and binary-searched
+// in place. Saving a file re-indexes just that file; saves that queue up
+// while a rebuild runs are folded into the next one.
+class SymbolIndex {
+public:
+  enum class Kind : uint8_t { Function, Class, Struct, LuaFunction };
+
+  struct Symbol {
+    std::string name;
+    std::string scope; // "TextEditor" for TextEditor::render, "M" for M.f
+    Kind kind;
+    int line;   // 0-based
+    int column; // 0-based byte column of the name
+  };
+
+  struct Location {
+    std::string path;
+    std::string scope;
+    Kind kind;
+    int line;
+    int column;
+  };
+
+  SymbolIndex() = default;
+  ~SymbolIndex();
+  SymbolIndex(const SymbolIndex &) = delete;
+  SymbolIndex &operator=(const SymbolIndex &) = delete;
+
+  void start(const std::string &root, const std::string &indexPath);
+  void stop();
+  // Queues a re-index of one file, e.g. after it was saved.
+  void updateFile(const std::string &path);
+
+  bool ready() const;
+  bool building() const { return building_.load(); }
+  size_t symbolCount() const;
+  // Every definition named `name`. Reads the mapped index only.
+  std::vector<Location> lookup(std::string_view name) const;
+
+  static bool isIndexable(const std::string &path);
+  static const char *kindName(Kind kind);
+  static void extractCpp(const char *data, size_t size,
+                         std::vector<Symbol> &out);
+  static void extractLua(const char *data, size_t size,
+                         std::vector<Symbol> &out);
+
+private:
+  struct Snapshot;
+  struct FileInfo {
+    std::string path;
+    int64_t mtime;
+    uint64_t size;
+  };
+
+  void run();
+  // force: files to re-read even if their mtime and size look unchanged
+  bool rebuild(std::vector<FileInfo> files,
+               const std::unordered_set<std::string> &force);
+  static std::shared_ptr<const Snapshot> load(const std::string &path);
+
+  std::string root_;
+  std::string indexPath_;
+  std::thread thread_;
+  std::atomic<bool> stop_{false};
+  std::atomic<bool> building_{false};
+
+  mutable std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<std::string> updates_;
+  std::shared_ptr<const Snapshot> snapshot_;
+};
@@ -0,0 +1,359 @@
+#include "TaskRunner.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <system_error>
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ;
+#endif
+
+// Lines handed to the UI at once; bigger reads are split into several
+static const size_t kBatchLines = 512;
+// Output without a newline is cut into lines of this size
+static const size_t kMaxLineBytes = 64 * 1024;
+// How long output is still read after the child exited. Whatever it left
+// running in the background may hold the pipes open for good.
+static const std::chrono::milliseconds kDrainTime(250);
+
+TaskRunner::~TaskRunner() {
+  // A task that ignores SIGTERM is killed after a grace period rather than
+  // holding up the editor's exit
+  if (stop()) {
+#ifndef _WIN32
+    for (int i = 0; i < 20 && running_.load(); ++i)
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    int pid = pid_.load();
+    if (running_.load() && pid > 0)
+      kill(-pid, SIGKILL);
+#endif
+  }
+  if (thread_.joinable())
+    thread_.join();
+#ifdef _WIN32
+  if (job_)
+    CloseHandle((HANDLE)job_);
+#endif
+}
+
+LogSeverity TaskRunner::classify(const std::string &line) {
+  if (line.find("error:") != std::string::npos ||
+      line.find("error C") != std::string::npos ||
+      line.find("Error ") == 0)
+    return LogSeverity::Error;
+  if (line.find("warning:") != std::string::npos ||
+      line.find("warning C") != std::string::npos)
+    return LogSeverity::Warning;
+  return LogSeverity::Info;
+}
+
+bool TaskRunner::start(const std::string &command, std::string &error) {
+  if (running_.load()) {
+    error = "a task is already running: " + command_;
+    return false;
+  }
+  if (thread_.joinable())
+    thread_.join();
+  command_ = command;
+
+#ifdef _WIN32
+  if (job_) {
+    CloseHandle((HANDLE)job_);
+    job_ = nullptr;
+  }
+  SECURITY_ATTRIBUTES inherit{sizeof(inherit), nullptr, TRUE};
+  HANDLE readEnd = nullptr, writeEnd = nullptr;
+  if (!CreatePipe(&readEnd, &writeEnd, &inherit, 0)) {
+    error = std::system_category().message((int)GetLastError());
+    return false;
+  }
+  SetHandleInformation(readEnd, HANDLE_FLAG_INHERIT, 0);
+
+  STARTUPINFOA startup{};
+  startup.cb = sizeof(startup);
+  startup.dwFlags = STARTF_USESTDHANDLES;
+  startup.hStdInput = GetStdHandle(STD_INPUT_HANDLE);
+  startup.hStdOutput = writeEnd;
+  startup.hStdError = writeEnd;
+  PROCESS_INFORMATION info{};
+  std::string commandLine = "cmd.exe /c " + command;
+  // Started suspended so everything it starts lands in the job as well
+  BOOL ok = CreateProcessA(nullptr, &commandLine[0], nullptr, nullptr, TRUE,
+                           CREATE_SUSPENDED | CREATE_NO_WINDOW, nullptr,
+                           nullptr, &startup, &info);
+  DWORD spawnError = GetLastError();
+  CloseHandle(writeEnd);
+  if (!ok) {
+    error = std::system_category().message((int)spawnError);
+    CloseHandle(readEnd);
+    return false;
+  }
+  job_ = CreateJobObjectA(nullptr, nullptr);
+  if (job_)
+    AssignProcessToJobObject((HANDLE)job_, info.hProcess);
+  ResumeThread(info.hThread);
+  CloseHandle(info.hThread);
+  process_ = info.hProcess;
+  pipe_ = readEnd;
+#else
+  int out[2], err[2];
+  if (pipe(out) != 0) {
+    error = std::strerror(errno);
+    return false;
+  }
+  if (pipe(err) != 0) {
+    error = std::strerror(errno);
+    close(out[0]);
+    close(out[1]);
+    return false;
+  }
+
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  posix_spawn_file_actions_adddup2(&actions, out[1], STDOUT_FILENO);
+  posix_spawn_file_actions_adddup2(&actions, err[1], STDERR_FILENO);
+  for (int fd : {out[0], out[1], err[0], err[1]})
+    posix_spawn_file_actions_addclose(&actions, fd);
+  // Own process group, so stop() reaches everything the shell starts
+  posix_spawnattr_t attr;
+  posix_spawnattr_init(&attr);
+  posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP);
+  posix_spawnattr_setpgroup(&attr, 0);
+
+  const char *argv[] = {"/bin/sh", "-c", command.c_str(), nullptr};
+  pid_t pid = -1;
+  int rc = posix_spawn(&pid, "/bin/sh", &actions, &attr,
+                       const_cast<char *const *>(argv), environ);
+  posix_spawn_file_actions_destroy(&actions);
+  posix_spawnattr_destroy(&attr);
+  close(out[1]);
+  close(err[1]);
+  if (rc != 0) {
+    error = std::strerror(rc);
+    close(out[0]);
+    close(err[0]);
+    return false;
+  }
+  for (int fd : {out[0], err[0]}) {
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+  }
+  outFd_ = out[0];
+  errFd_ = err[0];
+  pid_ = pid;
+#endif
+
+  started_ = std::chrono::steady_clock::now();
+  running_ = true;
+  thread_ = std::thread(&TaskRunner::run, this);
+  return true;
+}
+
+bool TaskRunner::stop() {
+#ifdef _WIN32
+  if (!running_.load() || !job_)
+    return false;
+  return TerminateJobObject((HANDLE)job_, 1) != 0;
+#else
+  int pid = pid_.load();
+  if (pid <= 0)
+    return false;
+  return kill(-pid, SIGTERM) == 0;
+#endif
+}
+
+void TaskRunner::emit(std::deque<OutputLine> &lines) {
+  if (lines.empty())
+    return;
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto &line : lines)
+    pending_.push_back(std::move(line));
+  lines.clear();
+  // A task printing faster than take() drains is kept to its newest lines
+  size_t max = maxQueued_.load();
+  while (pending_.size() > max) {
+    pending_.pop_front();
+    dropped_++;
+  }
+}
+
+size_t TaskRunner::take(OutputLog &log, size_t maxLines) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (dropped_ > 0) {
+    log.push({(ImTextureID)0,
+              "(" + std::to_string(dropped_) + " lines of task output dropped)",
+              LogSeverity::Warning, std::chrono::system_clock::now()});
+    dropped_ = 0;
+  }
+  size_t count = std::min(maxLines, pending_.size());
+  for (size_t i = 0; i < count; ++i) {
+    log.push(std::move(pending_.front()));
+    pending_.pop_front();
+  }
+  return count;
+}
+
+size_t TaskRunner::queued() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return pending_.size();
+}
+
+void TaskRunner::run() {
+  std::deque<OutputLine> batch;
+  auto addLine = [&](std::string text) {
+    if (!text.empty() && text.back() == '\r')
+      text.pop_back();
+    LogSeverity severity = classify(text);
+    batch.push_back({(ImTextureID)0, std::move(text), severity,
+                     std::chrono::system_clock::now()});
+    if (batch.size() >= kBatchLines)
+      emit(batch);
+  };
+
+  // Splits what was read into lines, keeping an unfinished one in partial
+  auto addText = [&](std::string &partial, const char *data, size_t size) {
+    partial.append(data, size);
+    size_t start = 0, nl;
+    while ((nl = partial.find('\n', start)) != std::string::npos) {
+      addLine(partial.substr(start, nl - start));
+      start = nl + 1;
+    }
+    partial.erase(0, start);
+    if (partial.size() >= kMaxLineBytes) {
+      addLine(std::move(partial));
+      partial.clear();
+    }
+  };
+  std::vector<char> buf(64 * 1024);
+  bool exited = false;
+  std::chrono::steady_clock::time_point exitedAt;
+
+  int code = -1;
+#ifdef _WIN32
+  HANDLE pipe = (HANDLE)pipe_;
+  HANDLE process = (HANDLE)process_;
+  std::string partial;
+  for (;;) {
+    DWORD available = 0;
+    if (!PeekNamedPipe(pipe, nullptr, 0, nullptr, &available, nullptr))
+      break; // every writer closed its end
+    if (available > 0) {
+      DWORD n = 0;
+      DWORD want = (DWORD)std::min<size_t>(available, buf.size());
+      if (!ReadFile(pipe, buf.data(), want, &n, nullptr) || n == 0)
+        break;
+      addText(partial, buf.data(), n);
+      continue;
+    }
+    emit(batch); // one hand-over each time the pipe runs dry
+    if (!exited) {
+      // Doubles as the wait for more output
+      if (WaitForSingleObject(process, 50) == WAIT_OBJECT_0) {
+        exited = true;
+        exitedAt = std::chrono::steady_clock::now();
+      }
+    } else if (std::chrono::steady_clock::now() - exitedAt >= kDrainTime) {
+      break;
+    } else {
+      Sleep(20);
+    }
+  }
+  if (!partial.empty())
+    addLine(std::move(partial));
+  WaitForSingleObject(process, INFINITE);
+  DWORD exitCode = 0;
+  if (GetExitCodeProcess(process, &exitCode))
+    code = (int)exitCode;
+  CloseHandle(process);
+  CloseHandle(pipe);
+  process_ = pipe_ = nullptr;
+#else
+  struct Stream {
+    int fd;
+    std::string partial;
+  } streams[2] = {{outFd_, {}}, {errFd_, {}}};
+  int status = 0;
+  pid_t pid = pid_.load();
+  int open = 2;
+  while (open > 0) {
+    if (!exited) {
+      pid_t reaped = waitpid(pid, &status, WNOHANG);
+      if (reaped == pid || (reaped < 0 && errno == ECHILD)) {
+        exited = true;
+        exitedAt = std::chrono::steady_clock::now();
+      }
+    } else if (std::chrono::steady_clock::now() - exitedAt >= kDrainTime) {
+      break;
+    }
+    pollfd fds[2];
+    int count = 0;
+    for (auto &stream : streams)
+      if (stream.fd >= 0)
+        fds[count++] = {stream.fd, POLLIN, 0};
+    // Wakes up now and then to notice the child exiting
+    int ready = poll(fds, count, exited ? 50 : 100);
+    if (ready < 0) {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+    if (ready == 0)
+      continue;
+    for (auto &stream : streams) {
+      if (stream.fd < 0)
+        continue;
+      ssize_t n;
+      while ((n = read(stream.fd, buf.data(), buf.size())) > 0)
+        addText(stream.partial, buf.data(), (size_t)n);
+      if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) {
+        if (!stream.partial.empty())
+          addLine(std::move(stream.partial));
+        stream.partial.clear();
+        close(stream.fd);
+        stream.fd = -1;
+        open--;
+      }
+    }
+    emit(batch); // one hand-over per wakeup
+  }
+  for (auto &stream : streams) {
+    if (!stream.partial.empty())
+      addLine(std::move(stream.partial));
+    if (stream.fd >= 0)
+      close(stream.fd);
+  }
+
+  if (!exited) {
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+    }
+  }
+  pid_ = -1;
+  if (WIFEXITED(status))
+    code = WEXITSTATUS(status);
+  else if (WIFSIGNALED(status))
+    code = 128 + WTERMSIG(status);
+#endif
+
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - started_)
+                       .count();
+  char summary[96];
+  snprintf(summary, sizeof(summary), "Task finished with exit code %d (%.1f s)",
+           code, seconds);
+  addLine(summary);
+  batch.back().severity = code == 0 ? LogSeverity::Info : LogSeverity::Error;
+  emit(batch);
+  running_ = false;
+}
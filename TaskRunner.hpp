@@ -0,0 +1,71 @@
+#pragma once
+
+#include "OutputLog.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Runs one shell command at a time in the background (builds, tests). The
+// child is started with posix_spawn and its stdout and stderr are read
+// through non-blocking pipes on an I/O thread, which hands finished lines
+// over in batches. The UI thread collects a bounded number of them per
+// frame with take(), so a chatty build never stalls rendering. On Windows
+// the child runs in a job object, with stderr merged into stdout. Reading
+// stops shortly after the child exits, even if something it left running
+// in the background still holds the pipes.
+class TaskRunner {
+public:
+  TaskRunner() = default;
+  ~TaskRunner();
+  TaskRunner(const TaskRunner &) = delete;
+  TaskRunner &operator=(const TaskRunner &) = delete;
+
+  // Runs command through the shell in the current directory. Returns false
+  // with error set if a task is still running or the spawn failed.
+  bool start(const std::string &command, std::string &error);
+  // Asks the running task (and anything it started) to terminate; on
+  // Windows they are killed. Returns false if nothing is running.
+  bool stop();
+  bool running() const { return running_.load(); }
+  const std::string &command() const { return command_; }
+
+  // Moves up to maxLines queued lines into log. UI thread only. If more
+  // than maxQueued lines piled up, the oldest were dropped; a line saying
+  // how many comes first.
+  size_t take(OutputLog &log, size_t maxLines);
+  size_t queued() const;
+  // Usually the output log's capacity: lines beyond that would only push
+  // each other out of the log anyway
+  void setMaxQueued(size_t lines) { maxQueued_ = std::max<size_t>(lines, 1); }
+
+  // Severity guessed from compiler-style "error:" / "warning:" text
+  static LogSeverity classify(const std::string &line);
+
+private:
+  void run();
+  void emit(std::deque<OutputLine> &lines);
+
+  std::string command_;
+  std::thread thread_;
+  std::atomic<bool> running_{false};
+  std::chrono::steady_clock::time_point started_;
+
+#ifdef _WIN32
+  void *process_ = nullptr;
+  void *job_ = nullptr; // kept until the next start(), for stop()
+  void *pipe_ = nullptr;
+#else
+  std::atomic<int> pid_{-1};
+  int outFd_ = -1;
+  int errFd_ = -1;
+#endif
+
+  mutable std::mutex mutex_;
+  std::deque<OutputLine> pending_;
+  std::atomic<size_t> maxQueued_{10000};
+  size_t dropped_ = 0; // lines dropped from pending_ since the last take()
+};
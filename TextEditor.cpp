@@ -1,23 +1,43 @@
 #include "TextEditor.hpp"
+#include "BufferManager.hpp"
+#include "BufferSearch.hpp"
 #include "EditorCommands.hpp"
 #include "EditorRenderer.hpp"
 #include "FileExplorer.hpp"
 #include "FileOperations.hpp"
+#include "FindInFilesPanel.hpp"
+#include "LargeFileView.hpp"
+#include "LineDiff.hpp"
+#include "Macros.hpp"
+#include "MultiCursor.hpp"
+#include "QuickOpenPanel.hpp"
+#include "StackThread.hpp"
 #include "IconManager.hpp"
 #include "LuaBindings.hpp"
 #include "OutputPanel.hpp"
 #include "imgui.h"
+#include <algorithm>
 #include <cstring>
+#include <filesystem>
+#include <iterator>
+#include <regex>
 
 TextEditor::TextEditor()
     : filename(""), content(), modified(false), showFileExplorer(true),
-      showOutput(true), showSettings(false), showGrid(false),
+      showOutput(true), showSettings(false), showFindInFiles(false),
+      showQuickOpen(false), focusQuickOpen(false), showGrid(false),
       showLineNumbers(true), focusEditor(false), closeEditor(false),
+      showFind(false), focusFind(false), findRegex(false), showReplace(false),
+      contentVersion(0),
+      largeFileThreshold((size_t)256 << 20),
+      bufferMemoryBudget((size_t)512 << 20),
       cursorIndex(0), cursorLine(0), cursorColumn(0), selectionStart(-1),
       selectionEnd(-1), isDragging(false), scrollX(0.0f), scrollY(0.0f),
       maxContentWidth(0.0f), lineHeight(0.0f), caretFollow(true),
       hDragging(false), hDragMouseStart(0.0f), hDragScrollStart(0.0f),
       vDragging(false), vDragMouseStart(0.0f), vDragScrollStart(0.0f) {
+  undoHistoryLimit = (size_t)32 << 20;
+
   // Initialize subsystems
   lua_ = new LuaBindings(this);
   iconManager_ = new IconManager(this);
@@ -26,14 +46,26 @@ TextEditor::TextEditor()
   renderer_ = new EditorRenderer(this, lua_);
   explorer_ = new FileExplorer(this, iconManager_, commands_);
   outputPanel_ = new OutputPanel(this, commands_);
+  findInFiles_ = new FindInFilesPanel(this);
+  quickOpen_ = new QuickOpenPanel(this);
+  largeView_ = new LargeFileView(this);
+  buffers_ = new BufferManager(this);
+  macros_ = new Macros(this);
+  multiCursor_ = new MultiCursor(this);
 
   iconManager_->loadIcons(ImGui::GetIO().FontGlobalScale);
   commands_->registerCommands();
   lua_->loadPlugins();
-  commands_->refreshFileList();
+  symbolIndex.start(".", ".donutex/symbols.idx");
 }
 
 TextEditor::~TextEditor() {
+  delete multiCursor_;
+  delete macros_;
+  delete buffers_;
+  delete largeView_;
+  delete quickOpen_;
+  delete findInFiles_;
   delete outputPanel_;
   delete explorer_;
   delete renderer_;
@@ -47,6 +79,13 @@ bool TextEditor::render() {
   ImGuiStyle &style = ImGui::GetStyle();
   style.Colors[ImGuiCol_TitleBgActive] = style.Colors[ImGuiCol_TitleBg];
 
+  // Swap in a file that finished loading in the background, then pick up
+  // anything appended to it on disk
+  fileOps_->pollLoad();
+  fileOps_->pollWatch();
+  logQueue_.drain(outputLines);
+  commands_->pollTasks();
+
   // Global shortcuts
   handleKeyboardShortcuts();
 
@@ -75,6 +114,15 @@ bool TextEditor::render() {
   ImGui::SetNextWindowSize(editorSize, ImGuiCond_Always);
   renderer_->renderEditor();
 
+  // Find bar floats over the top-right corner of the editor
+  if (showFind) {
+    renderer_->renderFindBar(editorPos, editorSize);
+  }
+
+  if (fileOps_->isLoading() || fileOps_->restoringBuffer()) {
+    renderer_->renderLoadProgress(editorPos, editorSize);
+  }
+
   // Output Panel
   if (showOutput) {
     outputPanel_->render(workPos, workSize, outputHeight, explorerWidth);
@@ -85,10 +133,25 @@ bool TextEditor::render() {
     renderer_->renderSettings();
   }
 
+  if (showFindInFiles) {
+    findInFiles_->render();
+  }
+
+  if (showQuickOpen) {
+    quickOpen_->render();
+  }
+
   // Lua hooks
   lua_->runHook("on_text_input");
   lua_->runHook("on_render");
 
+  // The line cache must not stay stale into the next frame
+  if (inTransaction()) {
+    log(LogSeverity::Warning, "An edit transaction was left open; committed");
+    while (inTransaction())
+      commitTransaction();
+  }
+
   return closeEditor;
 }
 
@@ -106,30 +169,457 @@ void TextEditor::handleKeyboardShortcuts() {
       fileOps_->saveFile();
     }
   }
+  if (io.KeyCtrl && ImGui::IsKeyPressed(ImGuiKey_W))
+    buffers_->close(buffers_->active());
+  if (io.KeyCtrl && ImGui::IsKeyPressed(ImGuiKey_Tab) &&
+      buffers_->count() > 1) {
+    size_t count = buffers_->count();
+    buffers_->activate((buffers_->active() + (io.KeyShift ? count - 1 : 1)) %
+                       count);
+  }
+  if (io.KeyCtrl && ImGui::IsKeyPressed(ImGuiKey_P)) {
+    showQuickOpen = true;
+    focusQuickOpen = true;
+  }
+  if (io.KeyCtrl && io.KeyShift && ImGui::IsKeyPressed(ImGuiKey_F)) {
+    showFindInFiles = true;
+  } else if (io.KeyCtrl && (ImGui::IsKeyPressed(ImGuiKey_F) ||
+                            ImGui::IsKeyPressed(ImGuiKey_H))) {
+    showFind = true;
+    focusFind = true;
+    showReplace = ImGui::IsKeyPressed(ImGuiKey_H);
+    if (hasSelection()) {
+      std::string sel = getSelectedText();
+      if (sel.find('\n') == std::string::npos)
+        findQuery = sel;
+    }
+  }
+  if (ImGui::IsKeyPressed(ImGuiKey_F12))
+    gotoDefinition();
+  if (ImGui::IsKeyPressed(ImGuiKey_F3)) {
+    if (io.KeyShift)
+      findPrev();
+    else
+      findNext();
+  }
 }
 
 void TextEditor::openFile(const std::string &fname) {
   fileOps_->openFile(fname);
 }
 
-void TextEditor::addOutput(ImTextureID icon, const std::string &text) {
-  outputLines.push_back({icon, text});
-  if (outputLines.size() > 1000) {
-    outputLines.erase(outputLines.begin());
+void TextEditor::gotoLine(int line, int col) {
+  if (fileOps_->isLoading()) {
+    fileOps_->gotoAfterLoad(line, col); // target is the file being opened
+    return;
+  }
+  if (largeView_->active()) {
+    largeView_->gotoLine((uint64_t)std::max(line, 0),
+                         (uint64_t)std::max(col, 0));
+    return;
+  }
+  line = std::clamp(line, 0, std::max(0, (int)lineCache.size() - 1));
+  cursorIndex = lineColToIndex(line, col);
+  selectionStart = selectionEnd = -1;
+  caretFollow = true;
+  focusEditor = true;
+}
+
+std::string TextEditor::wordAtCursor() const {
+  const size_t window = 128;
+  size_t pos = std::min((size_t)std::max(cursorIndex, 0), content.size());
+  size_t from = pos > window ? pos - window : 0;
+  std::string text =
+      content.substr(from, std::min(content.size(), pos + window) - from);
+  size_t at = pos - from;
+  size_t start = at, end = at;
+  while (start > 0 && WordIndex::isWordChar((unsigned char)text[start - 1]))
+    --start;
+  while (end < text.size() && WordIndex::isWordChar((unsigned char)text[end]))
+    ++end;
+  return text.substr(start, end - start);
+}
+
+void TextEditor::gotoDefinition() {
+  std::string word = wordAtCursor();
+  if (word.empty())
+    return;
+  auto defs = symbolIndex.lookup(word);
+  if (defs.empty()) {
+    addOutput(icons["error"], symbolIndex.ready()
+                                  ? "No definition found for " + word
+                                  : "Symbol index is still loading");
+    return;
+  }
+
+  // Prefer a definition in the current file
+  size_t pick = 0;
+  for (size_t i = 0; i < defs.size(); ++i) {
+    std::error_code ec;
+    if (!filename.empty() &&
+        std::filesystem::equivalent(defs[i].path, filename, ec)) {
+      pick = i;
+      break;
+    }
+  }
+  const auto &def = defs[pick];
+  std::error_code ec;
+  if (filename.empty() || !std::filesystem::equivalent(def.path, filename, ec))
+    openFile(def.path);
+  gotoLine(def.line, def.column);
+
+  if (defs.size() > 1) {
+    addOutput(std::to_string(defs.size()) + " definitions of " + word + ":");
+    for (const auto &d : defs)
+      addOutput(d.path + ":" + std::to_string(d.line + 1) + ":" +
+                std::to_string(d.column + 1) + ": " +
+                SymbolIndex::kindName(d.kind) + " " +
+                (d.scope.empty() ? "" : d.scope + "::") + word);
   }
 }
 
+void TextEditor::addOutput(ImTextureID icon, const std::string &text) {
+  // Lines carrying the error icon are errors as far as filtering goes
+  auto error = icons.find("error");
+  LogSeverity severity = icon != (ImTextureID)0 && error != icons.end() &&
+                                 icon == error->second
+                             ? LogSeverity::Error
+                             : LogSeverity::Info;
+  logQueue_.push({icon, text, severity, std::chrono::system_clock::now()});
+}
+
 void TextEditor::addOutput(const std::string &text) {
-  addOutput((ImTextureID)0, text);
+  log(LogSeverity::Info, text);
+}
+
+void TextEditor::log(LogSeverity severity, const std::string &text) {
+  logQueue_.push(
+      {(ImTextureID)0, text, severity, std::chrono::system_clock::now()});
 }
 
 // New edit helpers
+void TextEditor::rawInsert(int pos, const std::string &text) {
+  wordIndex.beginEdit(content, (size_t)pos, 0);
+  content.insert((size_t)pos, text);
+  wordIndex.endEdit(content, text.size());
+  contentVersion++;
+  markDirty(pos, 0, (int)text.size());
+}
+
+void TextEditor::rawInsertPieces(int pos, const std::vector<Piece> &pieces,
+                                 size_t length) {
+  wordIndex.beginEdit(content, (size_t)pos, 0);
+  content.insertPieces((size_t)pos, pieces);
+  wordIndex.endEdit(content, length);
+  contentVersion++;
+  markDirty(pos, 0, (int)length);
+}
+
+void TextEditor::rawErase(int pos, int len) {
+  wordIndex.beginEdit(content, (size_t)pos, (size_t)len);
+  content.erase((size_t)pos, (size_t)len);
+  wordIndex.endEdit(content, 0);
+  contentVersion++;
+  markDirty(pos, len, 0);
+}
+
+void TextEditor::appendUnrecorded(const std::string &text) {
+  if (text.empty())
+    return;
+  Piece piece = content.append(text.data(), text.size());
+  rawInsertPieces((int)content.size(), {piece}, text.size());
+  for (UndoNode &node : undo_.nodes) {
+    if (node.hasCheckpoint)
+      node.checkpoint.push_back(piece);
+  }
+}
+
+void TextEditor::rawSplice(const std::vector<PieceTable::Splice> &edits,
+                           const std::vector<Piece> &inserts,
+                           std::vector<PieceTable::Splice> *undo,
+                           std::vector<Piece> *undoPieces) {
+  if (edits.empty())
+    return;
+  wordEdits_.clear();
+  long long delta = 0;
+  for (const auto &edit : edits) {
+    size_t length = 0;
+    for (size_t k = edit.first; k < edit.first + edit.count; ++k)
+      length += inserts[k].length;
+    wordEdits_.push_back({edit.pos, edit.erase, length});
+    delta += (long long)length - (long long)edit.erase;
+  }
+  wordIndex.beginEdits(content, wordEdits_);
+  content.splice(edits, inserts, undo, undoPieces);
+  wordIndex.endEdits(content);
+  contentVersion++;
+  // One span from the first edit to the end of the last
+  int start = (int)edits.front().pos;
+  int erased = (int)(edits.back().pos + edits.back().erase) - start;
+  markDirty(start, erased, erased + (int)delta);
+}
+
+// Grows the span to cover an edit, after carrying its end across it
+void TextEditor::DirtySpan::add(int pos, int erased, int inserted) {
+  delta += inserted - erased;
+  if (start < 0) {
+    start = pos;
+    end = pos + inserted;
+    return;
+  }
+  int moved = end;
+  if (moved >= pos + erased)
+    moved += inserted - erased;
+  else if (moved > pos)
+    moved = pos;
+  start = std::min(start, pos);
+  end = std::max(moved, pos + inserted);
+}
+
+void TextEditor::markDirty(int pos, int erased, int inserted) {
+  changed_.add(pos, erased, inserted);
+  linesStale_.add(pos, erased, inserted);
+}
+
+void TextEditor::beginTransaction() { transactionDepth_++; }
+
+void TextEditor::commitTransaction() {
+  if (transactionDepth_ == 0 || --transactionDepth_ > 0)
+    return;
+  transactionStep_ = false;
+  if (transactionChanged_) {
+    transactionChanged_ = false;
+    onTextChanged();
+  }
+}
+
+TextEditor::UndoHistory::UndoHistory() {
+  nodes.resize(1);
+  nodes[0].hasCheckpoint = true; // an empty buffer
+}
+
 void TextEditor::clearUndoRedo() {
-  undoStack_.clear();
-  redoStack_.clear();
+  undo_ = UndoHistory();
+  undo_.nodes[0].checkpoint = content.pieceList();
+  editsSinceTrim_ = 0;
+}
+
+void TextEditor::breakUndoCoalescing() {
+  UndoNode &node = undo_.nodes[undo_.current];
+  if (!node.actions.empty())
+    node.actions.back().typed = false;
+}
+
+// Typed edits within this long of each other can become one undo step
+static const double kCoalesceSeconds = 1.0;
+// History size is checked against undoHistoryLimit every this many edits
+static const size_t kTrimInterval = 256;
+
+static char byteAt(const PieceTable &text, size_t pos) {
+  char c = 0;
+  text.forEachChunk(pos, 1, [&](const char *data, size_t) {
+    c = *data;
+    return false;
+  });
+  return c;
+}
+
+static bool isBlank(char c) { return c == ' ' || c == '\t' || c == '\n'; }
+
+// A word boundary: whitespace followed by anything else
+static bool startsWord(char before, char after) {
+  return isBlank(before) && !isBlank(after);
+}
+
+bool TextEditor::coalesceEdit(EditAction::Type type, int pos, int len,
+                              double now) {
+  // Only a leaf holding one typed edit grows; a state something branches
+  // from stays as it is
+  UndoNode &node = undo_.nodes[undo_.current];
+  if (node.parent < 0 || !node.children.empty() || node.actions.size() != 1)
+    return false;
+  EditAction &top = node.actions.back();
+  if (!top.typed || top.type != type || now - node.time > kCoalesceSeconds)
+    return false;
+  char first = byteAt(content, (size_t)pos);
+  char last = byteAt(content, (size_t)(pos + len - 1));
+  if (first == '\n' || last == '\n')
+    return false; // each line is its own step
+
+  pieceScratch_.clear();
+  content.slice((size_t)pos, (size_t)len, pieceScratch_);
+  bool append; // new text goes after the step's text rather than before
+  if (type == EditAction::Type::Insert && pos == top.pos + (int)top.length)
+    append = true;
+  else if (type == EditAction::Type::Erase && pos == top.pos)
+    append = true; // forward delete
+  else if (type == EditAction::Type::Erase && pos + len == top.pos)
+    append = false; // backspace
+  else
+    return false;
+
+  if (append) {
+    if (startsWord(top.last, first))
+      return false;
+    // slice() into the step's own list merges contiguous pieces
+    for (const Piece &piece : pieceScratch_) {
+      Piece &back = top.pieces.back();
+      if (back.buffer == piece.buffer &&
+          back.start + back.length == piece.start)
+        back.length += piece.length;
+      else
+        top.pieces.push_back(piece);
+    }
+    top.last = last;
+  } else {
+    if (startsWord(last, top.first))
+      return false;
+    top.pieces.insert(top.pieces.begin(), pieceScratch_.begin(),
+                      pieceScratch_.end());
+    top.pos = pos;
+    top.first = first;
+  }
+  top.length += (size_t)len;
+  node.time = now;
+  return true;
+}
+
+void TextEditor::recordEdit(EditAction::Type type, int pos, int len,
+                            bool typed) {
+  bool sameStep = transactionStep_;
+  if (transactionDepth_ > 0) {
+    typed = false;
+    transactionStep_ = true;
+  }
+  double now = ImGui::GetTime();
+  if (!sameStep && typed && coalesceEdit(type, pos, len, now))
+    return;
+
+  UndoNode &node = undo_.nodes[undo_.current];
+  if (!sameStep || node.parent < 0 || node.hasCheckpoint) {
+    // The state being left becomes a checkpoint every kCheckpointInterval
+    // levels. An insert is already in content, so it is cut back out.
+    if (node.depth % kCheckpointInterval == 0 && !node.hasCheckpoint) {
+      node.checkpoint = content.pieceList();
+      if (type == EditAction::Type::Insert)
+        PieceTable::erasePieces(node.checkpoint, (size_t)pos, (size_t)len);
+      node.hasCheckpoint = true;
+    }
+    UndoNode child;
+    child.parent = undo_.current;
+    child.seq = undo_.nextSeq++;
+    child.depth = node.depth + 1;
+    int index = (int)undo_.nodes.size();
+    node.children.push_back(index);
+    node.redoChild = index;
+    undo_.nodes.push_back(std::move(child));
+    undo_.current = index;
+  }
+
+  EditAction act;
+  act.type = type;
+  act.pos = pos;
+  act.length = (size_t)len;
+  content.slice((size_t)pos, (size_t)len, act.pieces);
+  act.typed = typed;
+  act.first = byteAt(content, (size_t)pos);
+  act.last = byteAt(content, (size_t)(pos + len - 1));
+  UndoNode &step = undo_.nodes[undo_.current];
+  step.actions.push_back(std::move(act));
+  step.time = now;
+}
+
+static size_t nodeBytes(const TextEditor::UndoNode &node) {
+  size_t bytes = node.children.capacity() * sizeof(int) +
+                 node.actions.capacity() * sizeof(TextEditor::EditAction) +
+                 node.checkpoint.capacity() * sizeof(Piece);
+  for (const auto &act : node.actions) {
+    bytes += act.pieces.capacity() * sizeof(Piece);
+    if (act.batch) {
+      const auto &batch = *act.batch;
+      bytes += sizeof(batch) +
+               (batch.redo.capacity() + batch.undo.capacity()) *
+                   sizeof(PieceTable::Splice) +
+               (batch.redoPieces.capacity() + batch.undoPieces.capacity()) *
+                   sizeof(Piece);
+    }
+  }
+  return bytes;
+}
+
+size_t TextEditor::undoHistoryBytes(const UndoHistory &history) {
+  size_t bytes = history.nodes.capacity() * sizeof(UndoNode);
+  for (const auto &node : history.nodes)
+    bytes += nodeBytes(node);
+  return bytes;
+}
+
+size_t TextEditor::undoHistoryTextBytes() const {
+  size_t bytes = 0;
+  for (const auto &node : undo_.nodes)
+    for (const auto &act : node.actions)
+      bytes += act.length;
+  return bytes;
+}
+
+// Keeps only the subtree under an ancestor of the current state, the
+// highest one that fits in 3/4 of the limit (so trimming doesn't repeat on
+// every check) and can serve as a root: it needs a checkpoint, which the
+// current state can take from content.
+void TextEditor::trimUndoHistory() {
+  if (transactionDepth_ > 0)
+    return; // its step must stay the current one
+  if (++editsSinceTrim_ < kTrimInterval)
+    return;
+  editsSinceTrim_ = 0;
+  if (undoHistoryBytes() <= undoHistoryLimit)
+    return;
+  size_t target = undoHistoryLimit / 4 * 3;
+
+  std::vector<UndoNode> &nodes = undo_.nodes;
+  std::vector<size_t> subtree(nodes.size(), 0);
+  for (size_t i = nodes.size(); i-- > 0;) {
+    subtree[i] += sizeof(UndoNode) + nodeBytes(nodes[i]);
+    if (nodes[i].parent >= 0)
+      subtree[nodes[i].parent] += subtree[i];
+  }
+  int root = undo_.current;
+  for (int a = nodes[root].parent; a >= 0 && subtree[a] <= target;
+       a = nodes[a].parent) {
+    if (nodes[a].hasCheckpoint)
+      root = a;
+  }
+  if (root == 0)
+    return;
+  if (!nodes[root].hasCheckpoint) {
+    nodes[root].checkpoint = content.pieceList();
+    nodes[root].hasCheckpoint = true;
+  }
+
+  // Parents come before children, so one forward pass renumbers the
+  // subtree and keeps the nodes in seq order
+  std::vector<int> remap(nodes.size(), -1);
+  std::vector<UndoNode> kept;
+  for (size_t i = (size_t)root; i < nodes.size(); ++i) {
+    if ((int)i != root && (nodes[i].parent < 0 || remap[nodes[i].parent] < 0))
+      continue;
+    remap[i] = (int)kept.size();
+    kept.push_back(std::move(nodes[i]));
+  }
+  for (auto &node : kept) {
+    node.parent = node.parent >= 0 ? remap[node.parent] : -1;
+    for (int &child : node.children)
+      child = remap[child];
+    if (node.redoChild >= 0)
+      node.redoChild = remap[node.redoChild];
+  }
+  kept[0].parent = -1;
+  std::vector<EditAction>().swap(kept[0].actions);
+  undo_.current = remap[undo_.current];
+  undo_.nodes = std::move(kept);
 }
 
-void TextEditor::applyInsert(int pos, const std::string &text) {
+void TextEditor::applyInsert(int pos, const std::string &text, bool typed) {
   if (text.empty())
     return;
   // clamp pos
@@ -139,18 +629,10 @@ void TextEditor::applyInsert(int pos, const std::string &text) {
   if (pos > maxPos)
     pos = maxPos;
 
-  // perform insert
-  content.insert((size_t)pos, text);
-
-  // record action
-  EditAction act;
-  act.type = EditAction::Type::Insert;
-  act.pos = pos;
-  act.text = text;
-  undoStack_.push_back(std::move(act));
-
-  // clear redo
-  redoStack_.clear();
+  // perform insert, then record it
+  rawInsert(pos, text);
+  recordEdit(EditAction::Type::Insert, pos, (int)text.size(), typed);
+  trimUndoHistory();
 
   // update cursor and state
   cursorIndex = pos + (int)text.size();
@@ -159,7 +641,7 @@ void TextEditor::applyInsert(int pos, const std::string &text) {
   caretFollow = true;
 }
 
-void TextEditor::applyErase(int pos, int len) {
+void TextEditor::applyErase(int pos, int len, bool typed) {
   if (len <= 0)
     return;
   int maxPos = (int)content.size();
@@ -170,22 +652,10 @@ void TextEditor::applyErase(int pos, int len) {
   if (pos + len > maxPos)
     len = maxPos - pos;
 
-  // capture erased text
-  std::string full = content.getText();
-  std::string erased = full.substr((size_t)pos, (size_t)len);
-
-  // perform erase
-  content.erase((size_t)pos, (size_t)len);
-
-  // record action
-  EditAction act;
-  act.type = EditAction::Type::Erase;
-  act.pos = pos;
-  act.text = erased;
-  undoStack_.push_back(std::move(act));
-
-  // clear redo
-  redoStack_.clear();
+  // record the text while it is still there, then erase it
+  recordEdit(EditAction::Type::Erase, pos, len, typed);
+  rawErase(pos, len);
+  trimUndoHistory(); // content must match the current state
 
   // update cursor and state
   cursorIndex = pos;
@@ -194,31 +664,67 @@ void TextEditor::applyErase(int pos, int len) {
   caretFollow = true;
 }
 
+void TextEditor::applySplices(std::vector<PieceTable::Splice> edits,
+                              std::vector<Piece> inserts) {
+  if (edits.empty())
+    return;
+  // The step is opened before the edit, so a checkpoint taken on the way
+  // is the text without it
+  recordEdit(EditAction::Type::Batch, (int)edits.front().pos, 0, false);
+  auto batch = std::make_shared<EditAction::Batch>();
+  rawSplice(edits, inserts, &batch->undo, &batch->undoPieces);
+  size_t inserted = 0; // splices may share pieces, so counted per splice
+  for (const auto &edit : edits)
+    for (size_t k = edit.first; k < edit.first + edit.count; ++k)
+      inserted += inserts[k].length;
+  batch->redo = std::move(edits);
+  batch->redoPieces = std::move(inserts);
+  EditAction &act = undo_.nodes[undo_.current].actions.back();
+  act.length = inserted;
+  act.batch = std::move(batch);
+  trimUndoHistory();
+
+  onTextChanged();
+  caretFollow = true;
+}
+
+void TextEditor::applyAction(const EditAction &act) {
+  if (act.type == EditAction::Type::Batch) {
+    rawSplice(act.batch->redo, act.batch->redoPieces);
+    cursorIndex = act.pos;
+  } else if (act.type == EditAction::Type::Insert) {
+    rawInsertPieces(act.pos, act.pieces, act.length);
+    cursorIndex = act.pos + (int)act.length;
+  } else {
+    rawErase(act.pos, (int)act.length);
+    cursorIndex = act.pos;
+  }
+}
+
+void TextEditor::revertAction(const EditAction &act) {
+  if (act.type == EditAction::Type::Batch) {
+    rawSplice(act.batch->undo, act.batch->undoPieces);
+    cursorIndex = act.pos;
+  } else if (act.type == EditAction::Type::Insert) {
+    rawErase(act.pos, (int)act.length);
+    cursorIndex = act.pos;
+  } else {
+    rawInsertPieces(act.pos, act.pieces, act.length);
+    cursorIndex = act.pos + (int)act.length;
+  }
+}
+
 void TextEditor::undo() {
-  if (undoStack_.empty())
+  UndoNode &node = undo_.nodes[undo_.current];
+  if (node.parent < 0)
     return;
-  EditAction act = std::move(undoStack_.back());
-  undoStack_.pop_back();
-
-  // inverse operation
-  if (act.type == EditAction::Type::Insert) {
-    // remove the inserted text
-    int pos = act.pos;
-    int len = (int)act.text.size();
-    // perform erase without recording a new undo (so push to redo)
-    content.erase((size_t)pos, (size_t)len);
-    // push to redo stack the same insert action (so redo will reapply)
-    redoStack_.push_back(act);
-    cursorIndex = pos;
-  } else if (act.type == EditAction::Type::Erase) {
-    // re-insert the erased text
-    int pos = act.pos;
-    const std::string &t = act.text;
-    content.insert((size_t)pos, t);
-    // push to redo stack the erase action (so redo will reapply erase)
-    redoStack_.push_back(act);
-    cursorIndex = pos + (int)t.size();
+  for (auto it = node.actions.rbegin(); it != node.actions.rend(); ++it) {
+    it->typed = false; // a redone step never absorbs new typing
+    revertAction(*it);
   }
+  undo_.nodes[node.parent].redoChild = undo_.current;
+  undo_.current = node.parent;
+  transactionStep_ = false;
 
   selectionStart = selectionEnd = -1;
   onTextChanged();
@@ -226,30 +732,146 @@ void TextEditor::undo() {
 }
 
 void TextEditor::redo() {
-  if (redoStack_.empty())
+  const UndoNode &node = undo_.nodes[undo_.current];
+  if (node.children.empty())
     return;
-  EditAction act = std::move(redoStack_.back());
-  redoStack_.pop_back();
-
-  if (act.type == EditAction::Type::Insert) {
-    // reapply insert
-    int pos = act.pos;
-    content.insert((size_t)pos, act.text);
-    // push back to undo
-    undoStack_.push_back(act);
-    cursorIndex = pos + (int)act.text.size();
-  } else if (act.type == EditAction::Type::Erase) {
-    // reapply erase
-    int pos = act.pos;
-    int len = (int)act.text.size();
-    content.erase((size_t)pos, (size_t)len);
-    undoStack_.push_back(act);
-    cursorIndex = pos;
+  undo_.current = node.redoChild >= 0 ? node.redoChild : node.children.back();
+  transactionStep_ = false;
+  for (const auto &act : undo_.nodes[undo_.current].actions)
+    applyAction(act);
+
+  selectionStart = selectionEnd = -1;
+  onTextChanged();
+  caretFollow = true;
+}
+
+int TextEditor::findUndoNode(unsigned seq) const {
+  auto it = std::lower_bound(
+      undo_.nodes.begin(), undo_.nodes.end(), seq,
+      [](const UndoNode &node, unsigned value) { return node.seq < value; });
+  if (it == undo_.nodes.end() || it->seq != seq)
+    return -1;
+  return (int)(it - undo_.nodes.begin());
+}
+
+bool TextEditor::gotoUndoState(unsigned seq) {
+  int target = findUndoNode(seq);
+  if (target < 0)
+    return false;
+  if (target == undo_.current)
+    return true;
+  std::vector<UndoNode> &nodes = undo_.nodes;
+
+  // Walk both states up to their common ancestor; `down` is the target's
+  // side, deepest first
+  std::vector<int> up, down;
+  int a = undo_.current, b = target;
+  while (nodes[a].depth > nodes[b].depth) {
+    up.push_back(a);
+    a = nodes[a].parent;
+  }
+  while (nodes[b].depth > nodes[a].depth) {
+    down.push_back(b);
+    b = nodes[b].parent;
+  }
+  while (a != b) {
+    up.push_back(a);
+    a = nodes[a].parent;
+    down.push_back(b);
+    b = nodes[b].parent;
   }
 
+  // The nearest checkpoint at or above the target is at most
+  // kCheckpointInterval levels away
+  std::vector<int> chain;
+  int c = target;
+  while (!nodes[c].hasCheckpoint) {
+    chain.push_back(c);
+    c = nodes[c].parent;
+  }
+
+  // Restoring a checkpoint costs a word index rebuild, worth it only when
+  // it saves a good number of steps
+  if (chain.size() + kCheckpointInterval < up.size() + down.size()) {
+    int before = (int)content.size();
+    content.setPieceList(nodes[c].checkpoint);
+    for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+      for (const auto &act : nodes[*it].actions) {
+        if (act.type == EditAction::Type::Batch) {
+          content.splice(act.batch->redo, act.batch->redoPieces);
+          cursorIndex = act.pos;
+        } else if (act.type == EditAction::Type::Insert) {
+          content.insertPieces((size_t)act.pos, act.pieces);
+          cursorIndex = act.pos + (int)act.length;
+        } else {
+          content.erase((size_t)act.pos, act.length);
+          cursorIndex = act.pos;
+        }
+      }
+    }
+    wordIndex.build(content);
+    contentVersion++;
+    markDirty(0, before, (int)content.size());
+  } else {
+    for (int n : up)
+      for (auto it = nodes[n].actions.rbegin(); it != nodes[n].actions.rend();
+           ++it)
+        revertAction(*it);
+    for (auto it = down.rbegin(); it != down.rend(); ++it)
+      for (const auto &act : nodes[*it].actions)
+        applyAction(act);
+  }
+
+  // Redo from any state on the way now leads back here
+  for (int n : down)
+    nodes[nodes[n].parent].redoChild = n;
+  for (int n : up)
+    for (auto &act : nodes[n].actions)
+      act.typed = false;
+  undo_.current = target;
+  transactionStep_ = false;
+  if (cursorIndex > (int)content.size())
+    cursorIndex = (int)content.size();
+
   selectionStart = selectionEnd = -1;
   onTextChanged();
   caretFollow = true;
+  return true;
+}
+
+size_t TextEditor::applyExternalText(const std::string &text) {
+  return applyHunks(text, LineDiff::compute(content.getText(), text));
+}
+
+size_t TextEditor::applyHunks(const std::string &text,
+                              const std::vector<LineDiff::Hunk> &hunks) {
+  if (hunks.empty())
+    return 0;
+
+  // Back to front, so each hunk's old offsets are still valid when reached
+  beginTransaction();
+  int cursor = cursorIndex;
+  for (auto it = hunks.rbegin(); it != hunks.rend(); ++it) {
+    int pos = (int)it->oldPos;
+    if (it->oldLen > 0) {
+      recordEdit(EditAction::Type::Erase, pos, (int)it->oldLen, false);
+      rawErase(pos, (int)it->oldLen);
+    }
+    if (it->newLen > 0) {
+      rawInsert(pos, text.substr(it->newPos, it->newLen));
+      recordEdit(EditAction::Type::Insert, pos, (int)it->newLen, false);
+    }
+    if (cursor >= pos + (int)it->oldLen)
+      cursor += (int)it->newLen - (int)it->oldLen;
+    else if (cursor > pos)
+      cursor = pos;
+  }
+
+  cursorIndex = cursor;
+  selectionStart = selectionEnd = -1;
+  onTextChanged();
+  commitTransaction();
+  return hunks.size();
 }
 
 // Selection helpers
@@ -311,12 +933,11 @@ void TextEditor::pasteFromClipboard() {
   if (!clipText || !clipText[0])
     return;
 
-  if (hasSelection()) {
-    deleteSelection();
-    // deleteSelection already recorded the erase
-  }
-
+  // Replacing a selection is one undo step
+  beginTransaction();
+  deleteSelection();
   applyInsert(cursorIndex, clipText);
+  commitTransaction();
   addOutput(icons["checkmark"], "Pasted text");
 }
 
@@ -327,48 +948,418 @@ void TextEditor::selectAll() {
   caretFollow = true;
 }
 
-void TextEditor::rebuildCache() {
-  lineCache.clear();
+void TextEditor::findNext() {
+  if (findQuery.empty())
+    return;
+  int from = hasSelection() ? std::max(selectionStart, selectionEnd)
+                            : cursorIndex;
+  SearchMatch hit{BufferSearch::npos, findQuery.size()};
+  if (findRegex) {
+    auto it = std::lower_bound(
+        regexMatches.begin(), regexMatches.end(), (size_t)from,
+        [](const SearchMatch &m, size_t p) { return m.pos < p; });
+    if (it == regexMatches.end())
+      it = regexMatches.begin(); // wrap
+    if (it != regexMatches.end())
+      hit = *it;
+  } else {
+    hit.pos = BufferSearch::findNext(content, findQuery, (size_t)from);
+  }
+  if (hit.pos == BufferSearch::npos) {
+    addOutput(icons["error"], "Not found: " + findQuery);
+    return;
+  }
+  selectionStart = (int)hit.pos;
+  selectionEnd = (int)(hit.pos + hit.len);
+  cursorIndex = selectionEnd;
+  caretFollow = true;
+}
 
-  const std::string full = content.getText();
-  const size_t n = full.size();
+void TextEditor::findPrev() {
+  if (findQuery.empty())
+    return;
+  int before = hasSelection() ? std::min(selectionStart, selectionEnd)
+                              : cursorIndex;
+  SearchMatch hit{BufferSearch::npos, findQuery.size()};
+  if (findRegex) {
+    auto it = std::lower_bound(
+        regexMatches.begin(), regexMatches.end(), (size_t)before,
+        [](const SearchMatch &m, size_t p) { return m.pos < p; });
+    if (it == regexMatches.begin())
+      it = regexMatches.end(); // wrap
+    if (it != regexMatches.begin())
+      hit = *(it - 1);
+  } else {
+    hit.pos = BufferSearch::findPrev(content, findQuery, (size_t)before);
+  }
+  if (hit.pos == BufferSearch::npos) {
+    addOutput(icons["error"], "Not found: " + findQuery);
+    return;
+  }
+  selectionStart = (int)hit.pos;
+  selectionEnd = (int)(hit.pos + hit.len);
+  cursorIndex = selectionStart;
+  caretFollow = true;
+}
 
-  const char *sample =
-      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789";
-  float cellWidth = ImGui::CalcTextSize(sample).x / (float)strlen(sample);
-
-  size_t start = 0;
-  for (size_t i = 0; i < n; ++i) {
-    if (full[i] == '\n') {
-      std::string seg = full.substr(start, i - start);
-      CachedLine cl;
-      cl.text = std::move(seg);
-      cl.width = cl.text.size() * cellWidth;
-      lineCache.push_back(std::move(cl));
-      start = i + 1;
+// Calls fn(begin, end, offset) for each line of text without its '\n'.
+// Lines inside a chunk are passed straight from the piece's memory; only
+// one crossing a chunk boundary is copied. Lines over kMaxRegexLine are
+// skipped, as the regex find does; returns how many.
+template <typename Fn>
+static size_t forEachLine(const PieceTable &text, Fn &&fn) {
+  std::string carry;
+  size_t carryStart = 0;
+  bool carryLong = false;
+  size_t skipped = 0;
+  size_t chunkPos = 0;
+  char last = 0;
+  text.forEachChunk(0, text.size(), [&](const char *data, size_t n) {
+    const char *end = data + n;
+    const char *lineBegin = data;
+    while (lineBegin < end) {
+      const char *nl =
+          (const char *)std::memchr(lineBegin, '\n', (size_t)(end - lineBegin));
+      if (!carryLong) {
+        if (carry.empty() && nl) {
+          if ((size_t)(nl - lineBegin) > kMaxRegexLine)
+            skipped++;
+          else
+            fn(lineBegin, nl, chunkPos + (size_t)(lineBegin - data));
+          lineBegin = nl + 1;
+          continue;
+        }
+        if (carry.empty())
+          carryStart = chunkPos + (size_t)(lineBegin - data);
+        carry.append(lineBegin, nl ? nl : end);
+        if (carry.size() > kMaxRegexLine) {
+          carryLong = true;
+          carry.clear();
+        }
+      }
+      if (!nl)
+        break;
+      if (carryLong)
+        skipped++;
+      else
+        fn(carry.data(), carry.data() + carry.size(), carryStart);
+      carry.clear();
+      carryLong = false;
+      lineBegin = nl + 1;
     }
+    chunkPos += n;
+    last = end[-1];
+    return true;
+  });
+  // The last line, which is empty after a final '\n'
+  if (carryLong)
+    skipped++;
+  else if (!carry.empty() || last == '\n' || chunkPos == 0)
+    fn(carry.data(), carry.data() + carry.size(),
+       carry.empty() ? chunkPos : carryStart);
+  return skipped;
+}
+
+// Calls fn(pos, length, textStart) for each match of re in [begin, end),
+// pos counted from begin, once its replacement is appended to `added`
+template <typename Fn>
+static void forEachRegexMatch(const std::regex &re,
+                              const std::string &replacement,
+                              const char *begin, const char *end,
+                              std::string &added, Fn &&fn) {
+  std::cmatch m;
+  const char *from = begin;
+  auto flags = std::regex_constants::match_default;
+  while (from <= end && std::regex_search(from, end, m, re, flags)) {
+    size_t start = added.size();
+    m.format(std::back_inserter(added), replacement);
+    fn((size_t)(m[0].first - begin), (size_t)m.length(0), start);
+    from = m[0].second + (m.length(0) == 0 ? 1 : 0);
+    flags = std::regex_constants::match_prev_avail;
   }
+}
 
-  if (start < n) {
-    std::string seg = full.substr(start);
-    CachedLine cl;
-    cl.text = std::move(seg);
-    cl.width = cl.text.size() * cellWidth;
-    lineCache.push_back(std::move(cl));
-  } else {
-    if (!full.empty() && full.back() == '\n') {
-      lineCache.push_back({"", 0.0f});
+size_t TextEditor::replaceAll(const std::string &query,
+                              const std::string &replacement, bool regex) {
+  if (query.empty())
+    return 0;
+  std::regex re;
+  if (regex) {
+    try {
+      re = std::regex(query, std::regex::ECMAScript);
+    } catch (const std::regex_error &e) {
+      addOutput(icons["error"], std::string("Regex error: ") + e.what());
+      return 0;
     }
   }
+  // A partial replace would leave matches behind while reporting a count
+  auto refuseSkipped = [&](uint64_t skipped) {
+    addOutput(icons["error"],
+              "Replace all cancelled: " + std::to_string(skipped) +
+                  " lines over " + std::to_string(kMaxRegexLine >> 20) +
+                  " MB can't be matched, so nothing was replaced");
+    return (size_t)0;
+  };
 
+  if (largeView_->active()) {
+    // Matched line by line over the paged file; the replacements become
+    // pieces in one rebuild of the piece list
+    LargeFileBuffer &buffer = largeView_->buffer();
+    if (!buffer.indexed() || !buffer.indexError().empty()) {
+      log(LogSeverity::Warning,
+          "Replace all needs the finished line index of a large file");
+      return 0;
+    }
+    if (!regex && query.find('\n') != std::string::npos) {
+      log(LogSeverity::Warning,
+          "Replace all can't match across lines in large file mode");
+      return 0;
+    }
+    std::vector<LargeFileBuffer::Splice> splices;
+    std::string added = regex ? std::string() : replacement;
+    uint64_t skipped = 0;
+    bool read = true;
+    auto scan = [&]() {
+      read = buffer.forEachLine(
+          kMaxRegexLine, skipped,
+          [&](const char *begin, const char *end, uint64_t offset,
+              uint64_t line) {
+            if (regex) {
+              forEachRegexMatch(
+                  re, replacement, begin, end, added,
+                  [&](size_t pos, size_t length, size_t start) {
+                    splices.push_back({offset + pos, length, line, start,
+                                       added.size() - start});
+                  });
+              return;
+            }
+            size_t n = (size_t)(end - begin), from = 0, hit;
+            while ((hit = BufferSearch::findInSpan(begin, n, query, from)) !=
+                   BufferSearch::npos) {
+              splices.push_back(
+                  {offset + hit, query.size(), line, 0, added.size()});
+              from = hit + query.size();
+            }
+          });
+    };
+    if (regex)
+      StackThread(kRegexStackSize, scan).join();
+    else
+      scan();
+    if (!read) {
+      addOutput(icons["error"], "Could not read " + buffer.path());
+      return 0;
+    }
+    if (skipped)
+      return refuseSkipped(skipped);
+    if (splices.empty()) {
+      addOutput(icons["error"], "Not found: " + query);
+      return 0;
+    }
+    if (!largeView_->replace(splices, added))
+      return 0;
+    addOutput(icons["checkmark"], "Replaced " +
+                                      std::to_string(splices.size()) +
+                                      " occurrences (no undo in large file "
+                                      "mode)");
+    return splices.size();
+  }
+
+  // Matches become splices; the replacement text is gathered first and
+  // goes into the add buffer in one append
+  std::vector<PieceTable::Splice> edits;
+  std::vector<Piece> inserts;
+  std::string added;
+  size_t skipped = 0;
+  if (regex) {
+    // Matching recurses once or more per character, so long lines need
+    // the big stack of a regex worker; this thread just waits for it
+    StackThread(kRegexStackSize, [&]() {
+      skipped = forEachLine(content, [&](const char *begin, const char *end,
+                                         size_t offset) {
+        forEachRegexMatch(re, replacement, begin, end, added,
+                          [&](size_t pos, size_t length, size_t start) {
+                            size_t count = 0;
+                            if (added.size() > start) {
+                              inserts.push_back({Piece::BufferKind::Add, start,
+                                                 added.size() - start});
+                              count = 1;
+                            }
+                            edits.push_back({offset + pos, length,
+                                             inserts.size() - count, count});
+                          });
+      });
+    }).join();
+  } else {
+    // Every match gets the same text, so one piece serves them all
+    added = replacement;
+    size_t count = added.empty() ? 0 : 1;
+    if (count)
+      inserts.push_back({Piece::BufferKind::Add, 0, added.size()});
+    BufferSearch::findAll(content, query, 0, content.size(), [&](size_t hit) {
+      edits.push_back({hit, query.size(), 0, count});
+      return true;
+    });
+  }
+  if (skipped)
+    return refuseSkipped(skipped);
+  if (edits.empty()) {
+    addOutput(icons["error"], "Not found: " + query);
+    return 0;
+  }
+
+  if (!added.empty()) {
+    size_t base = content.append(added.data(), added.size()).start;
+    for (Piece &piece : inserts)
+      piece.start += base;
+  }
+  size_t replaced = edits.size();
+  applySplices(std::move(edits), std::move(inserts));
+  cursorIndex = std::min(cursorIndex, (int)content.size());
+  selectionStart = selectionEnd = -1;
+  addOutput(icons["checkmark"],
+            "Replaced " + std::to_string(replaced) + " occurrences");
+  return replaced;
+}
+
+float TextEditor::cellWidth() {
+  const char *sample =
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789";
+  return ImGui::CalcTextSize(sample).x / (float)strlen(sample);
+}
+
+bool TextEditor::buildLineCache(const PieceTable &text, float cellWidth,
+                                std::vector<CachedLine> &lines,
+                                const std::atomic<bool> *cancel) {
+  lines.clear();
+  // Every '\n' ends a line; whatever follows the last one (possibly
+  // nothing) is the final line
+  CachedLine current{"", 0.0f};
+  bool stopped = false;
+  text.forEachChunk(0, text.size(), [&](const char *data, size_t n) {
+    if (cancel && *cancel) {
+      stopped = true;
+      return false;
+    }
+    const char *p = data;
+    const char *end = data + n;
+    while (p < end) {
+      // A freshly loaded file is one chunk, so cancel is also checked
+      // every few thousand lines
+      if (cancel && (lines.size() & 8191) == 8191 && *cancel) {
+        stopped = true;
+        return false;
+      }
+      const char *nl = (const char *)std::memchr(p, '\n', (size_t)(end - p));
+      if (!nl) {
+        current.text.append(p, (size_t)(end - p));
+        break;
+      }
+      current.text.append(p, (size_t)(nl - p));
+      current.width = current.text.size() * cellWidth;
+      lines.push_back(std::move(current));
+      current = CachedLine{"", 0.0f};
+      p = nl + 1;
+    }
+    return true;
+  });
+  current.width = current.text.size() * cellWidth;
+  lines.push_back(std::move(current));
+  return !stopped;
+}
+
+void TextEditor::rebuildCache() {
+  buildLineCache(content, cellWidth(), lineCache);
+  linesStale_ = DirtySpan();
+}
+
+void TextEditor::refreshLineCache() {
+  if (linesStale_.empty())
+    return;
+  DirtySpan span = linesStale_;
+  linesStale_ = DirtySpan();
   if (lineCache.empty()) {
-    lineCache.push_back({"", 0.0f});
+    rebuildCache();
+    return;
   }
+
+  // Lines of the old text touching [span.start, oldEnd): everything
+  // outside the span is unchanged, so only they need splitting again
+  int oldEnd = span.end - span.delta;
+  size_t first = 0;
+  int firstStart = 0;
+  while (first + 1 < lineCache.size() &&
+         firstStart + (int)lineCache[first].text.size() < span.start) {
+    firstStart += (int)lineCache[first].text.size() + 1;
+    first++;
+  }
+  size_t last = first;
+  int lastStart = firstStart;
+  while (last + 1 < lineCache.size() &&
+         lastStart + (int)lineCache[last].text.size() < oldEnd) {
+    lastStart += (int)lineCache[last].text.size() + 1;
+    last++;
+  }
+  int newEnd = lastStart + (int)lineCache[last].text.size() + span.delta;
+
+  // Refill those slots in place, so an edit within a line reuses its
+  // string; lines gained are added in one insert, lines lost erased
+  float width = cellWidth();
+  size_t slot = first;
+  std::vector<CachedLine> added;
+  CachedLine *line = &lineCache[slot];
+  line->text.clear();
+  content.forEachChunk(
+      (size_t)firstStart, (size_t)(newEnd - firstStart),
+      [&](const char *data, size_t n) {
+        const char *p = data;
+        const char *end = data + n;
+        while (p < end) {
+          const char *nl =
+              (const char *)std::memchr(p, '\n', (size_t)(end - p));
+          if (!nl) {
+            line->text.append(p, (size_t)(end - p));
+            break;
+          }
+          line->text.append(p, (size_t)(nl - p));
+          line->width = line->text.size() * width;
+          if (++slot <= last) {
+            line = &lineCache[slot];
+            line->text.clear();
+          } else {
+            added.push_back(CachedLine{"", 0.0f});
+            line = &added.back();
+          }
+          p = nl + 1;
+        }
+        return true;
+      });
+  line->width = line->text.size() * width;
+  if (slot < last)
+    lineCache.erase(lineCache.begin() + slot + 1, lineCache.begin() + last + 1);
+  else if (!added.empty())
+    lineCache.insert(lineCache.begin() + last + 1,
+                     std::make_move_iterator(added.begin()),
+                     std::make_move_iterator(added.end()));
 }
 
 void TextEditor::onTextChanged() {
-  rebuildCache();
+  if (transactionDepth_ > 0) {
+    transactionChanged_ = true;
+    return;
+  }
+  refreshLineCache();
   modified = true;
+  if (changed_.empty() || notifying_)
+    return; // edits made by a hook aren't reported back to the hooks
+
+  int size = (int)content.size();
+  int start = std::min(changed_.start, size);
+  int end = std::min(std::max(changed_.end, start), size);
+  notifying_ = true;
+  lua_->runChangeHook((size_t)start, (size_t)end);
+  notifying_ = false;
+  changed_ = DirtySpan();
 }
 
 void TextEditor::indexToLineCol(int index, int &line, int &col) {
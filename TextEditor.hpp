@@ -1,7 +1,15 @@
 #pragma once
 
+#include "BufferSearch.hpp"
+#include "LineDiff.hpp"
+#include "LogQueue.hpp"
+#include "OutputLog.hpp"
 #include "PieceTable.hpp"
+#include "SymbolIndex.hpp"
+#include "WordIndex.hpp"
 #include "imgui.h"
+#include <atomic>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -12,11 +20,12 @@ class FileExplorer;
 class OutputPanel;
 class IconManager;
 class EditorCommands;
-
-struct OutputLine {
-  ImTextureID icon;
-  std::string text;
-};
+class FindInFilesPanel;
+class QuickOpenPanel;
+class LargeFileView;
+class BufferManager;
+class Macros;
+class MultiCursor;
 
 struct CachedLine {
   std::string text;
@@ -31,8 +40,15 @@ public:
   bool render();
   void handleKeyboardShortcuts();
   void openFile(const std::string &fname);
+  void gotoLine(int line, int col = 0);
+  // Jumps to the definition of the word under the caret via symbolIndex
+  void gotoDefinition();
+  // Output panel messages. Lines are queued and reach outputLines at the
+  // start of the next frame; log() and addOutput(text) are safe from any
+  // thread, the icon overload only where `icons` may be read.
   void addOutput(ImTextureID icon, const std::string &text);
   void addOutput(const std::string &text);
+  void log(LogSeverity severity, const std::string &text);
 
   // Public data members (accessed by subsystems)
   std::string filename;
@@ -41,12 +57,30 @@ public:
   bool showFileExplorer;
   bool showOutput;
   bool showSettings;
+  bool showFindInFiles;
+  bool showQuickOpen;
+  bool focusQuickOpen;
   bool showGrid;
   bool showLineNumbers;
 
   bool focusEditor;
   bool closeEditor;
 
+  // Find bar
+  bool showFind;
+  bool focusFind;
+  std::string findQuery;
+  bool findRegex;
+  std::vector<SearchMatch> regexMatches; // streamed in by the regex worker
+  std::string searchStatus;              // shown in the output panel
+  bool showReplace;
+  std::string replaceText;
+  size_t contentVersion; // bumped on every buffer mutation
+  // Files at least this big open in large-file mode (LargeFileView)
+  size_t largeFileThreshold;
+  // Inactive buffers are evicted while all open buffers hold more than this
+  size_t bufferMemoryBudget;
+
   int cursorIndex;
   int cursorLine;
   int cursorColumn;
@@ -69,12 +103,25 @@ public:
   float vDragScrollStart;
 
   std::vector<CachedLine> lineCache;
-  std::vector<OutputLine> outputLines;
+  WordIndex wordIndex;
+  SymbolIndex symbolIndex;
+  OutputLog outputLines;
   std::unordered_map<std::string, ImTextureID> icons;
   std::unordered_map<std::string, ImFont *> fontPreviews;
 
   // Cache and position helpers
   void rebuildCache();
+  // Re-splits only the lines edited since lineCache was last brought up to
+  // date, reusing the rest (and their strings) as they are
+  void refreshLineCache();
+  // Splits text into lines; safe off the UI thread. Returns false if
+  // cancelled part way.
+  static bool buildLineCache(const PieceTable &text, float cellWidth,
+                             std::vector<CachedLine> &lines,
+                             const std::atomic<bool> *cancel = nullptr);
+  static float cellWidth(); // monospace advance of the current font
+  // Rebuilds the line cache and passes the span changed since the last
+  // call to the on_text_changed hooks; inside a transaction, waits for it
   void onTextChanged();
   void indexToLineCol(int index, int &line, int &col);
   int lineColToIndex(int line, int col);
@@ -88,18 +135,116 @@ public:
   void pasteFromClipboard();
   void selectAll();
 
+  std::string wordAtCursor() const;
+
+  // Find helpers (select the match and scroll to it)
+  void findNext();
+  void findPrev();
+  // Replaces every match of query in one pass over the piece table, as one
+  // undo step. A regex is matched line by line, like the find bar does,
+  // and replacement may refer to its groups ($&, $1...). In large file
+  // mode both kinds are matched per line and become pieces over the paged
+  // file, without undo. Nothing is replaced if a line was too long to
+  // match. Returns the number of replacements.
+  size_t replaceAll(const std::string &query, const std::string &replacement,
+                    bool regex);
+
   // Edit / Undo/Redo API
   struct EditAction {
-    enum class Type { Insert, Erase } type;
+    enum class Type { Insert, Erase, Batch } type;
     int pos;
-    std::string text; // inserted text (for Insert) or erased text (for Erase)
+    size_t length;             // bytes inserted or erased
+    std::vector<Piece> pieces; // that text, as spans of content's buffers
+    bool typed = false; // may absorb the next typed edit
+    char first = 0;     // first and last byte of the text, for word breaks
+    char last = 0;
+    // Batch: edits made in one pass by applySplices(), and the batch that
+    // undoes them; length is the bytes they inserted
+    struct Batch {
+      std::vector<PieceTable::Splice> redo;
+      std::vector<Piece> redoPieces;
+      std::vector<PieceTable::Splice> undo;
+      std::vector<Piece> undoPieces;
+    };
+    std::shared_ptr<const Batch> batch;
+  };
+
+  // Undo history is a tree of states: an edit made after undoing starts a
+  // new branch instead of discarding the redo steps. Each node holds the
+  // edits leading to it from its parent; every kCheckpointInterval levels a
+  // node also keeps a copy of the piece list, so a jump to any state
+  // replays only the few edits below the nearest checkpoint.
+  struct UndoNode {
+    int parent = -1;
+    std::vector<int> children;
+    int redoChild = -1; // where redo() goes: the child made or visited last
+    std::vector<EditAction> actions;
+    unsigned seq = 0; // state number, stable while the node exists
+    unsigned depth = 0;
+    double time = 0.0; // of the last edit merged in
+    bool hasCheckpoint = false;
+    std::vector<Piece> checkpoint;
+  };
+  struct UndoHistory {
+    UndoHistory(); // just a root state, checkpointed as an empty buffer
+    std::vector<UndoNode> nodes; // parents before children, by seq
+    int current = 0;
+    unsigned nextSeq = 1;
   };
+  static constexpr unsigned kCheckpointInterval = 64;
 
-  void applyInsert(int pos, const std::string &text); // records action
-  void applyErase(int pos, int len); // records action (captures erased text)
+  // Record an undo step. With `typed`, an edit continuing the previous
+  // typed one (same direction, adjacent, within a second, same word) is
+  // merged into it instead.
+  void applyInsert(int pos, const std::string &text, bool typed = false);
+  void applyErase(int pos, int len, bool typed = false);
+  // Many edits at once (PieceTable::splice: sorted, not overlapping,
+  // offsets in the current text), made in one pass over the piece table
+  // and recorded as one undo step. inserts normally come from
+  // content.append(). The caret is left to the caller.
+  void applySplices(std::vector<PieceTable::Splice> edits,
+                    std::vector<Piece> inserts);
   void undo();
   void redo();
+  // Starts a new history whose root is the buffer as it is now
   void clearUndoRedo();
+  // Ends the current typed run, e.g. when the caret is moved
+  void breakUndoCoalescing();
+  // Number of the state the buffer is in, and a jump to any other state
+  // in the tree (one line cache refresh however far away it is)
+  unsigned undoState() const { return undo_.nodes[undo_.current].seq; }
+  bool gotoUndoState(unsigned seq);
+  const UndoHistory &undoHistory() const { return undo_; }
+  // Memory held by the history itself (the text it refers to lives in
+  // content's buffers), and the bytes of text it refers to
+  static size_t undoHistoryBytes(const UndoHistory &history);
+  size_t undoHistoryBytes() const { return undoHistoryBytes(undo_); }
+  size_t undoHistoryTextBytes() const;
+  size_t undoSteps() const { return undo_.nodes.size() - 1; }
+  // Once the history holds more than this, states far from the current one
+  // are dropped
+  size_t undoHistoryLimit;
+  // Edits the buffer into `text` by replacing only the lines that differ,
+  // recorded as a single undo step. Caret and scroll stay put unless their
+  // lines changed. Returns the number of changed regions.
+  size_t applyExternalText(const std::string &text);
+  // The same with the diff already computed (e.g. by a FileLoader reload)
+  // from the buffer's current text to `text`
+  size_t applyHunks(const std::string &text,
+                    const std::vector<LineDiff::Hunk> &hunks);
+
+  // Edits made between these become one undo step, and the line cache
+  // rebuild and change notification happen once, at the outermost commit.
+  // Until then lineCache still describes the text as it was at the start.
+  // A transaction left open is committed at the end of the frame.
+  void beginTransaction();
+  void commitTransaction();
+  bool inTransaction() const { return transactionDepth_ > 0; }
+
+  // Keyboard macro recorder and player
+  Macros &macros() { return *macros_; }
+  // Extra carets; while there are any, editing keys act on all of them
+  MultiCursor &multiCursor() { return *multiCursor_; }
 
 private:
   LuaBindings *lua_;
@@ -109,14 +254,67 @@ private:
   OutputPanel *outputPanel_;
   IconManager *iconManager_;
   EditorCommands *commands_;
+  FindInFilesPanel *findInFiles_;
+  QuickOpenPanel *quickOpen_;
+  LargeFileView *largeView_;
+  BufferManager *buffers_;
+  Macros *macros_;
+  MultiCursor *multiCursor_;
+  LogQueue logQueue_;
 
-  // Undo/redo stacks
-  std::vector<EditAction> undoStack_;
-  std::vector<EditAction> redoStack_;
+  // Buffer mutation without undo bookkeeping; keeps wordIndex in sync
+  void rawInsert(int pos, const std::string &text);
+  void rawInsertPieces(int pos, const std::vector<Piece> &pieces,
+                       size_t length);
+  void rawErase(int pos, int len);
+  // Appends text as if every state in the undo history had ended with it
+  // (a followed file growing): no undo step, and each checkpoint gets it
+  // too, so jumping to one doesn't drop it
+  void appendUnrecorded(const std::string &text);
+  void rawSplice(const std::vector<PieceTable::Splice> &edits,
+                 const std::vector<Piece> &inserts,
+                 std::vector<PieceTable::Splice> *undo = nullptr,
+                 std::vector<Piece> *undoPieces = nullptr);
+  std::vector<WordIndex::Edit> wordEdits_;
+
+  // Undo history
+  UndoHistory undo_;
+  size_t editsSinceTrim_ = 0;
+  std::vector<Piece> pieceScratch_;
+  // Records text at [pos, pos + len) as an undo step: call after inserting
+  // it, or before erasing it. Inside a transaction every edit after the
+  // first joins the first one's step.
+  void recordEdit(EditAction::Type type, int pos, int len, bool typed);
+  bool coalesceEdit(EditAction::Type type, int pos, int len, double now);
+  void trimUndoHistory();
+  void applyAction(const EditAction &act);
+  void revertAction(const EditAction &act);
+  int findUndoNode(unsigned seq) const;
+
+  // Transactions
+  int transactionDepth_ = 0;
+  bool transactionStep_ = false;    // its undo step has been started
+  bool transactionChanged_ = false; // onTextChanged() is owed at commit
+  // A span of content edited since some point, in current offsets, and
+  // how much longer the text got
+  struct DirtySpan {
+    int start = -1;
+    int end = -1;
+    int delta = 0;
+    bool empty() const { return start < 0; }
+    void add(int pos, int erased, int inserted);
+  };
+  DirtySpan changed_;    // since the last on_text_changed notification
+  DirtySpan linesStale_; // since lineCache last matched content
+  bool notifying_ = false;
+  void markDirty(int pos, int erased, int inserted);
 
   friend class FileOperations;
   friend class EditorRenderer;
   friend class FileExplorer;
   friend class OutputPanel;
   friend class EditorCommands;
+  friend class BufferManager;
+  friend class Macros;
+  friend class MultiCursor;
 };
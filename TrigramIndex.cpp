@@ -0,0 +1,612 @@
+#include "TrigramIndex.hpp"
+#include "FileWatcher.hpp"
+#include "MappedFile.hpp"
+#include "WorkspaceWalker.hpp"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+
+namespace {
+const char kMagic[4] = {'D', 'X', 'T', 'G'};
+const uint32_t kVersion = 1;
+const uint64_t kMaxIndexedSize = 32ull << 20; // bigger files stay candidates
+const size_t kMaxFiles = 250000;              // give up on huge trees
+const int kQuietMs = 2000; // refresh once the watcher has been idle this long
+
+enum FileFlags : uint32_t {
+  kFlagUnindexed = 1, // too big: always a candidate
+  kFlagBinary = 2,    // never a candidate
+};
+
+// On-disk layout, native endianness (the index is a local cache):
+//   Header | FileEntry[fileCount] | TrigramEntry[trigramCount] | paths |
+//   postings (per trigram: varint deltas of ascending file ids)
+struct Header {
+  char magic[4];
+  uint32_t version;
+  uint32_t fileCount;
+  uint32_t trigramCount;
+  uint64_t filesOffset;
+  uint64_t trigramsOffset;
+  uint64_t pathsOffset;
+  uint64_t pathsSize;
+  uint64_t postingsOffset;
+  uint64_t postingsSize;
+};
+
+struct FileEntry {
+  int64_t mtime;
+  uint64_t size;
+  uint32_t pathOffset;
+  uint32_t pathLen;
+  uint32_t flags;
+  uint32_t reserved;
+};
+
+struct TrigramEntry {
+  uint32_t trigram;
+  uint32_t count;
+  uint64_t offset; // into the postings section
+};
+
+inline uint32_t trigramAt(const unsigned char *p) {
+  return (uint32_t)p[0] << 16 | (uint32_t)p[1] << 8 | p[2];
+}
+
+void putVarint(std::string &out, uint32_t v) {
+  while (v >= 0x80) {
+    out.push_back((char)(v | 0x80));
+    v >>= 7;
+  }
+  out.push_back((char)v);
+}
+
+// Distinct trigrams of data, ascending. `seen` is a 2^24-bit scratch set
+// that is left cleared again on return.
+void extractTrigrams(const char *data, size_t size, std::vector<uint64_t> &seen,
+                     std::vector<uint32_t> &out) {
+  out.clear();
+  const unsigned char *p = (const unsigned char *)data;
+  for (size_t i = 0; i + 3 <= size; ++i) {
+    uint32_t t = trigramAt(p + i);
+    uint64_t bit = 1ull << (t & 63);
+    if (!(seen[t >> 6] & bit)) {
+      seen[t >> 6] |= bit;
+      out.push_back(t);
+    }
+  }
+  for (uint32_t t : out)
+    seen[t >> 6] = 0;
+  std::sort(out.begin(), out.end());
+}
+
+int64_t modificationTime(const std::filesystem::path &path) {
+  std::error_code ec;
+  auto t = std::filesystem::last_write_time(path, ec);
+  return ec ? 0 : (int64_t)t.time_since_epoch().count();
+}
+} // namespace
+
+struct TrigramIndex::Snapshot {
+  MappedFile file;
+  const Header *header = nullptr;
+  const FileEntry *files = nullptr;
+  const TrigramEntry *trigrams = nullptr;
+  const char *paths = nullptr;
+  const unsigned char *postings = nullptr;
+  std::vector<uint32_t> unindexed;
+
+  std::string path(uint32_t id) const {
+    return std::string(paths + files[id].pathOffset, files[id].pathLen);
+  }
+  const TrigramEntry *find(uint32_t trigram) const {
+    const TrigramEntry *end = trigrams + header->trigramCount;
+    const TrigramEntry *it = std::lower_bound(
+        trigrams, end, trigram,
+        [](const TrigramEntry &e, uint32_t t) { return e.trigram < t; });
+    return it != end && it->trigram == trigram ? it : nullptr;
+  }
+  void decode(const TrigramEntry &e, std::vector<uint32_t> &out) const {
+    out.clear();
+    out.reserve(e.count);
+    const unsigned char *p = postings + e.offset;
+    const unsigned char *end = postings + header->postingsSize;
+    uint32_t id = 0;
+    for (uint32_t i = 0; i < e.count && p < end; ++i) {
+      uint32_t delta = 0;
+      for (int shift = 0; p < end && shift < 35; shift += 7) {
+        unsigned char b = *p++;
+        delta |= (uint32_t)(b & 0x7f) << shift;
+        if (!(b & 0x80))
+          break;
+      }
+      id += delta;
+      out.push_back(id);
+    }
+  }
+};
+
+TrigramIndex::~TrigramIndex() { stop(); }
+
+void TrigramIndex::start(const std::string &root,
+                         const std::string &indexPath) {
+  stop();
+  root_ = root;
+  indexPath_ = indexPath;
+  stop_ = false;
+  thread_ = std::thread(&TrigramIndex::run, this);
+}
+
+void TrigramIndex::stop() {
+  stop_ = true;
+  if (thread_.joinable())
+    thread_.join();
+}
+
+bool TrigramIndex::ready() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return snapshot_ != nullptr;
+}
+
+size_t TrigramIndex::fileCount() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return snapshot_ ? snapshot_->header->fileCount : 0;
+}
+
+std::shared_ptr<const TrigramIndex::Snapshot>
+TrigramIndex::load(const std::string &path) {
+  auto snap = std::make_shared<Snapshot>();
+  if (!snap->file.open(path) || snap->file.size() < sizeof(Header))
+    return nullptr;
+  const char *base = snap->file.data();
+  uint64_t size = snap->file.size();
+  const Header *h = (const Header *)base;
+  if (std::memcmp(h->magic, kMagic, 4) != 0 || h->version != kVersion)
+    return nullptr;
+
+  auto fits = [size](uint64_t off, uint64_t len) {
+    return off <= size && len <= size - off;
+  };
+  if (!fits(h->filesOffset, (uint64_t)h->fileCount * sizeof(FileEntry)) ||
+      !fits(h->trigramsOffset,
+            (uint64_t)h->trigramCount * sizeof(TrigramEntry)) ||
+      !fits(h->pathsOffset, h->pathsSize) ||
+      !fits(h->postingsOffset, h->postingsSize))
+    return nullptr;
+
+  snap->header = h;
+  snap->files = (const FileEntry *)(base + h->filesOffset);
+  snap->trigrams = (const TrigramEntry *)(base + h->trigramsOffset);
+  snap->paths = base + h->pathsOffset;
+  snap->postings = (const unsigned char *)(base + h->postingsOffset);
+  for (uint32_t i = 0; i < h->fileCount; ++i) {
+    const FileEntry &f = snap->files[i];
+    if ((uint64_t)f.pathOffset + f.pathLen > h->pathsSize)
+      return nullptr;
+    if (f.flags & kFlagUnindexed)
+      snap->unindexed.push_back(i);
+  }
+  return snap;
+}
+
+bool TrigramIndex::write(const std::vector<FileInfo> &files,
+                         const std::vector<uint32_t> &flags,
+                         const std::vector<std::vector<uint32_t>> &trigrams) {
+  std::vector<FileEntry> entries(files.size());
+  std::string paths;
+  for (size_t i = 0; i < files.size(); ++i) {
+    entries[i] = {files[i].mtime,        files[i].size,
+                  (uint32_t)paths.size(), (uint32_t)files[i].path.size(),
+                  flags[i],               0};
+    paths += files[i].path;
+  }
+
+  // Posting lists are built one leading byte at a time so only a 64K-entry
+  // count table is live, rather than one slot per possible trigram. Each
+  // file's list is sorted, so a cursor per file walks it exactly once.
+  std::vector<TrigramEntry> table;
+  std::string postings;
+  std::vector<size_t> cursor(files.size(), 0), stopAt(files.size(), 0);
+  std::vector<uint32_t> counts(1 << 16), offsets(1 << 16), flat;
+  for (uint32_t lead = 0; lead < 256 && !stop_; ++lead) {
+    std::fill(counts.begin(), counts.end(), 0);
+    size_t total = 0;
+    for (size_t f = 0; f < files.size(); ++f) {
+      const auto &list = trigrams[f];
+      size_t c = cursor[f];
+      while (c < list.size() && (list[c] >> 16) == lead)
+        counts[list[c++] & 0xffff]++;
+      total += c - cursor[f];
+      stopAt[f] = c;
+    }
+    if (total == 0)
+      continue;
+    uint32_t running = 0;
+    for (size_t t = 0; t < counts.size(); ++t) {
+      offsets[t] = running;
+      running += counts[t];
+    }
+    flat.resize(total);
+    for (size_t f = 0; f < files.size(); ++f) {
+      for (size_t c = cursor[f]; c < stopAt[f]; ++c)
+        flat[offsets[trigrams[f][c] & 0xffff]++] = (uint32_t)f;
+      cursor[f] = stopAt[f];
+    }
+    size_t begin = 0;
+    for (size_t t = 0; t < counts.size(); ++t) {
+      if (counts[t] == 0)
+        continue;
+      table.push_back({lead << 16 | (uint32_t)t, counts[t],
+                       (uint64_t)postings.size()});
+      uint32_t prev = 0;
+      for (size_t k = begin; k < begin + counts[t]; ++k) {
+        putVarint(postings, flat[k] - prev);
+        prev = flat[k];
+      }
+      begin += counts[t];
+    }
+  }
+  if (stop_)
+    return false;
+
+  Header h;
+  std::memcpy(h.magic, kMagic, 4);
+  h.version = kVersion;
+  h.fileCount = (uint32_t)entries.size();
+  h.trigramCount = (uint32_t)table.size();
+  h.filesOffset = sizeof(Header);
+  h.trigramsOffset = h.filesOffset + entries.size() * sizeof(FileEntry);
+  h.pathsOffset = h.trigramsOffset + table.size() * sizeof(TrigramEntry);
+  h.pathsSize = paths.size();
+  h.postingsOffset = h.pathsOffset + paths.size();
+  h.postingsSize = postings.size();
+
+  // Write beside the old index and rename over it, so a reader never sees
+  // a half-written file and existing mappings stay valid.
+  std::error_code ec;
+  std::filesystem::path target(indexPath_);
+  if (target.has_parent_path())
+    std::filesystem::create_directories(target.parent_path(), ec);
+  std::string tmp = indexPath_ + ".tmp";
+  {
+    std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+    if (!out)
+      return false;
+    out.write((const char *)&h, sizeof(h));
+    out.write((const char *)entries.data(),
+              (std::streamsize)(entries.size() * sizeof(FileEntry)));
+    out.write((const char *)table.data(),
+              (std::streamsize)(table.size() * sizeof(TrigramEntry)));
+    out.write(paths.data(), (std::streamsize)paths.size());
+    out.write(postings.data(), (std::streamsize)postings.size());
+    if (!out)
+      return false;
+  }
+  std::filesystem::rename(tmp, indexPath_, ec);
+  return !ec;
+}
+
+bool TrigramIndex::refresh() {
+  uint64_t seqAtStart;
+  std::shared_ptr<const Snapshot> old;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    seqAtStart = eventSeq_;
+    old = snapshot_;
+  }
+
+  std::vector<FileInfo> files;
+  bool tooMany = false;
+  WorkspaceWalker::walk(
+      root_, &stop_, [&](const std::filesystem::path &path, uintmax_t size) {
+        if (files.size() >= kMaxFiles) {
+          tooMany = true;
+          return;
+        }
+        files.push_back({path.string(), modificationTime(path), size});
+      });
+  if (stop_ || tooMany)
+    return false;
+  std::sort(files.begin(), files.end(),
+            [](const FileInfo &a, const FileInfo &b) { return a.path < b.path; });
+
+  // Match files against the previous index; unchanged ones keep their
+  // trigrams, the rest are re-read.
+  std::vector<std::vector<uint32_t>> trigrams(files.size());
+  std::vector<uint32_t> flags(files.size(), 0);
+  std::vector<uint32_t> changed;
+  std::vector<int64_t> oldToNew;
+  if (old) {
+    oldToNew.assign(old->header->fileCount, -1);
+    std::unordered_map<std::string, uint32_t> oldIds;
+    oldIds.reserve(old->header->fileCount);
+    for (uint32_t i = 0; i < old->header->fileCount; ++i)
+      oldIds.emplace(old->path(i), i);
+    for (size_t i = 0; i < files.size(); ++i) {
+      auto it = oldIds.find(files[i].path);
+      if (it != oldIds.end()) {
+        const FileEntry &e = old->files[it->second];
+        if (e.mtime == files[i].mtime && e.size == files[i].size) {
+          oldToNew[it->second] = (int64_t)i;
+          flags[i] = e.flags;
+          continue;
+        }
+      }
+      changed.push_back((uint32_t)i);
+    }
+    size_t kept = files.size() - changed.size();
+    if (changed.empty() && kept == old->header->fileCount)
+      return true; // nothing to rewrite
+  } else {
+    for (size_t i = 0; i < files.size(); ++i)
+      changed.push_back((uint32_t)i);
+  }
+
+  if (old) {
+    std::vector<uint32_t> ids;
+    for (uint32_t t = 0; t < old->header->trigramCount && !stop_; ++t) {
+      const TrigramEntry &e = old->trigrams[t];
+      old->decode(e, ids);
+      for (uint32_t id : ids) {
+        if (id < oldToNew.size() && oldToNew[id] >= 0)
+          trigrams[(size_t)oldToNew[id]].push_back(e.trigram);
+      }
+    }
+  }
+
+  std::atomic<size_t> next{0};
+  auto worker = [&]() {
+    std::vector<uint64_t> seen(1 << 18, 0);
+    while (!stop_) {
+      size_t k = next++;
+      if (k >= changed.size())
+        break;
+      uint32_t i = changed[k];
+      if (files[i].size > kMaxIndexedSize) {
+        flags[i] = kFlagUnindexed;
+        continue;
+      }
+      MappedFile file(files[i].path);
+      if (!file.isOpen()) {
+        flags[i] = kFlagUnindexed;
+        continue;
+      }
+      if (WorkspaceWalker::looksBinary(file.data(), file.size())) {
+        flags[i] = kFlagBinary;
+        continue;
+      }
+      extractTrigrams(file.data(), file.size(), seen, trigrams[i]);
+    }
+  };
+  unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+  std::vector<std::thread> pool;
+  for (unsigned i = 1; i < threads; ++i)
+    pool.emplace_back(worker);
+  worker();
+  for (auto &t : pool)
+    t.join();
+  if (stop_ || !write(files, flags, trigrams))
+    return false;
+
+  auto snap = load(indexPath_);
+  if (!snap)
+    return false;
+  std::lock_guard<std::mutex> lock(mutex_);
+  snapshot_ = snap;
+  for (auto it = dirty_.begin(); it != dirty_.end();) {
+    if (it->second <= seqAtStart)
+      it = dirty_.erase(it);
+    else
+      ++it;
+  }
+  return true;
+}
+
+void TrigramIndex::run() {
+  if (auto snap = load(indexPath_)) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    snapshot_ = snap;
+  }
+
+  FileWatcher watcher;
+  watcher.watchTree(root_);
+
+  building_ = true;
+  refresh();
+  building_ = false;
+
+  std::vector<FileWatcher::Event> events;
+  auto lastEvent = std::chrono::steady_clock::now();
+  bool pending = false;
+  while (!stop_) {
+    if (watcher.wait(250)) {
+      events.clear();
+      watcher.poll(events);
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (const auto &ev : events) {
+        if (ev.isDirectory || ev.kind == FileWatcher::Event::Kind::Overflow)
+          continue; // the next refresh walks the tree anyway
+        dirty_[ev.path] = ++eventSeq_;
+      }
+      lastEvent = std::chrono::steady_clock::now();
+      pending = true;
+    }
+    auto quiet = std::chrono::duration_cast<std::chrono::milliseconds>(
+                     std::chrono::steady_clock::now() - lastEvent)
+                     .count();
+    if (pending && quiet >= kQuietMs) {
+      pending = false;
+      building_ = true;
+      refresh();
+      building_ = false;
+    }
+  }
+}
+
+std::vector<std::string>
+TrigramIndex::requiredLiterals(const std::string &regex) {
+  std::vector<std::string> literals;
+  std::string run;
+  auto flush = [&]() {
+    if (!run.empty())
+      literals.push_back(run);
+    run.clear();
+  };
+  // Skips a bracketed class or parenthesised group starting at i
+  auto skipBalanced = [&](size_t i) {
+    int depth = 0;
+    bool inClass = false;
+    for (; i < regex.size(); ++i) {
+      char c = regex[i];
+      if (c == '\\') {
+        ++i;
+      } else if (inClass) {
+        if (c == ']')
+          inClass = false;
+      } else if (c == '[') {
+        inClass = true;
+        if (i + 1 < regex.size() && regex[i + 1] == '^')
+          ++i;
+        if (i + 1 < regex.size() && regex[i + 1] == ']')
+          ++i; // leading ] is literal
+      } else if (c == '(') {
+        depth++;
+      } else if (c == ')') {
+        if (--depth <= 0)
+          return i;
+      }
+      if (!inClass && depth == 0)
+        return i;
+    }
+    return regex.size();
+  };
+
+  for (size_t i = 0; i < regex.size(); ++i) {
+    char c = regex[i];
+    switch (c) {
+    case '|':
+      return {};
+    case '[':
+    case '(':
+      flush();
+      i = skipBalanced(i);
+      break;
+    case '.':
+    case '^':
+    case '$':
+      flush();
+      break;
+    case '*':
+    case '?':
+      if (!run.empty())
+        run.pop_back(); // the atom before may not be there at all
+      flush();
+      break;
+    case '{':
+      if (!run.empty())
+        run.pop_back();
+      flush();
+      while (i < regex.size() && regex[i] != '}')
+        ++i;
+      break;
+    case '+': {
+      // "ab+c" matches "abbc": the repeated atom ends one run and starts
+      // the next
+      std::string last = run.empty() ? "" : run.substr(run.size() - 1);
+      flush();
+      run = last;
+      break;
+    }
+    case '\\':
+      if (i + 1 < regex.size()) {
+        char e = regex[++i];
+        if (std::isalnum((unsigned char)e))
+          flush(); // \d, \w, \b, \n ...
+        else
+          run.push_back(e);
+      }
+      break;
+    default:
+      run.push_back(c);
+      break;
+    }
+  }
+  flush();
+  return literals;
+}
+
+bool TrigramIndex::candidates(const std::string &query, bool regex,
+                              std::vector<std::string> &out) const {
+  std::shared_ptr<const Snapshot> snap;
+  std::vector<std::string> dirty;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!snapshot_)
+      return false;
+    snap = snapshot_;
+    for (const auto &d : dirty_)
+      dirty.push_back(d.first);
+  }
+
+  std::vector<std::string> literals =
+      regex ? requiredLiterals(query) : std::vector<std::string>{query};
+  std::vector<uint32_t> wanted;
+  for (const auto &lit : literals) {
+    for (size_t i = 0; i + 3 <= lit.size(); ++i)
+      wanted.push_back(trigramAt((const unsigned char *)lit.data() + i));
+  }
+  if (wanted.empty())
+    return false;
+  std::sort(wanted.begin(), wanted.end());
+  wanted.erase(std::unique(wanted.begin(), wanted.end()), wanted.end());
+
+  // Intersect shortest posting lists first so the working set shrinks fast
+  std::vector<const TrigramEntry *> entries;
+  bool missing = false;
+  for (uint32_t t : wanted) {
+    const TrigramEntry *e = snap->find(t);
+    if (!e) {
+      missing = true;
+      break;
+    }
+    entries.push_back(e);
+  }
+  std::vector<uint32_t> ids;
+  if (!missing) {
+    std::sort(entries.begin(), entries.end(),
+              [](const TrigramEntry *a, const TrigramEntry *b) {
+                return a->count < b->count;
+              });
+    std::vector<uint32_t> list, merged;
+    snap->decode(*entries[0], ids);
+    for (size_t k = 1; k < entries.size() && !ids.empty(); ++k) {
+      snap->decode(*entries[k], list);
+      merged.clear();
+      std::set_intersection(ids.begin(), ids.end(), list.begin(), list.end(),
+                            std::back_inserter(merged));
+      ids.swap(merged);
+    }
+  }
+
+  // Files too big to index can't be ruled out
+  std::vector<uint32_t> all;
+  std::merge(ids.begin(), ids.end(), snap->unindexed.begin(),
+             snap->unindexed.end(), std::back_inserter(all));
+  all.erase(std::unique(all.begin(), all.end()), all.end());
+
+  out.clear();
+  std::sort(dirty.begin(), dirty.end());
+  for (uint32_t id : all) {
+    std::string path = snap->path(id);
+    if (!std::binary_search(dirty.begin(), dirty.end(), path))
+      out.push_back(std::move(path));
+  }
+  // Edited since the last refresh: the index can't vouch for them either way
+  for (auto &d : dirty)
+    out.push_back(std::move(d));
+  return true;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Persistent trigram index over the workspace, in the spirit of codesearch:
+// every text file is reduced to the set of 3-byte sequences it contains and
+// each trigram maps to a posting list of file ids. A query can only match
+// files holding all of its trigrams, so intersecting a handful of posting
+// lists leaves a short candidate list that WorkspaceSearch then verifies.
+//
+// The index lives in one file (e.g. .donutex/trigrams.idx) that is mapped
+// read-only and queried in place. On start the previous index is used
+// straight away while a background pass re-reads only files whose mtime or
+// size changed; after that a FileWatcher marks edited files dirty (they are
+// always candidates) until the next quiet-period refresh folds them in.
+class TrigramIndex {
+public:
+  TrigramIndex() = default;
+  ~TrigramIndex();
+  TrigramIndex(const TrigramIndex &) = delete;
+  TrigramIndex &operator=(const TrigramIndex &) = delete;
+
+  // Loads indexPath if present and keeps it fresh on a background thread.
+  void start(const std::string &root, const std::string &indexPath);
+  void stop();
+
+  bool ready() const;
+  bool building() const { return building_.load(); }
+  size_t fileCount() const;
+
+  // Files that may contain a match for query. Returns false when the index
+  // can't narrow the search (not loaded yet, or no literal of 3+ bytes that
+  // every match must contain) and the caller should scan everything.
+  bool candidates(const std::string &query, bool regex,
+                  std::vector<std::string> &out) const;
+
+  // Literal runs every match of a regex must contain. Conservative: groups,
+  // classes and optional atoms are skipped, and top-level alternation
+  // yields nothing.
+  static std::vector<std::string> requiredLiterals(const std::string &regex);
+
+private:
+  struct Snapshot;
+  struct FileInfo {
+    std::string path;
+    int64_t mtime;
+    uint64_t size;
+  };
+
+  void run();
+  bool refresh();
+  static std::shared_ptr<const Snapshot> load(const std::string &path);
+  bool write(const std::vector<FileInfo> &files,
+             const std::vector<uint32_t> &flags,
+             const std::vector<std::vector<uint32_t>> &trigrams);
+
+  std::string root_;
+  std::string indexPath_;
+  std::thread thread_;
+  std::atomic<bool> stop_{false};
+  std::atomic<bool> building_{false};
+
+  mutable std::mutex mutex_;
+  std::shared_ptr<const Snapshot> snapshot_;
+  // Paths changed since the snapshot was written, with the event sequence
+  // number that last touched them.
+  std::unordered_map<std::string, uint64_t> dirty_;
+  uint64_t eventSeq_ = 0;
+};
@@ -0,0 +1,339 @@
+#include "WordIndex.hpp"
+#include "PieceTable.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <queue>
+
+bool WordIndex::isWordChar(unsigned char c) {
+  return std::isalnum(c) || c == '_';
+}
+
+void WordIndex::clear() {
+  nodes_.assign(1, Node{});
+  words_ = 0;
+  editStart_ = editEnd_ = editErased_ = 0;
+}
+
+size_t WordIndex::memoryUsage() const {
+  size_t bytes = nodes_.capacity() * sizeof(Node);
+  for (const auto &node : nodes_)
+    bytes += node.children.capacity() * sizeof(node.children[0]);
+  return bytes;
+}
+
+bool WordIndex::build(const PieceTable &text,
+                      const std::atomic<bool> *cancel) {
+  clear();
+  // Blocks end on a word's end, so no word is split between two of them
+  const size_t block = 4 << 20;
+  size_t size = text.size();
+  for (size_t start = 0; start < size;) {
+    if (cancel && *cancel) {
+      clear();
+      return false;
+    }
+    size_t end = size - start > block ? wordEnd(text, start + block) : size;
+    scanRange(text, start, end, +1);
+    start = end;
+  }
+  return true;
+}
+
+void WordIndex::beginEdit(const PieceTable &text, size_t pos,
+                          size_t eraseLen) {
+  // Widen the edit to whole words on both sides; everything in between is
+  // dropped now and re-scanned once the edit has landed.
+  editStart_ = wordStart(text, pos);
+  editEnd_ = wordEnd(text, pos + eraseLen);
+  editErased_ = eraseLen;
+  scanRange(text, editStart_, editEnd_, -1);
+}
+
+void WordIndex::endEdit(const PieceTable &text, size_t insertLen) {
+  size_t end = editEnd_ - editErased_ + insertLen;
+  scanRange(text, editStart_, end, +1);
+}
+
+size_t WordIndex::wordStart(const PieceTable &text, size_t pos) const {
+  const size_t window = 64;
+  char chunk[window]; // on the stack: this runs on every keystroke
+  while (pos > 0) {
+    size_t from = pos > window ? pos - window : 0;
+    size_t filled = 0;
+    text.forEachChunk(from, pos - from, [&](const char *data, size_t n) {
+      std::memcpy(chunk + filled, data, n);
+      filled += n;
+      return true;
+    });
+    for (size_t i = filled; i > 0; --i) {
+      if (!isWordChar((unsigned char)chunk[i - 1]))
+        return from + i;
+    }
+    pos = from;
+  }
+  return 0;
+}
+
+size_t WordIndex::wordEnd(const PieceTable &text, size_t pos) const {
+  size_t total = text.size();
+  if (pos >= total)
+    return total;
+  size_t end = total;
+  size_t cur = pos;
+  text.forEachChunk(pos, total - pos, [&](const char *data, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+      if (!isWordChar((unsigned char)data[i])) {
+        end = cur + i;
+        return false;
+      }
+    }
+    cur += n;
+    return true;
+  });
+  return end;
+}
+
+void WordIndex::beginEdits(const PieceTable &text,
+                           const std::vector<Edit> &edits) {
+  batch_.clear();
+  if (edits.empty())
+    return;
+
+  // Word-aligned bounds of every edit from one walk: a start is just past
+  // the last non-word byte before the edit, an end the first non-word byte
+  // after what it erases. Stretches with nothing to find are skipped,
+  // looking back only as far as their last non-word byte.
+  spans_.assign(edits.size(), {0, 0});
+  size_t total = text.size();
+  size_t from = wordStart(text, edits.front().pos);
+  size_t boundary = from; // just past the last non-word byte seen
+  size_t next = 0;        // next edit whose start is wanted
+  size_t open = 0;        // next edit whose end is wanted
+  size_t cur = from;
+  text.forEachChunk(from, total - from, [&](const char *data, size_t n) {
+    size_t i = 0;
+    while (i < n && open < edits.size()) {
+      size_t at = cur + i;
+      while (next < edits.size() && edits[next].pos == at)
+        spans_[next++].first = boundary;
+      if (open < next && edits[open].pos + edits[open].erase <= at) {
+        if (!isWordChar((unsigned char)data[i])) {
+          while (open < next && edits[open].pos + edits[open].erase <= at)
+            spans_[open++].second = at;
+          boundary = at + 1;
+        }
+        ++i;
+        continue;
+      }
+      size_t target = next < edits.size() ? edits[next].pos : total;
+      if (open < next)
+        target = std::min(target, edits[open].pos + edits[open].erase);
+      size_t stop = std::min(n, i + (target - at));
+      for (size_t b = stop; b > i; --b) {
+        if (!isWordChar((unsigned char)data[b - 1])) {
+          boundary = cur + b;
+          break;
+        }
+      }
+      i = stop;
+    }
+    cur += n;
+    return open < edits.size();
+  });
+  while (next < edits.size())
+    spans_[next++].first = boundary;
+  while (open < edits.size())
+    spans_[open++].second = total;
+
+  long long shift = 0;
+  for (size_t k = 0; k < edits.size(); ++k) {
+    long long delta = (long long)edits[k].insert - (long long)edits[k].erase;
+    if (!batch_.empty() && spans_[k].first <= batch_.back().end) {
+      batch_.back().end = std::max(batch_.back().end, spans_[k].second);
+      batch_.back().delta += delta;
+    } else {
+      batch_.push_back({spans_[k].first, spans_[k].second, shift, delta});
+    }
+    shift += delta;
+  }
+
+  spans_.clear();
+  for (const auto &range : batch_)
+    spans_.push_back({range.start, range.end});
+  scanRanges(text, spans_.data(), spans_.size(), -1);
+}
+
+void WordIndex::endEdits(const PieceTable &text) {
+  spans_.clear();
+  for (const auto &range : batch_)
+    spans_.push_back({(size_t)((long long)range.start + range.shift),
+                      (size_t)((long long)range.end + range.shift +
+                               range.delta)});
+  scanRanges(text, spans_.data(), spans_.size(), +1);
+  batch_.clear();
+}
+
+void WordIndex::scanRange(const PieceTable &text, size_t start, size_t end,
+                          int delta) {
+  if (end <= start)
+    return;
+  std::pair<size_t, size_t> span(start, end);
+  scanRanges(text, &span, 1, delta);
+}
+
+void WordIndex::scanRanges(const PieceTable &text,
+                           const std::pair<size_t, size_t> *spans,
+                           size_t count, int delta) {
+  if (count == 0)
+    return;
+
+  // Words may straddle piece boundaries, so accumulate across chunks
+  std::string &word = scanWord_;
+  word.clear();
+  bool skip = false; // current run is too long or starts with a digit
+  auto flush = [&]() {
+    if (!skip && word.size() >= kMinWordLen)
+      addWord(word, delta);
+    word.clear();
+    skip = false;
+  };
+
+  // One walk from the first span to the end of the last, jumping the gaps
+  size_t k = 0;
+  size_t cur = spans[0].first;
+  text.forEachChunk(cur, spans[count - 1].second - cur,
+                    [&](const char *data, size_t n) {
+    size_t i = 0;
+    while (i < n && k < count) {
+      size_t at = cur + i;
+      if (at < spans[k].first) {
+        i += std::min(n - i, spans[k].first - at);
+        continue;
+      }
+      size_t stop = std::min(n, i + (spans[k].second - at));
+      for (; i < stop; ++i) {
+        unsigned char c = (unsigned char)data[i];
+        if (!isWordChar(c)) {
+          flush();
+          continue;
+        }
+        if (skip)
+          continue;
+        if ((word.empty() && std::isdigit(c)) || word.size() == kMaxWordLen) {
+          skip = true;
+          word.clear();
+          continue;
+        }
+        word.push_back((char)c);
+      }
+      if (cur + i == spans[k].second) {
+        flush();
+        ++k;
+      }
+    }
+    cur += n;
+    return k < count;
+  });
+  flush();
+}
+
+void WordIndex::addWord(std::string_view word, int delta) {
+  uint32_t path[kMaxWordLen + 1];
+  uint32_t node = 0;
+  path[0] = 0;
+
+  for (size_t i = 0; i < word.size(); ++i) {
+    auto &children = nodes_[node].children;
+    auto it = std::lower_bound(
+        children.begin(), children.end(), word[i],
+        [](const std::pair<char, uint32_t> &c, char ch) { return c.first < ch; });
+    if (it != children.end() && it->first == word[i]) {
+      node = it->second;
+    } else {
+      if (delta < 0)
+        return; // removing a word we never saw
+      uint32_t child = (uint32_t)nodes_.size();
+      children.insert(it, {word[i], child});
+      nodes_.emplace_back(); // invalidates `children`, which is not used again
+      node = child;
+    }
+    path[i + 1] = node;
+  }
+
+  Node &leaf = nodes_[node];
+  uint32_t before = leaf.count;
+  if (delta < 0)
+    leaf.count = leaf.count > (uint32_t)-delta ? leaf.count + delta : 0;
+  else
+    leaf.count += (uint32_t)delta;
+  if (before == 0 && leaf.count > 0)
+    words_++;
+  else if (before > 0 && leaf.count == 0)
+    words_--;
+
+  // Refresh subtree maxima bottom-up; stop once a node is unaffected
+  for (size_t i = word.size() + 1; i-- > 0;) {
+    Node &n = nodes_[path[i]];
+    uint32_t best = n.count;
+    for (const auto &c : n.children)
+      best = std::max(best, nodes_[c.second].best);
+    if (n.best == best)
+      break;
+    n.best = best;
+  }
+}
+
+std::vector<WordIndex::Completion>
+WordIndex::complete(std::string_view prefix, size_t limit) const {
+  std::vector<Completion> results;
+  if (limit == 0)
+    return results;
+
+  uint32_t node = 0;
+  for (char ch : prefix) {
+    const auto &children = nodes_[node].children;
+    auto it = std::lower_bound(
+        children.begin(), children.end(), ch,
+        [](const std::pair<char, uint32_t> &c, char x) { return c.first < x; });
+    if (it == children.end() || it->first != ch)
+      return results;
+    node = it->second;
+  }
+
+  // Best-first walk: subtree entries are keyed by their best count, word
+  // entries by their own count. Ties go to words, then alphabetical order.
+  struct Entry {
+    uint32_t key;
+    bool isWord;
+    uint32_t node;
+    std::string text;
+  };
+  auto lower = [](const Entry &a, const Entry &b) {
+    if (a.key != b.key)
+      return a.key < b.key;
+    if (a.isWord != b.isWord)
+      return !a.isWord;
+    return a.text > b.text;
+  };
+  std::priority_queue<Entry, std::vector<Entry>, decltype(lower)> queue(lower);
+  if (nodes_[node].best > 0)
+    queue.push({nodes_[node].best, false, node, std::string(prefix)});
+
+  while (!queue.empty() && results.size() < limit) {
+    Entry e = queue.top();
+    queue.pop();
+    if (e.isWord) {
+      results.push_back({std::move(e.text), e.key});
+      continue;
+    }
+    const Node &n = nodes_[e.node];
+    if (n.count > 0 && e.text.size() > prefix.size())
+      queue.push({n.count, true, e.node, e.text});
+    for (const auto &c : n.children) {
+      if (nodes_[c.second].best > 0)
+        queue.push({nodes_[c.second].best, false, c.second, e.text + c.first});
+    }
+  }
+  return results;
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+class PieceTable;
+
+// Identifier index over a PieceTable, used for buffer-word completion.
+// Words live in a byte trie whose nodes keep an occurrence count and the
+// highest count found in their subtree, so complete() can walk best-first
+// and stop as soon as it has `limit` results.
+class WordIndex {
+public:
+  struct Completion {
+    std::string word;
+    uint32_t count;
+  };
+
+  // False, with the index left empty, if *cancel became true first. It is
+  // checked between blocks of a few MB.
+  bool build(const PieceTable &text, const std::atomic<bool> *cancel = nullptr);
+  void clear();
+
+  // Incremental update: call beginEdit() before the buffer changes and
+  // endEdit() right after it, with the number of bytes that were inserted.
+  void beginEdit(const PieceTable &text, size_t pos, size_t eraseLen);
+  void endEdit(const PieceTable &text, size_t insertLen);
+  // The same for a batch of edits applied at once (PieceTable::splice):
+  // offsets are pre-edit, sorted and not overlapping. Each side costs one
+  // pass over the text the edits span, not one lookup per edit.
+  struct Edit {
+    size_t pos;
+    size_t erase;
+    size_t insert;
+  };
+  void beginEdits(const PieceTable &text, const std::vector<Edit> &edits);
+  void endEdits(const PieceTable &text);
+
+  // Most frequent words starting with prefix (excluding prefix itself).
+  std::vector<Completion> complete(std::string_view prefix,
+                                   size_t limit) const;
+  size_t wordCount() const { return words_; }
+  size_t memoryUsage() const;
+
+  static bool isWordChar(unsigned char c);
+
+private:
+  static constexpr size_t kMinWordLen = 2;
+  static constexpr size_t kMaxWordLen = 64;
+
+  struct Node {
+    std::vector<std::pair<char, uint32_t>> children; // sorted by byte
+    uint32_t count = 0; // occurrences of the word ending at this node
+    uint32_t best = 0;  // highest count in this subtree
+  };
+
+  void addWord(std::string_view word, int delta);
+  void scanRange(const PieceTable &text, size_t start, size_t end, int delta);
+  // scanRange() over sorted, disjoint [first, second) spans in one pass
+  void scanRanges(const PieceTable &text,
+                  const std::pair<size_t, size_t> *spans, size_t count,
+                  int delta);
+  size_t wordStart(const PieceTable &text, size_t pos) const;
+  size_t wordEnd(const PieceTable &text, size_t pos) const;
+
+  std::vector<Node> nodes_{Node{}};
+  size_t words_ = 0;
+
+  // Word-aligned range touched by the pending edit, in pre-edit offsets
+  size_t editStart_ = 0;
+  size_t editEnd_ = 0;
+  size_t editErased_ = 0;
+  std::string scanWord_; // scanRange()'s buffer, kept to avoid reallocating
+
+  // Pending batch: merged word-aligned ranges in pre-edit offsets, with the
+  // growth of the text before each and within it
+  struct BatchRange {
+    size_t start;
+    size_t end;
+    long long shift;
+    long long delta;
+  };
+  std::vector<BatchRange> batch_;
+  std::vector<std::pair<size_t, size_t>> spans_;
+};
@@ -0,0 +1,220 @@
+#include "WorkspaceSearch.hpp"
+#include "BufferSearch.hpp"
+#include "MappedFile.hpp"
+#include "WorkspaceWalker.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+const size_t kMaxStoredResults = 100000;
+const size_t kMaxPreview = 200;
+// Keeps the walker from racing arbitrarily far ahead of the workers
+const size_t kMaxQueued = 4096;
+} // namespace
+
+WorkspaceSearch::~WorkspaceSearch() { cancel(); }
+
+void WorkspaceSearch::cancel() {
+  {
+    // Set under the lock so a thread between its wait predicate and
+    // blocking can't miss the wakeup
+    std::lock_guard<std::mutex> lock(queueMutex_);
+    cancel_ = true;
+  }
+  queueCv_.notify_all();
+  if (walker_.joinable())
+    walker_.join();
+  for (auto &t : workers_) {
+    if (t.joinable())
+      t.join();
+  }
+  workers_.clear();
+  queue_.clear();
+  cancel_ = false;
+}
+
+bool WorkspaceSearch::prepare(const std::string &query, bool regex) {
+  cancel();
+  // Compile first so a bad pattern throws before anything is reset
+  if (regex && !query.empty())
+    pattern_ = std::regex(query, std::regex::ECMAScript | std::regex::optimize);
+  query_ = query;
+  regex_ = regex;
+  filesScanned_ = 0;
+  bytesScanned_ = 0;
+  matchCount_ = 0;
+  storedCount_ = 0;
+  skippedLines_ = 0;
+  {
+    std::lock_guard<std::mutex> lock(resultMutex_);
+    pending_.clear();
+  }
+  return !query_.empty();
+}
+
+void WorkspaceSearch::launch() {
+  walkDone_ = false;
+  unsigned threads = std::max(2u, std::thread::hardware_concurrency());
+  activeWorkers_ = (int)threads;
+  for (unsigned i = 0; i < threads; ++i)
+    workers_.emplace_back(regex_ ? kRegexStackSize : 0,
+                          [this] { workerMain(); });
+}
+
+void WorkspaceSearch::start(const std::string &root, const std::string &query,
+                            bool regex) {
+  if (!prepare(query, regex))
+    return;
+  launch();
+  walker_ = std::thread(&WorkspaceSearch::walkerMain, this, root);
+}
+
+void WorkspaceSearch::startOnFiles(std::vector<std::string> files,
+                                   const std::string &query, bool regex) {
+  if (!prepare(query, regex))
+    return;
+  launch();
+  walker_ = std::thread(&WorkspaceSearch::feederMain, this, std::move(files));
+}
+
+void WorkspaceSearch::enqueue(std::string path) {
+  std::unique_lock<std::mutex> lock(queueMutex_);
+  queueCv_.wait(lock, [this] { return queue_.size() < kMaxQueued || cancel_; });
+  queue_.push_back(std::move(path));
+  queueCv_.notify_one();
+}
+
+void WorkspaceSearch::finishFeeding() {
+  std::lock_guard<std::mutex> lock(queueMutex_);
+  walkDone_ = true;
+  queueCv_.notify_all();
+}
+
+void WorkspaceSearch::walkerMain(std::string root) {
+  WorkspaceWalker::walk(root, &cancel_,
+                        [this](const std::filesystem::path &path, uintmax_t) {
+                          enqueue(path.string());
+                        });
+  finishFeeding();
+}
+
+void WorkspaceSearch::feederMain(std::vector<std::string> files) {
+  for (auto &path : files) {
+    if (cancel_)
+      break;
+    enqueue(std::move(path));
+  }
+  finishFeeding();
+}
+
+void WorkspaceSearch::workerMain() {
+  std::vector<Result> batch;
+  while (!cancel_) {
+    std::string path;
+    {
+      std::unique_lock<std::mutex> lock(queueMutex_);
+      queueCv_.wait(lock,
+                    [this] { return !queue_.empty() || walkDone_ || cancel_; });
+      if (cancel_ || queue_.empty())
+        break;
+      path = std::move(queue_.front());
+      queue_.pop_front();
+    }
+    queueCv_.notify_all(); // room for the walker
+    searchFile(path, batch);
+    if (!batch.empty())
+      publish(batch);
+  }
+  activeWorkers_--;
+}
+
+void WorkspaceSearch::addResult(const std::string &path, const char *data,
+                                size_t size, size_t lineStart, int line,
+                                size_t column, std::vector<Result> &batch) {
+  matchCount_++;
+  if (storedCount_++ >= kMaxStoredResults)
+    return;
+  const char *lineEnd =
+      (const char *)std::memchr(data + lineStart, '\n', size - lineStart);
+  size_t lineLen =
+      lineEnd ? (size_t)(lineEnd - (data + lineStart)) : size - lineStart;
+  Result r;
+  r.path = path;
+  r.line = line;
+  r.column = (int)column;
+  r.preview.assign(data + lineStart, std::min(lineLen, kMaxPreview));
+  batch.push_back(std::move(r));
+}
+
+void WorkspaceSearch::searchFile(const std::string &path,
+                                 std::vector<Result> &batch) {
+  MappedFile file(path);
+  if (!file.isOpen() || (!regex_ && file.size() < query_.size()))
+    return;
+  const char *data = file.data();
+  size_t size = file.size();
+  if (WorkspaceWalker::looksBinary(data, size))
+    return;
+
+  if (regex_) {
+    // One line at a time, like the in-buffer regex search
+    int line = 0;
+    for (size_t lineStart = 0; lineStart < size && !cancel_; ++line) {
+      const char *nl =
+          (const char *)std::memchr(data + lineStart, '\n', size - lineStart);
+      size_t lineEnd = nl ? (size_t)(nl - data) : size;
+      if (lineEnd - lineStart > kMaxRegexLine) {
+        skippedLines_++;
+        lineStart = lineEnd + 1;
+        continue;
+      }
+      std::cregex_iterator it(data + lineStart, data + lineEnd, pattern_), end;
+      for (; it != end; ++it) {
+        if (it->length() == 0)
+          continue;
+        addResult(path, data, size, lineStart, line, (size_t)it->position(),
+                  batch);
+      }
+      lineStart = lineEnd + 1;
+    }
+    filesScanned_++;
+    bytesScanned_ += size;
+    return;
+  }
+
+  // Line numbers are counted incrementally between consecutive matches
+  int line = 0;
+  size_t lineStart = 0;
+  size_t counted = 0;
+  size_t from = 0;
+  size_t hit;
+  while (!cancel_ && (hit = BufferSearch::findInSpan(data, size, query_,
+                                                     from)) != BufferSearch::npos) {
+    const char *p = data + counted;
+    const char *stop = data + hit;
+    while ((p = (const char *)std::memchr(p, '\n', (size_t)(stop - p)))) {
+      line++;
+      lineStart = (size_t)(p - data) + 1;
+      p++;
+    }
+    counted = hit;
+    addResult(path, data, size, lineStart, line, hit - lineStart, batch);
+    from = hit + query_.size();
+  }
+  filesScanned_++;
+  bytesScanned_ += size;
+}
+
+void WorkspaceSearch::publish(std::vector<Result> &batch) {
+  std::lock_guard<std::mutex> lock(resultMutex_);
+  for (auto &r : batch)
+    pending_.push_back(std::move(r));
+  batch.clear();
+}
+
+void WorkspaceSearch::takeResults(std::vector<Result> &out) {
+  std::lock_guard<std::mutex> lock(resultMutex_);
+  for (auto &r : pending_)
+    out.push_back(std::move(r));
+  pending_.clear();
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "StackThread.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <regex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// "Find in Files": a walker thread feeds paths to a pool of workers, each
+// of which maps a file, skips it if it looks binary, and scans it with
+// BufferSearch::findInSpan (or line by line with std::regex). Results are published in batches as files
+// complete, so the panel fills in while the search is still running.
+class WorkspaceSearch {
+public:
+  struct Result {
+    std::string path;
+    int line;   // 0-based
+    int column; // 0-based byte column
+    std::string preview;
+  };
+
+  WorkspaceSearch() = default;
+  ~WorkspaceSearch();
+  WorkspaceSearch(const WorkspaceSearch &) = delete;
+  WorkspaceSearch &operator=(const WorkspaceSearch &) = delete;
+
+  // Cancels any running search and starts a new one over every file under
+  // root. Throws std::regex_error for an invalid pattern in regex mode.
+  void start(const std::string &root, const std::string &query,
+             bool regex = false);
+  // Same, but only the given files are searched (e.g. TrigramIndex
+  // candidates) instead of walking the tree.
+  void startOnFiles(std::vector<std::string> files, const std::string &query,
+                    bool regex = false);
+  void cancel();
+
+  bool busy() const { return activeWorkers_.load() > 0; }
+  size_t filesScanned() const { return filesScanned_.load(); }
+  size_t bytesScanned() const { return bytesScanned_.load(); }
+  size_t matchCount() const { return matchCount_.load(); }
+  // Regex mode skips lines longer than kMaxRegexLine
+  size_t skippedLines() const { return skippedLines_.load(); }
+  // Moves results found since the last call onto the end of out.
+  void takeResults(std::vector<Result> &out);
+
+private:
+  bool prepare(const std::string &query, bool regex);
+  void launch();
+  void walkerMain(std::string root);
+  void feederMain(std::vector<std::string> files);
+  void enqueue(std::string path);
+  void finishFeeding();
+  void workerMain();
+  void searchFile(const std::string &path, std::vector<Result> &batch);
+  void addResult(const std::string &path, const char *data, size_t size,
+                 size_t lineStart, int line, size_t column,
+                 std::vector<Result> &batch);
+  void publish(std::vector<Result> &batch);
+
+  std::string query_;
+  bool regex_ = false;
+  std::regex pattern_;
+  std::thread walker_;
+  std::vector<StackThread> workers_; // regex mode gives them a big stack
+
+  std::mutex queueMutex_;
+  std::condition_variable queueCv_;
+  std::deque<std::string> queue_;
+  bool walkDone_ = true;
+
+  std::mutex resultMutex_;
+  std::vector<Result> pending_;
+
+  std::atomic<bool> cancel_{false};
+  std::atomic<int> activeWorkers_{0};
+  std::atomic<size_t> filesScanned_{0};
+  std::atomic<size_t> bytesScanned_{0};
+  std::atomic<size_t> matchCount_{0};
+  std::atomic<size_t> storedCount_{0};
+  std::atomic<size_t> skippedLines_{0};
+};
@@ -0,0 +1,46 @@
+#include "WorkspaceWalker.hpp"
+#include <algorithm>
+#include <cstring>
+
+bool WorkspaceWalker::isIgnoredDirectory(const std::string &name) {
+  static const char *ignored[] = {"node_modules", "build", "CMakeFiles",
+                                  "__pycache__"};
+  if (!name.empty() && name[0] == '.' && name != "." && name != "..")
+    return true; // .git, .cache, .donutex, ...
+  for (const char *dir : ignored) {
+    if (name == dir)
+      return true;
+  }
+  return false;
+}
+
+bool WorkspaceWalker::looksBinary(const char *data, size_t size) {
+  return std::memchr(data, 0, std::min<size_t>(size, 8000)) != nullptr;
+}
+
+void WorkspaceWalker::walk(
+    const std::filesystem::path &root, const std::atomic<bool> *cancel,
+    const std::function<void(const std::filesystem::path &, uintmax_t)>
+        &onFile) {
+  namespace fs = std::filesystem;
+  std::error_code ec;
+  fs::recursive_directory_iterator it(
+      root, fs::directory_options::skip_permission_denied, ec);
+  fs::recursive_directory_iterator end;
+  while (!ec && it != end) {
+    if (cancel && *cancel)
+      return;
+    const fs::directory_entry &entry = *it;
+    std::error_code typeEc;
+    if (entry.is_directory(typeEc)) {
+      if (isIgnoredDirectory(entry.path().filename().string()))
+        it.disable_recursion_pending();
+    } else if (entry.is_regular_file(typeEc)) {
+      std::error_code sizeEc;
+      uintmax_t size = entry.file_size(sizeEc);
+      if (!sizeEc)
+        onFile(entry.path(), size);
+    }
+    it.increment(ec);
+  }
+}
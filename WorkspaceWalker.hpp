@@ -0,0 +1,23 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <string>
+
+// Recursive walk over the workspace that skips VCS metadata, build output
+// and other directories nobody wants in search results or indexes.
+class WorkspaceWalker {
+public:
+  static bool isIgnoredDirectory(const std::string &name);
+  // A NUL byte in the first 8 KB marks a file as binary (same rule as git).
+  static bool looksBinary(const char *data, size_t size);
+
+  // Calls onFile(path, size) for every regular file under root. Stops early
+  // when cancel becomes true.
+  static void walk(const std::filesystem::path &root,
+                   const std::atomic<bool> *cancel,
+                   const std::function<void(const std::filesystem::path &,
+                                            uintmax_t)> &onFile);
+};
@@ -21,14 +21,14 @@
 -- } -- this really isnt what we want as the final one TODO:
 
 -- autocomplete.register("cpp", function(prefix)
---   print("provider called, prefix=", prefix)
---   local out = {}
+--   -- identifiers already in the buffer first (native index, ranked by use)
+--   local out = complete(prefix, 20)
+--   local seen = {}
+--   for _, w in ipairs(out) do seen[w] = true end
 --   for _, kw in ipairs(cpp_keywords) do
---     if kw:find(prefix, 1, true) == 1 then
---       print(" match ->", kw)
+--     if not seen[kw] and kw:find(prefix, 1, true) == 1 then
 --       table.insert(out, kw)
 --     end
 --   end
---   print(" returning", #out, "results")
 --   return out
 -- end)